@@ -0,0 +1,1491 @@
+/*
+ * Host build of the badge's audio processing (../main/dsp), run over recorded audio. See
+ * README.md for usage.
+ */
+
+#include "aec.h"
+#include "agc.h"
+#include "audio_codec.h"
+#include "beam.h"
+#include "jitter.h"
+#include "ns.h"
+#include "sdkconfig.h"
+#include "vad.h"
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <time.h>
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t le32(const uint8_t *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t le16(const uint8_t *p) {
+	return p[0] | p[1] << 8;
+}
+
+#define SYNTH_SECONDS 20
+#define SYNTH_BABBLE_TALKERS 6
+
+// a generator of its own, so that the made-up audio is the same with any C library
+static uint32_t synth_rand(uint32_t *state) {
+	*state = *state * 1664525 + 1013904223;
+	return *state >> 8;
+}
+
+static double synth_uniform(uint32_t *state) {
+	return (synth_rand(state) + 0.5) / (1 << 24);
+}
+
+/*
+ * Adds a made-up talker to the `n` samples of `out`: phrases of 3 to 8 syllables with pauses
+ * between them, each syllable a voice with a falling pitch around `pitch_hz` and harmonics up
+ * to 4 kHz that roll off.
+ */
+static void synth_talker(double *out, size_t n, uint32_t seed, double pitch_hz) {
+	uint32_t s = seed;
+	double   phase = 0;
+	for (size_t i = 0; i < n;) {
+		int syllables = 3 + synth_rand(&s) % 6;
+		for (int k = 0; k < syllables && i < n; k++) {
+			size_t len = (0.1 + 0.2 * synth_uniform(&s)) * VAD_SAMPLE_RATE;
+			double f0 = pitch_hz * (0.8 + 0.4 * synth_uniform(&s));
+			double amp = 0.3 + 0.7 * synth_uniform(&s);
+			for (size_t j = 0; j < len && i < n; j++, i++) {
+				double t = (double)j / len;
+				double f = f0 * (1.1 - 0.2 * t);
+				phase = fmod(phase + 2 * M_PI * f / VAD_SAMPLE_RATE, 2 * M_PI);
+				double v = 0;
+				for (int h = 1; h * f < 4000; h++) {
+					v += sin(h * phase) / h;
+				}
+				out[i] += amp * sin(M_PI * t) * v;
+			}
+			i += (0.02 + 0.06 * synth_uniform(&s)) * VAD_SAMPLE_RATE;
+		}
+		i += (0.2 + 0.8 * synth_uniform(&s)) * VAD_SAMPLE_RATE;
+	}
+}
+
+/*
+ * Makes up SYNTH_SECONDS of `name`, into a malloc'd buffer: `speech`, one talker peaking at
+ * -6 dBFS, `babble`, SYNTH_BABBLE_TALKERS others at -20 dBFS RMS, or `noise`, steady noise
+ * falling off towards the high frequencies at -30 dBFS RMS. Returns the number of samples, or
+ * 0 for another name.
+ */
+static size_t synth_pcm(const char *name, int16_t **pcm) {
+	size_t  n = SYNTH_SECONDS * VAD_SAMPLE_RATE;
+	double *x = calloc(n, sizeof(double));
+	double  peak = 0, square = 0;
+	if (strcmp(name, "speech") == 0) {
+		synth_talker(x, n, 1, 140);
+	} else if (strcmp(name, "babble") == 0) {
+		for (int k = 0; k < SYNTH_BABBLE_TALKERS; k++) {
+			synth_talker(x, n, 100 + k, 100 + 30 * k);
+		}
+	} else if (strcmp(name, "noise") == 0) {
+		uint32_t s = 1;
+		double   low = 0;
+		for (size_t i = 0; i < n; i++) {
+			double w = synth_uniform(&s) - 0.5;
+			low = 0.95 * low + w;
+			x[i] = low + w;
+		}
+	} else {
+		fprintf(stderr, "@%s: No such made-up audio\n", name);
+		free(x);
+		return 0;
+	}
+	for (size_t i = 0; i < n; i++) {
+		peak = MAX(peak, fabs(x[i]));
+		square += x[i] * x[i];
+	}
+	double scale = strcmp(name, "speech") == 0 ? 16384 / MAX(peak, 1e-10)
+	               : strcmp(name, "babble") == 0
+	                   ? 32768 * pow(10, -20 / 20.0) / sqrt(MAX(square / n, 1e-20))
+	                   : 32768 * pow(10, -30 / 20.0) / sqrt(MAX(square / n, 1e-20));
+	*pcm = malloc(n * sizeof(int16_t));
+	for (size_t i = 0; i < n; i++) {
+		(*pcm)[i] = lround(x[i] * scale);
+	}
+	free(x);
+	return n;
+}
+
+/*
+ * Reads 16 kHz, 16-bit mono PCM from a WAV file, or from a raw file as recorded by the server,
+ * into a malloc'd buffer, or makes it up for a `path` of `@` and a name of synth_pcm(). Returns
+ * the number of samples, or 0 on error.
+ */
+static size_t read_pcm(const char *path, int16_t **pcm) {
+	if (path[0] == '@') {
+		return synth_pcm(path + 1, pcm);
+	}
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		perror(path);
+		return 0;
+	}
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *buf = malloc(len > 0 ? len : 1);
+	if (buf == NULL || fread(buf, 1, len, f) != (size_t)len) {
+		fprintf(stderr, "%s: Failed to read\n", path);
+		fclose(f);
+		free(buf);
+		return 0;
+	}
+	fclose(f);
+
+	size_t start = 0, bytes = len;
+	if (len >= 12 && memcmp(buf, "RIFF", 4) == 0 && memcmp(buf + 8, "WAVE", 4) == 0) {
+		bool fmt_ok = false;
+		bytes = 0;
+		for (size_t i = 12; i + 8 <= (size_t)len;) {
+			uint32_t size = le32(buf + i + 4);
+			if (memcmp(buf + i, "fmt ", 4) == 0 && size >= 16) {
+				fmt_ok = le16(buf + i + 8) == 1 && le16(buf + i + 10) == 1 &&
+				         le32(buf + i + 12) == VAD_SAMPLE_RATE && le16(buf + i + 22) == 16;
+			} else if (memcmp(buf + i, "data", 4) == 0) {
+				start = i + 8;
+				bytes = MIN(size, (size_t)len - start);
+				break;
+			}
+			i += 8 + size + (size & 1);
+		}
+		if (!fmt_ok || bytes == 0) {
+			fprintf(stderr, "%s: Not 16 kHz, 16-bit mono PCM\n", path);
+			free(buf);
+			return 0;
+		}
+	}
+
+	*pcm = malloc(bytes);
+	memcpy(*pcm, buf + start, bytes);
+	free(buf);
+	return bytes / sizeof(int16_t);
+}
+
+/*
+ * Gates the recording with the VAD like the vad element in the TX pipeline, and reports what
+ * goes up to the server and the time vad_process takes.
+ */
+static int bench_vad(const int16_t *pcm, size_t samples, const vad_cfg_t *cfg, FILE *out) {
+	vad_t vad;
+	if (vad_init(&vad, cfg) != ESP_OK) {
+		fprintf(stderr, "vad: Out of memory\n");
+		return 1;
+	}
+	int16_t *sent = malloc(vad_out_samples(&vad) * sizeof(int16_t));
+	uint64_t ns = 0;
+	size_t   frames = samples / VAD_FRAME_SAMPLES;
+	for (size_t i = 0; i < frames; i++) {
+		uint64_t start = now_ns();
+		size_t   n = vad_process(&vad, pcm + i * VAD_FRAME_SAMPLES, sent);
+		ns += now_ns() - start;
+		if (out != NULL && n > 0) {
+			fwrite(sent, sizeof(int16_t), n, out);
+		}
+	}
+
+	vad_stats_t *st = &vad.stats;
+	double       seconds = (double)frames * VAD_FRAME_MS / 1000;
+	uint64_t     speech_bytes = st->bytes_out - st->keepalives * VAD_FRAME_SAMPLES * 2;
+	printf("input: %.1f s, %u frames\n", seconds, st->frames);
+	printf("vad: %u frames of speech sent (%.1f%%) in %u utterances, %u keepalives\n",
+	       st->speech_frames, 100.0 * st->speech_frames / MAX(st->frames, 1), st->utterances,
+	       st->keepalives);
+	printf("uplink: %llu of %llu bytes (%.1f%%), %.1f of %.1f kbit/s\n",
+	       (unsigned long long)st->bytes_out, (unsigned long long)st->bytes_in,
+	       100.0 * st->bytes_out / MAX(st->bytes_in, 1), st->bytes_out * 8 / seconds / 1000,
+	       st->bytes_in * 8 / seconds / 1000);
+	printf("recognizer: %.1f of %.1f s of audio\n",
+	       (double)speech_bytes / (VAD_SAMPLE_RATE * 2), seconds);
+	printf("vad_process: %.0f ns of host time per frame\n", (double)ns / MAX(frames, 1));
+
+	free(sent);
+	vad_deinit(&vad);
+	return 0;
+}
+
+/*
+ * Encodes and decodes the recording a 20 ms frame at a time with each codec in `codecs`, and
+ * reports the bit rate, the host time per frame each way and, for ADPCM, which is not
+ * perceptual, the signal-to-noise ratio.
+ */
+static int bench_codec(const int16_t *pcm, size_t samples, const audio_codec_cfg_t *cfgs,
+                       size_t num_cfgs) {
+	size_t  frames = samples / AUDIO_CODEC_FRAME_SAMPLES;
+	uint8_t packet[AUDIO_CODEC_MAX_PACKET];
+	int16_t decoded[AUDIO_CODEC_FRAME_SAMPLES];
+	printf("input: %.1f s, %zu frames of 20 ms\n", frames * 0.02, frames);
+
+	for (size_t k = 0; k < num_cfgs; k++) {
+		const char    *name = audio_codec_name(cfgs[k].id);
+		audio_codec_t *codec;
+		esp_err_t      err = audio_codec_create(&cfgs[k], &codec);
+		if (err == ESP_ERR_NOT_SUPPORTED) {
+			printf("%s: not built in\n", name);
+			continue;
+		} else if (err != ESP_OK) {
+			fprintf(stderr, "%s: Failed to create\n", name);
+			return 1;
+		}
+
+		uint64_t enc_ns = 0, dec_ns = 0, bytes = 0;
+		double   signal = 0, noise = 0;
+		for (size_t i = 0; i < frames; i++) {
+			const int16_t *frame = pcm + i * AUDIO_CODEC_FRAME_SAMPLES;
+			uint64_t       start = now_ns();
+			int            len = audio_codec_encode(codec, frame, packet);
+			uint64_t       mid = now_ns();
+			int            n = len < 0 ? -1 : audio_codec_decode(codec, packet, len, decoded);
+			dec_ns += now_ns() - mid;
+			enc_ns += mid - start;
+			if (n != AUDIO_CODEC_FRAME_SAMPLES) {
+				fprintf(stderr, "%s: Frame %zu failed\n", name, i);
+				audio_codec_destroy(codec);
+				return 1;
+			}
+			bytes += AUDIO_CODEC_PACKET_HDR_LEN + len;
+			for (int j = 0; j < n; j++) {
+				double e = frame[j] - decoded[j];
+				signal += (double)frame[j] * frame[j];
+				noise += e * e;
+			}
+		}
+
+		frames = MAX(frames, 1);
+		printf("%s: %.1f bytes per frame with the packet header, %.1f kbit/s (%.1f%% of PCM)",
+		       name, (double)bytes / frames, bytes * 8 / (frames * 0.02) / 1000,
+		       100.0 * bytes / (frames * AUDIO_CODEC_FRAME_SAMPLES * sizeof(int16_t)));
+		if (cfgs[k].id == AUDIO_CODEC_ADPCM) {
+			printf(", SNR %.1f dB", 10 * log10(signal / MAX(noise, 1)));
+		}
+		printf("\n%s: encode %.2f us, decode %.2f us of host time per frame\n", name,
+		       enc_ns / 1000.0 / frames, dec_ns / 1000.0 / frames);
+		audio_codec_destroy(codec);
+	}
+	return 0;
+}
+
+// ES7210 analog gain steps in dB, like audio.c's, starting from the top like the badge
+static const float es7210_gain_db[] = {0,  3,  6,  9,  12, 15,   18, 21,
+                                       24, 27, 30, 33, 34.5, 36, 37.5};
+#define ES7210_GAINS (sizeof(es7210_gain_db) / sizeof(es7210_gain_db[0]))
+
+/*
+ * Returns the level of the `frames` frames in `mask` of `pcm`, in dBFS.
+ */
+static double speech_dbfs(const int16_t *pcm, const bool *mask, size_t frames) {
+	double   square = 0;
+	uint64_t n = 0;
+	for (size_t i = 0; i < frames; i++) {
+		if (!mask[i]) {
+			continue;
+		}
+		for (int j = 0; j < AGC_FRAME_SAMPLES; j++) {
+			double s = pcm[i * AGC_FRAME_SAMPLES + j];
+			square += s * s;
+		}
+		n += AGC_FRAME_SAMPLES;
+	}
+	return 10 * log10(square / MAX(n, 1) / (32768.0 * 32768.0) + 1e-10);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Plays the recording into the microphone `levels` dB louder or quieter than it was recorded
+ * at the old fixed gain of 37.5 dB, clipping in the ADC like the badge's, and runs it through
+ * the AGC like the agc element in the TX pipeline, with the analog gain following its steps.
+ * Reports the level of speech, the louder half of the frames of the recording, with the AGC
+ * and with the fixed gain, the clipping either way and the time agc_process takes. Fails if
+ * speech with the AGC is more than `within_db` off the target at any of the levels.
+ */
+static int bench_agc(const int16_t *pcm, size_t samples, const agc_cfg_t *cfg,
+                     const float *levels, size_t num_levels, double within_db, FILE *out) {
+	size_t    frames = samples / AGC_FRAME_SAMPLES;
+	bool     *mask = malloc(MAX(frames, 1) * sizeof(bool));
+	uint64_t *energy = malloc(MAX(frames, 1) * sizeof(uint64_t));
+	uint64_t *sorted = malloc(MAX(frames, 1) * sizeof(uint64_t));
+	int16_t  *fixed = malloc(MAX(frames, 1) * AGC_FRAME_SAMPLES * sizeof(int16_t));
+	int16_t  *agced = malloc(MAX(frames, 1) * AGC_FRAME_SAMPLES * sizeof(int16_t));
+	for (size_t i = 0; i < frames; i++) {
+		energy[i] = 0;
+		for (int j = 0; j < AGC_FRAME_SAMPLES; j++) {
+			int32_t s = pcm[i * AGC_FRAME_SAMPLES + j];
+			energy[i] += (uint64_t)(s * s);
+		}
+		sorted[i] = energy[i];
+	}
+	qsort(sorted, frames, sizeof(uint64_t), cmp_u64);
+	for (size_t i = 0; i < frames; i++) {
+		mask[i] = frames > 0 && energy[i] >= sorted[frames / 2];
+	}
+	printf("input: %.1f s, %zu frames, speech in %.1f dBFS at the old fixed gain\n",
+	       (double)frames * AGC_FRAME_MS / 1000, frames, speech_dbfs(pcm, mask, frames));
+
+	uint64_t ns = 0;
+	double   fixed_min = INFINITY, fixed_max = -INFINITY;
+	double   agc_min = INFINITY, agc_max = -INFINITY;
+	int      ret = 0;
+	for (size_t k = 0; k < num_levels; k++) {
+		agc_t agc;
+		agc_init(&agc, cfg);
+		size_t   gain = ES7210_GAINS - 1;
+		uint32_t clipped = 0, ups = 0, downs = 0;
+		int32_t  gain_min = INT32_MAX, gain_max = INT32_MIN;
+		for (size_t i = 0; i < frames; i++) {
+			// the ADC clips the fixed gain's input at full scale, and the AGC's after
+			// its analog gain
+			float    analog = es7210_gain_db[gain] - es7210_gain_db[ES7210_GAINS - 1];
+			float    fixed_scale = powf(10.0f, levels[k] / 20.0f);
+			float    agc_scale = powf(10.0f, (levels[k] + analog) / 20.0f);
+			int16_t *f = fixed + i * AGC_FRAME_SAMPLES;
+			int16_t *a = agced + i * AGC_FRAME_SAMPLES;
+			for (int j = 0; j < AGC_FRAME_SAMPLES; j++) {
+				float x = pcm[i * AGC_FRAME_SAMPLES + j];
+				float v = lroundf(x * fixed_scale);
+				clipped += v > INT16_MAX || v < INT16_MIN;
+				f[j] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+				v = lroundf(x * agc_scale);
+				a[j] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+			}
+
+			uint32_t raw = agc_count_clipped(a, AGC_FRAME_SAMPLES);
+			uint64_t start = now_ns();
+			int      step = agc_process(&agc, a, raw);
+			ns += now_ns() - start;
+			if (mask[i]) {
+				gain_min = MIN(gain_min, agc.stats.gain_db10);
+				gain_max = MAX(gain_max, agc.stats.gain_db10);
+			}
+			size_t next = gain;
+			if (step > 0 && gain + 1 < ES7210_GAINS) {
+				next = gain + 1;
+			} else if (step < 0 && gain > 0) {
+				next = gain - 1;
+			}
+			if (next != gain) {
+				ups += next > gain;
+				downs += next < gain;
+				float db = es7210_gain_db[next] - es7210_gain_db[gain];
+				agc_analog_stepped(&agc, db);
+				gain = next;
+			}
+		}
+		if (out != NULL) {
+			fwrite(agced, sizeof(int16_t), frames * AGC_FRAME_SAMPLES, out);
+		}
+
+		agc_stats_t *st = &agc.stats;
+		double       fixed_db = speech_dbfs(fixed, mask, frames);
+		double       agc_db = speech_dbfs(agced, mask, frames);
+		fixed_min = MIN(fixed_min, fixed_db);
+		fixed_max = MAX(fixed_max, fixed_db);
+		agc_min = MIN(agc_min, agc_db);
+		agc_max = MAX(agc_max, agc_db);
+		printf("%+.0f dB: fixed: speech %.1f dBFS, %u samples clipped (%.2f%%)\n",
+		       levels[k], fixed_db, clipped, 100.0 * clipped / MAX(samples, 1));
+		printf("%+.0f dB: agc: speech %.1f dBFS, %u samples clipped in the ADC and %u "
+		       "after, %u frames limited\n",
+		       levels[k], agc_db, st->clipped_in, st->clipped_out, st->limited_frames);
+		printf("%+.0f dB: agc: digital gain %.1f to %.1f dB in speech, analog %u steps up "
+		       "and %u down to %.1f dB\n",
+		       levels[k], gain_min / 10.0, gain_max / 10.0, ups, downs,
+		       es7210_gain_db[gain]);
+		if (fabs(agc_db - cfg->target_dbfs) > within_db) {
+			fprintf(stderr, "agc: Speech at %+.0f dB is %.1f dBFS, more than %.1f dB off %d\n",
+			        levels[k], agc_db, within_db, cfg->target_dbfs);
+			ret = 1;
+		}
+	}
+	printf("speech across the levels: fixed %.1f to %.1f dBFS, agc %.1f to %.1f dBFS\n",
+	       fixed_min, fixed_max, agc_min, agc_max);
+	printf("agc_process: %.0f ns of host time per frame\n",
+	       (double)ns / MAX(frames * num_levels, 1));
+
+	free(mask);
+	free(energy);
+	free(sorted);
+	free(fixed);
+	free(agced);
+	return ret;
+}
+
+#define BEAM_SYNTH_TAPS 16 // each side of the fractional delay of the synthesis
+
+/*
+ * Sets `out` to the `n` samples of `x` delayed by `delay` samples, which may be a fraction or
+ * less than 0, with a windowed sinc.
+ */
+static void delay_into(const double *x, size_t n, double delay, double *out) {
+	long   whole = (long)floor(delay);
+	double frac = delay - whole;
+	double h[2 * BEAM_SYNTH_TAPS];
+	for (int k = -BEAM_SYNTH_TAPS + 1; k <= BEAM_SYNTH_TAPS; k++) {
+		double t = k - frac;
+		double sinc = t == 0 ? 1 : sin(M_PI * t) / (M_PI * t);
+		h[k + BEAM_SYNTH_TAPS - 1] = sinc * (0.5 + 0.5 * cos(M_PI * t / BEAM_SYNTH_TAPS));
+	}
+	for (size_t i = 0; i < n; i++) {
+		double sum = 0;
+		for (int k = -BEAM_SYNTH_TAPS + 1; k <= BEAM_SYNTH_TAPS; k++) {
+			long j = (long)i - whole - k;
+			if (j >= 0 && j < (long)n) {
+				sum += x[j] * h[k + BEAM_SYNTH_TAPS - 1];
+			}
+		}
+		out[i] = sum;
+	}
+}
+
+static double power(const int16_t *x, size_t n, size_t stride) {
+	double sum = 0;
+	for (size_t i = 0; i < n; i++) {
+		double v = x[i * stride];
+		sum += v * v;
+	}
+	return sum / MAX(n, 1);
+}
+
+static int16_t clip16(double v) {
+	return v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : lround(v);
+}
+
+/*
+ * Writes `samples` frames of `channels` interleaved channels as a 16 kHz, 16-bit WAV file.
+ */
+static int write_wav(const char *path, const int16_t *pcm, size_t samples, int channels) {
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) {
+		perror(path);
+		return 1;
+	}
+	uint32_t data = samples * channels * sizeof(int16_t);
+	uint32_t rate = BEAM_SAMPLE_RATE, byte_rate = rate * channels * sizeof(int16_t);
+	uint16_t align = channels * sizeof(int16_t);
+	uint8_t  h[44];
+	memcpy(h, "RIFF", 4);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	memcpy(h + 36, "data", 4);
+	for (int i = 0; i < 4; i++) {
+		h[4 + i] = (36 + data) >> (8 * i);
+		h[16 + i] = 16 >> (8 * i);
+		h[24 + i] = rate >> (8 * i);
+		h[28 + i] = byte_rate >> (8 * i);
+		h[40 + i] = data >> (8 * i);
+	}
+	h[20] = 1, h[21] = 0; // PCM
+	h[22] = channels, h[23] = 0;
+	h[32] = align, h[33] = 0;
+	h[34] = 16, h[35] = 0;
+	fwrite(h, 1, sizeof(h), f);
+	fwrite(pcm, sizeof(int16_t), samples * channels, f);
+	fclose(f);
+	return 0;
+}
+
+/*
+ * Beamforms `mics` channels of `in` into `out` like the beam element in the TX pipeline, and
+ * returns the host time it took.
+ */
+static uint64_t run_beam(const beam_cfg_t *cfg, const int16_t *in, int16_t *out, size_t frames) {
+	beam_t beam;
+	beam_init(&beam, cfg);
+	uint64_t start = now_ns();
+	for (size_t i = 0; i < frames; i++) {
+		beam_process(&beam, in + i * BEAM_FRAME_SAMPLES * cfg->mics,
+		             out + i * BEAM_FRAME_SAMPLES);
+	}
+	return now_ns() - start;
+}
+
+/*
+ * Makes up what a line of up to `max_mics` microphones `spacing_mm` apart would pick up: the
+ * recording from the mouth, above them, `noise` from `noise_angle` degrees off it at `snr_db`
+ * below the recording at the first microphone, and noise of each microphone of its own at
+ * `self_dbfs`, all as plane waves. Beamforms the first 2, 3, up to `max_mics` of them like the
+ * beam element in the TX pipeline, and reports how much each part of it changed against the
+ * first microphone alone, and the time beam_process takes. Fails if the SNR with `max_mics`
+ * gains less than `min_gain_db` over the first microphone.
+ */
+static int bench_beam(const int16_t *pcm, size_t samples, const int16_t *noise,
+                      size_t noise_samples, uint32_t max_mics, uint32_t spacing_mm,
+                      double noise_angle, double snr_db, double self_dbfs, double min_gain_db,
+                      FILE *out, const char *mics_out) {
+	size_t frames = samples / BEAM_FRAME_SAMPLES;
+	size_t n = frames * BEAM_FRAME_SAMPLES;
+	if (n == 0) {
+		fprintf(stderr, "beam: Recording shorter than a frame\n");
+		return 1;
+	}
+	double *speech = malloc(n * sizeof(double));
+	double *noisy = malloc(n * sizeof(double));
+	double *delayed = malloc(n * sizeof(double));
+	double  speech_power = 0, noise_power = 0;
+	for (size_t i = 0; i < n; i++) {
+		speech[i] = pcm[i];
+		noisy[i] = noise[i % noise_samples];
+		speech_power += speech[i] * speech[i];
+		noise_power += noisy[i] * noisy[i];
+	}
+	double noise_scale = sqrt(speech_power / MAX(noise_power, 1) / pow(10, snr_db / 10));
+
+	// each part on its own, so that the beamformer's effect on each can be told apart
+	int16_t *parts[3];
+	for (int p = 0; p < 3; p++) {
+		parts[p] = malloc(n * max_mics * sizeof(int16_t));
+	}
+	int16_t *mixed = malloc(n * max_mics * sizeof(int16_t));
+	double   spacing = (double)spacing_mm / 1000 / BEAM_SPEED_OF_SOUND * BEAM_SAMPLE_RATE;
+	double   self_sigma = 32768 * pow(10, self_dbfs / 20);
+	srand(1);
+	for (uint32_t c = 0; c < max_mics; c++) {
+		delay_into(speech, n, c * spacing, delayed);
+		for (size_t i = 0; i < n; i++) {
+			parts[0][i * max_mics + c] = clip16(delayed[i]);
+		}
+		delay_into(noisy, n, c * spacing * cos(noise_angle * M_PI / 180), delayed);
+		for (size_t i = 0; i < n; i++) {
+			parts[1][i * max_mics + c] = clip16(delayed[i] * noise_scale);
+		}
+		for (size_t i = 0; i < n; i++) {
+			double u = (rand() + 1.0) / ((double)RAND_MAX + 2);
+			double v = (rand() + 1.0) / ((double)RAND_MAX + 2);
+			double g = sqrt(-2 * log(u)) * cos(2 * M_PI * v) * self_sigma;
+			parts[2][i * max_mics + c] = clip16(g);
+		}
+		for (size_t i = 0; i < n; i++) {
+			size_t j = i * max_mics + c;
+			mixed[j] = clip16((double)parts[0][j] + parts[1][j] + parts[2][j]);
+		}
+	}
+	if (mics_out != NULL && write_wav(mics_out, mixed, n, max_mics) != 0) {
+		return 1;
+	}
+
+	double in[3];
+	for (int p = 0; p < 3; p++) {
+		in[p] = power(parts[p], n, max_mics);
+	}
+	double snr_in = 10 * log10(in[0] / MAX(in[1] + in[2], 1e-10));
+	printf("input: %.1f s, %zu frames, %u microphones %u mm apart\n",
+	       (double)frames * BEAM_FRAME_MS / 1000, frames, max_mics, spacing_mm);
+	printf("1 microphone: noise from %.0f degrees off the mouth %.1f dB and of the microphone "
+	       "%.1f dB below speech, SNR %.1f dB\n",
+	       noise_angle, 10 * log10(in[0] / MAX(in[1], 1e-10)),
+	       10 * log10(in[0] / MAX(in[2], 1e-10)), snr_in);
+
+	int16_t *chans = malloc(n * max_mics * sizeof(int16_t));
+	int16_t *beamed = malloc(n * sizeof(int16_t));
+	int      ret = 0;
+	for (uint32_t m = 2; m <= max_mics; m++) {
+		beam_cfg_t cfg;
+		beam_line_delays(&cfg, m, spacing_mm);
+		double change[3];
+		for (int p = 0; p < 3; p++) {
+			for (size_t i = 0; i < n; i++) {
+				memcpy(chans + i * m, parts[p] + i * max_mics, m * sizeof(int16_t));
+			}
+			run_beam(&cfg, chans, beamed, frames);
+			change[p] = power(beamed, n, 1) / MAX(in[p], 1e-10);
+		}
+		for (size_t i = 0; i < n; i++) {
+			memcpy(chans + i * m, mixed + i * max_mics, m * sizeof(int16_t));
+		}
+		uint64_t ns = run_beam(&cfg, chans, beamed, frames);
+		if (out != NULL && m == max_mics) {
+			fwrite(beamed, sizeof(int16_t), n, out);
+		}
+		double snr = 10 * log10(in[0] * change[0] /
+		                        MAX(in[1] * change[1] + in[2] * change[2], 1e-10));
+		printf("%u microphones: speech %+.1f dB, noise from %.0f degrees %+.1f dB, of the "
+		       "microphones %+.1f dB, SNR %.1f dB (%+.1f dB), beam_process %.0f ns of host "
+		       "time per frame\n",
+		       m, 10 * log10(change[0]), noise_angle, 10 * log10(change[1]),
+		       10 * log10(change[2]), snr, snr - snr_in, (double)ns / frames);
+		if (m == max_mics && snr - snr_in < min_gain_db) {
+			fprintf(stderr, "beam: SNR %+.1f dB with %u microphones, less than %+.1f dB\n",
+			        snr - snr_in, m, min_gain_db);
+			ret = 1;
+		}
+	}
+
+	free(speech);
+	free(noisy);
+	free(delayed);
+	for (int p = 0; p < 3; p++) {
+		free(parts[p]);
+	}
+	free(mixed);
+	free(chans);
+	free(beamed);
+	return ret;
+}
+
+/*
+ * Returns the SNR of `x` against `ref`, over all of them and, in dB, as the mean over the
+ * frames, each held to -10..35 dB.
+ */
+static double snr_db(const int16_t *ref, const int16_t *x, size_t frames, double *segmental) {
+	double signal = 0, noise = 0, seg = 0;
+	for (size_t i = 0; i < frames; i++) {
+		double fs = 0, fn = 0;
+		size_t at = i * NS_FRAME_SAMPLES;
+		for (int j = 0; j < NS_FRAME_SAMPLES; j++) {
+			double r = ref[at + j], d = x[at + j] - r;
+			fs += r * r;
+			fn += d * d;
+		}
+		signal += fs;
+		noise += fn;
+		seg += MIN(35, MAX(-10, 10 * log10((fs + 1) / (fn + 1))));
+	}
+	*segmental = seg / MAX(frames, 1);
+	return 10 * log10((signal + 1) / (noise + 1));
+}
+
+#define NS_PAUSE_POWER 10.0 // of a frame of the clean recording, -65 dBFS
+
+/*
+ * Mixes `noise` into the clean recording at each of `snrs` dB, suppresses it like the ns
+ * element in the TX pipeline, and reports the SNR and segmental SNR against the clean
+ * recording before and after, how much quieter the noise is in its pauses, and the time
+ * ns_process takes. Fails if the SNR gains less than `min_gain_db` at any of the mixes.
+ */
+static int bench_ns(const int16_t *clean, size_t samples, const int16_t *noise,
+                    size_t noise_samples, const ns_cfg_t *cfg, const float *snrs,
+                    size_t num_snrs, double min_gain_db, FILE *out) {
+	size_t frames = samples / NS_FRAME_SAMPLES;
+	size_t n = frames * NS_FRAME_SAMPLES;
+	double clean_power = 0, noise_power = 0;
+	for (size_t i = 0; i < n; i++) {
+		clean_power += (double)clean[i] * clean[i];
+		noise_power += (double)noise[i % noise_samples] * noise[i % noise_samples];
+	}
+	printf("input: %.1f s, %zu frames\n", (double)frames * NS_FRAME_MS / 1000, frames);
+
+	ns_t    *ns = malloc(sizeof(ns_t));
+	int16_t *mixed = malloc(MAX(n, 1) * sizeof(int16_t));
+	int16_t *cleaned = malloc(MAX(n, 1) * sizeof(int16_t));
+	uint64_t ns_total = 0;
+	int      ret = 0;
+	for (size_t k = 0; k < num_snrs; k++) {
+		double scale = sqrt(clean_power / MAX(noise_power, 1) / pow(10, snrs[k] / 10));
+		for (size_t i = 0; i < n; i++) {
+			mixed[i] = clip16(clean[i] + noise[i % noise_samples] * scale);
+		}
+		ns_init(ns, cfg);
+		uint64_t start = now_ns();
+		for (size_t i = 0; i < frames; i++) {
+			size_t at = i * NS_FRAME_SAMPLES;
+			ns_process(ns, mixed + at, cleaned + at);
+		}
+		ns_total += now_ns() - start;
+		if (out != NULL) {
+			fwrite(cleaned + NS_FRAME_SAMPLES, sizeof(int16_t), n - NS_FRAME_SAMPLES,
+			       out);
+		}
+
+		// the output lags a frame
+		double seg_in, seg_out;
+		double in = snr_db(clean, mixed, frames, &seg_in);
+		double after = snr_db(clean, cleaned + NS_FRAME_SAMPLES, frames - 1, &seg_out);
+		printf("%+.0f dB: SNR %.1f dB in, %.1f dB out (%+.1f dB), segmental %.1f dB in, "
+		       "%.1f dB out (%+.1f dB)\n",
+		       snrs[k], in, after, after - in, seg_in, seg_out, seg_out - seg_in);
+		if (after - in < min_gain_db) {
+			fprintf(stderr, "ns: SNR %+.1f dB at %+.0f dB, less than %+.1f dB\n",
+			        after - in, snrs[k], min_gain_db);
+			ret = 1;
+		}
+
+		// in the pauses of the clean recording, all there is is the noise
+		double pause_in = 0, pause_out = 0;
+		for (size_t i = 0; i + 1 < frames; i++) {
+			size_t at = i * NS_FRAME_SAMPLES;
+			if (power(clean + at, NS_FRAME_SAMPLES, 1) > NS_PAUSE_POWER) {
+				continue;
+			}
+			pause_in += power(mixed + at, NS_FRAME_SAMPLES, 1);
+			pause_out += power(cleaned + at + NS_FRAME_SAMPLES, NS_FRAME_SAMPLES, 1);
+		}
+		printf("%+.0f dB: noise %.1f dB quieter in the pauses\n", snrs[k],
+		       10 * log10((pause_in + 1) / (pause_out + 1)));
+	}
+	printf("ns_process: %.0f ns of host time per frame\n",
+	       (double)ns_total / MAX(frames * num_snrs, 1));
+
+	free(ns);
+	free(mixed);
+	free(cleaned);
+	return ret;
+}
+
+#define AEC_TALK_POWER 100.0 // of a frame of the wearer, -50 dBFS, for telling double talk
+
+/*
+ * Cancels the echo of `far` in `mic` like the aec element in the TX pipeline, into `out`, and
+ * sets `double_talk` for the frames it took to have the wearer in them. Returns the host time
+ * aec_process took in frames with the far end playing, and their count in `far_frames`.
+ */
+static uint64_t run_aec(const aec_cfg_t *cfg, const int16_t *mic, const int16_t *far,
+                        int16_t *out, bool *double_talk, size_t frames, size_t *far_frames) {
+	aec_t    aec;
+	uint64_t total = 0;
+	aec_init(&aec, cfg);
+	for (size_t i = 0; i < frames; i++) {
+		size_t      at = i * AEC_FRAME_SAMPLES;
+		aec_stats_t before = aec.stats;
+		uint64_t    start = now_ns();
+		aec_process(&aec, mic + at, far + at, out + at);
+		uint64_t took = now_ns() - start;
+		if (aec.stats.far_frames != before.far_frames) {
+			total += took;
+		}
+		double_talk[i] = aec.stats.double_talk != before.double_talk;
+	}
+	*far_frames = aec.stats.far_frames;
+	printf("%s: echo peaks %u ms into the filter\n",
+	       cfg->suppress_db > 0 ? "suppressed" : "linear",
+	       aec_peak_delay(&aec) * 1000 / AEC_SAMPLE_RATE);
+	aec_deinit(&aec);
+	return total;
+}
+
+/*
+ * Plays `far` through a made-up echo path into the microphone: straight after
+ * `echo_delay_ms`, then a room that dies away by 60 dB over `t60_ms`, at `echo_db` against
+ * `far`, with noise of the microphone at `self_dbfs`. Halfway through, the wearer starts
+ * talking over it, with `near` at `ser_db` above the echo. Cancels the echo like the aec
+ * element in the TX pipeline, without suppression and with cfg->suppress_db, and reports the
+ * echo return loss enhancement with the far end alone and in double talk, how much of the
+ * wearer is kept, how well double talk was told, and the time aec_process takes. Fails if,
+ * with suppression, the ERLE with the far end alone is less than `min_gain_db` once the filter
+ * has settled.
+ */
+static int bench_aec(const int16_t *near, size_t near_samples, const int16_t *far,
+                     size_t far_samples, const aec_cfg_t *cfg, double echo_db,
+                     double echo_delay_ms, double t60_ms, double ser_db, double self_dbfs,
+                     double min_gain_db, FILE *out) {
+	size_t frames = far_samples / AEC_FRAME_SAMPLES;
+	size_t n = frames * AEC_FRAME_SAMPLES;
+	size_t half = frames / 2 * AEC_FRAME_SAMPLES;
+	if (frames < 4) {
+		fprintf(stderr, "aec: Far end shorter than 4 frames\n");
+		return 1;
+	}
+
+	// the echo path: a tap at the delay, and a tail of noise that dies away after it
+	size_t  delay = lround(echo_delay_ms * AEC_SAMPLE_RATE / 1000);
+	size_t  ir_len = delay + 1 + (size_t)(t60_ms * AEC_SAMPLE_RATE / 1000);
+	double *ir = calloc(ir_len, sizeof(double));
+	double  ir_energy = 1;
+	srand(1);
+	ir[delay] = 1;
+	for (size_t k = delay + 1; k < ir_len; k++) {
+		double u = (rand() + 1.0) / ((double)RAND_MAX + 2);
+		double v = (rand() + 1.0) / ((double)RAND_MAX + 2);
+		double g = sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+		double t = (double)(k - delay) / AEC_SAMPLE_RATE * 1000;
+		ir[k] = 0.25 * g * pow(10, -3 * t / t60_ms);
+		ir_energy += ir[k] * ir[k];
+	}
+	double   scale = pow(10, echo_db / 20) / sqrt(ir_energy);
+	int16_t *echo = malloc(n * sizeof(int16_t));
+	for (size_t i = 0; i < n; i++) {
+		double sum = 0;
+		for (size_t k = 0; k < ir_len && k <= i; k++) {
+			sum += ir[k] * far[i - k];
+		}
+		echo[i] = clip16(sum * scale);
+	}
+
+	// the wearer in the second half, at ser_db above the echo there
+	int16_t *talk = calloc(n, sizeof(int16_t));
+	double   near_power = 0;
+	for (size_t i = half; i < n; i++) {
+		double v = near[(i - half) % near_samples];
+		near_power += v * v;
+	}
+	double talk_scale = sqrt(power(echo + half, n - half, 1) * (n - half) /
+	                         MAX(near_power, 1) * pow(10, ser_db / 10));
+	for (size_t i = half; i < n; i++) {
+		talk[i] = clip16(near[(i - half) % near_samples] * talk_scale);
+	}
+
+	int16_t *mic = malloc(n * sizeof(int16_t));
+	double   self_sigma = 32768 * pow(10, self_dbfs / 20);
+	for (size_t i = 0; i < n; i++) {
+		double u = (rand() + 1.0) / ((double)RAND_MAX + 2);
+		double v = (rand() + 1.0) / ((double)RAND_MAX + 2);
+		double g = sqrt(-2 * log(u)) * cos(2 * M_PI * v) * self_sigma;
+		mic[i] = clip16((double)echo[i] + talk[i] + g);
+	}
+	double in_tail = 0;
+	for (size_t k = 0; k < ir_len && k < cfg->tail_ms * AEC_SAMPLE_RATE / 1000; k++) {
+		in_tail += ir[k] * ir[k];
+	}
+	printf("input: %.1f s, %zu frames, echo %.1f dB against the far end, %.1f dB of it past "
+	       "the filter's %u ms, wearer from %.1f s at %.1f dB above the echo\n",
+	       (double)frames * AEC_FRAME_MS / 1000, frames,
+	       10 * log10(power(echo, n, 1) / MAX(power(far, n, 1), 1e-10)),
+	       10 * log10(MAX(ir_energy - in_tail, 1e-10) / ir_energy), cfg->tail_ms,
+	       (double)half / AEC_SAMPLE_RATE, ser_db);
+
+	int16_t  *cancelled = malloc(n * sizeof(int16_t));
+	int16_t  *residual = malloc(n * sizeof(int16_t));
+	bool     *double_talk = malloc(frames * sizeof(bool));
+	aec_cfg_t linear = *cfg;
+	linear.suppress_db = 0;
+	int       ret = 0;
+	for (int pass = 0; pass < 2; pass++) {
+		size_t   far_frames;
+		uint64_t ns = run_aec(pass == 0 ? &linear : cfg, mic, far, cancelled, double_talk,
+		                      frames, &far_frames);
+		if (pass == 1 && out != NULL) {
+			fwrite(cancelled, sizeof(int16_t), n, out);
+		}
+		const char *what = pass == 0 ? "linear" : "suppressed";
+
+		// with the far end alone, all there is is the echo and the microphone's noise
+		size_t settled = MIN(half / 2, 2 * AEC_SAMPLE_RATE);
+		double first = power(cancelled, settled, 1);
+		double after = power(cancelled + settled, half - settled, 1);
+		double erle = 10 * log10(power(mic + settled, half - settled, 1) / MAX(after, 1e-10));
+		printf("%s: far end alone: ERLE %.1f dB in the first %.1f s, %.1f dB after\n", what,
+		       10 * log10(power(mic, settled, 1) / MAX(first, 1e-10)),
+		       (double)settled / AEC_SAMPLE_RATE, erle);
+		if (pass == 1 && erle < min_gain_db) {
+			fprintf(stderr, "aec: ERLE %.1f dB with the far end alone, less than %.1f dB\n",
+			        erle, min_gain_db);
+			ret = 1;
+		}
+
+		// in double talk, what differs from the wearer is the echo left
+		for (size_t i = half; i < n; i++) {
+			residual[i] = clip16((double)cancelled[i] - talk[i]);
+		}
+		double talk_in = power(talk + half, n - half, 1);
+		double left = MAX(power(residual + half, n - half, 1), 1e-10);
+		printf("%s: double talk: ERLE %.1f dB, wearer %.1f dB above the echo left and what "
+		       "was taken off them\n",
+		       what, 10 * log10(power(echo + half, n - half, 1) / left),
+		       10 * log10(talk_in / left));
+
+		size_t talking = 0, told = 0, false_told = 0;
+		for (size_t i = 0; i < frames; i++) {
+			size_t at = i * AEC_FRAME_SAMPLES;
+			bool   is_talking = power(talk + at, AEC_FRAME_SAMPLES, 1) > AEC_TALK_POWER;
+			talking += is_talking;
+			told += is_talking && double_talk[i];
+			false_told += at < half && double_talk[i];
+		}
+		printf("%s: double talk told in %.0f%% of the frames with the wearer talking, and "
+		       "%.0f%% of those of the far end alone\n",
+		       what, 100.0 * told / MAX(talking, 1),
+		       100.0 * false_told / (half / AEC_FRAME_SAMPLES));
+		printf("%s: aec_process %.0f ns of host time per frame with the far end playing\n",
+		       what, (double)ns / MAX(far_frames, 1));
+	}
+
+	free(ir);
+	free(echo);
+	free(talk);
+	free(mic);
+	free(cancelled);
+	free(residual);
+	free(double_talk);
+	return ret;
+}
+
+typedef struct {
+	uint32_t ms;    // arrival time
+	uint32_t bytes; // of PCM
+} arrival_t;
+
+/*
+ * Reads a jitter trace, one arrival per line as `<ms> <bytes>`, into a malloc'd array. Returns
+ * the number of arrivals, or 0 on error.
+ */
+static size_t read_trace(const char *path, arrival_t **arrivals) {
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		return 0;
+	}
+	size_t n = 0, cap = 1024;
+	char   line[256];
+	*arrivals = malloc(cap * sizeof(arrival_t));
+	while (fgets(line, sizeof(line), f) != NULL) {
+		unsigned ms, bytes;
+		if (line[0] == '#' || sscanf(line, "%u %u", &ms, &bytes) != 2) {
+			continue;
+		}
+		if (n > 0 && ms < (*arrivals)[n - 1].ms) {
+			fprintf(stderr, "%s: Arrival at %u ms is out of order\n", path, ms);
+			n = 0;
+			break;
+		}
+		if (n == cap) {
+			cap *= 2;
+			*arrivals = realloc(*arrivals, cap * sizeof(arrival_t));
+		}
+		(*arrivals)[n++] = (arrival_t){ms, bytes};
+	}
+	fclose(f);
+	if (n == 0) {
+		free(*arrivals);
+	}
+	return n;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Prints the mean, 95th percentile and maximum of `n` values, and sorts them.
+ */
+static void print_spread(const char *what, uint32_t *values, size_t n) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < n; i++) {
+		sum += values[i];
+	}
+	qsort(values, n, sizeof(uint32_t), cmp_u32);
+	n = MAX(n, 1);
+	printf("%s mean %.0f ms, p95 %u ms, max %u ms", what, (double)sum / n,
+	       values[n * 95 / 100], values[n - 1]);
+}
+
+/*
+ * Plays the recording as if it arrived as in the trace, through the jitter buffer like the
+ * jitter element in the RX pipeline, and straight to the DAC like before it, with the DAC
+ * taking a 10 ms frame at a time. Reports the gaps and the audio waiting either way.
+ */
+static int bench_jitter(const int16_t *pcm, size_t samples, const arrival_t *arrivals,
+                        size_t num_arrivals, const jitter_cfg_t *cfg, FILE *out) {
+	jitter_t jb;
+	if (jitter_init(&jb, cfg) != ESP_OK) {
+		fprintf(stderr, "jitter: Out of memory\n");
+		return 1;
+	}
+	uint64_t total = 0;
+	uint32_t max_bytes = 0;
+	for (size_t i = 0; i < num_arrivals; i++) {
+		total += arrivals[i].bytes / sizeof(int16_t);
+		max_bytes = MAX(max_bytes, arrivals[i].bytes);
+	}
+	int16_t *chunk = malloc(max_bytes + 1);
+	size_t   ticks = (arrivals[num_arrivals - 1].ms - arrivals[0].ms) / JITTER_FRAME_MS +
+	               total / JITTER_FRAME_SAMPLES + 1;
+	uint32_t *direct_level = malloc(ticks * sizeof(uint32_t));
+	uint32_t *jitter_level = malloc(ticks * sizeof(uint32_t));
+	uint32_t *jitter_delay = malloc(ticks * sizeof(uint32_t));
+
+	// straight to the DAC: it plays what there is, and is silent when there is not
+	uint64_t direct = 0, direct_played = 0;
+	uint32_t direct_underruns = 0, direct_silent = 0;
+	bool     direct_playing = false;
+
+	size_t   pos = 0, next = 0, n = 0;
+	uint64_t ns = 0;
+	int16_t  frame[JITTER_FRAME_SAMPLES];
+	for (uint32_t t = arrivals[0].ms; n < ticks; t += JITTER_FRAME_MS) {
+		for (; next < num_arrivals && arrivals[next].ms <= t; next++) {
+			// the recording, round and round
+			size_t len = arrivals[next].bytes / sizeof(int16_t);
+			for (size_t i = 0; i < len; i++) {
+				chunk[i] = pcm[pos];
+				pos = (pos + 1) % samples;
+			}
+			uint64_t start = now_ns();
+			jitter_put(&jb, chunk, len, arrivals[next].ms);
+			ns += now_ns() - start;
+			direct += len;
+		}
+		if (next == num_arrivals && jb.count < JITTER_FRAME_SAMPLES &&
+		    direct < JITTER_FRAME_SAMPLES) {
+			break;
+		}
+
+		direct_level[n] = direct / (JITTER_SAMPLE_RATE / 1000);
+		if (direct >= JITTER_FRAME_SAMPLES) {
+			direct -= JITTER_FRAME_SAMPLES;
+			direct_played += JITTER_FRAME_SAMPLES;
+			direct_playing = true;
+		} else if (direct_playing) {
+			direct_underruns++;
+			direct_playing = false;
+		}
+		if (!direct_playing && direct_played > 0) {
+			direct_silent++;
+		}
+
+		jitter_level[n] = jb.count / (JITTER_SAMPLE_RATE / 1000);
+		uint64_t start = now_ns();
+		jitter_get(&jb, frame, t);
+		ns += now_ns() - start;
+		jitter_delay[n] = jb.delay_ms;
+		if (out != NULL) {
+			fwrite(frame, sizeof(int16_t), JITTER_FRAME_SAMPLES, out);
+		}
+		n++;
+	}
+
+	jitter_stats_t *st = &jb.stats;
+	printf("trace: %zu arrivals, %.1f s of audio over %.1f s\n", num_arrivals,
+	       (double)total / JITTER_SAMPLE_RATE,
+	       (arrivals[num_arrivals - 1].ms - arrivals[0].ms) / 1000.0);
+	printf("no buffer: %u underruns, %u ms silent, ", direct_underruns,
+	       direct_silent * JITTER_FRAME_MS);
+	print_spread("audio waiting", direct_level, n);
+	printf("\njitter: %u underruns, %u ms concealed, %u frames stretched, %u compressed, "
+	       "%u dropped, ",
+	       st->underruns, st->concealed * JITTER_FRAME_MS, st->stretched, st->compressed,
+	       st->overruns);
+	print_spread("audio waiting", jitter_level, n);
+	printf("\njitter: ");
+	print_spread("delay", jitter_delay, n);
+	printf("\njitter_put and jitter_get: %.0f ns of host time per frame\n",
+	       (double)ns / MAX(n, 1));
+
+	free(chunk);
+	free(direct_level);
+	free(jitter_level);
+	free(jitter_delay);
+	jitter_deinit(&jb);
+	return 0;
+}
+
+#ifdef CONFIG_AUDIO_OPUS_BITRATE
+#define OPUS_BITRATE CONFIG_AUDIO_OPUS_BITRATE
+#define OPUS_COMPLEXITY CONFIG_AUDIO_OPUS_COMPLEXITY
+#else
+#define OPUS_BITRATE 24000 // the Kconfig defaults
+#define OPUS_COMPLEXITY 3
+#endif
+
+#ifdef CONFIG_AUDIO_BEAM_SPACING_MM
+#define BEAM_SPACING_MM CONFIG_AUDIO_BEAM_SPACING_MM
+#else
+#define BEAM_SPACING_MM 20 // the Kconfig default
+#endif
+
+/*
+ * Parses a comma separated list of up to `max` numbers into `values`. Returns how many there
+ * were, or 0 on error.
+ */
+static size_t parse_floats(const char *list, float *values, size_t max) {
+	size_t n = 0;
+	for (const char *p = list; *p != '\0';) {
+		char *end;
+		if (n == max) {
+			return 0;
+		}
+		values[n++] = strtof(p, &end);
+		if (end == p || (*end != ',' && *end != '\0')) {
+			return 0;
+		}
+		p = *end == ',' ? end + 1 : end;
+	}
+	return n;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr,
+	        "usage: %s [options] agc RECORDING\n"
+	        "       %s [options] beam RECORDING NOISE\n"
+	        "       %s [options] ns CLEAN NOISE\n"
+	        "       %s [options] aec NEAR FAR\n"
+	        "       %s [options] vad RECORDING\n"
+	        "       %s [options] codec RECORDING\n"
+	        "       %s [options] jitter RECORDING TRACE\n"
+	        "\n"
+	        "RECORDING, CLEAN, NOISE, NEAR and FAR are 16 kHz, 16-bit mono PCM, as WAV or\n"
+	        "raw, or @speech, @babble or @noise, made up. TRACE has a line `<ms> <bytes>`\n"
+	        "per arrival of the peer's audio.\n"
+	        "\n"
+	        "options:\n"
+	        "  -o FILE             write what would be sent to the server, or played, to\n"
+	        "                      FILE, raw\n"
+	        "  --levels LIST       agc: dB to play the recording louder, comma separated\n"
+	        "                      (default -20,-10,0,10,20)\n"
+	        "  --target-dbfs N     agc: level of speech out (default %d)\n"
+	        "  --max-gain-db N     agc: most digital gain (default %u)\n"
+	        "  --attack-ms N       agc: for the level to follow a rise (default %u)\n"
+	        "  --release-ms N      agc: and a fall (default %u)\n"
+	        "  --no-analog         agc: keep the analog gain at 37.5 dB\n"
+	        "  --mics N            beam: most microphones, 2..%d (default %d)\n"
+	        "  --spacing-mm N      beam: between the microphones (default %d)\n"
+	        "  --noise-angle DEG   beam: NOISE comes from this far off the mouth (default 90)\n"
+	        "  --snr-db N          beam: speech above NOISE at a microphone (default 0)\n"
+	        "  --self-noise-dbfs N beam, aec: noise of each microphone (default -60)\n"
+	        "  --mics-out FILE     beam: write what the microphones pick up to FILE, as WAV\n"
+	        "  --snrs LIST         ns: dB of CLEAN above NOISE, comma separated\n"
+	        "                      (default 0,5,10,20)\n"
+	        "  --max-db N          ns: most noise reduction (default %u)\n"
+	        "  --tail-ms N         aec: longest echo cancelled, in steps of 10 (default %u)\n"
+	        "  --suppress-db N     aec: most suppression of the echo left (default %u)\n"
+	        "  --echo-db N         aec: echo against the far end (default 0)\n"
+	        "  --echo-delay-ms N   aec: from the far end to the echo (default 5)\n"
+	        "  --t60-ms N          aec: for the echo to die away by 60 dB (default 150)\n"
+	        "  --ser-db N          aec: wearer above the echo in double talk (default 0)\n"
+	        "  --within-db N       agc: fail if speech is more than N dB off the target\n"
+	        "  --min-gain-db N     beam, ns: fail if the SNR gains less than N dB;\n"
+	        "                      aec: if the ERLE is less than N dB\n"
+	        "  --threshold-db N    vad: speech threshold above the noise floor (default %u)\n"
+	        "  --hangover-ms N     vad: speech kept after the last speech frame (default %u)\n"
+	        "  --preroll-ms N      vad: audio sent from before the onset (default %u)\n"
+	        "  --keepalive-ms N    vad: between keepalives in silence, 0 disables (default %u)\n"
+	        "  --codec NAME        codec: only adpcm or opus (default both)\n"
+	        "  --opus-bitrate N    codec: Opus bit rate (default %u)\n"
+	        "  --opus-complexity N codec: Opus complexity, 0..10 (default %u)\n"
+	        "  --min-delay-ms N    jitter: least playout delay (default %u)\n"
+	        "  --max-delay-ms N    jitter: most playout delay (default %u)\n"
+	        "  --conceal-ms N      jitter: longest gap concealed (default %u)\n",
+	        prog, prog, prog, prog, prog, prog, prog, CONFIG_AUDIO_AGC_TARGET_DBFS,
+	        CONFIG_AUDIO_AGC_MAX_GAIN_DB, CONFIG_AUDIO_AGC_ATTACK_MS,
+	        CONFIG_AUDIO_AGC_RELEASE_MS, BEAM_MAX_MICS, BEAM_MAX_MICS, BEAM_SPACING_MM,
+	        CONFIG_AUDIO_NS_MAX_DB, CONFIG_AUDIO_AEC_TAIL_MS, CONFIG_AUDIO_AEC_SUPPRESS_DB,
+	        CONFIG_AUDIO_VAD_THRESHOLD_DB, CONFIG_AUDIO_VAD_HANGOVER_MS,
+	        CONFIG_AUDIO_VAD_PREROLL_MS, CONFIG_AUDIO_VAD_KEEPALIVE_MS, OPUS_BITRATE,
+	        OPUS_COMPLEXITY, CONFIG_AUDIO_JITTER_MIN_DELAY_MS,
+	        CONFIG_AUDIO_JITTER_MAX_DELAY_MS, CONFIG_AUDIO_JITTER_CONCEAL_MS);
+	exit(2);
+}
+
+int main(int argc, char **argv) {
+	enum {
+		OPT_THRESHOLD_DB = 0x100,
+		OPT_HANGOVER_MS,
+		OPT_PREROLL_MS,
+		OPT_KEEPALIVE_MS,
+		OPT_CODEC,
+		OPT_OPUS_BITRATE,
+		OPT_OPUS_COMPLEXITY,
+		OPT_MIN_DELAY_MS,
+		OPT_MAX_DELAY_MS,
+		OPT_CONCEAL_MS,
+		OPT_LEVELS,
+		OPT_TARGET_DBFS,
+		OPT_MAX_GAIN_DB,
+		OPT_ATTACK_MS,
+		OPT_RELEASE_MS,
+		OPT_NO_ANALOG,
+		OPT_MICS,
+		OPT_SPACING_MM,
+		OPT_NOISE_ANGLE,
+		OPT_SNR_DB,
+		OPT_SELF_NOISE_DBFS,
+		OPT_MICS_OUT,
+		OPT_SNRS,
+		OPT_MAX_DB,
+		OPT_TAIL_MS,
+		OPT_SUPPRESS_DB,
+		OPT_ECHO_DB,
+		OPT_ECHO_DELAY_MS,
+		OPT_T60_MS,
+		OPT_SER_DB,
+		OPT_WITHIN_DB,
+		OPT_MIN_GAIN_DB,
+	};
+	static const struct option long_opts[] = {
+		{"threshold-db", required_argument, NULL, OPT_THRESHOLD_DB},
+		{"hangover-ms", required_argument, NULL, OPT_HANGOVER_MS},
+		{"preroll-ms", required_argument, NULL, OPT_PREROLL_MS},
+		{"keepalive-ms", required_argument, NULL, OPT_KEEPALIVE_MS},
+		{"codec", required_argument, NULL, OPT_CODEC},
+		{"opus-bitrate", required_argument, NULL, OPT_OPUS_BITRATE},
+		{"opus-complexity", required_argument, NULL, OPT_OPUS_COMPLEXITY},
+		{"min-delay-ms", required_argument, NULL, OPT_MIN_DELAY_MS},
+		{"max-delay-ms", required_argument, NULL, OPT_MAX_DELAY_MS},
+		{"conceal-ms", required_argument, NULL, OPT_CONCEAL_MS},
+		{"levels", required_argument, NULL, OPT_LEVELS},
+		{"target-dbfs", required_argument, NULL, OPT_TARGET_DBFS},
+		{"max-gain-db", required_argument, NULL, OPT_MAX_GAIN_DB},
+		{"attack-ms", required_argument, NULL, OPT_ATTACK_MS},
+		{"release-ms", required_argument, NULL, OPT_RELEASE_MS},
+		{"no-analog", no_argument, NULL, OPT_NO_ANALOG},
+		{"mics", required_argument, NULL, OPT_MICS},
+		{"spacing-mm", required_argument, NULL, OPT_SPACING_MM},
+		{"noise-angle", required_argument, NULL, OPT_NOISE_ANGLE},
+		{"snr-db", required_argument, NULL, OPT_SNR_DB},
+		{"self-noise-dbfs", required_argument, NULL, OPT_SELF_NOISE_DBFS},
+		{"mics-out", required_argument, NULL, OPT_MICS_OUT},
+		{"snrs", required_argument, NULL, OPT_SNRS},
+		{"max-db", required_argument, NULL, OPT_MAX_DB},
+		{"tail-ms", required_argument, NULL, OPT_TAIL_MS},
+		{"suppress-db", required_argument, NULL, OPT_SUPPRESS_DB},
+		{"echo-db", required_argument, NULL, OPT_ECHO_DB},
+		{"echo-delay-ms", required_argument, NULL, OPT_ECHO_DELAY_MS},
+		{"t60-ms", required_argument, NULL, OPT_T60_MS},
+		{"ser-db", required_argument, NULL, OPT_SER_DB},
+		{"within-db", required_argument, NULL, OPT_WITHIN_DB},
+		{"min-gain-db", required_argument, NULL, OPT_MIN_GAIN_DB},
+		{NULL, 0, NULL, 0},
+	};
+
+	vad_cfg_t vad_cfg = {
+	    .threshold_db = CONFIG_AUDIO_VAD_THRESHOLD_DB,
+	    .hangover_ms = CONFIG_AUDIO_VAD_HANGOVER_MS,
+	    .preroll_ms = CONFIG_AUDIO_VAD_PREROLL_MS,
+	    .keepalive_ms = CONFIG_AUDIO_VAD_KEEPALIVE_MS,
+	};
+	jitter_cfg_t jitter_cfg = {
+	    .min_delay_ms = CONFIG_AUDIO_JITTER_MIN_DELAY_MS,
+	    .max_delay_ms = CONFIG_AUDIO_JITTER_MAX_DELAY_MS,
+	    .conceal_ms = CONFIG_AUDIO_JITTER_CONCEAL_MS,
+	};
+	agc_cfg_t agc_cfg = {
+	    .target_dbfs = CONFIG_AUDIO_AGC_TARGET_DBFS,
+	    .max_gain_db = CONFIG_AUDIO_AGC_MAX_GAIN_DB,
+	    .attack_ms = CONFIG_AUDIO_AGC_ATTACK_MS,
+	    .release_ms = CONFIG_AUDIO_AGC_RELEASE_MS,
+	    .analog = true,
+	};
+	float  levels[16] = {-20, -10, 0, 10, 20};
+	size_t num_levels = 5;
+	// a line of microphones up to as many as the ES7210 has, with noise from in front
+	uint32_t    mics = BEAM_MAX_MICS, spacing_mm = BEAM_SPACING_MM;
+	double      noise_angle = 90, snr_db = 0, self_dbfs = -60;
+	const char *mics_out = NULL;
+	ns_cfg_t    ns_cfg = {.max_db = CONFIG_AUDIO_NS_MAX_DB};
+	float       snrs[16] = {0, 5, 10, 20};
+	size_t      num_snrs = 4;
+	aec_cfg_t   aec_cfg = {
+	    .tail_ms = CONFIG_AUDIO_AEC_TAIL_MS,
+	    .suppress_db = CONFIG_AUDIO_AEC_SUPPRESS_DB,
+	};
+	// a badge speaker a few cm from the microphone, in a small room
+	double      echo_db = 0, echo_delay_ms = 5, t60_ms = 150, ser_db = 0;
+	// what fails the run; nothing by default
+	double      within_db = INFINITY, min_gain_db = -INFINITY;
+	audio_codec_cfg_t codec_cfgs[] = {
+	    {.id = AUDIO_CODEC_ADPCM},
+	    {.id = AUDIO_CODEC_OPUS, .bitrate = OPUS_BITRATE, .complexity = OPUS_COMPLEXITY},
+	};
+	size_t first_codec = 0, num_codecs = 2;
+	FILE  *out = NULL;
+	int    c;
+	while ((c = getopt_long(argc, argv, "o:", long_opts, NULL)) != -1) {
+		switch (c) {
+		case 'o':
+			out = fopen(optarg, "wb");
+			if (out == NULL) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		case OPT_THRESHOLD_DB:
+			vad_cfg.threshold_db = atoi(optarg);
+			break;
+		case OPT_HANGOVER_MS:
+			vad_cfg.hangover_ms = atoi(optarg);
+			break;
+		case OPT_PREROLL_MS:
+			vad_cfg.preroll_ms = atoi(optarg);
+			break;
+		case OPT_KEEPALIVE_MS:
+			vad_cfg.keepalive_ms = atoi(optarg);
+			break;
+		case OPT_CODEC:
+			first_codec = strcmp(optarg, "opus") == 0;
+			num_codecs = 1;
+			if (strcmp(optarg, audio_codec_name(codec_cfgs[first_codec].id)) != 0) {
+				usage(argv[0]);
+			}
+			break;
+		case OPT_OPUS_BITRATE:
+			codec_cfgs[1].bitrate = atoi(optarg);
+			break;
+		case OPT_OPUS_COMPLEXITY:
+			codec_cfgs[1].complexity = atoi(optarg);
+			break;
+		case OPT_MIN_DELAY_MS:
+			jitter_cfg.min_delay_ms = atoi(optarg);
+			break;
+		case OPT_MAX_DELAY_MS:
+			jitter_cfg.max_delay_ms = atoi(optarg);
+			break;
+		case OPT_CONCEAL_MS:
+			jitter_cfg.conceal_ms = atoi(optarg);
+			break;
+		case OPT_LEVELS:
+			num_levels = parse_floats(optarg, levels, 16);
+			if (num_levels == 0) {
+				usage(argv[0]);
+			}
+			break;
+		case OPT_TARGET_DBFS:
+			agc_cfg.target_dbfs = atoi(optarg);
+			break;
+		case OPT_MAX_GAIN_DB:
+			agc_cfg.max_gain_db = atoi(optarg);
+			break;
+		case OPT_ATTACK_MS:
+			agc_cfg.attack_ms = atoi(optarg);
+			break;
+		case OPT_RELEASE_MS:
+			agc_cfg.release_ms = atoi(optarg);
+			break;
+		case OPT_NO_ANALOG:
+			agc_cfg.analog = false;
+			break;
+		case OPT_MICS:
+			mics = atoi(optarg);
+			if (mics < 2 || mics > BEAM_MAX_MICS) {
+				usage(argv[0]);
+			}
+			break;
+		case OPT_SPACING_MM:
+			spacing_mm = atoi(optarg);
+			break;
+		case OPT_NOISE_ANGLE:
+			noise_angle = atof(optarg);
+			break;
+		case OPT_SNR_DB:
+			snr_db = atof(optarg);
+			break;
+		case OPT_SELF_NOISE_DBFS:
+			self_dbfs = atof(optarg);
+			break;
+		case OPT_MICS_OUT:
+			mics_out = optarg;
+			break;
+		case OPT_SNRS:
+			num_snrs = parse_floats(optarg, snrs, 16);
+			if (num_snrs == 0) {
+				usage(argv[0]);
+			}
+			break;
+		case OPT_MAX_DB:
+			ns_cfg.max_db = atoi(optarg);
+			break;
+		case OPT_TAIL_MS:
+			aec_cfg.tail_ms = atoi(optarg);
+			if (aec_cfg.tail_ms < AEC_FRAME_MS || aec_cfg.tail_ms > AEC_MAX_TAIL_MS ||
+			    aec_cfg.tail_ms % AEC_FRAME_MS != 0) {
+				usage(argv[0]);
+			}
+			break;
+		case OPT_SUPPRESS_DB:
+			aec_cfg.suppress_db = atoi(optarg);
+			break;
+		case OPT_ECHO_DB:
+			echo_db = atof(optarg);
+			break;
+		case OPT_ECHO_DELAY_MS:
+			echo_delay_ms = atof(optarg);
+			break;
+		case OPT_T60_MS:
+			t60_ms = atof(optarg);
+			break;
+		case OPT_SER_DB:
+			ser_db = atof(optarg);
+			break;
+		case OPT_WITHIN_DB:
+			within_db = atof(optarg);
+			break;
+		case OPT_MIN_GAIN_DB:
+			min_gain_db = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	bool jitter = argc - optind == 3 && strcmp(argv[optind], "jitter") == 0;
+	bool beam = argc - optind == 3 && strcmp(argv[optind], "beam") == 0;
+	bool ns = argc - optind == 3 && strcmp(argv[optind], "ns") == 0;
+	bool aec = argc - optind == 3 && strcmp(argv[optind], "aec") == 0;
+	bool others = argc - optind == 2 && (strcmp(argv[optind], "vad") == 0 ||
+	                                     strcmp(argv[optind], "codec") == 0 ||
+	                                     strcmp(argv[optind], "agc") == 0);
+	if (!jitter && !beam && !ns && !aec && !others) {
+		usage(argv[0]);
+	}
+
+	int16_t *pcm;
+	size_t   samples = read_pcm(argv[optind + 1], &pcm);
+	if (samples == 0) {
+		return 1;
+	}
+	int ret;
+	if (jitter) {
+		arrival_t *arrivals;
+		size_t     num_arrivals = read_trace(argv[optind + 2], &arrivals);
+		if (num_arrivals == 0) {
+			free(pcm);
+			return 1;
+		}
+		ret = bench_jitter(pcm, samples, arrivals, num_arrivals, &jitter_cfg, out);
+		free(arrivals);
+	} else if (ns) {
+		int16_t *noise;
+		size_t   noise_samples = read_pcm(argv[optind + 2], &noise);
+		if (noise_samples == 0) {
+			free(pcm);
+			return 1;
+		}
+		ret = bench_ns(pcm, samples, noise, noise_samples, &ns_cfg, snrs, num_snrs,
+		               min_gain_db, out);
+		free(noise);
+	} else if (aec) {
+		int16_t *far;
+		size_t   far_samples = read_pcm(argv[optind + 2], &far);
+		if (far_samples == 0) {
+			free(pcm);
+			return 1;
+		}
+		ret = bench_aec(pcm, samples, far, far_samples, &aec_cfg, echo_db, echo_delay_ms,
+		                t60_ms, ser_db, self_dbfs, min_gain_db, out);
+		free(far);
+	} else if (beam) {
+		int16_t *noise;
+		size_t   noise_samples = read_pcm(argv[optind + 2], &noise);
+		if (noise_samples == 0) {
+			free(pcm);
+			return 1;
+		}
+		if ((uint64_t)(mics - 1) * spacing_mm * BEAM_SAMPLE_RATE >=
+		    (uint64_t)BEAM_MAX_DELAY * BEAM_SPEED_OF_SOUND * 1000) {
+			fprintf(stderr, "beam: %u microphones %u mm apart are too far for the "
+			                "beamformer\n",
+			        mics, spacing_mm);
+			free(noise);
+			free(pcm);
+			return 1;
+		}
+		ret = bench_beam(pcm, samples, noise, noise_samples, mics, spacing_mm, noise_angle,
+		                 snr_db, self_dbfs, min_gain_db, out, mics_out);
+		free(noise);
+	} else if (strcmp(argv[optind], "agc") == 0) {
+		ret = bench_agc(pcm, samples, &agc_cfg, levels, num_levels, within_db, out);
+	} else if (strcmp(argv[optind], "vad") == 0) {
+		ret = bench_vad(pcm, samples, &vad_cfg, out);
+	} else {
+		ret = bench_codec(pcm, samples, codec_cfgs + first_codec, num_codecs);
+	}
+	if (out != NULL) {
+		fclose(out);
+	}
+	free(pcm);
+	return ret;
+}
@@ -0,0 +1,95 @@
+#include "dev_mock.h"
+#include "DEV_Config.h"
+#include "SPI.h"
+#include "sim_rtos.h"
+
+epd_panel_t dev_mock_panel;
+void (*dev_mock_refresh_hook)(const epd_panel_t *panel, uint64_t start_us, uint32_t busy_us);
+
+static uint32_t   spi_hz = DEV_MOCK_SPI_HZ;
+static int        dc_level, rst_level = 1;
+static uint64_t   busy_until_us;
+static gpio_isr_t busy_isr;
+static void      *busy_isr_arg;
+
+void dev_mock_init(const epd_timing_t *timing, uint32_t hz) {
+	epd_panel_init(&dev_mock_panel, timing);
+	spi_hz = hz;
+}
+
+static void busy_released(void *arg) {
+	// BUSY is active low; the driver's interrupt fires on the rising edge
+	if (sim_now_us() >= busy_until_us && busy_isr != NULL) {
+		busy_isr(busy_isr_arg);
+	}
+}
+
+/******************************************************************************
+ * GPIO
+ ******************************************************************************/
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+	if (gpio_num == EPD_DC_PIN) {
+		dc_level = level;
+	} else if (gpio_num == EPD_RST_PIN) {
+		if (rst_level == 0 && level == 1) {
+			epd_panel_reset(&dev_mock_panel, sim_now_us());
+		}
+		rst_level = level;
+	}
+	return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+	if (gpio_num == EPD_BUSY_PIN) {
+		return sim_now_us() >= busy_until_us;
+	}
+	return 0;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args) {
+	if (gpio_num == EPD_BUSY_PIN) {
+		busy_isr = isr_handler;
+		busy_isr_arg = args;
+	}
+	return ESP_OK;
+}
+
+/******************************************************************************
+ * DEV_Config / SPI
+ ******************************************************************************/
+
+UBYTE DEV_Module_Init(void) {
+	spi_init();
+	return 0;
+}
+
+void spi_init(void) {}
+
+static void spi_transfer(const uint8_t *data, uint32_t len) {
+	epd_panel_t *p = &dev_mock_panel;
+	p->spi_bytes += len;
+	p->spi_transactions++;
+	sim_delay_us(DEV_MOCK_SPI_OVERHEAD_US + (uint64_t)len * 8 * 1000000 / spi_hz);
+
+	uint64_t now = sim_now_us();
+	if (dc_level == 0) {
+		for (uint32_t i = 0; i < len; i++) {
+			uint32_t busy_us = epd_panel_command(p, data[i], now);
+			if (busy_us == 0) {
+				continue;
+			}
+			busy_until_us = now + busy_us;
+			sim_timer_add(busy_until_us, busy_released, NULL);
+			if (data[i] == 0x12 && dev_mock_refresh_hook != NULL) {
+				dev_mock_refresh_hook(p, now, busy_us);
+			}
+		}
+	} else {
+		epd_panel_data(p, data, len, now);
+	}
+}
+
+void spi_write_byte(uint8_t byte) { spi_transfer(&byte, 1); }
+
+void spi_write_bytes(uint8_t *data, uint16_t len) { spi_transfer(data, len); }
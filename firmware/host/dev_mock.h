@@ -0,0 +1,22 @@
+#pragma once
+
+/*
+ * Mock of DEV_Config.c and SPI.c: routes the driver's GPIO and SPI traffic into a simulated
+ * panel and charges SPI transfer time to the virtual clock.
+ */
+
+#include "epd_panel.h"
+
+#define DEV_MOCK_SPI_HZ (2 * 1000 * 1000) // clock_speed_hz in SPI.c
+#define DEV_MOCK_SPI_OVERHEAD_US 20       // per spi_device_transmit call
+
+extern epd_panel_t dev_mock_panel;
+
+/*
+ * Called after every display refresh command (0x12) with the time it was issued and how
+ * long the panel stays busy.
+ */
+extern void (*dev_mock_refresh_hook)(const epd_panel_t *panel, uint64_t start_us,
+                                     uint32_t busy_us);
+
+void dev_mock_init(const epd_timing_t *timing, uint32_t spi_hz);
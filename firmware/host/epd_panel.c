@@ -0,0 +1,236 @@
+#include "epd_panel.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Typical figures for the 7.5" V2 panel: ~5 s for the full (KW) waveform, ~1.5 s for the
+ * fast waveform selected by 0xE5=0x5A and ~0.4 s for a partial update (0xE5=0x6E, 0x91).
+ */
+const epd_timing_t epd_default_timing = {
+	.refresh_ms = {[EPD_REFRESH_FULL] = 5000, [EPD_REFRESH_FAST] = 1500,
+	               [EPD_REFRESH_PART] = 400},
+	.power_on_ms = 40,
+	.power_off_ms = 20,
+};
+
+/*
+ * Refresh and deep sleep figures are from the Waveshare 7.5" V2 spec sheet (26.4 mW refresh
+ * power at 3.3 V, ~0 standby). "off" is the controller clocked with the charge pumps off, and
+ * "on" the charge pumps running between refreshes; neither is specified, so these are
+ * estimates worth checking against a current meter.
+ */
+const epd_current_t epd_default_current = {
+	.deep_sleep_ua = 1,
+	.off_ua = 5,
+	.on_ua = 1000,
+	.refresh_ua = 8000,
+};
+
+static void set_power(epd_panel_t *p, epd_power_state_t state, uint64_t now_us) {
+	p->power_us[p->power] += now_us - p->power_since_us;
+	p->power_since_us = now_us;
+	p->power = state;
+}
+
+void epd_panel_init(epd_panel_t *p, const epd_timing_t *timing) {
+	memset(p, 0, sizeof(*p));
+	p->timing = *timing;
+	// a blank (white) panel; controller RAM contents are undefined at power-up
+	memset(p->image, 0xFF, sizeof(p->image));
+	p->power = EPD_POWER_OFF;
+}
+
+void epd_panel_reset(epd_panel_t *p, uint64_t now_us) {
+	p->resets++;
+	p->cdi = 0;
+	p->e5 = 0;
+	p->partial = false;
+	p->win_x0 = 0;
+	p->win_x1 = EPD_PANEL_WIDTH - 1;
+	p->win_y0 = 0;
+	p->win_y1 = EPD_PANEL_HEIGHT - 1;
+	p->ram = NULL;
+	p->cmd = 0;
+	p->arg_idx = 0;
+	if (p->power == EPD_POWER_DEEP_SLEEP) {
+		set_power(p, EPD_POWER_OFF, now_us);
+	}
+}
+
+static uint32_t refresh(epd_panel_t *p) {
+	epd_refresh_kind_t kind;
+	if (p->partial) {
+		kind = EPD_REFRESH_PART;
+	} else if (p->e5 != 0) {
+		kind = EPD_REFRESH_FAST;
+	} else {
+		kind = EPD_REFRESH_FULL;
+	}
+
+	if (p->power != EPD_POWER_ON) {
+		fprintf(stderr, "epd_panel: display refresh while %s\n",
+		        epd_power_state_name(p->power));
+		p->errors++;
+		return 0;
+	}
+
+	uint16_t x0 = 0, x1 = EPD_PANEL_WIDTH_BYTES - 1, y0 = 0, y1 = EPD_PANEL_HEIGHT - 1;
+	if (p->partial) {
+		x0 = p->win_x0 / 8;
+		x1 = p->win_x1 / 8;
+		y0 = p->win_y0;
+		y1 = p->win_y1;
+	}
+
+	// DDX=0: 1 bits in the new RAM are black; DDX=1: 1 bits are white
+	bool invert = (p->cdi & 0x01) == 0;
+	for (uint32_t y = y0; y <= y1; y++) {
+		for (uint32_t x = x0; x <= x1; x++) {
+			uint32_t addr = y * EPD_PANEL_WIDTH_BYTES + x;
+			p->image[addr] = invert ? ~p->new_ram[addr] : p->new_ram[addr];
+		}
+	}
+
+	uint32_t busy_us = p->timing.refresh_ms[kind] * 1000;
+	epd_refresh_stats_t *s = &p->refresh[kind];
+	s->count++;
+	s->busy_us += busy_us;
+	s->pixels += (uint64_t)(x1 - x0 + 1) * 8 * (y1 - y0 + 1);
+
+	p->last_kind = kind;
+	p->last_x0 = x0 * 8;
+	p->last_x1 = (x1 + 1) * 8;
+	p->last_y0 = y0;
+	p->last_y1 = y1 + 1;
+	return busy_us;
+}
+
+uint32_t epd_panel_command(epd_panel_t *p, uint8_t cmd, uint64_t now_us) {
+	if (p->power == EPD_POWER_DEEP_SLEEP) {
+		// only a reset wakes the controller
+		return 0;
+	}
+
+	p->commands++;
+	p->cmd = cmd;
+	p->arg_idx = 0;
+	p->ram = NULL;
+
+	switch (cmd) {
+	case 0x02: // POWER OFF
+		set_power(p, EPD_POWER_OFF, now_us);
+		return p->timing.power_off_ms * 1000;
+	case 0x04: // POWER ON
+		set_power(p, EPD_POWER_ON, now_us);
+		return p->timing.power_on_ms * 1000;
+	case 0x10: // DATA START TRANSMISSION 1
+	case 0x13: // DATA START TRANSMISSION 2
+		p->ram = cmd == 0x10 ? p->old_ram : p->new_ram;
+		if (p->partial) {
+			p->wr_x = p->win_x0 / 8;
+			p->wr_y = p->win_y0;
+		} else {
+			p->wr_x = 0;
+			p->wr_y = 0;
+		}
+		return 0;
+	case 0x12: // DISPLAY REFRESH
+		return refresh(p);
+	case 0x91: // PARTIAL IN
+		p->partial = true;
+		return 0;
+	case 0x92: // PARTIAL OUT
+		p->partial = false;
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+static void write_ram(epd_panel_t *p, uint8_t byte) {
+	uint16_t x_first = 0, x_last = EPD_PANEL_WIDTH_BYTES - 1;
+	uint16_t y_first = 0, y_last = EPD_PANEL_HEIGHT - 1;
+	if (p->partial) {
+		x_first = p->win_x0 / 8;
+		x_last = p->win_x1 / 8;
+		y_first = p->win_y0;
+		y_last = p->win_y1;
+	}
+
+	p->ram[p->wr_y * EPD_PANEL_WIDTH_BYTES + p->wr_x] = byte;
+	if (++p->wr_x > x_last) {
+		p->wr_x = x_first;
+		if (++p->wr_y > y_last) {
+			p->wr_y = y_first;
+		}
+	}
+}
+
+void epd_panel_data(epd_panel_t *p, const uint8_t *data, uint32_t len, uint64_t now_us) {
+	if (p->power == EPD_POWER_DEEP_SLEEP) {
+		return;
+	}
+
+	if (p->ram != NULL) {
+		for (uint32_t i = 0; i < len; i++) {
+			write_ram(p, data[i]);
+		}
+		return;
+	}
+
+	for (uint32_t i = 0; i < len; i++, p->arg_idx++) {
+		uint8_t b = data[i];
+		if (p->arg_idx < sizeof(p->args)) {
+			p->args[p->arg_idx] = b;
+		}
+
+		switch (p->cmd) {
+		case 0x07: // DEEP SLEEP
+			if (b == 0xA5) {
+				set_power(p, EPD_POWER_DEEP_SLEEP, now_us);
+			}
+			break;
+		case 0x50: // VCOM AND DATA INTERVAL SETTING
+			if (p->arg_idx == 0) {
+				p->cdi = b;
+			}
+			break;
+		case 0x90: // PARTIAL WINDOW
+			if (p->arg_idx == 7) {
+				p->win_x0 = ((p->args[0] << 8) | p->args[1]) & ~7;
+				p->win_x1 = ((p->args[2] << 8) | p->args[3]) | 7;
+				p->win_y0 = (p->args[4] << 8) | p->args[5];
+				p->win_y1 = (p->args[6] << 8) | p->args[7];
+				if (p->win_x1 >= EPD_PANEL_WIDTH || p->win_y1 >= EPD_PANEL_HEIGHT ||
+				    p->win_x0 > p->win_x1 || p->win_y0 > p->win_y1) {
+					fprintf(stderr, "epd_panel: bad partial window (%u,%u)-(%u,%u)\n",
+					        p->win_x0, p->win_y0, p->win_x1, p->win_y1);
+					p->errors++;
+					p->win_x0 = 0;
+					p->win_x1 = EPD_PANEL_WIDTH - 1;
+					p->win_y0 = 0;
+					p->win_y1 = EPD_PANEL_HEIGHT - 1;
+				}
+			}
+			break;
+		case 0xE5: // TEMPERATURE VALUE
+			p->e5 = b;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void epd_panel_finish(epd_panel_t *p, uint64_t now_us) { set_power(p, p->power, now_us); }
+
+const char *epd_refresh_kind_name(epd_refresh_kind_t kind) {
+	static const char *names[] = {"full", "fast", "partial"};
+	return kind < EPD_REFRESH_NUM_MODES ? names[kind] : "?";
+}
+
+const char *epd_power_state_name(epd_power_state_t state) {
+	static const char *names[] = {"off", "on", "deep sleep"};
+	return state < EPD_POWER_NUM_STATES ? names[state] : "?";
+}
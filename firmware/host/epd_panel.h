@@ -0,0 +1,114 @@
+#pragma once
+
+/*
+ * Model of the UC8179 controller on the Waveshare 7.5" V2 panel, fed with the command and
+ * data bytes the driver (main/epaper/EPD_7in5_V2.c) puts on the SPI bus.
+ *
+ * The model keeps both data RAMs (0x10 "old", 0x13 "new"), the partial window (0x90/0x91),
+ * the data polarity from 0x50 and the waveform selected with 0xE5, and turns every display
+ * refresh (0x12) into an update of `image`, the picture a person would see on the glass.
+ * `image` uses the framebuffer polarity: 1 bits are white.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EPD_PANEL_WIDTH 800
+#define EPD_PANEL_WIDTH_BYTES 100
+#define EPD_PANEL_HEIGHT 480
+#define EPD_PANEL_BYTES (EPD_PANEL_WIDTH_BYTES * EPD_PANEL_HEIGHT)
+
+typedef enum {
+	EPD_REFRESH_FULL,
+	EPD_REFRESH_FAST,
+	EPD_REFRESH_PART,
+	EPD_REFRESH_NUM_MODES,
+} epd_refresh_kind_t;
+
+typedef enum {
+	EPD_POWER_OFF,
+	EPD_POWER_ON,
+	EPD_POWER_DEEP_SLEEP,
+	EPD_POWER_NUM_STATES,
+} epd_power_state_t;
+
+typedef struct {
+	// panel busy time, in ms, for each refresh kind and power transition
+	uint32_t refresh_ms[EPD_REFRESH_NUM_MODES];
+	uint32_t power_on_ms, power_off_ms;
+} epd_timing_t;
+
+typedef struct {
+	// supply current, in uA, in each power state; `on` is with charge pumps running but no
+	// refresh in progress
+	uint32_t deep_sleep_ua, off_ua, on_ua, refresh_ua;
+} epd_current_t;
+
+typedef struct {
+	uint32_t count;
+	uint64_t busy_us;
+	uint64_t pixels; // area of the refreshed window
+} epd_refresh_stats_t;
+
+typedef struct {
+	uint8_t old_ram[EPD_PANEL_BYTES];
+	uint8_t new_ram[EPD_PANEL_BYTES];
+	uint8_t image[EPD_PANEL_BYTES];
+
+	epd_timing_t timing;
+
+	// registers
+	uint8_t cdi;     // first byte of 0x50, holds DDX
+	uint8_t e5;      // temperature override, selects the fast/partial waveforms
+	bool    partial; // 0x91 received since reset
+	uint16_t win_x0, win_x1, win_y0, win_y1; // inclusive, as sent with 0x90
+
+	// command decoder
+	uint8_t  cmd;
+	uint32_t arg_idx;
+	uint8_t  args[16];
+	uint8_t *ram;     // target of data writes, NULL when not in 0x10/0x13
+	uint16_t wr_x, wr_y; // write pointer, x in bytes
+
+	epd_power_state_t power;
+	uint64_t          power_since_us;
+	uint64_t          power_us[EPD_POWER_NUM_STATES];
+
+	// statistics
+	epd_refresh_stats_t refresh[EPD_REFRESH_NUM_MODES];
+	uint64_t            spi_bytes, spi_transactions, commands, resets;
+	uint32_t            errors; // protocol violations, e.g. refresh while powered off
+
+	// last refresh, for the event trace
+	epd_refresh_kind_t last_kind;
+	uint16_t           last_x0, last_y0, last_x1, last_y1; // start-inclusive, end-exclusive
+} epd_panel_t;
+
+extern const epd_timing_t  epd_default_timing;
+extern const epd_current_t epd_default_current;
+
+void epd_panel_init(epd_panel_t *p, const epd_timing_t *timing);
+
+/*
+ * RST pin pulse. Registers return to defaults; RAM keeps its contents.
+ */
+void epd_panel_reset(epd_panel_t *p, uint64_t now_us);
+
+/*
+ * Feeds one command byte (DC low). Returns how long, in us, the panel holds BUSY for this
+ * command, or 0.
+ */
+uint32_t epd_panel_command(epd_panel_t *p, uint8_t cmd, uint64_t now_us);
+
+/*
+ * Feeds data bytes (DC high) belonging to the last command.
+ */
+void epd_panel_data(epd_panel_t *p, const uint8_t *data, uint32_t len, uint64_t now_us);
+
+/*
+ * Closes the power-state accounting at `now_us`.
+ */
+void epd_panel_finish(epd_panel_t *p, uint64_t now_us);
+
+const char *epd_refresh_kind_name(epd_refresh_kind_t kind);
+const char *epd_power_state_name(epd_power_state_t state);
@@ -0,0 +1,866 @@
+/*
+ * Host build of the e-paper stack (GUI_Paint, caption, ui, epaper, EPD_7in5_V2) against a
+ * simulated panel. See README.md for usage.
+ */
+
+#include "DEV_Config.h"
+#include "EPD_7in5_V2.h"
+#include "caption.h"
+#include "caption_history.h"
+#include "caption_strip.h"
+#include "dev_mock.h"
+#include "epaper.h"
+#include "sdkconfig.h"
+#include "sim_rtos.h"
+#include "snapshot.h"
+#include "sprite_cache.h"
+#include "ui.h"
+
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// badge identity, normally defined in main.c
+char name[20] = CONFIG_PARTICIPANT_NAME;
+char pronouns[20] = CONFIG_PARTICIPANT_PRONOUNS;
+char affiliation[30] = CONFIG_PARTICIPANT_AFFILIATION;
+char role[20] = CONFIG_PARTICIPANT_ROLE;
+
+static const char *out_dir = NULL;
+static bool        snapshot_every = false;
+static FILE       *trace = NULL;
+static const char *scenario = NULL;
+static const char *transcript_path = NULL;
+static unsigned    stress_words = 10000;
+static double      stress_wps = 5; // peak speech rate, words per second
+static int         live_rows = -1; // -1 keeps CONFIG_EPAPER_CAPTION_LIVE_ROWS
+static int         scroll = -1;    // -1 keeps CONFIG_EPAPER_CAPTION_SCROLL
+static int         batch_ms = -1;  // -1 keeps CONFIG_EPAPER_CAPTION_BATCH_DEADLINE_MS
+static int         sprite_kb = -1; // -1 keeps CONFIG_EPAPER_CAPTION_SPRITE_CACHE_KB
+
+#ifdef CONFIG_EPAPER_CAPTION_SCROLL
+#define DEFAULT_SCROLL 1
+#else
+#define DEFAULT_SCROLL 0
+#endif
+static unsigned    num_snapshots = 0;
+static epd_current_t current;
+
+/*
+ * Caption latency: from a POST to /transcription until the refresh showing its words is
+ * done, grouped by the panel's power state when the POST arrived.
+ */
+#define MAX_PENDING_POSTS 64
+
+typedef enum {
+	POST_DEEP_SLEEP,
+	POST_OFF,
+	POST_ON,      // powered, no refresh in progress
+	POST_REFRESH, // has to wait for the refresh in progress first
+	POST_NUM_STATES,
+} post_state_t;
+
+static const char *post_state_names[] = {"deep sleep", "off", "on", "refresh"};
+
+static struct {
+	uint64_t     at_us;
+	post_state_t state;
+} pending_posts[MAX_PENDING_POSTS];
+static unsigned num_pending_posts = 0;
+
+static struct {
+	unsigned count;
+	uint64_t total_us, max_us;
+} latency[POST_NUM_STATES];
+
+/*
+ * History paging: from a button press until the refresh showing the page is done.
+ */
+static uint64_t page_pressed_us = 0; // 0 if none is waiting
+static uint32_t pages_seen = 0;
+static struct {
+	unsigned count;
+	uint64_t total_us, max_us;
+} page_latency;
+
+/*
+ * Reading continuity: rows of committed text on the panel after each refresh in caption mode,
+ * from the first time the caption text reaches the last row.
+ */
+static bool in_caption = false;
+static struct {
+	bool     cleared; // the previous layout is gone
+	bool     filled;
+	unsigned refreshes, total_rows, min_rows;
+} context;
+
+static unsigned visible_text_rows(const epd_panel_t *p) {
+	caption_cfg_t cfg = caption_get_cfg();
+	unsigned      rows = (cfg.y_end - cfg.y_start) / cfg.font->Height - cfg.live_rows;
+	unsigned      visible = 0;
+	for (unsigned r = 0; r < rows; r++) {
+		bool text = false;
+		for (unsigned y = cfg.y_start + r * cfg.font->Height;
+		     !text && y < cfg.y_start + (r + 1) * cfg.font->Height; y++) {
+			for (unsigned x = cfg.x_start / 8; !text && x < cfg.x_end / 8; x++) {
+				text = p->image[y * (EPD_PANEL_WIDTH / 8) + x] != 0xFF;
+			}
+		}
+		visible += text;
+		if (r == rows - 1 && text && context.cleared) {
+			context.filled = true;
+		}
+	}
+	context.cleared |= visible == 0;
+	return visible;
+}
+
+static post_state_t post_state(void) {
+	switch (dev_mock_panel.power) {
+	case EPD_POWER_DEEP_SLEEP:
+		return POST_DEEP_SLEEP;
+	case EPD_POWER_OFF:
+		return POST_OFF;
+	default:
+		return gpio_get_level(EPD_BUSY_PIN) == 0 ? POST_REFRESH : POST_ON;
+	}
+}
+
+// epaper_task internals, see epaper.c and caption.c
+extern SemaphoreHandle_t     epaper_sem;
+
+/*
+ * Whether caption_display has drawn every word caption_append accepted.
+ */
+static bool caption_drained(void) {
+	caption_stats_t s = caption_get_stats();
+	return s.tokens_in == s.tokens_out;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr,
+	        "usage: %s [options] badge\n"
+	        "       %s [options] caption TRANSCRIPT\n"
+	        "       %s [options] lines LINES\n"
+	        "       %s [options] strips STRIPS\n"
+	        "       %s [options] stress\n"
+	        "\n"
+	        "options:\n"
+	        "  -o DIR         write final.png and final.pbm of the simulated panel to DIR\n"
+	        "  -s             also write DIR/NNNN-MODE.png after every display refresh\n"
+	        "  -t FILE        write one CSV line per display refresh to FILE\n"
+	        "  -v             log firmware messages (repeat for more)\n"
+	        "  --full-ms N    full refresh duration (default %u)\n"
+	        "  --fast-ms N    fast refresh duration (default %u)\n"
+	        "  --part-ms N    partial refresh duration (default %u)\n"
+	        "  --spi-hz N     SPI clock (default %u)\n"
+	        "  --idle-off-ms N, --idle-sleep-ms N\n"
+	        "                 idle time before the panel is powered off / put into deep sleep,\n"
+	        "                 0 disables (default %u, %u)\n"
+	        "  --current-ua DEEP_SLEEP,OFF,ON,REFRESH\n"
+	        "                 panel supply current per state (default %u,%u,%u,%u)\n"
+	        "  --live-rows N  caption rows for the live hypothesis (default %u)\n"
+	        "  --scroll 0|1   scroll the caption instead of wrapping to the top (default %d)\n"
+	        "  --batch-ms N   longest a caption word is held for the next ones, 0 disables\n"
+	        "                 (default %u)\n"
+	        "  --sprite-kb N  caption word cache size, 0 disables (default %u)\n"
+	        "  --words N      stress: words to append (default %u)\n"
+	        "  --wps R        stress: words per second (default %g)\n",
+	        prog, prog, prog, prog, prog, epd_default_timing.refresh_ms[EPD_REFRESH_FULL],
+	        epd_default_timing.refresh_ms[EPD_REFRESH_FAST],
+	        epd_default_timing.refresh_ms[EPD_REFRESH_PART], DEV_MOCK_SPI_HZ,
+	        CONFIG_EPAPER_IDLE_POWER_OFF_MS, CONFIG_EPAPER_IDLE_DEEP_SLEEP_MS,
+	        epd_default_current.deep_sleep_ua, epd_default_current.off_ua,
+	        epd_default_current.on_ua, epd_default_current.refresh_ua,
+	        CONFIG_EPAPER_CAPTION_LIVE_ROWS, DEFAULT_SCROLL,
+	        CONFIG_EPAPER_CAPTION_BATCH_DEADLINE_MS, CONFIG_EPAPER_CAPTION_SPRITE_CACHE_KB,
+	        stress_words,
+	        stress_wps);
+	exit(2);
+}
+
+static void on_refresh(const epd_panel_t *p, uint64_t start_us, uint32_t busy_us) {
+	if (trace != NULL) {
+		fprintf(trace, "%llu,%s,%u,%u,%u,%u,%u\n", (unsigned long long)(start_us / 1000),
+		        epd_refresh_kind_name(p->last_kind), p->last_x0, p->last_y0, p->last_x1,
+		        p->last_y1, busy_us / 1000);
+	}
+	// words are drawn before the refresh, so once the caption queue is drained every pending
+	// post is part of this refresh
+	if (num_pending_posts > 0 && caption_drained()) {
+		for (unsigned i = 0; i < num_pending_posts; i++) {
+			uint64_t us = start_us + busy_us - pending_posts[i].at_us;
+			post_state_t state = pending_posts[i].state;
+			latency[state].count++;
+			latency[state].total_us += us;
+			if (us > latency[state].max_us) {
+				latency[state].max_us = us;
+			}
+		}
+		num_pending_posts = 0;
+	}
+	if (page_pressed_us != 0 && caption_get_stats().pages_shown > pages_seen) {
+		uint64_t us = start_us + busy_us - page_pressed_us;
+		page_latency.count++;
+		page_latency.total_us += us;
+		page_latency.max_us = MAX(page_latency.max_us, us);
+		pages_seen = caption_get_stats().pages_shown;
+		page_pressed_us = 0;
+	}
+	if (in_caption) {
+		unsigned rows = visible_text_rows(p);
+		if (context.filled) {
+			context.min_rows = context.refreshes == 0 ? rows : MIN(context.min_rows, rows);
+			context.refreshes++;
+			context.total_rows += rows;
+		}
+	}
+	if (snapshot_every && out_dir != NULL) {
+		char path[512];
+		snprintf(path, sizeof(path), "%s/%04u-%s.png", out_dir, ++num_snapshots,
+		         epd_refresh_kind_name(p->last_kind));
+		snapshot_write(path, p->image, EPD_PANEL_WIDTH, EPD_PANEL_HEIGHT);
+	}
+}
+
+/*
+ * Waits until epaper_task has nothing left to draw or refresh.
+ */
+static void wait_idle(void) {
+	while (true) {
+		DEV_Delay_ms(100);
+		if (xSemaphoreTake(epaper_sem, pdMS_TO_TICKS(5000)) != pdTRUE) {
+			continue;
+		}
+		bool idle = caption_drained() && epaper_refresh_waiting() == 0;
+		xSemaphoreGive(epaper_sem);
+		if (idle) {
+			return;
+		}
+	}
+}
+
+/*
+ * Same sequence as app_main, up to the badge layout.
+ */
+static void boot(void) {
+	epaper_init();
+	DEV_Delay_ms(500);
+	ui_layout_wifi_connecting();
+	ui_layout_wifi_connected();
+	DEV_Delay_ms(1000);
+	ui_layout_badge(NULL);
+	wait_idle();
+
+	if (live_rows >= 0 || scroll >= 0 || batch_ms >= 0 || sprite_kb >= 0) {
+		caption_cfg_t cfg = caption_get_cfg();
+		if (live_rows >= 0) {
+			cfg.live_rows = live_rows;
+		}
+		if (scroll >= 0) {
+			cfg.scroll = scroll;
+		}
+		if (batch_ms >= 0) {
+			cfg.batch_deadline_ms = batch_ms;
+		}
+		if (sprite_kb >= 0) {
+			cfg.sprite_cache_size = sprite_kb * 1024;
+		}
+		if (caption_init(&cfg) != EPAPER_OK) {
+			fprintf(stderr, "--live-rows %d does not fit the caption area\n", live_rows);
+			exit(2);
+		}
+	}
+}
+
+/*
+ * Prints the host time caption_display spent on text, and how the word cache did.
+ */
+static void report_drawing(void) {
+	caption_stats_t        s = caption_get_stats();
+	epaper_refresh_stats_t rs[EPAPER_NUM_CLASSES];
+	epaper_get_refresh_stats(rs);
+	sprite_cache_stats_t c = sprite_cache_get_stats();
+	uint32_t             lookups = c.hits + c.misses + c.uncached;
+	printf("caption drawing: %.2f ms of host time, %.2f ms of it rasterizing cached words\n",
+	       s.draw_cycles / 1e6, c.raster_cycles / 1e6);
+	if (rs[EPAPER_CLASS_CAPTION].count > 0) {
+		printf("caption passes: %.2f ms of host time with layout, %.1f us per caption "
+		       "refresh\n",
+		       s.display_cycles / 1e6,
+		       s.display_cycles / 1e3 / rs[EPAPER_CLASS_CAPTION].count);
+	}
+	if (lookups > 0) {
+		printf("word cache: %u hits, %u misses, %u uncached (%.1f%% hits), %u evicted, "
+		       "%u words in %zu of %zu bytes\n",
+		       c.hits, c.misses, c.uncached, 100.0 * c.hits / lookups, c.evictions,
+		       c.sprites, c.bytes, c.size);
+	}
+}
+
+/*
+ * Replays a transcript. Each line is "<ms> <text>": the time, relative to entering caption
+ * mode, at which the server POSTed <text> to /transcription. <text> may start with "=K " or
+ * "!K " to replace the hypothesis from word K on (and commit it, for !), like the
+ * x-caption-op header. Lines starting with # are comments.
+ */
+static void replay(const char *path) {
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	ui_layout_caption();
+	in_caption = true;
+	uint64_t start_us = sim_now_us();
+
+	char     line[1024];
+	unsigned lineno = 0, posts = 0, words = 0, failed = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineno++;
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '#' || line[0] == '\0') {
+			continue;
+		}
+
+		char         *text;
+		unsigned long at_ms = strtoul(line, &text, 10);
+		if (text == line || *text != ' ') {
+			fprintf(stderr, "%s:%u: expected \"<ms> <text>\"\n", path, lineno);
+			exit(1);
+		}
+		text++;
+
+		uint64_t at_us = start_us + (uint64_t)at_ms * 1000;
+		if (at_us > sim_now_us()) {
+			sim_delay_us(at_us - sim_now_us());
+		}
+
+		if (text[0] == '^') {
+			// a press of the history buttons, not a POST
+			pages_seen = caption_get_stats().pages_shown;
+			page_pressed_us = sim_now_us();
+			caption_page(atoi(text + 1));
+			continue;
+		}
+
+		caption_op_t op = CAPTION_OP_APPEND;
+		uint16_t     index = CAPTION_INDEX_END;
+		if (text[0] == '=' || text[0] == '!') {
+			op = text[0] == '=' ? CAPTION_OP_REPLACE : CAPTION_OP_COMMIT;
+			index = strtoul(text + 1, &text, 10);
+			text += strspn(text, " ");
+		}
+
+		posts++;
+		if (num_pending_posts < MAX_PENDING_POSTS) {
+			pending_posts[num_pending_posts].at_us = sim_now_us();
+			pending_posts[num_pending_posts].state = post_state();
+			num_pending_posts++;
+		}
+		for (const char *p = text; *p != '\0'; p++) {
+			if (*p != ' ' && (p == text || p[-1] == ' ')) {
+				words++;
+			}
+		}
+		if (caption_edit(op, posts, index, text) != EPAPER_OK) {
+			failed++;
+		}
+	}
+	fclose(f);
+
+	wait_idle();
+	in_caption = false;
+	caption_stats_t s = caption_get_stats();
+	printf("transcript: %u posts, %u words, %u rejected by caption_edit, %u words revised\n",
+	       posts, words, failed, s.words_revised);
+	epaper_refresh_stats_t rs[EPAPER_NUM_CLASSES];
+	epaper_get_refresh_stats(rs);
+	if (rs[EPAPER_CLASS_CAPTION].count > 0) {
+		printf("caption refreshes: %u, %.2f words each\n", rs[EPAPER_CLASS_CAPTION].count,
+		       (double)words / rs[EPAPER_CLASS_CAPTION].count);
+	}
+
+	caption_history_stats_t h = caption_history_get_stats();
+	double                  minutes = (h.last_ms - h.first_ms) / 60000.0;
+	printf("history: %u rows in %zu of %zu bytes, %u dropped", h.rows, h.bytes, h.size,
+	       h.rows_dropped);
+	if (minutes > 0) {
+		printf(", %.0f bytes per minute of speech", h.bytes / minutes);
+	}
+	printf("\n");
+	if (page_latency.count > 0) {
+		printf("history pages: %u shown, mean %llu ms, max %llu ms from button to refresh\n",
+		       page_latency.count,
+		       (unsigned long long)(page_latency.total_us / page_latency.count / 1000),
+		       (unsigned long long)(page_latency.max_us / 1000));
+	}
+
+	report_drawing();
+}
+
+static int hex_digit(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+/*
+ * Replays a strips file: one POST to /caption/strip per line, as "<ms> <y> <height> <scroll>
+ * rle|delta <hex>", made by transcribe/caption_strips.py from a transcript. Like the transcriber, a strip
+ * refused with EPAPER_ERR_FULL is sent again after a second.
+ */
+static void replay_strips(const char *path) {
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	ui_layout_caption();
+	in_caption = true;
+	uint64_t start_us = sim_now_us();
+
+	static char    line[2 * CAPTION_STRIP_MAX_LEN + 64];
+	static uint8_t data[CAPTION_STRIP_MAX_LEN];
+	unsigned       lineno = 0, posts = 0, updates = 0, retries = 0, failed = 0;
+	unsigned long  last_ms = ULONG_MAX;
+	uint64_t       bytes = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineno++;
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '#' || line[0] == '\0') {
+			continue;
+		}
+
+		unsigned long at_ms;
+		unsigned      y, height, scroll;
+		char          enc[8];
+		int           hex_at = 0;
+		if (sscanf(line, "%lu %u %u %u %7s %n", &at_ms, &y, &height, &scroll, enc,
+		           &hex_at) != 5 ||
+		    hex_at == 0 || (strcmp(enc, "rle") != 0 && strcmp(enc, "delta") != 0)) {
+			fprintf(stderr,
+			        "%s:%u: expected \"<ms> <y> <height> <scroll> rle|delta <hex>\"\n",
+			        path, lineno);
+			exit(1);
+		}
+		const char *hex = line + hex_at;
+		size_t      len = strlen(hex) / 2;
+		for (size_t i = 0; i < len && i < sizeof(data); i++) {
+			int hi = hex_digit(hex[2 * i]), lo = hex_digit(hex[2 * i + 1]);
+			if (hi < 0 || lo < 0) {
+				fprintf(stderr, "%s:%u: bad hex\n", path, lineno);
+				exit(1);
+			}
+			data[i] = hi << 4 | lo;
+		}
+
+		uint64_t at_us = start_us + (uint64_t)at_ms * 1000;
+		if (at_us > sim_now_us()) {
+			sim_delay_us(at_us - sim_now_us());
+		}
+
+		// strips with the same time are one caption update
+		updates += at_ms != last_ms;
+		last_ms = at_ms;
+		posts++;
+		bytes += len;
+		caption_strip_enc_t strip_enc =
+		    strcmp(enc, "delta") == 0 ? CAPTION_STRIP_DELTA : CAPTION_STRIP_RLE;
+		epaper_err_t err;
+		while ((err = caption_strip_post(strip_enc, y, height, scroll, data, len)) ==
+		       EPAPER_ERR_FULL) {
+			retries++;
+			DEV_Delay_ms(1000);
+		}
+		if (err != EPAPER_OK) {
+			failed++;
+		}
+	}
+	fclose(f);
+
+	wait_idle();
+	in_caption = false;
+	caption_strip_stats_t s = caption_strip_get_stats();
+	printf("strips: %u posts in %u caption updates, %u retries, %u failed, %u stale\n", posts,
+	       updates, retries, failed, s.strips_stale);
+	if (updates > 0 && s.strips_out > 0) {
+		printf("strip bytes: %llu, %.0f per caption update\n", (unsigned long long)bytes,
+		       (double)bytes / updates);
+		printf("strip decoding: %.2f ms of host time, %.1f us per caption update\n",
+		       s.decode_cycles / 1e6, s.decode_cycles / 1e3 / updates);
+	}
+	printf("strip queue: high-water %zu of %zu bytes\n", s.ring_used_max, s.ring_size);
+}
+
+/*
+ * Replays a lines file: one POST to /caption/lines per line, as "<ms> <scroll> <row> <col>
+ * <text>", where | separates the rows of <text>, made by transcribe/caption_lines.py from a transcript.
+ * Like the transcriber, lines refused with EPAPER_ERR_FULL are sent again after a second.
+ */
+static void replay_lines(const char *path) {
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	ui_layout_caption();
+	in_caption = true;
+	uint64_t start_us = sim_now_us();
+
+	char     line[1024];
+	unsigned lineno = 0, posts = 0, retries = 0, failed = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineno++;
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '#' || line[0] == '\0') {
+			continue;
+		}
+
+		unsigned long at_ms;
+		unsigned      scroll, row, col;
+		int           text_at = 0;
+		if (sscanf(line, "%lu %u %u %u%n", &at_ms, &scroll, &row, &col, &text_at) != 4 ||
+		    (line[text_at] != ' ' && line[text_at] != '\0')) {
+			fprintf(stderr, "%s:%u: expected \"<ms> <scroll> <row> <col> <text>\"\n", path,
+			        lineno);
+			exit(1);
+		}
+		char *text = line + text_at + (line[text_at] == ' ');
+		for (char *p = text; *p != '\0'; p++) {
+			*p = *p == '|' ? '\n' : *p;
+		}
+
+		uint64_t at_us = start_us + (uint64_t)at_ms * 1000;
+		if (at_us > sim_now_us()) {
+			sim_delay_us(at_us - sim_now_us());
+		}
+
+		posts++;
+		epaper_err_t err;
+		while ((err = caption_lines(scroll, row, col, text)) == EPAPER_ERR_FULL) {
+			retries++;
+			DEV_Delay_ms(1000);
+		}
+		if (err != EPAPER_OK) {
+			failed++;
+		}
+	}
+	fclose(f);
+
+	wait_idle();
+	in_caption = false;
+	printf("lines: %u posts, %u retries, %u failed\n", posts, retries, failed);
+	report_drawing();
+}
+
+/*
+ * Appends stress_words words at stress_wps, in POSTs of 1 to 3 words like the transcriber
+ * sends them. A POST refused with EPAPER_ERR_FULL is sent again after a second (the
+ * Retry-After the badge gives), and later words wait for it, so every word must come out.
+ */
+static void stress(void) {
+	static const char *vocab[] = {
+		"the",     "badge",   "shows",   "live",    "captions", "so",       "visitors",
+		"can",     "follow",  "along",   "while",   "we",       "talk",     "about",
+		"e-paper", "refresh", "latency", "and",     "power",    "a",        "microcontroller",
+		"reads",   "words",   "from",    "server",  "over",     "wifi",     "uncharacteristically",
+	};
+	const size_t vocab_len = sizeof(vocab) / sizeof(vocab[0]);
+
+	ui_layout_caption();
+	in_caption = true;
+	uint64_t start_us = sim_now_us();
+	uint64_t word_us = (uint64_t)(1e6 / stress_wps);
+
+	uint32_t rng = 1;
+	unsigned sent = 0, posts = 0, retries = 0, failed = 0;
+	uint64_t max_delay_us = 0;
+	while (sent < stress_words) {
+		rng = rng * 1103515245 + 12345;
+		unsigned n = MIN(1 + (rng >> 16) % 3, stress_words - sent);
+
+		char text[256] = "";
+		for (unsigned i = 0; i < n; i++) {
+			rng = rng * 1103515245 + 12345;
+			if (i > 0) {
+				strcat(text, " ");
+			}
+			strcat(text, vocab[(rng >> 16) % vocab_len]);
+		}
+
+		// the last word of the POST is spoken at its slot in the stream
+		uint64_t at_us = start_us + (uint64_t)(sent + n) * word_us;
+		if (at_us > sim_now_us()) {
+			sim_delay_us(at_us - sim_now_us());
+		}
+
+		posts++;
+		epaper_err_t err;
+		while ((err = caption_append(text)) == EPAPER_ERR_FULL) {
+			retries++;
+			DEV_Delay_ms(1000);
+		}
+		if (err != EPAPER_OK) {
+			failed++;
+		}
+		max_delay_us = MAX(max_delay_us, sim_now_us() - at_us);
+		sent += n;
+	}
+
+	wait_idle();
+	in_caption = false;
+	caption_stats_t s = caption_get_stats();
+	printf("stress: %u words in %u posts at %g words/s, %u retries, %u failed, max delay "
+	       "%llu ms\n",
+	       sent, posts, stress_wps, retries, failed, (unsigned long long)(max_delay_us / 1000));
+	printf("caption queue: %u tokens in, %u out, %u lost, high-water %zu of %zu bytes\n",
+	       s.tokens_in, s.tokens_out, sent - s.tokens_out, s.ring_used_max, s.ring_size);
+}
+
+static void report(void) {
+	epd_panel_t *p = &dev_mock_panel;
+	epd_panel_finish(p, sim_now_us());
+
+	printf("virtual time: %llu ms\n", (unsigned long long)(sim_now_us() / 1000));
+	printf("%-8s %8s %10s %12s\n", "refresh", "count", "busy_ms", "pixels");
+	for (int k = 0; k < EPD_REFRESH_NUM_MODES; k++) {
+		const epd_refresh_stats_t *s = &p->refresh[k];
+		printf("%-8s %8u %10llu %12llu\n", epd_refresh_kind_name(k), s->count,
+		       (unsigned long long)(s->busy_us / 1000), (unsigned long long)s->pixels);
+	}
+	printf("spi: %llu bytes in %llu transactions, %llu commands, %llu resets\n",
+	       (unsigned long long)p->spi_bytes, (unsigned long long)p->spi_transactions,
+	       (unsigned long long)p->commands, (unsigned long long)p->resets);
+
+	// time in the "on" state includes refreshes, which draw more
+	uint64_t refresh_us = 0;
+	for (int k = 0; k < EPD_REFRESH_NUM_MODES; k++) {
+		refresh_us += p->refresh[k].busy_us;
+	}
+	struct {
+		const char *name;
+		uint64_t    us;
+		uint32_t    ua;
+	} states[] = {
+		{"deep sleep", p->power_us[EPD_POWER_DEEP_SLEEP], current.deep_sleep_ua},
+		{"off", p->power_us[EPD_POWER_OFF], current.off_ua},
+		{"on", p->power_us[EPD_POWER_ON] - refresh_us, current.on_ua},
+		{"refresh", refresh_us, current.refresh_ua},
+	};
+	double total_uas = 0;
+	printf("%-10s %10s %10s %10s\n", "power", "time_ms", "uA", "uAh");
+	for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); i++) {
+		double uas = (double)states[i].us / 1e6 * states[i].ua;
+		total_uas += uas;
+		printf("%-10s %10llu %10u %10.2f\n", states[i].name,
+		       (unsigned long long)(states[i].us / 1000), states[i].ua, uas / 3600);
+	}
+	printf("average panel current: %.0f uA\n", total_uas / ((double)sim_now_us() / 1e6));
+
+	static const char *class_names[] = {"input", "caption", "housekeeping"};
+	epaper_refresh_stats_t stats[EPAPER_NUM_CLASSES];
+	epaper_get_refresh_stats(stats);
+	printf("%-12s %6s %8s %8s %8s %8s\n", "class", "count", "mean_ms", "max_ms", "promoted",
+	       "dropped");
+	for (int i = 0; i < EPAPER_NUM_CLASSES; i++) {
+		printf("%-12s %6u %8llu %8llu %8u %8u\n", class_names[i], stats[i].count,
+		       (unsigned long long)(stats[i].count ? stats[i].total_us / stats[i].count / 1000
+		                                           : 0),
+		       (unsigned long long)(stats[i].max_us / 1000), stats[i].promoted,
+		       stats[i].dropped);
+	}
+
+	if (context.refreshes > 0) {
+		printf("committed rows on screen once full: mean %.1f, min %u\n",
+		       (double)context.total_rows / context.refreshes, context.min_rows);
+	}
+	if (scenario != NULL && strcmp(scenario, "caption") == 0) {
+		printf("caption latency by panel state at POST:\n");
+		for (int s = 0; s < POST_NUM_STATES; s++) {
+			if (latency[s].count == 0) {
+				continue;
+			}
+			printf("  %-10s %4u posts, mean %5llu ms, max %5llu ms\n",
+			       post_state_names[s], latency[s].count,
+			       (unsigned long long)(latency[s].total_us / latency[s].count / 1000),
+			       (unsigned long long)(latency[s].max_us / 1000));
+		}
+	}
+	if (p->errors > 0) {
+		printf("panel protocol errors: %u\n", p->errors);
+	}
+}
+
+static void sim_main(void *arg) {
+	boot();
+	if (strcmp(scenario, "caption") == 0) {
+		replay(transcript_path);
+		ui_layout_badge(NULL);
+		wait_idle();
+	} else if (strcmp(scenario, "lines") == 0) {
+		replay_lines(transcript_path);
+		ui_layout_badge(NULL);
+		wait_idle();
+	} else if (strcmp(scenario, "strips") == 0) {
+		replay_strips(transcript_path);
+		ui_layout_badge(NULL);
+		wait_idle();
+	} else if (strcmp(scenario, "stress") == 0) {
+		stress();
+	}
+
+	report();
+	if (out_dir != NULL) {
+		char path[512];
+		snprintf(path, sizeof(path), "%s/final.png", out_dir);
+		snapshot_write(path, dev_mock_panel.image, EPD_PANEL_WIDTH, EPD_PANEL_HEIGHT);
+		snprintf(path, sizeof(path), "%s/final.pbm", out_dir);
+		snapshot_write(path, dev_mock_panel.image, EPD_PANEL_WIDTH, EPD_PANEL_HEIGHT);
+	}
+}
+
+int main(int argc, char **argv) {
+	enum {
+		OPT_FULL_MS = 256,
+		OPT_FAST_MS,
+		OPT_PART_MS,
+		OPT_SPI_HZ,
+		OPT_IDLE_OFF_MS,
+		OPT_IDLE_SLEEP_MS,
+		OPT_CURRENT_UA,
+		OPT_WORDS,
+		OPT_WPS,
+		OPT_LIVE_ROWS,
+		OPT_SCROLL,
+		OPT_BATCH_MS,
+		OPT_SPRITE_KB,
+	};
+	static const struct option long_opts[] = {
+		{"full-ms", required_argument, NULL, OPT_FULL_MS},
+		{"fast-ms", required_argument, NULL, OPT_FAST_MS},
+		{"part-ms", required_argument, NULL, OPT_PART_MS},
+		{"spi-hz", required_argument, NULL, OPT_SPI_HZ},
+		{"idle-off-ms", required_argument, NULL, OPT_IDLE_OFF_MS},
+		{"idle-sleep-ms", required_argument, NULL, OPT_IDLE_SLEEP_MS},
+		{"current-ua", required_argument, NULL, OPT_CURRENT_UA},
+		{"words", required_argument, NULL, OPT_WORDS},
+		{"wps", required_argument, NULL, OPT_WPS},
+		{"live-rows", required_argument, NULL, OPT_LIVE_ROWS},
+		{"scroll", required_argument, NULL, OPT_SCROLL},
+		{"batch-ms", required_argument, NULL, OPT_BATCH_MS},
+		{"sprite-kb", required_argument, NULL, OPT_SPRITE_KB},
+		{NULL, 0, NULL, 0},
+	};
+
+	epd_timing_t timing = epd_default_timing;
+	uint32_t     spi_hz = DEV_MOCK_SPI_HZ;
+	uint32_t     idle_off_ms = CONFIG_EPAPER_IDLE_POWER_OFF_MS;
+	uint32_t     idle_sleep_ms = CONFIG_EPAPER_IDLE_DEEP_SLEEP_MS;
+	int          verbose = 0;
+	current = epd_default_current;
+	int          c;
+	while ((c = getopt_long(argc, argv, "o:st:v", long_opts, NULL)) != -1) {
+		switch (c) {
+		case 'o':
+			out_dir = optarg;
+			break;
+		case 's':
+			snapshot_every = true;
+			break;
+		case 't':
+			trace = fopen(optarg, "w");
+			if (trace == NULL) {
+				perror(optarg);
+				return 1;
+			}
+			fprintf(trace, "start_ms,mode,x_start,y_start,x_end,y_end,busy_ms\n");
+			break;
+		case 'v':
+			verbose++;
+			break;
+		case OPT_FULL_MS:
+			timing.refresh_ms[EPD_REFRESH_FULL] = atoi(optarg);
+			break;
+		case OPT_FAST_MS:
+			timing.refresh_ms[EPD_REFRESH_FAST] = atoi(optarg);
+			break;
+		case OPT_PART_MS:
+			timing.refresh_ms[EPD_REFRESH_PART] = atoi(optarg);
+			break;
+		case OPT_SPI_HZ:
+			spi_hz = atoi(optarg);
+			break;
+		case OPT_IDLE_OFF_MS:
+			idle_off_ms = atoi(optarg);
+			break;
+		case OPT_IDLE_SLEEP_MS:
+			idle_sleep_ms = atoi(optarg);
+			break;
+		case OPT_CURRENT_UA:
+			if (sscanf(optarg, "%u,%u,%u,%u", &current.deep_sleep_ua, &current.off_ua,
+			           &current.on_ua, &current.refresh_ua) != 4) {
+				usage(argv[0]);
+			}
+			break;
+		case OPT_LIVE_ROWS:
+			live_rows = atoi(optarg);
+			break;
+		case OPT_SCROLL:
+			scroll = atoi(optarg) != 0;
+			break;
+		case OPT_BATCH_MS:
+			batch_ms = atoi(optarg);
+			break;
+		case OPT_SPRITE_KB:
+			sprite_kb = atoi(optarg);
+			break;
+		case OPT_WORDS:
+			stress_words = atoi(optarg);
+			break;
+		case OPT_WPS:
+			stress_wps = atof(optarg);
+			if (stress_wps <= 0) {
+				usage(argv[0]);
+			}
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+	}
+	scenario = argv[optind];
+	if (strcmp(scenario, "caption") == 0 || strcmp(scenario, "lines") == 0 ||
+	    strcmp(scenario, "strips") == 0) {
+		if (optind + 1 >= argc) {
+			usage(argv[0]);
+		}
+		transcript_path = argv[optind + 1];
+	} else if (strcmp(scenario, "badge") != 0 && strcmp(scenario, "stress") != 0) {
+		usage(argv[0]);
+	}
+
+	sim_log_set_default(verbose == 0 ? ESP_LOG_WARN : ESP_LOG_WARN + verbose);
+	dev_mock_init(&timing, spi_hz);
+	dev_mock_refresh_hook = on_refresh;
+	epaper_set_idle_timeout(idle_off_ms, idle_sleep_ms);
+
+	sim_run(sim_main, NULL);
+
+	if (trace != NULL) {
+		fclose(trace);
+	}
+	return dev_mock_panel.errors == 0 ? 0 : 1;
+}
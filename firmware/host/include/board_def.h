@@ -0,0 +1,6 @@
+#pragma once
+
+/* Button ids from components/lcb/lcb/board_def.h */
+#define BUTTON_ID_1 42
+#define BUTTON_ID_2 41
+#define BUTTON_ID_3 40
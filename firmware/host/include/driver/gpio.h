@@ -0,0 +1,10 @@
+#pragma once
+
+#include "esp_err.h"
+#include "hal/gpio_types.h"
+
+typedef void (*gpio_isr_t)(void *arg);
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+int       gpio_get_level(gpio_num_t gpio_num);
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args);
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "esp_err.h"
+
+#define SPI2_HOST 1
+
+typedef struct sim_spi_device *spi_device_handle_t;
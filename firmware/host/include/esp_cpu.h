@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+/* Host time in ns, i.e. cycles of a 1 GHz CPU. Unlike esp_timer, this is real time, so it
+ * differs from run to run. */
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void);
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Microseconds of virtual time since the simulation started. */
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+ * Host stand-in for the FreeRTOS API subset used by firmware/main/epaper.
+ *
+ * Tasks are cooperative coroutines scheduled by sim_rtos.c on a virtual clock, so a run is
+ * deterministic and a 30 minute transcript replays in seconds. Every kernel call is a yield
+ * point and costs SIM_KERNEL_CALL_US of virtual time, which keeps polling loops from
+ * freezing the clock.
+ */
+
+#include "esp_attr.h"
+#include "esp_err.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define configTICK_RATE_HZ 100
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define pdTICKS_TO_MS(t) ((uint32_t)(((uint64_t)(t) * 1000) / configTICK_RATE_HZ))
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+typedef uint32_t     TickType_t;
+typedef int          BaseType_t;
+typedef unsigned int UBaseType_t;
+
+typedef struct sim_queue  *QueueHandle_t;
+typedef struct sim_queue  *SemaphoreHandle_t;
+typedef struct sim_msgbuf *MessageBufferHandle_t;
+typedef struct sim_task   *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+/* tasks */
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                                   void *arg, UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core);
+void       vTaskDelete(TaskHandle_t task);
+void       vTaskDelay(TickType_t ticks);
+void       vTaskSuspend(TaskHandle_t task);
+void       vTaskResume(TaskHandle_t task);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+uint32_t     ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+BaseType_t   xTaskNotifyGive(TaskHandle_t task);
+
+/* queues and semaphores */
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void          vQueueDelete(QueueHandle_t queue);
+BaseType_t    xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t    xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t    xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken);
+BaseType_t    xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+BaseType_t    xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks);
+BaseType_t    xQueueReset(QueueHandle_t queue);
+UBaseType_t   uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t   uxQueueSpacesAvailable(QueueHandle_t queue);
+
+#define xQueueSendToBack xQueueSend
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t        xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t        xSemaphoreGive(SemaphoreHandle_t sem);
+
+/* message buffers */
+MessageBufferHandle_t xMessageBufferCreate(size_t size);
+size_t     xMessageBufferSend(MessageBufferHandle_t buf, const void *data, size_t len,
+                              TickType_t ticks);
+size_t     xMessageBufferReceive(MessageBufferHandle_t buf, void *data, size_t max_len,
+                                 TickType_t ticks);
+BaseType_t xMessageBufferIsEmpty(MessageBufferHandle_t buf);
+BaseType_t xMessageBufferReset(MessageBufferHandle_t buf);
+size_t     xMessageBufferSpacesAvailable(MessageBufferHandle_t buf);
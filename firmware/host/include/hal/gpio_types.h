@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef int gpio_num_t;
+
+#define GPIO_NUM_7 7
+#define GPIO_NUM_11 11
+#define GPIO_NUM_12 12
+#define GPIO_NUM_13 13
+#define GPIO_NUM_14 14
+#define GPIO_NUM_21 21
+#define GPIO_NUM_47 47
+#define GPIO_NUM_48 48
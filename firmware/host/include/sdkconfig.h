@@ -0,0 +1,38 @@
+#pragma once
+
+/* Defaults from main/Kconfig.projbuild */
+#define CONFIG_PARTICIPANT_NAME "Lynn CONWAY"
+#define CONFIG_PARTICIPANT_PRONOUNS "she/her"
+#define CONFIG_PARTICIPANT_AFFILIATION "University of Michigan"
+#define CONFIG_PARTICIPANT_ROLE "Speaker"
+#define CONFIG_AUDIO_CODEC_ADPCM 1
+#define CONFIG_AUDIO_MICS 1
+#define CONFIG_AUDIO_AEC 1
+#define CONFIG_AUDIO_AEC_TAIL_MS 60
+#define CONFIG_AUDIO_AEC_DELAY_MS 80
+#define CONFIG_AUDIO_AEC_SUPPRESS_DB 12
+#define CONFIG_AUDIO_NS 1
+#define CONFIG_AUDIO_NS_MAX_DB 12
+#define CONFIG_AUDIO_AGC 1
+#define CONFIG_AUDIO_AGC_TARGET_DBFS -20
+#define CONFIG_AUDIO_AGC_MAX_GAIN_DB 30
+#define CONFIG_AUDIO_AGC_ATTACK_MS 20
+#define CONFIG_AUDIO_AGC_RELEASE_MS 1000
+#define CONFIG_AUDIO_AGC_ANALOG 1
+#define CONFIG_AUDIO_VAD 1
+#define CONFIG_AUDIO_VAD_THRESHOLD_DB 9
+#define CONFIG_AUDIO_VAD_HANGOVER_MS 500
+#define CONFIG_AUDIO_VAD_PREROLL_MS 200
+#define CONFIG_AUDIO_VAD_KEEPALIVE_MS 1000
+#define CONFIG_AUDIO_JITTER_MIN_DELAY_MS 40
+#define CONFIG_AUDIO_JITTER_MAX_DELAY_MS 400
+#define CONFIG_AUDIO_JITTER_CONCEAL_MS 60
+#define CONFIG_EPAPER_IDLE_POWER_OFF_MS 2000
+#define CONFIG_EPAPER_IDLE_DEEP_SLEEP_MS 60000
+#define CONFIG_EPAPER_GHOST_CLEANUP_PARTIALS 100
+#define CONFIG_EPAPER_CAPTION_LIVE_ROWS 0
+#define CONFIG_EPAPER_CAPTION_SCROLL 1
+#define CONFIG_EPAPER_CAPTION_BATCH_DEADLINE_MS 2000
+#define CONFIG_EPAPER_CAPTION_HISTORY_KB 64
+#define CONFIG_EPAPER_CAPTION_HISTORY_MINUTES 30
+#define CONFIG_EPAPER_CAPTION_SPRITE_CACHE_KB 512
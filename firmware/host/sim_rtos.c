@@ -0,0 +1,609 @@
+#include "sim_rtos.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+
+#define MAX_TASKS 16
+#define MAX_TIMERS 64
+#define TASK_STACK_SIZE (256 * 1024)
+#define FOREVER UINT64_MAX
+
+typedef enum {
+	TASK_READY,
+	TASK_DELAYED,   // waiting for wake_us
+	TASK_BLOCKED,   // waiting for wait_obj or wake_us
+	TASK_SUSPENDED,
+	TASK_DEAD,
+} task_state_t;
+
+struct sim_task {
+	char           name[16];
+	ucontext_t     ctx;
+	void          *stack;
+	TaskFunction_t fn;
+	void          *arg;
+	task_state_t   state;
+	uint64_t       wake_us;
+	const void    *wait_obj;
+	uint32_t       notify;
+};
+
+struct sim_queue {
+	uint8_t    *items;
+	UBaseType_t length, item_size, head, count;
+	bool        is_semaphore;
+};
+
+struct sim_msgbuf {
+	uint8_t *data;
+	size_t   size, head, used;
+};
+
+typedef struct {
+	uint64_t       at_us;
+	sim_timer_fn_t fn;
+	void          *arg;
+} sim_timer_t;
+
+static struct sim_task tasks[MAX_TASKS];
+static int             num_tasks;
+static struct sim_task *current;
+static ucontext_t      sched_ctx;
+static uint64_t        now_us;
+
+static sim_timer_t timers[MAX_TIMERS];
+static int         num_timers;
+
+static int log_default = ESP_LOG_WARN;
+static struct {
+	char tag[24];
+	int  level;
+} log_levels[32];
+static int num_log_levels;
+
+/******************************************************************************
+ * Scheduler
+ ******************************************************************************/
+
+uint64_t sim_now_us(void) { return now_us; }
+
+int64_t esp_timer_get_time(void) { return (int64_t)now_us; }
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (esp_cpu_cycle_count_t)((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static uint64_t ticks_to_deadline(TickType_t ticks) {
+	if (ticks == portMAX_DELAY) {
+		return FOREVER;
+	}
+	return now_us + (uint64_t)ticks * (1000000 / configTICK_RATE_HZ);
+}
+
+static void wake_waiters(const void *obj) {
+	for (int i = 0; i < num_tasks; i++) {
+		if (tasks[i].state == TASK_BLOCKED && tasks[i].wait_obj == obj) {
+			tasks[i].state = TASK_READY;
+		}
+	}
+}
+
+static void fire_due(void) {
+	// timers may add timers, so rescan after each one
+	bool fired = true;
+	while (fired) {
+		fired = false;
+		for (int i = 0; i < num_timers; i++) {
+			if (timers[i].at_us <= now_us) {
+				sim_timer_t t = timers[i];
+				timers[i] = timers[--num_timers];
+				t.fn(t.arg);
+				fired = true;
+				break;
+			}
+		}
+	}
+	for (int i = 0; i < num_tasks; i++) {
+		struct sim_task *t = &tasks[i];
+		if ((t->state == TASK_DELAYED || t->state == TASK_BLOCKED) && t->wake_us <= now_us) {
+			t->state = TASK_READY;
+		}
+	}
+}
+
+static uint64_t next_event_us(void) {
+	uint64_t next = FOREVER;
+	for (int i = 0; i < num_timers; i++) {
+		if (timers[i].at_us < next) {
+			next = timers[i].at_us;
+		}
+	}
+	for (int i = 0; i < num_tasks; i++) {
+		const struct sim_task *t = &tasks[i];
+		if ((t->state == TASK_DELAYED || t->state == TASK_BLOCKED) && t->wake_us < next) {
+			next = t->wake_us;
+		}
+	}
+	return next;
+}
+
+static void task_entry(void) {
+	current->fn(current->arg);
+	current->state = TASK_DEAD;
+	swapcontext(&current->ctx, &sched_ctx);
+}
+
+static void yield(void) {
+	struct sim_task *self = current;
+	swapcontext(&self->ctx, &sched_ctx);
+}
+
+/*
+ * Charges one kernel call to the virtual clock and lets other ready tasks run. Calls from
+ * timer (ISR) context are free.
+ */
+static void kernel_call(void) {
+	if (current == NULL) {
+		return;
+	}
+	now_us += SIM_KERNEL_CALL_US;
+	yield();
+}
+
+void sim_delay_us(uint64_t us) {
+	if (current == NULL) {
+		now_us += us;
+		return;
+	}
+	current->state = TASK_DELAYED;
+	current->wake_us = now_us + us;
+	yield();
+}
+
+void sim_timer_add(uint64_t at_us, sim_timer_fn_t fn, void *arg) {
+	if (num_timers == MAX_TIMERS) {
+		fprintf(stderr, "sim: too many pending timers\n");
+		abort();
+	}
+	timers[num_timers++] = (sim_timer_t){.at_us = at_us, .fn = fn, .arg = arg};
+}
+
+void sim_run(void (*main_fn)(void *), void *arg) {
+	TaskHandle_t main_task;
+	xTaskCreate(main_fn, "main", 0, arg, 1, &main_task);
+
+	int last = -1;
+	while (main_task->state != TASK_DEAD) {
+		fire_due();
+
+		// round robin over ready tasks
+		int pick = -1;
+		for (int n = 1; n <= num_tasks; n++) {
+			int i = (last + n) % num_tasks;
+			if (tasks[i].state == TASK_READY) {
+				pick = i;
+				break;
+			}
+		}
+
+		if (pick < 0) {
+			uint64_t next = next_event_us();
+			if (next == FOREVER) {
+				fprintf(stderr, "sim: deadlock, all tasks blocked forever\n");
+				abort();
+			}
+			now_us = next;
+			continue;
+		}
+
+		last = pick;
+		current = &tasks[pick];
+		swapcontext(&sched_ctx, &current->ctx);
+		current = NULL;
+	}
+}
+
+/******************************************************************************
+ * Tasks
+ ******************************************************************************/
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+	if (num_tasks == MAX_TASKS) {
+		return pdFAIL;
+	}
+	struct sim_task *t = &tasks[num_tasks++];
+	memset(t, 0, sizeof(*t));
+	snprintf(t->name, sizeof(t->name), "%s", name);
+	t->fn = fn;
+	t->arg = arg;
+	t->stack = malloc(TASK_STACK_SIZE);
+	getcontext(&t->ctx);
+	t->ctx.uc_stack.ss_sp = t->stack;
+	t->ctx.uc_stack.ss_size = TASK_STACK_SIZE;
+	t->ctx.uc_link = NULL;
+	makecontext(&t->ctx, task_entry, 0);
+	t->state = TASK_READY;
+	if (handle != NULL) {
+		*handle = t;
+	}
+	return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                                   void *arg, UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core) {
+	return xTaskCreate(fn, name, stack_depth, arg, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+	if (task == NULL) {
+		task = current;
+	}
+	task->state = TASK_DEAD;
+	if (task == current) {
+		yield();
+	}
+}
+
+void vTaskDelay(TickType_t ticks) {
+	if (ticks == 0) {
+		kernel_call();
+		return;
+	}
+	sim_delay_us((uint64_t)ticks * (1000000 / configTICK_RATE_HZ));
+}
+
+void vTaskSuspend(TaskHandle_t task) {
+	if (task == NULL) {
+		task = current;
+	}
+	task->state = TASK_SUSPENDED;
+	if (task == current) {
+		yield();
+	}
+}
+
+void vTaskResume(TaskHandle_t task) {
+	if (task->state == TASK_SUSPENDED) {
+		task->state = TASK_READY;
+	}
+	kernel_call();
+}
+
+TickType_t xTaskGetTickCount(void) {
+	return (TickType_t)(now_us / (1000000 / configTICK_RATE_HZ));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return current; }
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+	kernel_call();
+	uint64_t deadline = ticks_to_deadline(ticks);
+	while (current->notify == 0 && now_us < deadline) {
+		current->state = TASK_BLOCKED;
+		current->wait_obj = current;
+		current->wake_us = deadline;
+		yield();
+	}
+	uint32_t value = current->notify;
+	if (value > 0) {
+		current->notify = clear_on_exit ? 0 : value - 1;
+	}
+	return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+	task->notify++;
+	wake_waiters(task);
+	return pdPASS;
+}
+
+/******************************************************************************
+ * Queues and semaphores
+ ******************************************************************************/
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+	QueueHandle_t q = calloc(1, sizeof(*q));
+	q->length = length;
+	q->item_size = item_size;
+	q->items = calloc(length, item_size > 0 ? item_size : 1);
+	return q;
+}
+
+void vQueueDelete(QueueHandle_t q) {
+	free(q->items);
+	free(q);
+}
+
+static void queue_put(QueueHandle_t q, const void *item, bool front) {
+	UBaseType_t slot;
+	if (front) {
+		q->head = (q->head + q->length - 1) % q->length;
+		slot = q->head;
+	} else {
+		slot = (q->head + q->count) % q->length;
+	}
+	if (q->item_size > 0) {
+		memcpy(q->items + slot * q->item_size, item, q->item_size);
+	}
+	q->count++;
+	wake_waiters(q);
+}
+
+static BaseType_t queue_send(QueueHandle_t q, const void *item, TickType_t ticks, bool front) {
+	kernel_call();
+	uint64_t deadline = ticks_to_deadline(ticks);
+	while (q->count == q->length) {
+		if (now_us >= deadline) {
+			return pdFALSE;
+		}
+		current->state = TASK_BLOCKED;
+		current->wait_obj = q;
+		current->wake_us = deadline;
+		yield();
+	}
+	queue_put(q, item, front);
+	return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks) {
+	return queue_send(q, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t ticks) {
+	return queue_send(q, item, ticks, true);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken) {
+	if (q->count == q->length) {
+		return pdFALSE;
+	}
+	queue_put(q, item, false);
+	if (woken != NULL) {
+		*woken = pdTRUE;
+	}
+	return pdTRUE;
+}
+
+static BaseType_t queue_receive(QueueHandle_t q, void *item, TickType_t ticks, bool peek) {
+	kernel_call();
+	uint64_t deadline = ticks_to_deadline(ticks);
+	while (q->count == 0) {
+		if (now_us >= deadline) {
+			return pdFALSE;
+		}
+		current->state = TASK_BLOCKED;
+		current->wait_obj = q;
+		current->wake_us = deadline;
+		yield();
+	}
+	if (q->item_size > 0 && item != NULL) {
+		memcpy(item, q->items + q->head * q->item_size, q->item_size);
+	}
+	if (!peek) {
+		q->head = (q->head + 1) % q->length;
+		q->count--;
+		wake_waiters(q);
+	}
+	return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks) {
+	return queue_receive(q, item, ticks, false);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t ticks) {
+	return queue_receive(q, item, ticks, true);
+}
+
+BaseType_t xQueueReset(QueueHandle_t q) {
+	kernel_call();
+	q->head = 0;
+	q->count = 0;
+	wake_waiters(q);
+	return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+	kernel_call();
+	return q->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q) {
+	kernel_call();
+	return q->length - q->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+	SemaphoreHandle_t s = xQueueCreate(1, 0);
+	s->is_semaphore = true;
+	return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+	SemaphoreHandle_t s = xSemaphoreCreateBinary();
+	s->count = 1;
+	return s;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks) {
+	return queue_receive(s, NULL, ticks, false);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+	kernel_call();
+	if (s->count == s->length) {
+		return pdFALSE;
+	}
+	queue_put(s, NULL, false);
+	return pdTRUE;
+}
+
+/******************************************************************************
+ * Message buffers
+ *
+ * Same framing as FreeRTOS: each message is prefixed by its length as a size_t-sized
+ * (4 bytes on the ESP32) header, and one byte of the storage area is never used.
+ ******************************************************************************/
+
+#define MSG_HDR_LEN 4
+
+static void msgbuf_copy_in(MessageBufferHandle_t b, const void *src, size_t len) {
+	const uint8_t *p = src;
+	for (size_t i = 0; i < len; i++) {
+		b->data[(b->head + b->used + i) % b->size] = p[i];
+	}
+	b->used += len;
+}
+
+static void msgbuf_copy_out(MessageBufferHandle_t b, size_t offset, void *dst, size_t len) {
+	uint8_t *p = dst;
+	for (size_t i = 0; i < len; i++) {
+		p[i] = b->data[(b->head + offset + i) % b->size];
+	}
+}
+
+MessageBufferHandle_t xMessageBufferCreate(size_t size) {
+	MessageBufferHandle_t b = calloc(1, sizeof(*b));
+	b->size = size;
+	b->data = calloc(1, size);
+	return b;
+}
+
+size_t xMessageBufferSpacesAvailable(MessageBufferHandle_t b) {
+	kernel_call();
+	return b->size - 1 - b->used;
+}
+
+size_t xMessageBufferSend(MessageBufferHandle_t b, const void *data, size_t len,
+                          TickType_t ticks) {
+	kernel_call();
+	uint64_t deadline = ticks_to_deadline(ticks);
+	while (b->size - 1 - b->used < len + MSG_HDR_LEN) {
+		if (now_us >= deadline) {
+			return 0;
+		}
+		current->state = TASK_BLOCKED;
+		current->wait_obj = b;
+		current->wake_us = deadline;
+		yield();
+	}
+	uint32_t hdr = (uint32_t)len;
+	msgbuf_copy_in(b, &hdr, MSG_HDR_LEN);
+	msgbuf_copy_in(b, data, len);
+	wake_waiters(b);
+	return len;
+}
+
+size_t xMessageBufferReceive(MessageBufferHandle_t b, void *data, size_t max_len,
+                             TickType_t ticks) {
+	kernel_call();
+	uint64_t deadline = ticks_to_deadline(ticks);
+	while (b->used == 0) {
+		if (now_us >= deadline) {
+			return 0;
+		}
+		current->state = TASK_BLOCKED;
+		current->wait_obj = b;
+		current->wake_us = deadline;
+		yield();
+	}
+	uint32_t len;
+	msgbuf_copy_out(b, 0, &len, MSG_HDR_LEN);
+	if (len > max_len) {
+		return 0;
+	}
+	msgbuf_copy_out(b, MSG_HDR_LEN, data, len);
+	b->head = (b->head + MSG_HDR_LEN + len) % b->size;
+	b->used -= MSG_HDR_LEN + len;
+	wake_waiters(b);
+	return len;
+}
+
+BaseType_t xMessageBufferIsEmpty(MessageBufferHandle_t b) {
+	kernel_call();
+	return b->used == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xMessageBufferReset(MessageBufferHandle_t b) {
+	kernel_call();
+	b->head = 0;
+	b->used = 0;
+	wake_waiters(b);
+	return pdPASS;
+}
+
+/******************************************************************************
+ * esp_log / esp_err
+ ******************************************************************************/
+
+void sim_log_set_default(int level) { log_default = level; }
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+	if (strcmp(tag, "*") == 0) {
+		// firmware calls this for its own defaults; keep the command line setting
+		return;
+	}
+	for (int i = 0; i < num_log_levels; i++) {
+		if (strcmp(log_levels[i].tag, tag) == 0) {
+			log_levels[i].level = level;
+			return;
+		}
+	}
+	if (num_log_levels < (int)(sizeof(log_levels) / sizeof(log_levels[0]))) {
+		snprintf(log_levels[num_log_levels].tag, sizeof(log_levels[0].tag), "%s", tag);
+		log_levels[num_log_levels].level = level;
+		num_log_levels++;
+	}
+}
+
+void sim_log(esp_log_level_t level, const char *tag, const char *fmt, ...) {
+	int limit = log_default;
+	for (int i = 0; i < num_log_levels; i++) {
+		if (strcmp(log_levels[i].tag, tag) == 0) {
+			limit = log_levels[i].level < limit ? log_levels[i].level : limit;
+			break;
+		}
+	}
+	if ((int)level > limit) {
+		return;
+	}
+	static const char letters[] = "NEWIDV";
+	fprintf(stderr, "%c (%llu) %s: ", letters[level], (unsigned long long)(now_us / 1000),
+	        tag);
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+	switch (code) {
+	case ESP_OK:
+		return "ESP_OK";
+	case ESP_FAIL:
+		return "ESP_FAIL";
+	case ESP_ERR_NO_MEM:
+		return "ESP_ERR_NO_MEM";
+	case ESP_ERR_INVALID_ARG:
+		return "ESP_ERR_INVALID_ARG";
+	case ESP_ERR_INVALID_STATE:
+		return "ESP_ERR_INVALID_STATE";
+	case ESP_ERR_TIMEOUT:
+		return "ESP_ERR_TIMEOUT";
+	default:
+		return "ESP_ERR_UNKNOWN";
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+ * Virtual-time scheduler behind the FreeRTOS shim in include/freertos.
+ *
+ * sim_run() turns the calling thread into the scheduler and runs `main_fn` as the first task
+ * (the stand-in for app_main). It returns when main_fn returns; other tasks are abandoned.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// virtual CPU cost of one kernel call, see include/freertos/FreeRTOS.h
+#define SIM_KERNEL_CALL_US 20
+
+typedef void (*sim_timer_fn_t)(void *arg);
+
+void     sim_run(void (*main_fn)(void *), void *arg);
+uint64_t sim_now_us(void);
+
+/*
+ * Blocks the calling task for `us` of virtual time. Used by the device mocks to charge
+ * SPI transfer time.
+ */
+void sim_delay_us(uint64_t us);
+
+/*
+ * Runs `fn(arg)` from scheduler context at virtual time `at_us`, like an ISR. `fn` may only
+ * use the *FromISR calls and xTaskNotifyGive.
+ */
+void sim_timer_add(uint64_t at_us, sim_timer_fn_t fn, void *arg);
+
+/*
+ * Log filter for the esp_log shim. Messages above `level` are dropped, except for tags
+ * raised with esp_log_level_set.
+ */
+void sim_log_set_default(int level);
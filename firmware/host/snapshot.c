@@ -0,0 +1,128 @@
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool snapshot_write_pbm(const char *path, const uint8_t *image, int width, int height) {
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) {
+		perror(path);
+		return false;
+	}
+	int row_bytes = (width + 7) / 8;
+	fprintf(f, "P4\n%d %d\n", width, height);
+	for (int y = 0; y < height; y++) {
+		uint8_t row[row_bytes];
+		for (int x = 0; x < row_bytes; x++) {
+			row[x] = ~image[y * row_bytes + x]; // PBM: 1 bits are black
+		}
+		fwrite(row, 1, row_bytes, f);
+	}
+	return fclose(f) == 0;
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t len) {
+	static uint32_t table[256];
+	if (table[1] == 0) {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			table[n] = c;
+		}
+	}
+	crc = ~crc;
+	for (size_t i = 0; i < len; i++) {
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void write_chunk(FILE *f, const char *type, const uint8_t *data, uint32_t len) {
+	uint8_t hdr[8];
+	put_be32(hdr, len);
+	memcpy(hdr + 4, type, 4);
+	fwrite(hdr, 1, 8, f);
+	fwrite(data, 1, len, f);
+	uint32_t crc = crc32(crc32(0, (const uint8_t *)type, 4), data, len);
+	uint8_t  trailer[4];
+	put_be32(trailer, crc);
+	fwrite(trailer, 1, 4, f);
+}
+
+bool snapshot_write_png(const char *path, const uint8_t *image, int width, int height) {
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) {
+		perror(path);
+		return false;
+	}
+
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	fwrite(signature, 1, sizeof(signature), f);
+
+	uint8_t ihdr[13];
+	put_be32(ihdr, width);
+	put_be32(ihdr + 4, height);
+	ihdr[8] = 1;  // bit depth
+	ihdr[9] = 0;  // grayscale: 0 is black, 1 is white, same as the framebuffer
+	ihdr[10] = 0; // deflate
+	ihdr[11] = 0; // adaptive filtering (filter type 0 on every row)
+	ihdr[12] = 0; // no interlace
+	write_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+
+	// raw scanlines, each prefixed with filter type 0
+	int    row_bytes = (width + 7) / 8;
+	size_t raw_len = (size_t)(row_bytes + 1) * height;
+	uint8_t *raw = malloc(raw_len);
+	for (int y = 0; y < height; y++) {
+		raw[y * (row_bytes + 1)] = 0;
+		memcpy(raw + y * (row_bytes + 1) + 1, image + y * row_bytes, row_bytes);
+	}
+
+	// zlib stream made of stored blocks
+	size_t   num_blocks = (raw_len + 65534) / 65535;
+	size_t   z_len = 2 + raw_len + num_blocks * 5 + 4;
+	uint8_t *z = malloc(z_len);
+	uint8_t *zp = z;
+	*zp++ = 0x78;
+	*zp++ = 0x01;
+	uint32_t a = 1, b = 0; // adler32
+	for (size_t off = 0; off < raw_len; off += 65535) {
+		uint16_t len = raw_len - off > 65535 ? 65535 : raw_len - off;
+		*zp++ = off + len == raw_len; // BFINAL, BTYPE=00
+		*zp++ = len & 0xFF;
+		*zp++ = len >> 8;
+		*zp++ = ~len & 0xFF;
+		*zp++ = (~len >> 8) & 0xFF;
+		memcpy(zp, raw + off, len);
+		zp += len;
+		for (size_t i = 0; i < len; i++) {
+			a = (a + raw[off + i]) % 65521;
+			b = (b + a) % 65521;
+		}
+	}
+	put_be32(zp, (b << 16) | a);
+	write_chunk(f, "IDAT", z, z_len);
+	write_chunk(f, "IEND", NULL, 0);
+
+	free(z);
+	free(raw);
+	return fclose(f) == 0;
+}
+
+bool snapshot_write(const char *path, const uint8_t *image, int width, int height) {
+	size_t len = strlen(path);
+	if (len > 4 && strcmp(path + len - 4, ".png") == 0) {
+		return snapshot_write_png(path, image, width, height);
+	}
+	return snapshot_write_pbm(path, image, width, height);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+/*
+ * Writers for 1 bpp images in framebuffer polarity (1 bits are white, rows are packed
+ * MSB-first). PNGs use stored (uncompressed) deflate blocks so no zlib is needed.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+bool snapshot_write_pbm(const char *path, const uint8_t *image, int width, int height);
+bool snapshot_write_png(const char *path, const uint8_t *image, int width, int height);
+
+/*
+ * Picks the format from the extension of `path` (".png", anything else is PBM).
+ */
+bool snapshot_write(const char *path, const uint8_t *image, int width, int height);
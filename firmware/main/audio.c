@@ -1,4 +1,8 @@
 #include "audio.h"
+#include "aec_stage.h"
+#include "agc_stage.h"
+#include "beam_stage.h"
+#include "codec_stream.h"
 #include "http_client.h"
 
 #include "audio_common.h"
@@ -12,9 +16,16 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_peripherals.h"
+#include "esp_timer.h"
 #include "freertos/task.h"
+#include "gate_stream.h"
 #include "http_stream.h"
 #include "i2s_stream.h"
+#include "jitter_stream.h"
+#include "ns_stage.h"
+#include "spill.h"
+#include "udp_stream.h"
+#include "vad_stream.h"
 
 static const char *TAG = "AUDIO";
 
@@ -24,9 +35,57 @@ int mic_gain = GAIN_37_5DB;
 esp_periph_set_handle_t    periph_set;
 audio_board_handle_t       board_handle;
 audio_pipeline_handle_t    tx_pipeline, rx_pipeline;
-audio_element_handle_t     adc_i2s, tx_http;
-audio_element_handle_t     dac_i2s, rx_http;
+audio_element_handle_t     adc_i2s, tx_dsp, tx_gate, tx_vad;
+frame_stage_t             *tx_beam, *tx_aec, *tx_ns, *tx_agc;
+audio_element_handle_t     tx_encoder, tx_http, tx_udp;
+audio_element_handle_t     dac_i2s, rx_jitter, rx_decoder, rx_http;
 audio_event_iface_handle_t evt;
+audio_codec_id_t           audio_codec = AUDIO_CODEC;
+
+#if AUDIO_MIC_CHANNELS > 1
+#define AUDIO_MIC_INPUTS (ES7210_INPUT_MIC1 | ES7210_INPUT_MIC2)
+#else
+#define AUDIO_MIC_INPUTS ES7210_INPUT_MIC1
+#endif
+
+// written by the task of audio_tx_start() and read by the transport's, so only with atomics
+static int64_t  tx_start_us; // when the talk button went on, 0 once the first write is logged
+static uint32_t tx_starts;
+static int64_t  tx_latency_sum_us, tx_latency_max_us;
+
+#ifdef CONFIG_AUDIO_AGC_ANALOG
+// ES7210 analog gain of each es7210_gain_value_t, in tenths of a dB
+static const int16_t mic_gain_db10[] = {0,   30,  60,  90,  120, 150, 180, 210,
+                                        240, 270, 300, 330, 345, 360, 375};
+
+/*
+ * Steps the microphone's analog gain for the AGC, from its task.
+ */
+static float audio_mic_gain_step(int step) {
+	int next = mic_gain + step;
+	if (next < GAIN_0DB || next > GAIN_37_5DB) {
+		return 0;
+	}
+	if (es7210_adc_set_gain(AUDIO_MIC_INPUTS, next) != ESP_OK) {
+		ESP_LOGW(TAG, "audio_mic_gain_step: Failed to set the mic gain");
+		return 0;
+	}
+	float db = (mic_gain_db10[next] - mic_gain_db10[mic_gain]) / 10.0f;
+	mic_gain = next;
+	ESP_LOGI(TAG, "audio_mic_gain_step: Mic gain is %d.%d dB", mic_gain_db10[mic_gain] / 10,
+	         mic_gain_db10[mic_gain] % 10);
+	return db;
+}
+#endif
+
+#ifdef CONFIG_AUDIO_AEC
+/*
+ * Hands what the jitter element gives the DAC to the echo canceller, from the jitter's task.
+ */
+static void audio_rx_played(const int16_t *frame, size_t n) {
+	aec_stage_far_end(tx_aec, frame, n);
+}
+#endif
 
 esp_err_t audio_init(void) {
 	// Initialize ES8311 and ES7210
@@ -41,10 +100,19 @@ esp_err_t audio_init(void) {
 	ESP_ERROR_CHECK(audio_hal_get_volume(board_handle->audio_hal, &player_volume));
 	ESP_LOGW(TAG, "DAC volume is: %d", player_volume);
 
-	ESP_ERROR_CHECK(es7210_adc_set_gain(ES7210_INPUT_MIC1, GAIN_37_5DB));
+#ifdef AUDIO_TX_BEAM
+	ESP_ERROR_CHECK(es7210_mic_select(AUDIO_MIC_INPUTS));
+#endif
+	// the same on every microphone, so that the beamformer can add them up
+	ESP_ERROR_CHECK(es7210_adc_set_gain(AUDIO_MIC_INPUTS, GAIN_37_5DB));
 	ESP_ERROR_CHECK(es7210_adc_get_gain(ES7210_INPUT_MIC1, &mic_gain));
 	ESP_LOGW(TAG, "Mic gain is: %d", mic_gain);
 
+#ifndef CONFIG_AUDIO_CODEC_PCM
+	// before the pipelines, which are built for the codec, so that the server does not refuse it
+	audio_codec = http_request_codec(AUDIO_CODEC);
+#endif
+
 	// Create pipelines
 	// TX pipelines: Vosk & Peer TX
 	ESP_LOGI(TAG, "Create Vosk pipeline");
@@ -54,15 +122,158 @@ esp_err_t audio_init(void) {
 
 	ESP_LOGI(TAG, "Create ADC i2s stream");
 	i2s_stream_cfg_t adc_i2s_cfg = I2S_STREAM_CFG_DEFAULT_WITH_TYLE_AND_CH(
-	    (i2s_port_t)0, AUDIO_SAMPLE_RATE, AUDIO_BITS, AUDIO_STREAM_READER, AUDIO_CHANNELS);
+	    (i2s_port_t)0, AUDIO_SAMPLE_RATE, AUDIO_BITS, AUDIO_STREAM_READER, AUDIO_MIC_CHANNELS);
 	adc_i2s_cfg.type = AUDIO_STREAM_READER;
 	adc_i2s_cfg.out_rb_size = 64 * 1024;
+#if defined(CONFIG_AUDIO_TRANSPORT_UDP) || defined(CONFIG_AUDIO_TX_WARM)
+	// a frame at a time, so that each goes up as soon as it is captured, and the gate opens
+	// on the frame the talk button went on in rather than up to 112 ms later
+	adc_i2s_cfg.buffer_len = AUDIO_CODEC_FRAME_SAMPLES * AUDIO_MIC_CHANNELS * sizeof(int16_t);
+#endif
 	adc_i2s = i2s_stream_init(&adc_i2s_cfg);
-	i2s_stream_set_clk(adc_i2s, AUDIO_SAMPLE_RATE, AUDIO_BITS, AUDIO_CHANNELS);
+	i2s_stream_set_clk(adc_i2s, AUDIO_SAMPLE_RATE, AUDIO_BITS, AUDIO_MIC_CHANNELS);
 	audio_pipeline_register(tx_pipeline, adc_i2s, "adc");
 
+#ifdef AUDIO_TX_DSP
+	frame_stage_t *dsp_stages[FRAME_STREAM_MAX_STAGES];
+	int            dsp_stage_count = 0;
+#endif
+
+#ifdef CONFIG_AUDIO_AGC
+	ESP_LOGI(TAG, "Create AGC");
+	agc_cfg_t agc_cfg = {
+	    .target_dbfs = CONFIG_AUDIO_AGC_TARGET_DBFS,
+	    .max_gain_db = CONFIG_AUDIO_AGC_MAX_GAIN_DB,
+	    .attack_ms = CONFIG_AUDIO_AGC_ATTACK_MS,
+	    .release_ms = CONFIG_AUDIO_AGC_RELEASE_MS,
+	};
+#ifdef CONFIG_AUDIO_AGC_ANALOG
+	agc_cfg.analog = true;
+	tx_agc = agc_stage_init(&agc_cfg, audio_mic_gain_step);
+#else
+	tx_agc = agc_stage_init(&agc_cfg, NULL);
+#endif
+	mem_assert(tx_agc);
+	// first, so that its tap counts what the ADC clipped before the beamformer, echo canceller
+	// and noise suppressor smooth it over
+	frame_stage_t *agc_tap = agc_stage_tap_init(tx_agc, AUDIO_MIC_CHANNELS);
+	mem_assert(agc_tap);
+	dsp_stages[dsp_stage_count++] = agc_tap;
+#endif
+
+#ifdef AUDIO_TX_BEAM
+	ESP_LOGI(TAG, "Create beamformer");
+	beam_cfg_t beam_cfg;
+	beam_line_delays(&beam_cfg, AUDIO_MIC_CHANNELS, CONFIG_AUDIO_BEAM_SPACING_MM);
+	tx_beam = beam_stage_init(&beam_cfg);
+	mem_assert(tx_beam);
+	dsp_stages[dsp_stage_count++] = tx_beam;
+#endif
+
+#ifdef CONFIG_AUDIO_AEC
+	ESP_LOGI(TAG, "Create echo canceller");
+	aec_stage_cfg_t aec_cfg = {.delay_ms = CONFIG_AUDIO_AEC_DELAY_MS};
+	aec_cfg.aec.tail_ms = CONFIG_AUDIO_AEC_TAIL_MS / AEC_FRAME_MS * AEC_FRAME_MS;
+	aec_cfg.aec.suppress_db = CONFIG_AUDIO_AEC_SUPPRESS_DB;
+	tx_aec = aec_stage_init(&aec_cfg);
+	mem_assert(tx_aec);
+	dsp_stages[dsp_stage_count++] = tx_aec;
+#endif
+
+#ifdef CONFIG_AUDIO_NS
+	ESP_LOGI(TAG, "Create noise suppressor");
+	ns_cfg_t ns_cfg = {.max_db = CONFIG_AUDIO_NS_MAX_DB};
+	tx_ns = ns_stage_init(&ns_cfg);
+	mem_assert(tx_ns);
+	dsp_stages[dsp_stage_count++] = tx_ns;
+#endif
+
+#ifdef CONFIG_AUDIO_AGC
+	dsp_stages[dsp_stage_count++] = tx_agc;
+#endif
+
+#ifdef AUDIO_TX_DSP
+	// all in one task, since each stage takes the same 10 ms frames and does not wait
+	tx_dsp = frame_stream_init("dsp", dsp_stages, dsp_stage_count);
+	mem_assert(tx_dsp);
+	audio_pipeline_register(tx_pipeline, tx_dsp, "dsp");
+#endif
+
+#ifdef CONFIG_AUDIO_TX_WARM
+	ESP_LOGI(TAG, "Create talk gate");
+	gate_cfg_t gate_cfg = {
+	    .preroll_ms = CONFIG_AUDIO_TX_WARM_PREROLL_MS,
+	    .keepalive_ms = CONFIG_AUDIO_TX_WARM_KEEPALIVE_MS,
+	};
+	tx_gate = gate_stream_init(&gate_cfg);
+	mem_assert(tx_gate);
+	audio_pipeline_register(tx_pipeline, tx_gate, "gate");
+#endif
+
+#ifdef CONFIG_AUDIO_VAD
+	ESP_LOGI(TAG, "Create VAD");
+	vad_cfg_t vad_cfg = {
+	    .threshold_db = CONFIG_AUDIO_VAD_THRESHOLD_DB,
+	    .hangover_ms = CONFIG_AUDIO_VAD_HANGOVER_MS,
+	    .preroll_ms = CONFIG_AUDIO_VAD_PREROLL_MS,
+	    .keepalive_ms = CONFIG_AUDIO_VAD_KEEPALIVE_MS,
+	};
+	tx_vad = vad_stream_init(&vad_cfg);
+	mem_assert(tx_vad);
+	audio_pipeline_register(tx_pipeline, tx_vad, "vad");
+#endif
+
+#ifdef AUDIO_TX_ENCODER
+	ESP_LOGI(TAG, "Create %s encoder", audio_codec_name(audio_codec));
+	codec_stream_cfg_t encoder_cfg = {
+	    .codec = {.id = audio_codec},
+	    .encode = true,
+#ifdef AUDIO_TX_KEEPALIVES
+	    .keepalives = true,
+#endif
+	};
+#ifdef CONFIG_AUDIO_CODEC_OPUS
+	encoder_cfg.codec.bitrate = CONFIG_AUDIO_OPUS_BITRATE;
+	encoder_cfg.codec.complexity = CONFIG_AUDIO_OPUS_COMPLEXITY;
+#endif
+	tx_encoder = codec_stream_init(&encoder_cfg);
+	mem_assert(tx_encoder);
+	audio_pipeline_register(tx_pipeline, tx_encoder, "encoder");
+#endif
+
 	const char *server_url = "http://" CONFIG_SERVER_IP ":" CONFIG_SERVER_PORT "/audio";
 
+#ifdef CONFIG_AUDIO_TRANSPORT_UDP
+#ifdef CONFIG_AUDIO_SPILL
+	ESP_LOGI(TAG, "Create backlog of the UDP Vosk stream");
+	spill_cfg_t spill_cfg = {
+	    .host = CONFIG_SERVER_IP,
+	    .port = atoi(CONFIG_SERVER_PORT),
+	    .ram_len = CONFIG_AUDIO_SPILL_RAM_KB * 1024,
+#ifdef CONFIG_AUDIO_SPILL_FLASH
+	    .partition = "spill",
+#endif
+	    .resend_ms = CONFIG_AUDIO_SPILL_RESEND_MS,
+	    .rate = CONFIG_AUDIO_SPILL_RATE,
+	};
+	if (spill_init(&spill_cfg) != ESP_OK) {
+		ESP_LOGW(TAG, "Audio sent while Wi-Fi is down will be lost");
+	}
+#endif
+	ESP_LOGI(TAG, "Create UDP Vosk stream");
+	udp_stream_cfg_t tx_udp_cfg = {
+	    .host = CONFIG_SERVER_IP,
+	    .port = atoi(CONFIG_SERVER_PORT),
+	    .codec = audio_codec,
+#ifdef AUDIO_TX_KEEPALIVES
+	    .vad = true,
+#endif
+	    .sent = audio_tx_sent,
+	};
+	tx_udp = udp_stream_init(&tx_udp_cfg);
+	mem_assert(tx_udp);
+	audio_pipeline_register(tx_pipeline, tx_udp, "tx-udp");
+#else
 	ESP_LOGI(TAG, "Create HTTP Vosk stream");
 	http_stream_cfg_t tx_http_cfg = HTTP_STREAM_CFG_DEFAULT();
 	tx_http_cfg.type = AUDIO_STREAM_WRITER;
@@ -70,6 +281,7 @@ esp_err_t audio_init(void) {
 	tx_http = http_stream_init(&tx_http_cfg);
 	audio_element_set_uri(tx_http, server_url);
 	audio_pipeline_register(tx_pipeline, tx_http, "tx-http");
+#endif
 
 	// RX pipeline: Peer RX
 	ESP_LOGI(TAG, "Create Peer RX pipeline");
@@ -80,6 +292,8 @@ esp_err_t audio_init(void) {
 	ESP_LOGI(TAG, "Create DAC i2s stream");
 	i2s_stream_cfg_t dac_i2s_cfg = I2S_STREAM_CFG_DEFAULT();
 	dac_i2s_cfg.type = AUDIO_STREAM_WRITER;
+	// a couple of frames at a time, so that the jitter buffer sets the delay
+	dac_i2s_cfg.buffer_len = 2 * JITTER_FRAME_SAMPLES * sizeof(int16_t);
 	dac_i2s = i2s_stream_init(&dac_i2s_cfg);
 	i2s_stream_set_clk(dac_i2s, AUDIO_SAMPLE_RATE, AUDIO_BITS, AUDIO_CHANNELS);
 	audio_pipeline_register(rx_pipeline, dac_i2s, "dac");
@@ -92,22 +306,75 @@ esp_err_t audio_init(void) {
 	audio_element_set_uri(rx_http, server_url);
 	audio_pipeline_register(rx_pipeline, rx_http, "rx-http");
 
+#ifndef CONFIG_AUDIO_CODEC_PCM
+	ESP_LOGI(TAG, "Create %s decoder", audio_codec_name(audio_codec));
+	codec_stream_cfg_t decoder_cfg = {.codec = encoder_cfg.codec};
+	rx_decoder = codec_stream_init(&decoder_cfg);
+	mem_assert(rx_decoder);
+	audio_pipeline_register(rx_pipeline, rx_decoder, "decoder");
+#endif
+
+	ESP_LOGI(TAG, "Create jitter buffer");
+	jitter_cfg_t jitter_cfg = {
+	    .min_delay_ms = CONFIG_AUDIO_JITTER_MIN_DELAY_MS,
+	    .max_delay_ms = CONFIG_AUDIO_JITTER_MAX_DELAY_MS,
+	    .conceal_ms = CONFIG_AUDIO_JITTER_CONCEAL_MS,
+	};
+#ifdef CONFIG_AUDIO_AEC
+	rx_jitter = jitter_stream_init(&jitter_cfg, audio_rx_played);
+#else
+	rx_jitter = jitter_stream_init(&jitter_cfg, NULL);
+#endif
+	mem_assert(rx_jitter);
+	audio_pipeline_register(rx_pipeline, rx_jitter, "jitter");
+
 	/*
 	 * Link pipelines:
 	 *
-	 * adc_i2s ------- tx_http
+	 * adc_i2s --- tx_dsp --- tx_gate --- tx_vad --- tx_encoder --- tx_http or tx_udp
 	 *
+	 * tx_dsp runs the stages tx_beam, only with more than one microphone, tx_aec, only with
+	 * CONFIG_AUDIO_AEC, tx_ns, only with CONFIG_AUDIO_NS, and tx_agc, only with
+	 * CONFIG_AUDIO_AGC and behind its tap, in that order, and only with any of them. tx_gate only with
+	 * CONFIG_AUDIO_TX_WARM, tx_vad only with CONFIG_AUDIO_VAD, tx_encoder only with a codec or
+	 * UDP
 	 */
 	ESP_LOGI(TAG, "Link TX pipelines");
-	const char *vosk_link_tag[2] = {"adc", "tx-http"};
-	audio_pipeline_link(tx_pipeline, vosk_link_tag, 2);
+	const char *vosk_link_tag[6];
+	int         vosk_links = 0;
+	vosk_link_tag[vosk_links++] = "adc";
+#ifdef AUDIO_TX_DSP
+	vosk_link_tag[vosk_links++] = "dsp";
+#endif
+#ifdef CONFIG_AUDIO_TX_WARM
+	vosk_link_tag[vosk_links++] = "gate";
+#endif
+#ifdef CONFIG_AUDIO_VAD
+	vosk_link_tag[vosk_links++] = "vad";
+#endif
+#ifdef AUDIO_TX_ENCODER
+	vosk_link_tag[vosk_links++] = "encoder";
+#endif
+#ifdef CONFIG_AUDIO_TRANSPORT_UDP
+	vosk_link_tag[vosk_links++] = "tx-udp";
+#else
+	vosk_link_tag[vosk_links++] = "tx-http";
+#endif
+	audio_pipeline_link(tx_pipeline, vosk_link_tag, vosk_links);
 
 	/*
-	 * rx_http ------- dac_i2s
+	 * rx_http ------- rx_decoder ------- rx_jitter ------- dac_i2s
+	 *
+	 * rx_decoder only with a codec
 	 */
 	ESP_LOGI(TAG, "Link RX pipeline");
-	const char *rx_link_tag[2] = {"rx-http", "dac"};
-	audio_pipeline_link(rx_pipeline, rx_link_tag, 2);
+#ifndef CONFIG_AUDIO_CODEC_PCM
+	const char *rx_link_tag[4] = {"rx-http", "decoder", "jitter", "dac"};
+	audio_pipeline_link(rx_pipeline, rx_link_tag, 4);
+#else
+	const char *rx_link_tag[3] = {"rx-http", "jitter", "dac"};
+	audio_pipeline_link(rx_pipeline, rx_link_tag, 3);
+#endif
 
 	ESP_LOGI(TAG, "Set up event listener");
 	audio_event_iface_cfg_t evt_cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
@@ -120,9 +387,91 @@ esp_err_t audio_init(void) {
 	ESP_LOGI(TAG, "Listening event from peripherals");
 	audio_event_iface_set_listener(esp_periph_set_get_event_iface(periph_set), evt);
 
+#ifdef CONFIG_AUDIO_TX_WARM
+	// closed until the talk button goes on, but connected and capturing the pre-roll
+	ESP_LOGI(TAG, "Start TX pipeline");
+	if (audio_pipeline_run(tx_pipeline) != ESP_OK) {
+		ESP_LOGW(TAG, "TX pipeline did not start, will retry at the talk button");
+	}
+#endif
+
 	return ESP_OK;
 }
 
+static void audio_tx_halt(void) {
+	audio_element_set_ringbuf_done(adc_i2s);
+	audio_pipeline_stop(tx_pipeline);
+	audio_pipeline_wait_for_stop(tx_pipeline);
+	audio_pipeline_reset_ringbuffer(tx_pipeline);
+	audio_pipeline_reset_elements(tx_pipeline);
+	audio_pipeline_terminate(tx_pipeline);
+}
+
+esp_err_t audio_tx_start(void) {
+	__atomic_store_n(&tx_start_us, esp_timer_get_time(), __ATOMIC_RELEASE);
+#ifdef CONFIG_AUDIO_TX_WARM
+#ifdef CONFIG_AUDIO_TRANSPORT_UDP
+	audio_element_handle_t transport = tx_udp;
+#else
+	audio_element_handle_t transport = tx_http;
+#endif
+	// e.g. the server was down at boot or dropped the connection, so start over cold
+	if (audio_element_get_state(transport) != AEL_STATE_RUNNING) {
+		ESP_LOGW(TAG, "audio_tx_start: TX pipeline is not running, restarting it");
+		audio_tx_halt();
+		esp_err_t err = audio_pipeline_run(tx_pipeline);
+		if (err != ESP_OK) {
+			__atomic_store_n(&tx_start_us, 0, __ATOMIC_RELEASE);
+			return err;
+		}
+	}
+	gate_stream_set_open(tx_gate, true);
+	return ESP_OK;
+#else
+	esp_err_t err = audio_pipeline_run(tx_pipeline);
+	if (err != ESP_OK) {
+		__atomic_store_n(&tx_start_us, 0, __ATOMIC_RELEASE);
+	}
+	return err;
+#endif
+}
+
+void audio_tx_stop(void) {
+	__atomic_store_n(&tx_start_us, 0, __ATOMIC_RELEASE);
+#ifdef CONFIG_AUDIO_TX_WARM
+	gate_stream_set_open(tx_gate, false);
+#else
+	audio_tx_halt();
+#endif
+}
+
+void audio_tx_sent(void) {
+	// takes the start, so that only one write logs it
+	int64_t start = __atomic_exchange_n(&tx_start_us, 0, __ATOMIC_ACQ_REL);
+	if (start == 0) {
+		return;
+	}
+	int64_t  latency = esp_timer_get_time() - start;
+	uint32_t starts = __atomic_add_fetch(&tx_starts, 1, __ATOMIC_RELAXED);
+	int64_t  sum = __atomic_add_fetch(&tx_latency_sum_us, latency, __ATOMIC_RELAXED);
+	int64_t  max = __atomic_load_n(&tx_latency_max_us, __ATOMIC_RELAXED);
+	while (latency > max && !__atomic_compare_exchange_n(&tx_latency_max_us, &max, latency,
+	                                                     false, __ATOMIC_RELAXED,
+	                                                     __ATOMIC_RELAXED)) {
+	}
+	if (latency > max) {
+		max = latency;
+	}
+#ifdef CONFIG_AUDIO_TX_WARM
+	const char *mode = "warm";
+#else
+	const char *mode = "cold";
+#endif
+	ESP_LOGI(TAG, "audio_tx_sent: First audio sent %lld ms after the talk button (%s), "
+	              "mean %lld ms, max %lld ms over %lu",
+	         latency / 1000, mode, sum / starts / 1000, max / 1000, starts);
+}
+
 esp_err_t audio_deinit(void) {
 	ESP_LOGI(TAG, "Stop ADC pipeline");
 	audio_pipeline_stop(tx_pipeline);
@@ -147,7 +496,27 @@ esp_err_t audio_deinit(void) {
 	audio_pipeline_deinit(tx_pipeline);
 	audio_pipeline_deinit(rx_pipeline);
 	audio_element_deinit(adc_i2s);
+#ifdef AUDIO_TX_DSP
+	audio_element_deinit(tx_dsp); // and its stages
+#endif
+#ifdef CONFIG_AUDIO_TX_WARM
+	audio_element_deinit(tx_gate);
+#endif
+#ifdef CONFIG_AUDIO_VAD
+	audio_element_deinit(tx_vad);
+#endif
+#ifdef AUDIO_TX_ENCODER
+	audio_element_deinit(tx_encoder);
+#endif
+#ifndef CONFIG_AUDIO_CODEC_PCM
+	audio_element_deinit(rx_decoder);
+#endif
+	audio_element_deinit(rx_jitter);
+#ifdef CONFIG_AUDIO_TRANSPORT_UDP
+	audio_element_deinit(tx_udp);
+#else
 	audio_element_deinit(tx_http);
+#endif
 	audio_element_deinit(rx_http);
 	audio_element_deinit(dac_i2s);
 	return ESP_OK;
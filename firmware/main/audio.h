@@ -1,5 +1,6 @@
 #pragma once
 
+#include "audio_codec.h"
 #include "audio_common.h"
 #include "audio_element.h"
 #include "audio_event_iface.h"
@@ -7,12 +8,44 @@
 #include "board.h"
 #include "esp_err.h"
 #include "esp_peripherals.h"
+#include "frame_stream.h"
 #include "freertos/task.h"
+#include "sdkconfig.h"
 
 #define AUDIO_SAMPLE_RATE 16000
 #define AUDIO_BITS 16
 #define AUDIO_CHANNELS 1
 
+// the I2S reader gives a channel per microphone, which the TX pipeline beamforms into one
+#define AUDIO_MIC_CHANNELS CONFIG_AUDIO_MICS
+#if AUDIO_MIC_CHANNELS > 1
+#define AUDIO_TX_BEAM 1
+#endif
+
+// the beamformer, echo canceller, noise suppressor and AGC run as stages of one element
+#if defined(AUDIO_TX_BEAM) || defined(CONFIG_AUDIO_AEC) || defined(CONFIG_AUDIO_NS) || \
+    defined(CONFIG_AUDIO_AGC)
+#define AUDIO_TX_DSP 1
+#endif
+
+#if defined(CONFIG_AUDIO_CODEC_ADPCM)
+#define AUDIO_CODEC AUDIO_CODEC_ADPCM
+#elif defined(CONFIG_AUDIO_CODEC_OPUS)
+#define AUDIO_CODEC AUDIO_CODEC_OPUS
+#else
+#define AUDIO_CODEC AUDIO_CODEC_PCM
+#endif
+
+// the UDP transport sends frames, so the TX pipeline makes them even for PCM
+#if !defined(CONFIG_AUDIO_CODEC_PCM) || defined(CONFIG_AUDIO_TRANSPORT_UDP)
+#define AUDIO_TX_ENCODER 1
+#endif
+
+// the VAD or the gate sends keepalives instead of silence
+#if defined(CONFIG_AUDIO_VAD) || defined(CONFIG_AUDIO_TX_WARM)
+#define AUDIO_TX_KEEPALIVES 1
+#endif
+
 #define BUTTON_ID_1 42
 #define BUTTON_ID_2 41
 #define BUTTON_ID_3 40
@@ -20,9 +53,28 @@
 extern esp_periph_set_handle_t    periph_set;
 extern audio_board_handle_t       board_handle;
 extern audio_pipeline_handle_t    tx_pipeline, rx_pipeline;
-extern audio_element_handle_t     adc_i2s, tx_http;
-extern audio_element_handle_t     dac_i2s, rx_http;
+extern audio_element_handle_t     adc_i2s, tx_dsp, tx_gate, tx_vad;
+extern frame_stage_t             *tx_beam, *tx_aec, *tx_ns, *tx_agc;
+extern audio_element_handle_t     tx_encoder, tx_http, tx_udp;
+extern audio_element_handle_t     dac_i2s, rx_jitter, rx_decoder, rx_http;
 extern audio_event_iface_handle_t evt;
 
+// AUDIO_CODEC, or ADPCM if audio_init() found that the server does not take it
+extern audio_codec_id_t audio_codec;
+
 esp_err_t audio_init(void);
 esp_err_t audio_deinit(void);
+
+/*
+ * Starts and stops sending the microphone audio to the server. With CONFIG_AUDIO_TX_WARM this
+ * opens and closes the gate of the TX pipeline, which runs all along, otherwise it runs and
+ * stops the pipeline.
+ */
+esp_err_t audio_tx_start(void);
+void      audio_tx_stop(void);
+
+/*
+ * Called by the transports after each write of microphone audio. Logs how long the first one
+ * took after audio_tx_start().
+ */
+void audio_tx_sent(void);
@@ -0,0 +1,92 @@
+#include "adpcm.h"
+
+static const int16_t step_table[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,
+    25,    28,    31,    34,    37,    41,    45,    50,    55,    60,    66,    73,    80,
+    88,    97,    107,   118,   130,   143,   157,   173,   190,   209,   230,   253,   279,
+    307,   337,   371,   408,   449,   494,   544,   598,   658,   724,   796,   876,   963,
+    1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,  2272,  2499,  2749,  3024,  3327,
+    3660,  4026,  4428,  4871,  5358,  5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+static const int8_t index_table[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+/*
+ * Applies `nibble` to the state, as both the encoder and the decoder do.
+ */
+static inline void adpcm_step(adpcm_state_t *st, uint8_t nibble) {
+	int32_t step = step_table[st->index];
+	int32_t diff = step >> 3;
+	if (nibble & 4) {
+		diff += step;
+	}
+	if (nibble & 2) {
+		diff += step >> 1;
+	}
+	if (nibble & 1) {
+		diff += step >> 2;
+	}
+	int32_t p = nibble & 8 ? st->predictor - diff : st->predictor + diff;
+	st->predictor = p > INT16_MAX ? INT16_MAX : p < INT16_MIN ? INT16_MIN : p;
+
+	int32_t index = st->index + index_table[nibble];
+	st->index = index < 0 ? 0 : index > 88 ? 88 : index;
+}
+
+static inline uint8_t adpcm_quantize(adpcm_state_t *st, int16_t sample) {
+	int32_t diff = sample - st->predictor;
+	int32_t step = step_table[st->index];
+	uint8_t nibble = 0;
+	if (diff < 0) {
+		nibble = 8;
+		diff = -diff;
+	}
+	if (diff >= step) {
+		nibble |= 4;
+		diff -= step;
+	}
+	step >>= 1;
+	if (diff >= step) {
+		nibble |= 2;
+		diff -= step;
+	}
+	step >>= 1;
+	if (diff >= step) {
+		nibble |= 1;
+	}
+	adpcm_step(st, nibble);
+	return nibble;
+}
+
+size_t adpcm_encode(adpcm_state_t *st, const int16_t *pcm, size_t samples, uint8_t *out) {
+	out[0] = (uint16_t)st->predictor & 0xFF;
+	out[1] = (uint16_t)st->predictor >> 8;
+	out[2] = st->index;
+	out[3] = 0;
+	uint8_t *p = out + ADPCM_HDR_LEN;
+	for (size_t i = 0; i < samples; i += 2) {
+		uint8_t lo = adpcm_quantize(st, pcm[i]);
+		uint8_t hi = i + 1 < samples ? adpcm_quantize(st, pcm[i + 1]) : 0;
+		*p++ = lo | hi << 4;
+	}
+	return p - out;
+}
+
+size_t adpcm_decode(const uint8_t *block, size_t len, int16_t *pcm) {
+	if (len < ADPCM_HDR_LEN || block[2] > 88) {
+		return 0;
+	}
+	adpcm_state_t st = {
+	    .predictor = (int16_t)(block[0] | block[1] << 8),
+	    .index = block[2],
+	};
+	size_t n = 0;
+	for (size_t i = ADPCM_HDR_LEN; i < len; i++) {
+		adpcm_step(&st, block[i] & 0xF);
+		pcm[n++] = st.predictor;
+		adpcm_step(&st, block[i] >> 4);
+		pcm[n++] = st.predictor;
+	}
+	return n;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+/*
+ * IMA ADPCM, 4 bits per sample, in blocks that each start from a header with the predictor
+ * and step index, so that a block decodes on its own:
+ *
+ *   int16 predictor (little-endian), uint8 step index, uint8 0, then one nibble per sample,
+ *   the first sample in the low nibble of each byte.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ADPCM_HDR_LEN 4
+#define ADPCM_BLOCK_LEN(samples) (ADPCM_HDR_LEN + ((samples) + 1) / 2)
+
+typedef struct {
+	int16_t predictor;
+	uint8_t index;
+} adpcm_state_t;
+
+/*
+ * Encodes `samples` samples into a block of ADPCM_BLOCK_LEN(samples) bytes at `out`, carrying
+ * the state on from the previous block. Returns the block length.
+ */
+size_t adpcm_encode(adpcm_state_t *st, const int16_t *pcm, size_t samples, uint8_t *out);
+
+/*
+ * Decodes a block of `len` bytes into `pcm`, which holds (len - ADPCM_HDR_LEN) * 2 samples.
+ * Returns the number of samples, or 0 if the block is malformed.
+ */
+size_t adpcm_decode(const uint8_t *block, size_t len, int16_t *pcm);
@@ -0,0 +1,353 @@
+#include "aec.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AEC_SPEC_SMOOTH 0.01f    // share of this frame in the mean power spectra of the leak
+#define AEC_LEAK_RATE 0.02f      // most share of this frame in the leak, by the echo's power,
+#define AEC_LEAK_RATE_MAX 0.005f // and by what is left
+#define AEC_ADAPTED_LEAK 0.03f   // least leak that counts once the filter has adapted enough
+#define AEC_BIN_FLOOR 10.0f      // added to the powers of a bin, so that quiet does not blow up
+#define AEC_DOUBLE_TALK 4.0f     // more left than this times the leaked echo is the wearer
+#define AEC_TAKE_BACK 4.0f       // times more than chance the adapting filter leaves to lose it
+
+static inline int16_t aec_round(float v) {
+	int32_t s = lrintf(v);
+	return s > INT16_MAX ? INT16_MAX : s < INT16_MIN ? INT16_MIN : s;
+}
+
+esp_err_t aec_init(aec_t *aec, const aec_cfg_t *cfg) {
+	memset(aec, 0, sizeof(*aec));
+	if (cfg->tail_ms < AEC_FRAME_MS || cfg->tail_ms > AEC_MAX_TAIL_MS ||
+	    cfg->tail_ms % AEC_FRAME_MS != 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	aec->partitions = cfg->tail_ms / AEC_FRAME_MS;
+	esp_err_t err = fft_init(&aec->fft, AEC_FFT_BITS);
+	if (err != ESP_OK) {
+		return err;
+	}
+	aec->spectra = calloc(aec->partitions, 2 * AEC_BINS * sizeof(float));
+	aec->weights = calloc(aec->partitions, 2 * AEC_BINS * sizeof(float));
+	aec->fore = calloc(aec->partitions, 2 * AEC_BINS * sizeof(float));
+	if (aec->spectra == NULL || aec->weights == NULL || aec->fore == NULL) {
+		aec_deinit(aec);
+		return ESP_ERR_NO_MEM;
+	}
+	aec->far_min = 32768.0f * 32768.0f * AEC_FRAME_SAMPLES * powf(10.0f, AEC_FAR_DBFS / 10.0f);
+	aec->min_gain = powf(10.0f, -(float)cfg->suppress_db / 20);
+	aec->pyy = 1;
+	aec->pey = AEC_MIN_LEAK;
+	aec->leak = AEC_MIN_LEAK;
+	aec_reset(aec);
+	return ESP_OK;
+}
+
+void aec_deinit(aec_t *aec) {
+	fft_deinit(&aec->fft);
+	free(aec->spectra);
+	free(aec->weights);
+	free(aec->fore);
+	aec->spectra = NULL;
+	aec->weights = NULL;
+	aec->fore = NULL;
+}
+
+void aec_reset(aec_t *aec) {
+	memset(aec->far, 0, sizeof(aec->far));
+	memset(aec->spectra, 0, aec->partitions * 2 * AEC_BINS * sizeof(float));
+	aec->far_quiet = UINT32_MAX;
+	aec->gain = 1;
+}
+
+/*
+ * Transforms `n` real samples at the end of AEC_FFT_SIZE, after zeros, into aec->work.
+ */
+static void aec_fft_tail(aec_t *aec, const float *x, size_t n) {
+	memset(aec->work, 0, sizeof(aec->work));
+	for (size_t i = 0; i < n; i++) {
+		aec->work[2 * (AEC_FFT_SIZE - n + i)] = x[i];
+	}
+	fft_forward(&aec->fft, aec->work);
+}
+
+/*
+ * Transforms the bins of a real signal in `bins` back into aec->work, with the mirror of each.
+ */
+static void aec_ifft_bins(aec_t *aec, const float *bins) {
+	memcpy(aec->work, bins, 2 * AEC_BINS * sizeof(float));
+	for (int k = 1; k < AEC_FFT_SIZE / 2; k++) {
+		aec->work[2 * (AEC_FFT_SIZE - k)] = bins[2 * k];
+		aec->work[2 * (AEC_FFT_SIZE - k) + 1] = -bins[2 * k + 1];
+	}
+	fft_inverse(&aec->fft, aec->work);
+}
+
+/*
+ * Brings partition p of the filter back to a frame's length in the time domain, which the
+ * updates in the frequency domain let it grow beyond.
+ */
+static void aec_constrain(aec_t *aec, uint32_t p) {
+	float *w = aec->weights + p * 2 * AEC_BINS;
+	aec_ifft_bins(aec, w);
+	for (int i = 0; i < AEC_FFT_SIZE; i++) {
+		aec->work[2 * i + 1] = 0;
+		if (i >= AEC_FRAME_SAMPLES) {
+			aec->work[2 * i] = 0;
+		}
+	}
+	fft_forward(&aec->fft, aec->work);
+	memcpy(w, aec->work, 2 * AEC_BINS * sizeof(float));
+}
+
+/*
+ * Filters the far end in the ring of spectra with `weights`, into the frame `y` of the echo
+ * estimate. Only the last frame of the circular convolution is whole.
+ */
+static void aec_filter(aec_t *aec, const float *weights, float *y) {
+	uint32_t parts = aec->partitions;
+	float   *sum = aec->error; // not needed again until the update
+	memset(sum, 0, 2 * AEC_BINS * sizeof(float));
+	for (uint32_t p = 0; p < parts; p++) {
+		const float *xp = aec->spectra + ((aec->newest + parts - p) % parts) * 2 * AEC_BINS;
+		const float *wp = weights + p * 2 * AEC_BINS;
+		for (int k = 0; k < AEC_BINS; k++) {
+			float xr = xp[2 * k], xi = xp[2 * k + 1];
+			float wr = wp[2 * k], wi = wp[2 * k + 1];
+			sum[2 * k] += xr * wr - xi * wi;
+			sum[2 * k + 1] += xr * wi + xi * wr;
+		}
+	}
+	aec_ifft_bins(aec, sum);
+	for (int i = 0; i < AEC_FRAME_SAMPLES; i++) {
+		y[i] = aec->work[2 * (AEC_FFT_SIZE - AEC_FRAME_SAMPLES + i)];
+	}
+}
+
+void aec_process(aec_t *aec, const int16_t *near, const int16_t *far, int16_t *out) {
+	aec_stats_t *st = &aec->stats;
+	uint32_t     parts = aec->partitions;
+	st->frames++;
+
+	// the far end, into the ring of spectra
+	float far_energy = 0;
+	memmove(aec->far, aec->far + AEC_FRAME_SAMPLES,
+	        (AEC_FFT_SIZE - AEC_FRAME_SAMPLES) * sizeof(int16_t));
+	for (int i = 0; i < AEC_FRAME_SAMPLES; i++) {
+		int16_t s = far != NULL ? far[i] : 0;
+		aec->far[AEC_FFT_SIZE - AEC_FRAME_SAMPLES + i] = s;
+		far_energy += (float)s * s;
+	}
+	if (far_energy > 0) {
+		aec->far_quiet = 0;
+	} else if (aec->far_quiet < UINT32_MAX) {
+		aec->far_quiet++;
+	}
+	aec->newest = (aec->newest + 1) % parts;
+	float *x = aec->spectra + aec->newest * 2 * AEC_BINS;
+	if (aec->far_quiet < AEC_FFT_SIZE / AEC_FRAME_SAMPLES + 1) {
+		for (int i = 0; i < AEC_FFT_SIZE; i++) {
+			aec->work[2 * i] = aec->far[i];
+			aec->work[2 * i + 1] = 0;
+		}
+		fft_forward(&aec->fft, aec->work);
+		memcpy(x, aec->work, 2 * AEC_BINS * sizeof(float));
+	} else {
+		memset(x, 0, 2 * AEC_BINS * sizeof(float));
+	}
+
+	bool playing = far_energy > aec->far_min;
+	if (playing) {
+		st->far_frames++;
+	}
+
+	// with no far end in any partition there is no echo to cancel, nor anything to adapt to
+	bool echo = aec->far_quiet < AEC_FFT_SIZE / AEC_FRAME_SAMPLES + parts;
+	if (!echo) {
+		float step = (1 - aec->gain) / AEC_FRAME_SAMPLES;
+		for (int i = 0; i < AEC_FRAME_SAMPLES; i++) {
+			aec->gain += step;
+			out[i] = aec_round(near[i] * aec->gain);
+		}
+		aec->gain = 1;
+		return;
+	}
+
+	// the echo estimates of both filters, and what each leaves
+	aec_filter(aec, aec->weights, aec->y);
+	aec_filter(aec, aec->fore, aec->fore_y);
+	float see = 0, sff = 0, sbf = 0;
+	for (int i = 0; i < AEC_FRAME_SAMPLES; i++) {
+		float e = near[i] - aec->y[i], f = near[i] - aec->fore_y[i];
+		see += e * e;
+		sff += f * f;
+		sbf += (e - f) * (e - f);
+	}
+
+	// the filter adapting takes over once it leaves less by more than the two differ by chance,
+	// over a frame or over a few, and is taken back to the one in use once it leaves a lot more
+	float diff = sff - see;
+	aec->diff_fast = 0.6f * aec->diff_fast + 0.4f * diff;
+	aec->diff_slow = 0.85f * aec->diff_slow + 0.15f * diff;
+	aec->var_fast = 0.36f * aec->var_fast + 0.16f * sff * sbf;
+	aec->var_slow = 0.7225f * aec->var_slow + 0.0225f * sff * sbf;
+	bool take_over = diff * fabsf(diff) > sff * sbf ||
+	                 aec->diff_fast * fabsf(aec->diff_fast) > 0.5f * aec->var_fast ||
+	                 aec->diff_slow * fabsf(aec->diff_slow) > 0.25f * aec->var_slow;
+	bool take_back = -diff * fabsf(diff) > AEC_TAKE_BACK * sff * sbf ||
+	                 -aec->diff_fast * fabsf(aec->diff_fast) > AEC_TAKE_BACK * aec->var_fast ||
+	                 -aec->diff_slow * fabsf(aec->diff_slow) > AEC_TAKE_BACK * aec->var_slow;
+	if (take_over) {
+		memcpy(aec->fore, aec->weights, parts * 2 * AEC_BINS * sizeof(float));
+		aec->diff_fast = aec->diff_slow = aec->var_fast = aec->var_slow = 0;
+	} else if (take_back) {
+		memcpy(aec->weights, aec->fore, parts * 2 * AEC_BINS * sizeof(float));
+		memcpy(aec->y, aec->fore_y, sizeof(aec->y));
+		aec->diff_fast = aec->diff_slow = aec->var_fast = aec->var_slow = 0;
+		st->resets++;
+	}
+
+	// what goes out is what the filter in use leaves, crossfaded to the other one's when it
+	// takes over
+	float see_out = 0, syy = 0, sey = 0;
+	for (int i = 0; i < AEC_FRAME_SAMPLES; i++) {
+		float y = aec->fore_y[i];
+		if (take_over) {
+			y += (aec->y[i] - y) * (i + 1) / AEC_FRAME_SAMPLES;
+		}
+		aec->out[i] = near[i] - y;
+		see_out += aec->out[i] * aec->out[i];
+		aec->e[i] = near[i] - aec->y[i];
+		syy += aec->y[i] * aec->y[i];
+		sey += aec->e[i] * aec->y[i];
+	}
+	see = take_back ? sff : see;
+
+	// the power spectra of the echo estimate and what is left, and the leak between them
+	float pey = 0, pyy = 0;
+	aec_fft_tail(aec, aec->y, AEC_FRAME_SAMPLES);
+	for (int k = 0; k < AEC_BINS; k++) {
+		aec->echo_power[k] = aec->work[2 * k] * aec->work[2 * k] +
+		                     aec->work[2 * k + 1] * aec->work[2 * k + 1];
+	}
+	aec_fft_tail(aec, aec->e, AEC_FRAME_SAMPLES);
+	memcpy(aec->error, aec->work, 2 * AEC_BINS * sizeof(float));
+	for (int k = 0; k < AEC_BINS; k++) {
+		float er = aec->error[2 * k], ei = aec->error[2 * k + 1];
+		aec->error_power[k] = er * er + ei * ei;
+		float de = aec->error_power[k] - aec->error_mean[k];
+		float dy = aec->echo_power[k] - aec->echo_mean[k];
+		pey += de * dy;
+		pyy += dy * dy;
+		aec->error_mean[k] += AEC_SPEC_SMOOTH * de;
+		aec->echo_mean[k] += AEC_SPEC_SMOOTH * dy;
+	}
+	pyy = sqrtf(pyy);
+	pey = pyy > 0 ? pey / pyy : 0;
+	float rate = AEC_LEAK_RATE * syy;
+	if (rate > AEC_LEAK_RATE_MAX * see) {
+		rate = AEC_LEAK_RATE_MAX * see;
+	}
+	rate = see > 0 ? rate / see : 0;
+	aec->pey = (1 - rate) * aec->pey + rate * pey;
+	aec->pyy = (1 - rate) * aec->pyy + rate * pyy;
+	if (aec->pyy < 1) {
+		aec->pyy = 1;
+	}
+	if (aec->pey < AEC_MIN_LEAK * aec->pyy) {
+		aec->pey = AEC_MIN_LEAK * aec->pyy;
+	}
+	if (aec->pey > aec->pyy) {
+		aec->pey = aec->pyy;
+	}
+	aec->leak = aec->pey / aec->pyy;
+
+	// the residual echo to what is left, at least as much as is still correlated with the
+	// estimate
+	float rer = (0.0001f * far_energy + aec->leak * syy) / (see + 1);
+	float correlated = sey * sey / (1 + see * syy);
+	rer = rer < correlated ? correlated : rer;
+	rer = rer > 0.5f ? 0.5f : rer;
+
+	// the far end's power in each bin, over the partitions
+	memset(aec->far_power, 0, sizeof(aec->far_power));
+	for (uint32_t p = 0; p < parts; p++) {
+		const float *xp = aec->spectra + p * 2 * AEC_BINS;
+		for (int k = 0; k < AEC_BINS; k++) {
+			aec->far_power[k] += xp[2 * k] * xp[2 * k] + xp[2 * k + 1] * xp[2 * k + 1];
+		}
+	}
+
+	// the step of each bin, which the error is only part of the transform of
+	float scale = (float)AEC_FFT_SIZE / AEC_FRAME_SAMPLES;
+	if (aec->adapted) {
+		for (int k = 0; k < AEC_BINS; k++) {
+			float left = aec->error_power[k] + 1;
+			float r = aec->leak * aec->echo_power[k];
+			r = r > left / 2 ? left / 2 : r;
+			r = 0.7f * r + 0.3f * rer * left;
+			aec->steps[k] = scale * r / (left * (aec->far_power[k] + AEC_BIN_FLOOR));
+		}
+	} else {
+		float r = 0;
+		if (playing) {
+			r = 0.25f * far_energy;
+			r = r > see / 4 ? see / 4 : r;
+			r = see > 0 ? r / see : 0;
+		}
+		for (int k = 0; k < AEC_BINS; k++) {
+			aec->steps[k] = scale * r / (aec->far_power[k] + AEC_BIN_FLOOR);
+		}
+		aec->adapting += r;
+		aec->adapted = aec->adapting > parts && aec->leak > AEC_ADAPTED_LEAK;
+	}
+	for (uint32_t p = 0; p < parts; p++) {
+		const float *xp = aec->spectra + ((aec->newest + parts - p) % parts) * 2 * AEC_BINS;
+		float       *wp = aec->weights + p * 2 * AEC_BINS;
+		for (int k = 0; k < AEC_BINS; k++) {
+			float xr = xp[2 * k], xi = xp[2 * k + 1];
+			float er = aec->error[2 * k], ei = aec->error[2 * k + 1];
+			wp[2 * k] += aec->steps[k] * (xr * er + xi * ei);
+			wp[2 * k + 1] += aec->steps[k] * (xr * ei - xi * er);
+		}
+	}
+	aec_constrain(aec, aec->constrain);
+	aec->constrain = (aec->constrain + 1) % parts;
+
+	// suppressed by the share of what is left that is echo, over the frame so as not to click
+	float residual = aec->leak * syy;
+	float target = see_out > residual ? 1 - residual / see_out : 0;
+	target = target < aec->min_gain ? aec->min_gain : target;
+	bool alone = playing && see_out <= AEC_DOUBLE_TALK * residual;
+	if (playing && !alone) {
+		st->double_talk++;
+	}
+	float step = (target - aec->gain) / AEC_FRAME_SAMPLES;
+	for (int i = 0; i < AEC_FRAME_SAMPLES; i++) {
+		aec->gain += step;
+		out[i] = aec_round(aec->out[i] * aec->gain);
+		if (alone) {
+			int32_t r = aec_round(aec->out[i]);
+			st->echo_in += (uint32_t)(near[i] * near[i]);
+			st->echo_out += (uint32_t)(r * r);
+			st->echo_suppressed += (uint32_t)(out[i] * out[i]);
+		}
+	}
+	aec->gain = target;
+}
+
+uint32_t aec_peak_delay(aec_t *aec) {
+	uint32_t peak = 0;
+	float    loudest = 0;
+	for (uint32_t p = 0; p < aec->partitions; p++) {
+		aec_ifft_bins(aec, aec->weights + p * 2 * AEC_BINS);
+		for (int i = 0; i < AEC_FRAME_SAMPLES; i++) {
+			float w = fabsf(aec->work[2 * i]);
+			if (w > loudest) {
+				loudest = w;
+				peak = p * AEC_FRAME_SAMPLES + i;
+			}
+		}
+	}
+	return peak;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+/*
+ * Acoustic echo cancellation of the badge's own speaker in its microphone, on 16 kHz, 16-bit
+ * mono PCM in 10 ms frames.
+ *
+ * The far end, what the speaker played, goes through an adaptive filter of tail_ms that models
+ * the path from the speaker to the microphone, and the filter's estimate of the echo is taken
+ * off the microphone. The far end has to reach aec_process() no later than its echo, and the
+ * echo has to fit in the filter after it. The filter is in the frequency domain, a partition a
+ * frame long for each frame of the tail, filtered by overlap-save on FFTs of AEC_FFT_SIZE
+ * points (fft.h). It adapts every frame, each bin by its share of the error normalized by the
+ * far end's power in it, which converges on speech much faster than a filter in the time
+ * domain, for a fraction of the multiply-adds. Each frame, one of the partitions is brought
+ * back to a frame's length in the time domain.
+ *
+ * How fast it adapts follows how much of what it leaves is still echo, after Valin, "On
+ * adjusting the learning rate in frequency domain echo cancellation with double-talk" (2007).
+ * The leak, the share of the echo it misses, comes from regressing the power spectrum of what
+ * is left on that of the echo estimate, over frames. Each bin then adapts by the share of what
+ * is left in it that the leaked echo makes up, so that when the wearer talks over the far end
+ * the filter holds still, without a double-talk detector. Until it has adapted enough for the
+ * leak to mean something, it adapts at a rate set by the far end's power against what is left.
+ *
+ * What holds still is not quite still, so what goes out is what a second copy of the filter
+ * leaves, which is only ever replaced by the one adapting when that leaves clearly less, and
+ * which the one adapting goes back to when it leaves clearly more, after Valin too.
+ *
+ * What the filter leaves of the echo, by the leak, is suppressed by up to suppress_db, so that
+ * the far end alone is suppressed and the wearer talking over it is not.
+ */
+
+#include "esp_err.h"
+#include "fft.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AEC_SAMPLE_RATE 16000
+#define AEC_FRAME_SAMPLES 160 // 10 ms, and the length of a partition of the filter
+#define AEC_FRAME_MS (AEC_FRAME_SAMPLES * 1000 / AEC_SAMPLE_RATE)
+#define AEC_FFT_BITS 9
+#define AEC_FFT_SIZE (1 << AEC_FFT_BITS) // at least a frame and a partition
+#define AEC_BINS (AEC_FFT_SIZE / 2 + 1)
+#define AEC_MAX_TAIL_MS 120
+#define AEC_FAR_DBFS -60    // a frame of the far end quieter than this is not playing
+#define AEC_MIN_LEAK 0.005f // the most the echo is taken to be cancelled by, 23 dB
+
+typedef struct {
+	uint32_t tail_ms;     // longest echo cancelled, a multiple of AEC_FRAME_MS
+	uint32_t suppress_db; // most the echo left is suppressed by
+} aec_cfg_t;
+
+typedef struct {
+	uint32_t frames;
+	uint32_t far_frames;  // with the far end playing
+	uint32_t double_talk; // of those, with more left than the leaked echo, e.g. the wearer
+	uint32_t resets;      // of the filter adapting to the one in use, after it diverged
+	// sums of squared samples of the frames of the far end alone: of the microphone, of what
+	// the filter leaves, and of what goes out
+	uint64_t echo_in;
+	uint64_t echo_out;
+	uint64_t echo_suppressed;
+} aec_stats_t;
+
+typedef struct {
+	fft_t    fft;
+	uint32_t partitions;
+	float    far_min;  // energy of a frame of the far end below which it is not playing
+	float    min_gain; // of suppression
+
+	int16_t  far[AEC_FFT_SIZE];   // the last AEC_FFT_SIZE samples of the far end, oldest first
+	uint32_t far_quiet;           // frames since the far end last played anything
+	float   *spectra;             // of `far` over the last `partitions` frames, AEC_BINS each
+	uint32_t newest;              // of them
+	float   *weights;             // of the partitions, AEC_BINS each, the first for no delay
+	float   *fore;                // the same of the filter in use, which `weights` takes over
+	uint32_t constrain;           // partition brought back to a frame's length next
+	float    far_power[AEC_BINS]; // power of the far end in each bin, over the partitions
+
+	float work[2 * AEC_FFT_SIZE];    // re, im
+	float y[AEC_FRAME_SAMPLES];      // echo estimate of the filter adapting,
+	float fore_y[AEC_FRAME_SAMPLES]; // and of the one in use
+	float e[AEC_FRAME_SAMPLES];      // what the filter adapting leaves,
+	float out[AEC_FRAME_SAMPLES];    // and what goes out
+	float error[2 * AEC_BINS];       // spectrum of `e`
+	float error_power[AEC_BINS];     // power spectrum of it,
+	float echo_power[AEC_BINS];      // and of `y`
+	float error_mean[AEC_BINS];      // smoothed power spectra of the two
+	float echo_mean[AEC_BINS];
+	float steps[AEC_BINS];           // of the update of each bin
+	float pey, pyy;                  // smoothed covariance of the two and variance of the echo
+	float leak;
+	float diff_fast, diff_slow;      // smoothed difference in what the two filters leave,
+	float var_fast, var_slow;        // and how much it varies by chance
+	float adapting;                  // sum of the rates adapted at before the leak settled
+	bool  adapted;                   // enough for the leak to set the rate
+	float gain;                      // of suppression at the end of the last frame
+
+	aec_stats_t stats;
+} aec_t;
+
+/*
+ * Allocates the filter for cfg->tail_ms, and starts with it at 0. Returns ESP_ERR_INVALID_ARG if
+ * the tail is not a multiple of AEC_FRAME_MS up to AEC_MAX_TAIL_MS, or ESP_ERR_NO_MEM.
+ */
+esp_err_t aec_init(aec_t *aec, const aec_cfg_t *cfg);
+void      aec_deinit(aec_t *aec);
+
+/*
+ * Forgets the far end, e.g. when the stream restarts. Keeps the filter, since the echo path of
+ * the badge stays the same, and the counters.
+ */
+void aec_reset(aec_t *aec);
+
+/*
+ * Cancels the echo of `far` in one frame of AEC_FRAME_SAMPLES samples of the microphone `near`,
+ * into `out`. `far` holds what the speaker played at the same time, or is NULL if it played
+ * nothing.
+ */
+void aec_process(aec_t *aec, const int16_t *near, const int16_t *far, int16_t *out);
+
+/*
+ * Returns how far back the loudest tap of the filter is, in samples, which is where the echo
+ * arrives at its loudest.
+ */
+uint32_t aec_peak_delay(aec_t *aec);
@@ -0,0 +1,169 @@
+#include "aec_stage.h"
+#include "esp_log.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AEC_FRAME_BYTES (AEC_FRAME_SAMPLES * sizeof(int16_t))
+
+static const char *TAG = "aec_stage";
+
+typedef struct {
+	frame_stage_t stage;
+	aec_t         aec;
+	int16_t       far[AEC_FRAME_SAMPLES];
+	int16_t       out[AEC_FRAME_SAMPLES];
+	uint32_t      delay; // samples
+
+	int16_t  ring[AEC_STAGE_RING_SAMPLES];
+	uint32_t written; // samples of the far end ever handed over; shared, atomics
+	uint32_t seen;    // `written` at the last frame
+	uint32_t read;    // sample of the far end that goes with the next frame
+	bool     aligned;
+
+	uint32_t alignments;
+	bool     far_last;   // the far end played in the last frame
+	uint64_t far_cycles; // of stage.cycles, in frames with the far end playing
+} aec_stage_t;
+
+/*
+ * Returns 10 log10(a / b) in tenths of a dB.
+ */
+static int32_t aec_stage_db10(uint64_t a, uint64_t b) {
+	return lroundf(100 * log10f((a + 1.0f) / (b + 1.0f)));
+}
+
+/*
+ * Adds the cycles of the last frame to far_cycles if the far end played in it, which is only
+ * known once frame_stream.c has counted them.
+ */
+static void aec_stage_count_far(aec_stage_t *as) {
+	if (as->far_last) {
+		as->far_cycles += as->stage.frame_cycles;
+		as->far_last = false;
+	}
+}
+
+static void aec_stage_open(frame_stage_t *self) {
+	aec_stage_t *as = (aec_stage_t *)self->data;
+	aec_reset(&as->aec);
+	as->aligned = false;
+	as->far_last = false;
+	as->seen = __atomic_load_n(&as->written, __ATOMIC_ACQUIRE);
+}
+
+static void aec_stage_close(frame_stage_t *self) {
+	aec_stage_t *as = (aec_stage_t *)self->data;
+	aec_stats_t *st = &as->aec.stats;
+	aec_stage_count_far(as);
+	if (st->frames > 0) {
+		int32_t  erle = aec_stage_db10(st->echo_in, st->echo_out);
+		int32_t  total = aec_stage_db10(st->echo_in, st->echo_suppressed);
+		uint32_t quiet = st->frames - st->far_frames;
+		ESP_LOGI(TAG,
+		         "aec_stage_close: %lu frames, far end in %lu, double talk in %lu, ERLE "
+		         "%s%ld.%ld dB, %s%ld.%ld dB with suppression, echo peaks at %lu ms, "
+		         "%lu alignments, %lu resets",
+		         st->frames, st->far_frames, st->double_talk, erle < 0 ? "-" : "",
+		         labs(erle) / 10, labs(erle) % 10, total < 0 ? "-" : "", labs(total) / 10,
+		         labs(total) % 10, aec_peak_delay(&as->aec) * 1000 / AEC_SAMPLE_RATE,
+		         as->alignments, st->resets);
+		ESP_LOGI(TAG,
+		         "aec_stage_close: %llu cycles per frame with the far end playing, %llu "
+		         "without",
+		         st->far_frames > 0 ? as->far_cycles / st->far_frames : 0,
+		         quiet > 0 ? (self->cycles - as->far_cycles) / quiet : 0);
+	}
+}
+
+/*
+ * Returns the frame of the far end that goes with the frame of the microphone just read, or
+ * NULL if the speaker is not playing.
+ */
+static const int16_t *aec_stage_far_frame(aec_stage_t *as) {
+	uint32_t written = __atomic_load_n(&as->written, __ATOMIC_ACQUIRE);
+	bool     started = written != as->seen;
+	as->seen = written;
+
+	uint32_t ahead = written - as->read;
+	if (as->aligned && (ahead < AEC_FRAME_SAMPLES || ahead > AEC_STAGE_RING_SAMPLES)) {
+		// the far end stopped, or this fell a ring behind it
+		as->aligned = false;
+	}
+	if (!as->aligned) {
+		if (!started) {
+			return NULL;
+		}
+		as->read = written - as->delay;
+		as->aligned = true;
+		as->alignments++;
+	}
+
+	for (int i = 0; i < AEC_FRAME_SAMPLES; i++) {
+		as->far[i] = as->ring[(as->read + i) % AEC_STAGE_RING_SAMPLES];
+	}
+	as->read += AEC_FRAME_SAMPLES;
+	return as->far;
+}
+
+static size_t aec_stage_process(frame_stage_t *self, int16_t *in, int16_t **out) {
+	aec_stage_t *as = (aec_stage_t *)self->data;
+	aec_stage_count_far(as);
+
+	const int16_t *far = aec_stage_far_frame(as);
+	uint32_t       far_frames = as->aec.stats.far_frames;
+	aec_process(&as->aec, in, far, as->out);
+	as->far_last = as->aec.stats.far_frames != far_frames;
+	*out = as->out;
+	return AEC_FRAME_BYTES;
+}
+
+static void aec_stage_destroy(frame_stage_t *self) {
+	aec_stage_t *as = (aec_stage_t *)self->data;
+	aec_deinit(&as->aec);
+	free(as);
+}
+
+frame_stage_t *aec_stage_init(const aec_stage_cfg_t *cfg) {
+	aec_stage_t *as = calloc(1, sizeof(aec_stage_t));
+	if (as == NULL) {
+		ESP_LOGE(TAG, "aec_stage_init: Out of memory");
+		return NULL;
+	}
+	if (aec_init(&as->aec, &cfg->aec) != ESP_OK) {
+		ESP_LOGE(TAG, "aec_stage_init: Failed to allocate the filter");
+		free(as);
+		return NULL;
+	}
+	as->delay = cfg->delay_ms * AEC_SAMPLE_RATE / 1000;
+	if (as->delay + AEC_FRAME_SAMPLES > AEC_STAGE_RING_SAMPLES) {
+		as->delay = AEC_STAGE_RING_SAMPLES - AEC_FRAME_SAMPLES;
+	}
+
+	as->stage = (frame_stage_t){
+	    .frame_bytes = AEC_FRAME_BYTES,
+	    .data = as,
+	    .open = aec_stage_open,
+	    .close = aec_stage_close,
+	    .destroy = aec_stage_destroy,
+	    .process = aec_stage_process,
+	};
+	return &as->stage;
+}
+
+void aec_stage_far_end(frame_stage_t *self, const int16_t *samples, size_t n) {
+	aec_stage_t *as = (aec_stage_t *)self->data;
+	// only this task writes `written`, so it reads its own last store
+	uint32_t written = __atomic_load_n(&as->written, __ATOMIC_RELAXED);
+	for (size_t i = 0; i < n; i++) {
+		as->ring[(written + i) % AEC_STAGE_RING_SAMPLES] = samples[i];
+	}
+	__atomic_store_n(&as->written, written + n, __ATOMIC_RELEASE);
+}
+
+aec_stage_stats_t aec_stage_get_stats(const frame_stage_t *self) {
+	aec_stage_t      *as = (aec_stage_t *)self->data;
+	aec_stage_stats_t ret = {
+	    .aec = as->aec.stats, .alignments = as->alignments, .cycles = self->cycles};
+	return ret;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+/*
+ * Stage of a frame_stream.h element that cancels the echo of the badge's speaker, see aec.h.
+ * Goes after the beamformer in the DSP of the TX pipeline and before the noise suppressor, and
+ * takes 16 kHz, 16-bit mono PCM.
+ *
+ * The far end comes from the RX pipeline through aec_stage_far_end(), as it is handed to the
+ * DAC, into a ring of AEC_STAGE_RING_SAMPLES. Both run off the same I2S clock, so once the
+ * stage has lined a frame of the microphone up with the far end `delay_ms` before the latest
+ * handed over, it takes the next frame of each together. It lines them up again whenever the
+ * far end has stopped and started, or the ring ran over.
+ */
+
+#include "aec.h"
+#include "frame_stream.h"
+
+#define AEC_STAGE_RING_SAMPLES 16384 // a second of the far end
+
+typedef struct {
+	aec_cfg_t aec;
+	uint32_t  delay_ms; // from handing the far end over until its echo reaches the stage
+} aec_stage_cfg_t;
+
+typedef struct {
+	aec_stats_t aec;
+	uint32_t    alignments; // times the far end was lined up with the microphone
+	uint64_t    cycles;     // CPU cycles spent in the stage
+} aec_stage_stats_t;
+
+/*
+ * Creates the stage with `cfg`, or returns NULL.
+ */
+frame_stage_t *aec_stage_init(const aec_stage_cfg_t *cfg);
+
+/*
+ * Hands the stage `n` samples the speaker is about to play. Called from the task of the
+ * element that feeds the DAC, a frame at a time.
+ */
+void aec_stage_far_end(frame_stage_t *self, const int16_t *samples, size_t n);
+
+/*
+ * Returns counters since the stage was created.
+ */
+aec_stage_stats_t aec_stage_get_stats(const frame_stage_t *self);
@@ -0,0 +1,149 @@
+#include "agc.h"
+#include <math.h>
+#include <string.h>
+
+#define AGC_FULL_SCALE 32768.0f
+#define AGC_CLIP_SAMPLES 2 // at full scale in a frame for the ADC to count as clipping
+
+esp_err_t agc_init(agc_t *agc, const agc_cfg_t *cfg) {
+	memset(agc, 0, sizeof(*agc));
+	agc->cfg = *cfg;
+	agc->attack = 1.0f - expf(-(float)AGC_FRAME_MS / (cfg->attack_ms > 0 ? cfg->attack_ms : 1));
+	agc->release =
+	    1.0f - expf(-(float)AGC_FRAME_MS / (cfg->release_ms > 0 ? cfg->release_ms : 1));
+	agc->limit_release = 6.0f * AGC_FRAME_MS / AGC_LIMIT_RELEASE_MS;
+	agc_reset(agc);
+	return ESP_OK;
+}
+
+void agc_reset(agc_t *agc) {
+	// unity gain until there is speech to measure
+	agc->envelope_db = agc->cfg.target_dbfs;
+	agc->floor_db = 0;
+	agc->limit_db = 0;
+	agc->gain_q16 = 1 << 16;
+	agc->want_more = 0;
+	agc->want_less = 0;
+	agc->settle = 0;
+}
+
+void agc_analog_stepped(agc_t *agc, float db) {
+	agc->envelope_db += db;
+	agc->floor_db += db;
+}
+
+/*
+ * Returns the analog step wanted after a frame that wanted `want` dB of gain and had `clipped`
+ * samples at full scale.
+ */
+static int agc_analog_step(agc_t *agc, bool speech, float want, uint32_t clipped) {
+	if (speech) {
+		agc->want_more = want > agc->cfg.max_gain_db ? agc->want_more + 1 : 0;
+		agc->want_less = want < AGC_MIN_GAIN_DB ? agc->want_less + 1 : 0;
+	}
+	if (!agc->cfg.analog) {
+		return 0;
+	}
+	if (agc->settle > 0) {
+		agc->settle--;
+		return 0;
+	}
+
+	int step = 0;
+	if (clipped >= AGC_CLIP_SAMPLES || agc->want_less >= AGC_ANALOG_HOLD_MS / AGC_FRAME_MS) {
+		step = -1;
+		agc->stats.analog_down++;
+	} else if (agc->want_more >= AGC_ANALOG_HOLD_MS / AGC_FRAME_MS) {
+		step = 1;
+		agc->stats.analog_up++;
+	} else {
+		return 0;
+	}
+	agc->want_more = 0;
+	agc->want_less = 0;
+	agc->settle = AGC_ANALOG_SETTLE_MS / AGC_FRAME_MS;
+	return step;
+}
+
+uint32_t agc_count_clipped(const int16_t *samples, size_t n) {
+	uint32_t clipped = 0;
+	for (size_t i = 0; i < n; i++) {
+		clipped += samples[i] >= INT16_MAX || samples[i] <= -INT16_MAX;
+	}
+	return clipped;
+}
+
+int agc_process(agc_t *agc, int16_t *frame, uint32_t clipped) {
+	agc_stats_t *st = &agc->stats;
+	st->frames++;
+
+	uint64_t square = 0;
+	int32_t  peak = 0;
+	for (int i = 0; i < AGC_FRAME_SAMPLES; i++) {
+		int32_t s = frame[i];
+		int32_t a = s < 0 ? -s : s;
+		square += (uint32_t)(s * s);
+		if (a > peak) {
+			peak = a;
+		}
+	}
+	st->clipped_in += clipped;
+
+	float level = 10.0f * log10f((float)square / AGC_FRAME_SAMPLES /
+	                                 (AGC_FULL_SCALE * AGC_FULL_SCALE) +
+	                             1e-10f);
+	if (agc->floor_db == 0 || level < agc->floor_db) {
+		agc->floor_db = level;
+	} else {
+		agc->floor_db += AGC_FLOOR_RISE_DB * AGC_FRAME_MS / 1000.0f;
+	}
+	bool speech = level > AGC_GATE_DBFS && level > agc->floor_db + AGC_SPEECH_DB;
+	if (speech) {
+		st->active_frames++;
+		float k = level > agc->envelope_db ? agc->attack : agc->release;
+		agc->envelope_db += (level - agc->envelope_db) * k;
+	}
+	float want = agc->cfg.target_dbfs - agc->envelope_db;
+	float gain = want;
+	if (gain > (float)agc->cfg.max_gain_db) {
+		gain = agc->cfg.max_gain_db;
+	} else if (gain < AGC_MIN_GAIN_DB) {
+		gain = AGC_MIN_GAIN_DB;
+	}
+	int step = agc_analog_step(agc, speech, want, clipped);
+
+	// the limiter gives back a little each frame, and cuts at once what the peak needs
+	agc->limit_db += agc->limit_release;
+	if (agc->limit_db > 0) {
+		agc->limit_db = 0;
+	}
+	float peak_db = 20.0f * log10f(peak / AGC_FULL_SCALE + 1e-10f);
+	float over = peak_db + gain + agc->limit_db - AGC_LIMIT_DBFS;
+	if (over > 0) {
+		agc->limit_db -= over;
+		st->limited_frames++;
+	}
+	float applied = gain + agc->limit_db;
+
+	// ramps a rise over the frame, but applies a cut from the first sample, where the peak
+	// may be
+	int32_t g = (int32_t)(65536.0f * powf(10.0f, applied / 20.0f) + 0.5f);
+	int32_t g0 = g < agc->gain_q16 ? g : agc->gain_q16;
+	for (int i = 0; i < AGC_FRAME_SAMPLES; i++) {
+		int64_t gi = g0 + (int64_t)(g - g0) * (i + 1) / AGC_FRAME_SAMPLES;
+		int64_t v = (frame[i] * gi + (1 << 15)) >> 16;
+		if (v > INT16_MAX) {
+			v = INT16_MAX;
+			st->clipped_out++;
+		} else if (v < INT16_MIN) {
+			v = INT16_MIN;
+			st->clipped_out++;
+		}
+		frame[i] = v;
+	}
+	agc->gain_q16 = g;
+
+	st->gain_db10 = (int32_t)lroundf(applied * 10);
+	st->level_db10 = (int32_t)lroundf(agc->envelope_db * 10);
+	return step;
+}
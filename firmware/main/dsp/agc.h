@@ -0,0 +1,102 @@
+#pragma once
+
+/*
+ * Automatic gain control of the microphone, on 16 kHz, 16-bit mono PCM in 10 ms frames.
+ *
+ * The level of each frame, its RMS in dBFS, is followed by an envelope that rises with
+ * attack_ms and falls with release_ms, and the gain brings the envelope to target_dbfs, within
+ * AGC_MIN_GAIN_DB and max_gain_db. Frames less than AGC_SPEECH_DB above the noise floor, or
+ * below AGC_GATE_DBFS, are background, and hold the envelope where it was, so that the gain
+ * does not creep up between sentences and raise the noise. The noise floor follows quiet
+ * frames down at once and rises AGC_FLOOR_RISE_DB a second. A limiter after the gain keeps
+ * peaks below AGC_LIMIT_DBFS: it cuts the gain at once for a frame that would go over, and
+ * lets it back up over AGC_LIMIT_RELEASE_MS.
+ *
+ * The digital gain cannot undo clipping in the ADC, nor lift a quiet speaker out of its noise. So
+ * agc_process() asks for the analog gain in front of the ADC to go down when the ADC clips, or when
+ * the wanted gain has been below AGC_MIN_GAIN_DB for AGC_ANALOG_HOLD_MS, and up when it has been
+ * above max_gain_db that long. Once the caller has changed it, agc_analog_stepped() moves the
+ * envelope along, so that the output level does not jump.
+ *
+ * Whatever runs between the ADC and the AGC, such as the beamformer, echo canceller and noise
+ * suppressor, takes the flat tops off clipped samples, so the caller counts them with
+ * agc_count_clipped() on the frames as the ADC gave them.
+ */
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AGC_SAMPLE_RATE 16000
+#define AGC_FRAME_SAMPLES 160 // 10 ms
+#define AGC_FRAME_MS (AGC_FRAME_SAMPLES * 1000 / AGC_SAMPLE_RATE)
+#define AGC_MIN_GAIN_DB -12
+#define AGC_GATE_DBFS -60        // frames quieter than this leave the gain alone
+#define AGC_SPEECH_DB 6          // and so do frames less than this above the noise floor
+#define AGC_FLOOR_RISE_DB 3      // per second
+#define AGC_LIMIT_DBFS -1        // most the peaks may reach
+#define AGC_LIMIT_RELEASE_MS 50  // per 6 dB the limiter gives back
+#define AGC_ANALOG_HOLD_MS 2000  // of wanting more gain before asking for analog gain
+#define AGC_ANALOG_SETTLE_MS 100 // after an analog step before asking for another
+
+typedef struct {
+	int32_t  target_dbfs; // level of speech out
+	uint32_t max_gain_db; // most digital gain
+	uint32_t attack_ms;   // for the envelope to follow a rise in level
+	uint32_t release_ms;  // and a fall
+	bool     analog;      // ask for steps of the analog gain
+} agc_cfg_t;
+
+typedef struct {
+	uint32_t frames;
+	uint32_t active_frames;  // speech, which the gain follows
+	uint32_t limited_frames; // with the limiter below the gain of the AGC
+	uint32_t clipped_in;     // samples at full scale from the ADC
+	uint32_t clipped_out;    // samples that still went over full scale, ideally none
+	uint32_t analog_up;      // steps asked for
+	uint32_t analog_down;
+	int32_t  gain_db10;      // gain applied now, in tenths of a dB
+	int32_t  level_db10;     // envelope now, in tenths of a dBFS
+} agc_stats_t;
+
+typedef struct {
+	agc_cfg_t cfg;
+	float     attack, release; // share of the gap the envelope closes per frame
+	float     limit_release;   // dB the limiter gives back per frame
+
+	float    envelope_db; // level of the speech in, in dBFS
+	float    floor_db;    // level of the background in, in dBFS; 0 before the first frame
+	float    limit_db;    // cut by the limiter, 0 or less
+	int32_t  gain_q16;    // applied at the end of the last frame
+	uint32_t want_more;   // speech frames in a row that wanted more than max_gain_db
+	uint32_t want_less;   // and less than AGC_MIN_GAIN_DB
+	uint32_t settle;      // frames left before another analog step
+
+	agc_stats_t stats;
+} agc_t;
+
+esp_err_t agc_init(agc_t *agc, const agc_cfg_t *cfg);
+
+/*
+ * Forgets the level, e.g. when the stream restarts. Keeps the counters.
+ */
+void agc_reset(agc_t *agc);
+
+/*
+ * Returns how many of the `n` samples are at full scale.
+ */
+uint32_t agc_count_clipped(const int16_t *samples, size_t n);
+
+/*
+ * Applies the gain to one frame of AGC_FRAME_SAMPLES samples in place. `clipped` is how many
+ * samples of what the ADC gave for the frame were at full scale, from agc_count_clipped().
+ * Returns the analog step wanted: 1 for more gain, -1 for less, 0 for none.
+ */
+int agc_process(agc_t *agc, int16_t *frame, uint32_t clipped);
+
+/*
+ * Tells the AGC that the analog gain changed by `db`, so that it expects the input that much
+ * louder.
+ */
+void agc_analog_stepped(agc_t *agc, float db);
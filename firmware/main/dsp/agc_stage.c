@@ -0,0 +1,116 @@
+#include "agc_stage.h"
+#include "esp_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define AGC_FRAME_BYTES (AGC_FRAME_SAMPLES * sizeof(int16_t))
+#define AGC_STAGE_LOG_FRAMES 1000 // 10 s, since the TX pipeline may never stop
+
+static const char *TAG = "agc_stage";
+
+typedef struct {
+	frame_stage_t      stage;
+	agc_t              agc;
+	agc_stage_analog_t analog;
+	float              analog_db;
+	uint32_t           clipped; // by the ADC in the frame the tap last passed
+} agc_stage_t;
+
+typedef struct {
+	frame_stage_t stage;
+	agc_stage_t  *agc;
+} agc_stage_tap_t;
+
+static void agc_stage_log(agc_stage_t *as, const char *when) {
+	agc_stats_t *st = &as->agc.stats;
+	ESP_LOGI(TAG,
+	         "%s: gain %s%ld.%ld dB, level %ld dBFS, %lu analog steps up and %lu down, %lu of "
+	         "%lu frames limited, %lu samples clipped in and %lu out, %llu cycles per frame",
+	         when, st->gain_db10 < 0 ? "-" : "", labs(st->gain_db10) / 10,
+	         labs(st->gain_db10) % 10, st->level_db10 / 10, st->analog_up, st->analog_down,
+	         st->limited_frames, st->frames, st->clipped_in, st->clipped_out,
+	         as->stage.cycles / st->frames);
+}
+
+static void agc_stage_open(frame_stage_t *self) {
+	agc_stage_t *as = (agc_stage_t *)self->data;
+	agc_reset(&as->agc);
+	as->clipped = 0;
+}
+
+static void agc_stage_close(frame_stage_t *self) {
+	agc_stage_t *as = (agc_stage_t *)self->data;
+	if (as->agc.stats.frames > 0) {
+		agc_stage_log(as, "agc_stage_close");
+	}
+}
+
+static size_t agc_stage_process(frame_stage_t *self, int16_t *in, int16_t **out) {
+	agc_stage_t *as = (agc_stage_t *)self->data;
+	int          step = agc_process(&as->agc, in, as->clipped);
+	if (step != 0 && as->analog != NULL) {
+		float db = as->analog(step);
+		if (db != 0) {
+			agc_analog_stepped(&as->agc, db);
+			as->analog_db += db;
+		}
+	}
+	if (as->agc.stats.frames % AGC_STAGE_LOG_FRAMES == 0) {
+		agc_stage_log(as, "agc_stage_process");
+	}
+	return AGC_FRAME_BYTES; // in place
+}
+
+static void agc_stage_destroy(frame_stage_t *self) {
+	free(self->data);
+}
+
+frame_stage_t *agc_stage_init(const agc_cfg_t *cfg, agc_stage_analog_t analog) {
+	agc_stage_t *as = calloc(1, sizeof(agc_stage_t));
+	if (as == NULL) {
+		ESP_LOGE(TAG, "agc_stage_init: Out of memory");
+		return NULL;
+	}
+	agc_init(&as->agc, cfg);
+	as->analog = cfg->analog ? analog : NULL;
+
+	as->stage = (frame_stage_t){
+	    .frame_bytes = AGC_FRAME_BYTES,
+	    .data = as,
+	    .open = agc_stage_open,
+	    .close = agc_stage_close,
+	    .destroy = agc_stage_destroy,
+	    .process = agc_stage_process,
+	};
+	return &as->stage;
+}
+
+static size_t agc_stage_tap_process(frame_stage_t *self, int16_t *in, int16_t **out) {
+	agc_stage_tap_t *ts = (agc_stage_tap_t *)self->data;
+	ts->agc->clipped = agc_count_clipped(in, self->frame_bytes / sizeof(int16_t));
+	return self->frame_bytes; // as it is
+}
+
+frame_stage_t *agc_stage_tap_init(frame_stage_t *agc, uint32_t channels) {
+	agc_stage_tap_t *ts = calloc(1, sizeof(agc_stage_tap_t));
+	if (ts == NULL) {
+		ESP_LOGE(TAG, "agc_stage_tap_init: Out of memory");
+		return NULL;
+	}
+	ts->agc = (agc_stage_t *)agc->data;
+
+	ts->stage = (frame_stage_t){
+	    .frame_bytes = AGC_FRAME_BYTES * channels,
+	    .data = ts,
+	    .destroy = agc_stage_destroy,
+	    .process = agc_stage_tap_process,
+	};
+	return &ts->stage;
+}
+
+agc_stage_stats_t agc_stage_get_stats(const frame_stage_t *self) {
+	agc_stage_t      *as = (agc_stage_t *)self->data;
+	agc_stage_stats_t ret = {.agc = as->agc.stats, .analog_db = as->analog_db,
+	                         .cycles = self->cycles};
+	return ret;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+ * Stage of a frame_stream.h element that evens out the level of the microphone, see agc.h.
+ * Goes last in the DSP of the TX pipeline, and takes 16 kHz, 16-bit mono PCM.
+ *
+ * Its tap goes first, right on the frames of the I2S reader, and counts the samples the ADC
+ * clipped for it.
+ */
+
+#include "agc.h"
+#include "frame_stream.h"
+
+/*
+ * Steps the analog gain in front of the ADC up for `step` 1 or down for -1, and returns by how
+ * many dB it changed, 0 at the end of its range.
+ */
+typedef float (*agc_stage_analog_t)(int step);
+
+typedef struct {
+	agc_stats_t agc;
+	float       analog_db; // analog gain changed by the AGC since the stage was created
+	uint64_t    cycles;    // CPU cycles spent in the stage
+} agc_stage_stats_t;
+
+/*
+ * Creates the stage with `cfg`, or returns NULL. With cfg->analog, `analog` is called from the
+ * element's task to step the analog gain.
+ */
+frame_stage_t *agc_stage_init(const agc_cfg_t *cfg, agc_stage_analog_t analog);
+
+/*
+ * Creates the tap of the AGC stage `agc`, which takes frames of `channels` microphones and
+ * passes them on as they are, or returns NULL.
+ */
+frame_stage_t *agc_stage_tap_init(frame_stage_t *agc, uint32_t channels);
+
+/*
+ * Returns counters since the stage was created.
+ */
+agc_stage_stats_t agc_stage_get_stats(const frame_stage_t *self);
@@ -0,0 +1,119 @@
+#include "audio_codec.h"
+#include "adpcm.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CONFIG_AUDIO_CODEC_OPUS
+#include "opus.h"
+#endif
+
+struct audio_codec {
+	audio_codec_cfg_t cfg;
+	adpcm_state_t     adpcm;
+#ifdef CONFIG_AUDIO_CODEC_OPUS
+	OpusEncoder *opus_enc;
+	OpusDecoder *opus_dec;
+#endif
+};
+
+const char *audio_codec_name(audio_codec_id_t id) {
+	switch (id) {
+	case AUDIO_CODEC_ADPCM:
+		return "adpcm";
+	case AUDIO_CODEC_OPUS:
+		return "opus";
+	default:
+		return "pcm";
+	}
+}
+
+esp_err_t audio_codec_create(const audio_codec_cfg_t *cfg, audio_codec_t **codec) {
+	audio_codec_t *c = calloc(1, sizeof(audio_codec_t));
+	if (c == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+	c->cfg = *cfg;
+
+	if (cfg->id == AUDIO_CODEC_OPUS) {
+#ifdef CONFIG_AUDIO_CODEC_OPUS
+		int err;
+		c->opus_enc = opus_encoder_create(16000, 1, OPUS_APPLICATION_VOIP, &err);
+		if (err == OPUS_OK) {
+			opus_encoder_ctl(c->opus_enc, OPUS_SET_BITRATE(cfg->bitrate));
+			opus_encoder_ctl(c->opus_enc, OPUS_SET_COMPLEXITY(cfg->complexity));
+			opus_encoder_ctl(c->opus_enc, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+			c->opus_dec = opus_decoder_create(16000, 1, &err);
+		}
+		if (err != OPUS_OK) {
+			audio_codec_destroy(c);
+			return ESP_ERR_NO_MEM;
+		}
+#else
+		free(c);
+		return ESP_ERR_NOT_SUPPORTED;
+#endif
+	}
+	*codec = c;
+	return ESP_OK;
+}
+
+void audio_codec_destroy(audio_codec_t *codec) {
+	if (codec == NULL) {
+		return;
+	}
+#ifdef CONFIG_AUDIO_CODEC_OPUS
+	if (codec->opus_enc != NULL) {
+		opus_encoder_destroy(codec->opus_enc);
+	}
+	if (codec->opus_dec != NULL) {
+		opus_decoder_destroy(codec->opus_dec);
+	}
+#endif
+	free(codec);
+}
+
+int audio_codec_encode(audio_codec_t *codec, const int16_t *pcm, uint8_t *packet) {
+	switch (codec->cfg.id) {
+	case AUDIO_CODEC_PCM:
+		memcpy(packet, pcm, AUDIO_CODEC_FRAME_SAMPLES * sizeof(int16_t));
+		return AUDIO_CODEC_FRAME_SAMPLES * sizeof(int16_t);
+	case AUDIO_CODEC_ADPCM:
+		return adpcm_encode(&codec->adpcm, pcm, AUDIO_CODEC_FRAME_SAMPLES, packet);
+#ifdef CONFIG_AUDIO_CODEC_OPUS
+	case AUDIO_CODEC_OPUS: {
+		int len = opus_encode(codec->opus_enc, pcm, AUDIO_CODEC_FRAME_SAMPLES, packet,
+		                      AUDIO_CODEC_MAX_PACKET);
+		return len > 0 ? len : -1;
+	}
+#endif
+	default:
+		return -1;
+	}
+}
+
+int audio_codec_decode(audio_codec_t *codec, const uint8_t *packet, size_t len, int16_t *pcm) {
+	switch (codec->cfg.id) {
+	case AUDIO_CODEC_PCM:
+		if (len % sizeof(int16_t) || len > AUDIO_CODEC_FRAME_SAMPLES * sizeof(int16_t)) {
+			return -1;
+		}
+		memcpy(pcm, packet, len);
+		return len / sizeof(int16_t);
+	case AUDIO_CODEC_ADPCM: {
+		size_t n = len <= ADPCM_BLOCK_LEN(AUDIO_CODEC_FRAME_SAMPLES)
+		               ? adpcm_decode(packet, len, pcm)
+		               : 0;
+		return n > 0 ? (int)n : -1;
+	}
+#ifdef CONFIG_AUDIO_CODEC_OPUS
+	case AUDIO_CODEC_OPUS: {
+		int samples = opus_decode(codec->opus_dec, packet, len, pcm,
+		                          AUDIO_CODEC_FRAME_SAMPLES, 0);
+		return samples > 0 ? samples : -1;
+	}
+#endif
+	default:
+		return -1;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ * Audio codecs for the links to the server, on 20 ms frames of 16 kHz, 16-bit mono PCM.
+ *
+ * On the wire, an encoded stream is a sequence of packets, each a 2-byte little-endian length
+ * and that many bytes. A packet of length 0 is a keepalive (see vad.h) and decodes to
+ * VAD_FRAME_SAMPLES zero samples. A stream of AUDIO_CODEC_PCM is plain samples without packets,
+ * as before there were codecs, but its codec still makes packets of plain samples for transports
+ * that need frames, like udp_stream.h.
+ *
+ * AUDIO_CODEC_ADPCM is IMA ADPCM (adpcm.h), 4:1 at almost no CPU cost. AUDIO_CODEC_OPUS is
+ * Opus in VoIP mode at a set bit rate, which takes far fewer bytes for far more CPU, and is
+ * only built with CONFIG_AUDIO_CODEC_OPUS.
+ */
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AUDIO_CODEC_FRAME_SAMPLES 320 // 20 ms
+#define AUDIO_CODEC_MAX_PACKET 1276   // longest Opus packet of one frame
+#define AUDIO_CODEC_PACKET_HDR_LEN 2
+
+typedef enum {
+	AUDIO_CODEC_PCM,
+	AUDIO_CODEC_ADPCM,
+	AUDIO_CODEC_OPUS,
+} audio_codec_id_t;
+
+typedef struct {
+	audio_codec_id_t id;
+	uint32_t         bitrate;    // Opus only, bits per second
+	uint8_t          complexity; // Opus only, 0..10
+} audio_codec_cfg_t;
+
+typedef struct audio_codec audio_codec_t;
+
+/*
+ * Returns the name used in the x-audio-codec header.
+ */
+const char *audio_codec_name(audio_codec_id_t id);
+
+/*
+ * Creates an encoder and decoder for `cfg`. Returns ESP_ERR_NOT_SUPPORTED for a codec that is
+ * not built in, or ESP_ERR_NO_MEM.
+ */
+esp_err_t audio_codec_create(const audio_codec_cfg_t *cfg, audio_codec_t **codec);
+
+void audio_codec_destroy(audio_codec_t *codec);
+
+/*
+ * Encodes one frame of AUDIO_CODEC_FRAME_SAMPLES samples into `packet`, which holds
+ * AUDIO_CODEC_MAX_PACKET bytes. Returns the packet length, or -1 on error.
+ */
+int audio_codec_encode(audio_codec_t *codec, const int16_t *pcm, uint8_t *packet);
+
+/*
+ * Decodes a packet into `pcm`, which holds AUDIO_CODEC_FRAME_SAMPLES samples. Returns the
+ * number of samples, or -1 if the packet is malformed.
+ */
+int audio_codec_decode(audio_codec_t *codec, const uint8_t *packet, size_t len, int16_t *pcm);
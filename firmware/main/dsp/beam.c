@@ -0,0 +1,75 @@
+#include "beam.h"
+#include <string.h>
+
+#define BEAM_HISTORY (BEAM_MAX_DELAY + 1)
+
+esp_err_t beam_init(beam_t *beam, const beam_cfg_t *cfg) {
+	memset(beam, 0, sizeof(*beam));
+	if (cfg->mics < 1 || cfg->mics > BEAM_MAX_MICS) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	beam->mics = cfg->mics;
+	for (uint32_t c = 0; c < cfg->mics; c++) {
+		if (cfg->delay_q8[c] >= BEAM_MAX_DELAY << 8) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		// the average of the microphones, split between the two samples around the delay
+		int32_t weight = (1 << 15) / cfg->mics;
+		int32_t frac = cfg->delay_q8[c] & 0xff;
+		beam->delay[c] = cfg->delay_q8[c] >> 8;
+		beam->tap[c][1] = weight * frac >> 8;
+		beam->tap[c][0] = weight - beam->tap[c][1];
+	}
+	beam_reset(beam);
+	return ESP_OK;
+}
+
+void beam_reset(beam_t *beam) {
+	memset(beam->history, 0, sizeof(beam->history));
+}
+
+void beam_line_delays(beam_cfg_t *cfg, uint32_t mics, uint32_t spacing_mm) {
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->mics = mics;
+	// sound from the mouth reaches microphone c c spacings after the first, so the ones
+	// before the last wait for it
+	for (uint32_t c = 0; c < mics && c < BEAM_MAX_MICS; c++) {
+		uint64_t mm_q8 = (uint64_t)(mics - 1 - c) * spacing_mm * BEAM_SAMPLE_RATE * 256;
+		cfg->delay_q8[c] =
+		    (mm_q8 + BEAM_SPEED_OF_SOUND * 1000 / 2) / (BEAM_SPEED_OF_SOUND * 1000);
+	}
+}
+
+void beam_process(beam_t *beam, const int16_t *in, int16_t *out) {
+	uint32_t mics = beam->mics;
+	int32_t  acc[BEAM_FRAME_SAMPLES];
+	memset(acc, 0, sizeof(acc));
+
+	// a channel at a time, so that the inner loop is a plain multiply-add over the frame
+	for (uint32_t c = 0; c < mics; c++) {
+		int16_t *x = beam->history[c];
+		for (int i = 0; i < BEAM_FRAME_SAMPLES; i++) {
+			x[BEAM_HISTORY + i] = in[i * mics + c];
+		}
+		const int16_t *x0 = x + BEAM_HISTORY - beam->delay[c];
+		const int16_t *x1 = x0 - 1;
+		int32_t        w0 = beam->tap[c][0], w1 = beam->tap[c][1];
+		for (int i = 0; i < BEAM_FRAME_SAMPLES; i++) {
+			acc[i] += w0 * x0[i] + w1 * x1[i];
+		}
+		memmove(x, x + BEAM_FRAME_SAMPLES, BEAM_HISTORY * sizeof(int16_t));
+	}
+
+	for (int i = 0; i < BEAM_FRAME_SAMPLES; i++) {
+		int32_t v = (acc[i] + (1 << 14)) >> 15;
+		if (v > INT16_MAX) {
+			v = INT16_MAX;
+			beam->stats.clipped++;
+		} else if (v < INT16_MIN) {
+			v = INT16_MIN;
+			beam->stats.clipped++;
+		}
+		out[i] = v;
+	}
+	beam->stats.frames++;
+}
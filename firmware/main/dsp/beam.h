@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+ * Delay-and-sum beamforming of several microphones into one, on 16 kHz, 16-bit PCM in 10 ms
+ * frames, in fixed point.
+ *
+ * The input is a frame of each microphone, interleaved like the I2S reader gives them. Each is
+ * delayed so that sound from the wearer's mouth lines up across them, and they are averaged:
+ * the speech adds up in phase, and the noise of each microphone and sound from elsewhere do
+ * not, so they come out quieter. Delays are in 1/256 samples, and a fraction of a sample is
+ * taken by linear interpolation between two samples, so each microphone costs two
+ * multiply-adds per sample.
+ *
+ * beam_line_delays() steers a line of microphones, the first nearest the mouth, towards it,
+ * taking the mouth as far away compared to the spacing.
+ */
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BEAM_SAMPLE_RATE 16000
+#define BEAM_FRAME_SAMPLES 160 // 10 ms
+#define BEAM_FRAME_MS (BEAM_FRAME_SAMPLES * 1000 / BEAM_SAMPLE_RATE)
+#define BEAM_MAX_MICS 4
+#define BEAM_MAX_DELAY 16       // samples, 34 cm of sound
+#define BEAM_SPEED_OF_SOUND 343 // m/s
+
+typedef struct {
+	uint32_t mics;                    // interleaved in the input, 1 to BEAM_MAX_MICS
+	uint32_t delay_q8[BEAM_MAX_MICS]; // of each, in 1/256 samples, below BEAM_MAX_DELAY
+} beam_cfg_t;
+
+typedef struct {
+	uint32_t frames;
+	uint32_t clipped; // samples of the sum that went over full scale, only by rounding
+} beam_stats_t;
+
+typedef struct {
+	uint32_t mics;
+	uint16_t delay[BEAM_MAX_MICS];  // whole samples
+	int32_t  tap[BEAM_MAX_MICS][2]; // Q15 weights of the sample at the delay and the one before
+
+	// the end of the last frame, then this frame, of each microphone
+	int16_t history[BEAM_MAX_MICS][BEAM_MAX_DELAY + 1 + BEAM_FRAME_SAMPLES];
+
+	beam_stats_t stats;
+} beam_t;
+
+/*
+ * Returns ESP_ERR_INVALID_ARG if there are too many microphones or a delay is too long.
+ */
+esp_err_t beam_init(beam_t *beam, const beam_cfg_t *cfg);
+
+/*
+ * Forgets the audio of the last frame, e.g. when the stream restarts. Keeps the counters.
+ */
+void beam_reset(beam_t *beam);
+
+/*
+ * Sets cfg->mics and the delays that steer a line of `mics` microphones `spacing_mm` apart,
+ * the first nearest the mouth, towards the mouth.
+ */
+void beam_line_delays(beam_cfg_t *cfg, uint32_t mics, uint32_t spacing_mm);
+
+/*
+ * Beamforms one frame of BEAM_FRAME_SAMPLES samples of each microphone, interleaved in `in`,
+ * into BEAM_FRAME_SAMPLES samples in `out`.
+ */
+void beam_process(beam_t *beam, const int16_t *in, int16_t *out);
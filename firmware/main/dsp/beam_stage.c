@@ -0,0 +1,71 @@
+#include "beam_stage.h"
+#include "esp_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BEAM_FRAME_BYTES (BEAM_FRAME_SAMPLES * sizeof(int16_t))
+
+static const char *TAG = "beam_stage";
+
+typedef struct {
+	frame_stage_t stage;
+	beam_t        beam;
+	int16_t       out[BEAM_FRAME_SAMPLES];
+} beam_stage_t;
+
+static void beam_stage_open(frame_stage_t *self) {
+	beam_stage_t *bs = (beam_stage_t *)self->data;
+	beam_reset(&bs->beam);
+}
+
+static void beam_stage_close(frame_stage_t *self) {
+	beam_stage_t *bs = (beam_stage_t *)self->data;
+	beam_stats_t *st = &bs->beam.stats;
+	if (st->frames > 0) {
+		ESP_LOGI(TAG,
+		         "beam_stage_close: %lu frames of %lu microphones, %lu samples clipped, "
+		         "%llu cycles per frame",
+		         st->frames, bs->beam.mics, st->clipped, self->cycles / st->frames);
+	}
+}
+
+static size_t beam_stage_process(frame_stage_t *self, int16_t *in, int16_t **out) {
+	beam_stage_t *bs = (beam_stage_t *)self->data;
+	beam_process(&bs->beam, in, bs->out);
+	*out = bs->out;
+	return BEAM_FRAME_BYTES;
+}
+
+static void beam_stage_destroy(frame_stage_t *self) {
+	free(self->data);
+}
+
+frame_stage_t *beam_stage_init(const beam_cfg_t *cfg) {
+	beam_stage_t *bs = calloc(1, sizeof(beam_stage_t));
+	if (bs == NULL) {
+		ESP_LOGE(TAG, "beam_stage_init: Out of memory");
+		return NULL;
+	}
+	if (beam_init(&bs->beam, cfg) != ESP_OK) {
+		ESP_LOGE(TAG, "beam_stage_init: %lu microphones or their delays out of range",
+		         cfg->mics);
+		free(bs);
+		return NULL;
+	}
+
+	bs->stage = (frame_stage_t){
+	    .frame_bytes = BEAM_FRAME_BYTES * cfg->mics,
+	    .data = bs,
+	    .open = beam_stage_open,
+	    .close = beam_stage_close,
+	    .destroy = beam_stage_destroy,
+	    .process = beam_stage_process,
+	};
+	return &bs->stage;
+}
+
+beam_stage_stats_t beam_stage_get_stats(const frame_stage_t *self) {
+	beam_stage_t      *bs = (beam_stage_t *)self->data;
+	beam_stage_stats_t ret = {.beam = bs->beam.stats, .cycles = self->cycles};
+	return ret;
+}
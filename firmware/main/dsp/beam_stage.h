@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+ * Stage of a frame_stream.h element that beamforms the microphones into one, see beam.h. Goes
+ * first in the DSP of the TX pipeline, takes 16 kHz, 16-bit PCM with a channel per microphone,
+ * and gives mono to the rest of it.
+ */
+
+#include "beam.h"
+#include "frame_stream.h"
+
+typedef struct {
+	beam_stats_t beam;
+	uint64_t     cycles; // CPU cycles spent in the stage
+} beam_stage_stats_t;
+
+/*
+ * Creates the stage with `cfg`, or returns NULL.
+ */
+frame_stage_t *beam_stage_init(const beam_cfg_t *cfg);
+
+/*
+ * Returns counters since the stage was created.
+ */
+beam_stage_stats_t beam_stage_get_stats(const frame_stage_t *self);
@@ -0,0 +1,198 @@
+#include "codec_stream.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "vad.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "codec_stream";
+
+typedef struct {
+	codec_stream_cfg_t   cfg;
+	audio_codec_t       *codec;
+	int16_t              pcm[AUDIO_CODEC_FRAME_SAMPLES];
+	size_t               pcm_fill; // encoder: samples of the frame so far
+	uint8_t              in[AUDIO_CODEC_PACKET_HDR_LEN + AUDIO_CODEC_MAX_PACKET];
+	size_t               in_fill; // bytes of `in` read so far
+	uint8_t              packet[AUDIO_CODEC_PACKET_HDR_LEN + AUDIO_CODEC_MAX_PACKET];
+	codec_stream_stats_t stats;
+} codec_stream_t;
+
+static esp_err_t codec_stream_open(audio_element_handle_t self) {
+	codec_stream_t *cs = (codec_stream_t *)audio_element_getdata(self);
+	cs->pcm_fill = 0;
+	cs->in_fill = 0;
+	return ESP_OK;
+}
+
+static esp_err_t codec_stream_close(audio_element_handle_t self) {
+	codec_stream_t       *cs = (codec_stream_t *)audio_element_getdata(self);
+	codec_stream_stats_t *st = &cs->stats;
+	if (st->frames > 0) {
+		ESP_LOGI(TAG,
+		         "codec_stream_close: %s %lu frames of %s, %llu of %llu bytes, %llu cycles "
+		         "per frame",
+		         cs->cfg.encode ? "Encoded" : "Decoded", st->frames,
+		         audio_codec_name(cs->cfg.codec.id), st->packet_bytes, st->pcm_bytes,
+		         st->cycles / st->frames);
+	}
+	return ESP_OK;
+}
+
+/*
+ * Encodes the frame in cs->pcm and writes the packet out.
+ */
+static int codec_stream_put_frame(audio_element_handle_t self, codec_stream_t *cs) {
+	esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+	int len = audio_codec_encode(cs->codec, cs->pcm, cs->packet + AUDIO_CODEC_PACKET_HDR_LEN);
+	cs->stats.cycles += (esp_cpu_cycle_count_t)(esp_cpu_get_cycle_count() - start);
+	cs->pcm_fill = 0;
+	if (len < 0) {
+		ESP_LOGE(TAG, "codec_stream_put_frame: Failed to encode");
+		return ESP_FAIL;
+	}
+	cs->packet[0] = len & 0xFF;
+	cs->packet[1] = len >> 8;
+	cs->stats.frames++;
+	cs->stats.pcm_bytes += sizeof(cs->pcm);
+	cs->stats.packet_bytes += AUDIO_CODEC_PACKET_HDR_LEN + len;
+	return audio_element_output(self, (char *)cs->packet, AUDIO_CODEC_PACKET_HDR_LEN + len);
+}
+
+static int codec_stream_encode(audio_element_handle_t self, codec_stream_t *cs) {
+	// a VAD frame at a time, so that keepalives can be told from audio
+	int16_t *sub = (int16_t *)cs->in;
+	size_t   sub_len = VAD_FRAME_SAMPLES * sizeof(int16_t);
+	int      r = audio_element_input(self, (char *)cs->in + cs->in_fill, sub_len - cs->in_fill);
+	if (r <= 0) {
+		return r;
+	}
+	cs->in_fill += r;
+	if (cs->in_fill < sub_len) {
+		return r;
+	}
+	cs->in_fill = 0;
+
+	bool keepalive = cs->cfg.keepalives;
+	for (size_t i = 0; keepalive && i < VAD_FRAME_SAMPLES; i++) {
+		keepalive = sub[i] == 0;
+	}
+	if (keepalive) {
+		// the end of an utterance goes up without waiting for the rest of the frame
+		if (cs->pcm_fill > 0) {
+			memset(cs->pcm + cs->pcm_fill, 0,
+			       (AUDIO_CODEC_FRAME_SAMPLES - cs->pcm_fill) * sizeof(int16_t));
+			if (codec_stream_put_frame(self, cs) < 0) {
+				return ESP_FAIL;
+			}
+		}
+		static const uint8_t empty[AUDIO_CODEC_PACKET_HDR_LEN] = {0};
+		cs->stats.keepalives++;
+		cs->stats.packet_bytes += sizeof(empty);
+		return audio_element_output(self, (char *)empty, sizeof(empty));
+	}
+
+	memcpy(cs->pcm + cs->pcm_fill, sub, sub_len);
+	cs->pcm_fill += VAD_FRAME_SAMPLES;
+	if (cs->pcm_fill < AUDIO_CODEC_FRAME_SAMPLES) {
+		return r;
+	}
+	return codec_stream_put_frame(self, cs);
+}
+
+static int codec_stream_decode(audio_element_handle_t self, codec_stream_t *cs) {
+	size_t need = AUDIO_CODEC_PACKET_HDR_LEN;
+	if (cs->in_fill >= AUDIO_CODEC_PACKET_HDR_LEN) {
+		need += cs->in[0] | cs->in[1] << 8;
+	}
+	int r = audio_element_input(self, (char *)cs->in + cs->in_fill, need - cs->in_fill);
+	if (r <= 0) {
+		return r;
+	}
+	cs->in_fill += r;
+	if (cs->in_fill == AUDIO_CODEC_PACKET_HDR_LEN) {
+		need += cs->in[0] | cs->in[1] << 8;
+		if (need > sizeof(cs->in)) {
+			ESP_LOGE(TAG, "codec_stream_decode: Packet of %u bytes is too long",
+			         need - AUDIO_CODEC_PACKET_HDR_LEN);
+			return ESP_FAIL;
+		}
+	}
+	if (cs->in_fill < need) {
+		return r;
+	}
+	cs->in_fill = 0;
+
+	size_t len = need - AUDIO_CODEC_PACKET_HDR_LEN;
+	int    samples = VAD_FRAME_SAMPLES;
+	if (len == 0) {
+		memset(cs->pcm, 0, samples * sizeof(int16_t));
+		cs->stats.keepalives++;
+	} else {
+		esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+		samples = audio_codec_decode(cs->codec, cs->in + AUDIO_CODEC_PACKET_HDR_LEN, len,
+		                             cs->pcm);
+		cs->stats.cycles += (esp_cpu_cycle_count_t)(esp_cpu_get_cycle_count() - start);
+		if (samples < 0) {
+			ESP_LOGE(TAG, "codec_stream_decode: Malformed packet of %u bytes", len);
+			return ESP_FAIL;
+		}
+		cs->stats.frames++;
+	}
+	cs->stats.pcm_bytes += samples * sizeof(int16_t);
+	cs->stats.packet_bytes += need;
+	return audio_element_output(self, (char *)cs->pcm, samples * sizeof(int16_t));
+}
+
+static int codec_stream_process(audio_element_handle_t self, char *buf, int len) {
+	codec_stream_t *cs = (codec_stream_t *)audio_element_getdata(self);
+	return cs->cfg.encode ? codec_stream_encode(self, cs) : codec_stream_decode(self, cs);
+}
+
+static esp_err_t codec_stream_destroy(audio_element_handle_t self) {
+	codec_stream_t *cs = (codec_stream_t *)audio_element_getdata(self);
+	audio_codec_destroy(cs->codec);
+	free(cs);
+	return ESP_OK;
+}
+
+audio_element_handle_t codec_stream_init(const codec_stream_cfg_t *cfg) {
+	codec_stream_t *cs = calloc(1, sizeof(codec_stream_t));
+	if (cs == NULL) {
+		ESP_LOGE(TAG, "codec_stream_init: Out of memory");
+		return NULL;
+	}
+	cs->cfg = *cfg;
+	esp_err_t err = audio_codec_create(&cfg->codec, &cs->codec);
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "codec_stream_init: Failed to create %s codec: %s",
+		         audio_codec_name(cfg->codec.id), esp_err_to_name(err));
+		free(cs);
+		return NULL;
+	}
+
+	audio_element_cfg_t el_cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+	el_cfg.open = codec_stream_open;
+	el_cfg.close = codec_stream_close;
+	el_cfg.process = codec_stream_process;
+	el_cfg.destroy = codec_stream_destroy;
+	el_cfg.buffer_len = 0; // reads straight into cs->in
+	el_cfg.tag = cfg->encode ? "encoder" : "decoder";
+	if (cfg->codec.id == AUDIO_CODEC_OPUS) {
+		el_cfg.task_stack = 24 * 1024; // opus_encode recurses deep
+	}
+	audio_element_handle_t el = audio_element_init(&el_cfg);
+	if (el == NULL) {
+		ESP_LOGE(TAG, "codec_stream_init: Failed to create element");
+		audio_codec_destroy(cs->codec);
+		free(cs);
+		return NULL;
+	}
+	audio_element_setdata(el, cs);
+	return el;
+}
+
+codec_stream_stats_t codec_stream_get_stats(audio_element_handle_t self) {
+	codec_stream_t *cs = (codec_stream_t *)audio_element_getdata(self);
+	return cs->stats;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+ * Audio elements that encode 16 kHz, 16-bit mono PCM into packets of audio_codec.h, for the
+ * HTTP writer of the TX pipeline, and decode them back, after the HTTP reader of the RX
+ * pipeline.
+ */
+
+#include "audio_codec.h"
+#include "audio_element.h"
+
+typedef struct {
+	audio_codec_cfg_t codec;
+	bool              encode;     // encoder, otherwise decoder
+	bool              keepalives; // encoder: pass on the keepalives of the VAD before it
+} codec_stream_cfg_t;
+
+typedef struct {
+	uint32_t frames;  // encoded or decoded
+	uint32_t keepalives;
+	uint64_t pcm_bytes;
+	uint64_t packet_bytes; // with the packet headers
+	uint64_t cycles;       // CPU cycles spent in the codec
+} codec_stream_stats_t;
+
+/*
+ * Creates the element with `cfg`, or returns NULL.
+ */
+audio_element_handle_t codec_stream_init(const codec_stream_cfg_t *cfg);
+
+/*
+ * Returns counters since the element was created.
+ */
+codec_stream_stats_t codec_stream_get_stats(audio_element_handle_t self);
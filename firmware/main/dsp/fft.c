@@ -0,0 +1,88 @@
+#include "fft.h"
+#include <math.h>
+#include <stdlib.h>
+
+#ifdef CONFIG_AUDIO_ESP_DSP
+#include "dsps_fft2r.h"
+#endif
+
+esp_err_t fft_init(fft_t *fft, uint32_t bits) {
+	fft->size = 1 << bits;
+	fft->twiddle = NULL;
+	if (bits > FFT_MAX_BITS) {
+		return ESP_ERR_INVALID_ARG;
+	}
+#ifdef CONFIG_AUDIO_ESP_DSP
+	// one table for every size up to it, which later calls leave alone
+	return dsps_fft2r_init_fc32(NULL, CONFIG_DSP_MAX_FFT_SIZE);
+#else
+	fft->twiddle = malloc(fft->size * sizeof(float));
+	if (fft->twiddle == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+	for (uint32_t k = 0; k < fft->size / 2; k++) {
+		fft->twiddle[2 * k] = cosf(2 * (float)M_PI * k / fft->size);
+		fft->twiddle[2 * k + 1] = -sinf(2 * (float)M_PI * k / fft->size);
+	}
+	return ESP_OK;
+#endif
+}
+
+void fft_deinit(fft_t *fft) {
+	free(fft->twiddle);
+	fft->twiddle = NULL;
+}
+
+#ifdef CONFIG_AUDIO_ESP_DSP
+void fft_forward(const fft_t *fft, float *x) {
+	dsps_fft2r_fc32(x, fft->size);
+	dsps_bit_rev_fc32(x, fft->size);
+}
+#else
+void fft_forward(const fft_t *fft, float *x) {
+	uint32_t n = fft->size;
+	for (uint32_t i = 0, j = 0; i < n; i++) {
+		if (i < j) {
+			float re = x[2 * i], im = x[2 * i + 1];
+			x[2 * i] = x[2 * j];
+			x[2 * i + 1] = x[2 * j + 1];
+			x[2 * j] = re;
+			x[2 * j + 1] = im;
+		}
+		uint32_t bit = n >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j |= bit;
+	}
+
+	for (uint32_t half = 1; half < n; half <<= 1) {
+		uint32_t step = n / (2 * half);
+		for (uint32_t k = 0; k < half; k++) {
+			float wr = fft->twiddle[2 * k * step], wi = fft->twiddle[2 * k * step + 1];
+			for (uint32_t i = k; i < n; i += 2 * half) {
+				uint32_t j = i + half;
+				float    tr = x[2 * j] * wr - x[2 * j + 1] * wi;
+				float    ti = x[2 * j] * wi + x[2 * j + 1] * wr;
+				x[2 * j] = x[2 * i] - tr;
+				x[2 * j + 1] = x[2 * i + 1] - ti;
+				x[2 * i] += tr;
+				x[2 * i + 1] += ti;
+			}
+		}
+	}
+}
+#endif
+
+void fft_inverse(const fft_t *fft, float *x) {
+	// conj(fft(conj(X))) / size is the inverse
+	for (uint32_t i = 0; i < fft->size; i++) {
+		x[2 * i + 1] = -x[2 * i + 1];
+	}
+	fft_forward(fft, x);
+	float scale = 1.0f / fft->size;
+	for (uint32_t i = 0; i < fft->size; i++) {
+		x[2 * i] *= scale;
+		x[2 * i + 1] *= -scale;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+/*
+ * Complex FFT in floating point, in place on interleaved re, im, of a power of 2 up to
+ * FFT_MAX_SIZE points.
+ *
+ * With CONFIG_AUDIO_ESP_DSP it is esp-dsp's, which uses the ESP32-S3's SIMD instructions.
+ * Otherwise it is a portable radix 2 one in C.
+ */
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define FFT_MAX_BITS 10
+#define FFT_MAX_SIZE (1 << FFT_MAX_BITS)
+
+#ifdef CONFIG_AUDIO_ESP_DSP
+#define FFT_NAME "esp-dsp"
+#else
+#define FFT_NAME "portable"
+#endif
+
+typedef struct {
+	uint32_t size;
+	float   *twiddle; // cos and -sin over the first half turn, of the portable FFT
+} fft_t;
+
+/*
+ * Returns ESP_ERR_INVALID_ARG if 2^bits is more than FFT_MAX_SIZE, or ESP_ERR_NO_MEM.
+ */
+esp_err_t fft_init(fft_t *fft, uint32_t bits);
+void      fft_deinit(fft_t *fft);
+
+/*
+ * Transforms the fft->size complex points of `x`, unscaled, into the same order.
+ */
+void fft_forward(const fft_t *fft, float *x);
+
+/*
+ * Transforms `x` back, divided by fft->size, so that it undoes fft_forward().
+ */
+void fft_inverse(const fft_t *fft, float *x);
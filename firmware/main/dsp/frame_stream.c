@@ -0,0 +1,119 @@
+#include "frame_stream.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "frame_stream";
+
+typedef struct {
+	frame_stage_t *stages[FRAME_STREAM_MAX_STAGES];
+	size_t         n;
+	int16_t       *frame; // of the first stage
+	size_t         fill;  // bytes of `frame` read so far
+} frame_stream_t;
+
+static esp_err_t frame_stream_open(audio_element_handle_t self) {
+	frame_stream_t *fs = (frame_stream_t *)audio_element_getdata(self);
+	for (size_t i = 0; i < fs->n; i++) {
+		if (fs->stages[i]->open != NULL) {
+			fs->stages[i]->open(fs->stages[i]);
+		}
+	}
+	fs->fill = 0;
+	return ESP_OK;
+}
+
+static esp_err_t frame_stream_close(audio_element_handle_t self) {
+	frame_stream_t *fs = (frame_stream_t *)audio_element_getdata(self);
+	for (size_t i = 0; i < fs->n; i++) {
+		if (fs->stages[i]->close != NULL) {
+			fs->stages[i]->close(fs->stages[i]);
+		}
+	}
+	return ESP_OK;
+}
+
+static int frame_stream_process(audio_element_handle_t self, char *buf, int len) {
+	frame_stream_t *fs = (frame_stream_t *)audio_element_getdata(self);
+	size_t          frame_bytes = fs->stages[0]->frame_bytes;
+	int r = audio_element_input(self, (char *)fs->frame + fs->fill, frame_bytes - fs->fill);
+	if (r <= 0) {
+		return r;
+	}
+	fs->fill += r;
+	if (fs->fill < frame_bytes) {
+		return r;
+	}
+	fs->fill = 0;
+
+	int16_t *in = fs->frame;
+	size_t   n = frame_bytes;
+	for (size_t i = 0; i < fs->n; i++) {
+		frame_stage_t        *stage = fs->stages[i];
+		int16_t              *out = in;
+		esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+		n = stage->process(stage, in, &out);
+		stage->frame_cycles = esp_cpu_get_cycle_count() - start;
+		stage->cycles += stage->frame_cycles;
+		if (n == 0) {
+			// consumed, and nothing to send
+			return r;
+		}
+		in = out;
+	}
+	return audio_element_output(self, (char *)in, n);
+}
+
+static esp_err_t frame_stream_destroy(audio_element_handle_t self) {
+	frame_stream_t *fs = (frame_stream_t *)audio_element_getdata(self);
+	for (size_t i = 0; i < fs->n; i++) {
+		fs->stages[i]->destroy(fs->stages[i]);
+	}
+	free(fs->frame);
+	free(fs);
+	return ESP_OK;
+}
+
+audio_element_handle_t frame_stream_init(const char *tag, frame_stage_t *const *stages,
+                                         size_t n) {
+	if (n == 0 || n > FRAME_STREAM_MAX_STAGES) {
+		ESP_LOGE(TAG, "frame_stream_init: %d stages out of range", (int)n);
+		return NULL;
+	}
+	frame_stream_t *fs = calloc(1, sizeof(frame_stream_t));
+	if (fs == NULL) {
+		ESP_LOGE(TAG, "frame_stream_init: Out of memory");
+		return NULL;
+	}
+	memcpy(fs->stages, stages, n * sizeof(frame_stage_t *));
+	fs->n = n;
+	fs->frame = malloc(stages[0]->frame_bytes);
+	if (fs->frame == NULL) {
+		ESP_LOGE(TAG, "frame_stream_init: Out of memory");
+		free(fs);
+		return NULL;
+	}
+
+	audio_element_cfg_t el_cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+	el_cfg.open = frame_stream_open;
+	el_cfg.close = frame_stream_close;
+	el_cfg.process = frame_stream_process;
+	el_cfg.destroy = frame_stream_destroy;
+	el_cfg.buffer_len = 0; // reads straight into fs->frame
+	el_cfg.tag = tag;
+	audio_element_handle_t el = audio_element_init(&el_cfg);
+	if (el == NULL) {
+		ESP_LOGE(TAG, "frame_stream_init: Failed to create element");
+		free(fs->frame);
+		free(fs);
+		return NULL;
+	}
+	audio_element_setdata(el, fs);
+	return el;
+}
+
+frame_stage_t *frame_stream_stage(audio_element_handle_t self, size_t i) {
+	frame_stream_t *fs = (frame_stream_t *)audio_element_getdata(self);
+	return fs->stages[i];
+}
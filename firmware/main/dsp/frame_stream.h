@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * Audio element that runs a chain of stages over fixed frames of 16-bit PCM, in the element's
+ * one task. It reads a whole frame of the first stage before it calls the stages on it in
+ * turn, each on what the one before gave, and sends on what the last gives.
+ *
+ * Every stage but the last has to give exactly a frame of the next. A stage that gives nothing
+ * ends the chain for that frame.
+ */
+
+#include "audio_element.h"
+#include <stdint.h>
+
+#define FRAME_STREAM_MAX_STAGES 6
+
+typedef struct frame_stage frame_stage_t;
+
+struct frame_stage {
+	size_t frame_bytes; // taken by each call of `process`
+	void  *data;
+
+	/*
+	 * Called as the pipeline starts and stops, either may be NULL, and as the element is
+	 * deinitialized, to free the stage.
+	 */
+	void (*open)(frame_stage_t *self);
+	void (*close)(frame_stage_t *self);
+	void (*destroy)(frame_stage_t *self);
+
+	/*
+	 * Takes a frame in `in`, and returns how many bytes it gives, pointing `out` at them, which
+	 * may be `in`. Returns 0 to give nothing for it.
+	 */
+	size_t (*process)(frame_stage_t *self, int16_t *in, int16_t **out);
+
+	uint64_t cycles;       // CPU cycles spent in `process`,
+	uint32_t frame_cycles; // and in its last call
+};
+
+/*
+ * Creates the element, tagged `tag`, which runs the `n` stages in order and destroys them with
+ * itself, or returns NULL and destroys none of them.
+ */
+audio_element_handle_t frame_stream_init(const char *tag, frame_stage_t *const *stages,
+                                         size_t n);
+
+/*
+ * Returns stage `i` of the element.
+ */
+frame_stage_t *frame_stream_stage(audio_element_handle_t self, size_t i);
@@ -0,0 +1,98 @@
+#include "gate.h"
+#include <stdlib.h>
+#include <string.h>
+
+esp_err_t gate_init(gate_t *gate, const gate_cfg_t *cfg) {
+	memset(gate, 0, sizeof(*gate));
+	gate->preroll_frames = cfg->preroll_ms / GATE_FRAME_MS;
+	gate->keepalive_frames = cfg->keepalive_ms / GATE_FRAME_MS;
+	if (gate->preroll_frames > 0) {
+		gate->preroll = malloc(gate->preroll_frames * GATE_FRAME_SAMPLES * sizeof(int16_t));
+		if (gate->preroll == NULL) {
+			return ESP_ERR_NO_MEM;
+		}
+	}
+	gate_reset(gate);
+	return ESP_OK;
+}
+
+void gate_reset(gate_t *gate) {
+	gate->want_open = false;
+	gate->open = false;
+	gate->silence = 0;
+	gate->preroll_head = 0;
+	gate->preroll_count = 0;
+}
+
+void gate_deinit(gate_t *gate) {
+	free(gate->preroll);
+	gate->preroll = NULL;
+}
+
+void gate_set_open(gate_t *gate, bool open) {
+	gate->want_open = open;
+}
+
+size_t gate_out_samples(const gate_t *gate) {
+	return (gate->preroll_frames + 1) * GATE_FRAME_SAMPLES;
+}
+
+/*
+ * Writes the audio held back to `out`, oldest first, and returns the number of samples.
+ */
+static size_t gate_flush(gate_t *gate, int16_t *out) {
+	size_t n = 0;
+	if (gate->preroll_count == 0) {
+		return 0;
+	}
+	uint16_t i = (gate->preroll_head + gate->preroll_frames - gate->preroll_count) %
+	             gate->preroll_frames;
+	for (; gate->preroll_count > 0; gate->preroll_count--) {
+		memcpy(out + n, gate->preroll + i * GATE_FRAME_SAMPLES,
+		       GATE_FRAME_SAMPLES * sizeof(int16_t));
+		n += GATE_FRAME_SAMPLES;
+		i = (i + 1) % gate->preroll_frames;
+	}
+	gate->preroll_head = 0;
+	return n;
+}
+
+size_t gate_process(gate_t *gate, const int16_t *frame, int16_t *out) {
+	size_t n = 0;
+	gate->stats.frames++;
+
+	if (gate->want_open) {
+		if (!gate->open) {
+			gate->open = true;
+			gate->stats.opens++;
+			n = gate_flush(gate, out);
+		}
+		memcpy(out + n, frame, GATE_FRAME_SAMPLES * sizeof(int16_t));
+		n += GATE_FRAME_SAMPLES;
+		gate->stats.passed_frames += n / GATE_FRAME_SAMPLES;
+		return n;
+	}
+
+	if (gate->open) {
+		// the keepalive right away tells the server that the utterance is over
+		gate->open = false;
+		gate->silence = gate->keepalive_frames;
+	} else {
+		gate->silence++;
+	}
+	if (gate->preroll_frames > 0) {
+		memcpy(gate->preroll + gate->preroll_head * GATE_FRAME_SAMPLES, frame,
+		       GATE_FRAME_SAMPLES * sizeof(int16_t));
+		gate->preroll_head = (gate->preroll_head + 1) % gate->preroll_frames;
+		if (gate->preroll_count < gate->preroll_frames) {
+			gate->preroll_count++;
+		}
+	}
+	if (gate->keepalive_frames > 0 && gate->silence >= gate->keepalive_frames) {
+		memset(out, 0, GATE_FRAME_SAMPLES * sizeof(int16_t));
+		n = GATE_FRAME_SAMPLES;
+		gate->silence = 0;
+		gate->stats.keepalives++;
+	}
+	return n;
+}
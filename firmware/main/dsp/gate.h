@@ -0,0 +1,75 @@
+#pragma once
+
+/*
+ * Push-to-talk gate on 16 kHz, 16-bit mono PCM in 10 ms frames, for a TX pipeline that runs all
+ * along so that the server connection is up before the button is pressed.
+ *
+ * Closed, the gate passes nothing but a keepalive of GATE_FRAME_SAMPLES zero samples every
+ * keepalive_ms, like vad.h's, to keep the connection up, and holds the last preroll_ms of audio
+ * back. Opening it passes that pre-roll on at once, so that the words spoken as the button went
+ * down reach the server, and then every frame. Closing it passes a keepalive at once, which the
+ * server takes as the end of the utterance.
+ */
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GATE_SAMPLE_RATE 16000
+#define GATE_FRAME_SAMPLES 160 // 10 ms
+#define GATE_FRAME_MS (GATE_FRAME_SAMPLES * 1000 / GATE_SAMPLE_RATE)
+
+typedef struct {
+	uint32_t preroll_ms;   // audio from before opening that is passed on with it
+	uint32_t keepalive_ms; // between keepalives while closed; 0 sends none
+} gate_cfg_t;
+
+typedef struct {
+	uint32_t frames;        // processed
+	uint32_t passed_frames; // passed on, with the pre-roll
+	uint32_t opens;
+	uint32_t keepalives;
+} gate_stats_t;
+
+typedef struct {
+	uint16_t preroll_frames;
+	uint16_t keepalive_frames;
+
+	volatile bool want_open; // set by gate_set_open(), from any task
+	bool          open;      // as of the last frame
+	uint32_t      silence;   // frames since the last keepalive
+
+	int16_t *preroll; // ring of preroll_frames frames
+	uint16_t preroll_head, preroll_count;
+
+	gate_stats_t stats;
+} gate_t;
+
+/*
+ * Allocates the pre-roll buffer and starts closed.
+ */
+esp_err_t gate_init(gate_t *gate, const gate_cfg_t *cfg);
+
+/*
+ * Closes the gate and forgets the audio held back. Keeps the counters.
+ */
+void gate_reset(gate_t *gate);
+
+void gate_deinit(gate_t *gate);
+
+/*
+ * Opens or closes the gate from the next frame on.
+ */
+void gate_set_open(gate_t *gate, bool open);
+
+/*
+ * Most samples one call to gate_process() can write: the pre-roll and the frame.
+ */
+size_t gate_out_samples(const gate_t *gate);
+
+/*
+ * Takes one frame of GATE_FRAME_SAMPLES samples and writes what is to be sent to `out`, which
+ * holds gate_out_samples(). Returns the number of samples written, often 0 while closed.
+ */
+size_t gate_process(gate_t *gate, const int16_t *frame, int16_t *out);
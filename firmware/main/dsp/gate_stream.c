@@ -0,0 +1,92 @@
+#include "gate_stream.h"
+#include "esp_log.h"
+#include "frame_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define GATE_FRAME_BYTES (GATE_FRAME_SAMPLES * sizeof(int16_t))
+
+static const char *TAG = "gate_stream";
+
+typedef struct {
+	frame_stage_t stage;
+	gate_t        gate;
+	int16_t      *out;
+} gate_stream_t;
+
+static void gate_stream_open(frame_stage_t *self) {
+	gate_stream_t *gs = (gate_stream_t *)self->data;
+	// stays open or closed across a restart of the pipeline
+	bool want_open = gs->gate.want_open;
+	gate_reset(&gs->gate);
+	gate_set_open(&gs->gate, want_open);
+}
+
+static void gate_stream_close(frame_stage_t *self) {
+	gate_stream_t *gs = (gate_stream_t *)self->data;
+	gate_stats_t  *st = &gs->gate.stats;
+	if (st->frames > 0) {
+		ESP_LOGI(TAG,
+		         "gate_stream_close: %lu of %lu frames passed in %lu opens, %lu keepalives",
+		         st->passed_frames, st->frames, st->opens, st->keepalives);
+	}
+}
+
+static size_t gate_stream_process(frame_stage_t *self, int16_t *in, int16_t **out) {
+	gate_stream_t *gs = (gate_stream_t *)self->data;
+	*out = gs->out;
+	return gate_process(&gs->gate, in, gs->out) * sizeof(int16_t);
+}
+
+static void gate_stream_destroy(frame_stage_t *self) {
+	gate_stream_t *gs = (gate_stream_t *)self->data;
+	gate_deinit(&gs->gate);
+	free(gs->out);
+	free(gs);
+}
+
+audio_element_handle_t gate_stream_init(const gate_cfg_t *cfg) {
+	gate_stream_t *gs = calloc(1, sizeof(gate_stream_t));
+	if (gs == NULL) {
+		ESP_LOGE(TAG, "gate_stream_init: Out of memory");
+		return NULL;
+	}
+	if (gate_init(&gs->gate, cfg) != ESP_OK) {
+		ESP_LOGE(TAG, "gate_stream_init: Failed to allocate the pre-roll");
+		free(gs);
+		return NULL;
+	}
+	gs->out = malloc(gate_out_samples(&gs->gate) * sizeof(int16_t));
+	if (gs->out == NULL) {
+		ESP_LOGE(TAG, "gate_stream_init: Out of memory");
+		gate_deinit(&gs->gate);
+		free(gs);
+		return NULL;
+	}
+
+	gs->stage = (frame_stage_t){
+	    .frame_bytes = GATE_FRAME_BYTES,
+	    .data = gs,
+	    .open = gate_stream_open,
+	    .close = gate_stream_close,
+	    .destroy = gate_stream_destroy,
+	    .process = gate_stream_process,
+	};
+	frame_stage_t         *stage = &gs->stage;
+	audio_element_handle_t el = frame_stream_init("gate", &stage, 1);
+	if (el == NULL) {
+		gate_stream_destroy(stage);
+		return NULL;
+	}
+	return el;
+}
+
+void gate_stream_set_open(audio_element_handle_t self, bool open) {
+	gate_stream_t *gs = (gate_stream_t *)frame_stream_stage(self, 0)->data;
+	gate_set_open(&gs->gate, open);
+}
+
+gate_stats_t gate_stream_get_stats(audio_element_handle_t self) {
+	gate_stream_t *gs = (gate_stream_t *)frame_stream_stage(self, 0)->data;
+	return gs->gate.stats;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+ * Audio element that passes the microphone audio on only while the talk button is on, see
+ * gate.h. Goes right after the I2S reader of the TX pipeline, and takes 16 kHz, 16-bit mono
+ * PCM.
+ */
+
+#include "audio_element.h"
+#include "gate.h"
+
+/*
+ * Creates the element with `cfg`, closed, or returns NULL.
+ */
+audio_element_handle_t gate_stream_init(const gate_cfg_t *cfg);
+
+/*
+ * Opens or closes the gate. Safe from any task while the pipeline runs.
+ */
+void gate_stream_set_open(audio_element_handle_t self, bool open);
+
+/*
+ * Returns counters since the element was created.
+ */
+gate_stats_t gate_stream_get_stats(audio_element_handle_t self);
@@ -0,0 +1,308 @@
+#include "jitter.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define JITTER_SAMPLES_PER_MS (JITTER_SAMPLE_RATE / 1000)
+#define JITTER_BURST_MS 300      // room above max_delay_ms for audio arriving all at once
+#define JITTER_FORGET_SHIFT 6    // each arrival takes 1/64 of the lateness histogram
+#define JITTER_PERCENTILE 95     // of lateness covered by the delay
+#define JITTER_WINDOW_FRAMES 50  // over which the least audio waiting is measured, 500 ms
+#define JITTER_MIN_LAG 40        // shortest pitch period concealed, 2.5 ms
+#define JITTER_XFADE_SAMPLES 80  // from concealment or silence back to audio, 5 ms
+#define JITTER_SILENT UINT32_MAX // conceal_pos before the first audio
+
+esp_err_t jitter_init(jitter_t *jb, const jitter_cfg_t *cfg) {
+	memset(jb, 0, sizeof(*jb));
+	jb->cfg = *cfg;
+	if (jb->cfg.max_delay_ms < jb->cfg.min_delay_ms) {
+		jb->cfg.max_delay_ms = jb->cfg.min_delay_ms;
+	}
+	jb->fifo_len = (jb->cfg.max_delay_ms + JITTER_BURST_MS) * JITTER_SAMPLES_PER_MS;
+	jb->fifo = malloc(jb->fifo_len * sizeof(int16_t));
+	if (jb->fifo == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+	jitter_reset(jb);
+	return ESP_OK;
+}
+
+void jitter_reset(jitter_t *jb) {
+	jb->head = 0;
+	jb->count = 0;
+	jb->paused = true;
+	memset(jb->hist, 0, sizeof(jb->hist));
+	jb->delay_ms = jb->cfg.min_delay_ms;
+	jb->playing = false;
+	jb->level_min = SIZE_MAX;
+	jb->level_frames = 0;
+	jb->compress = 0;
+	memset(jb->history, 0, sizeof(jb->history));
+	jb->conceal_pos = JITTER_SILENT;
+	jb->stats.delay_ms = jb->delay_ms;
+	jb->stats.level_ms = 0;
+}
+
+void jitter_deinit(jitter_t *jb) {
+	free(jb->fifo);
+	jb->fifo = NULL;
+}
+
+/*
+ * Copies the oldest `samples` samples waiting to `out`, or drops them if `out` is NULL.
+ */
+static void jitter_pop(jitter_t *jb, int16_t *out, size_t samples) {
+	while (samples > 0) {
+		size_t n = jb->fifo_len - jb->head;
+		n = n < samples ? n : samples;
+		if (out != NULL) {
+			memcpy(out, jb->fifo + jb->head, n * sizeof(int16_t));
+			out += n;
+		}
+		jb->head = (jb->head + n) % jb->fifo_len;
+		jb->count -= n;
+		samples -= n;
+	}
+}
+
+/*
+ * Sets the delay to cover JITTER_PERCENTILE of the lateness in the histogram.
+ */
+static void jitter_update_delay(jitter_t *jb) {
+	uint32_t total = 0;
+	for (int i = 0; i < JITTER_BINS; i++) {
+		total += jb->hist[i];
+	}
+	uint32_t sum = 0, bin = 0;
+	while (bin < JITTER_BINS - 1) {
+		sum += jb->hist[bin];
+		if (sum * 100 >= total * JITTER_PERCENTILE) {
+			break;
+		}
+		bin++;
+	}
+	// the top of the bin, and a frame for the playout's steps
+	uint32_t delay = (bin + 2) * JITTER_FRAME_MS;
+	if (delay < jb->cfg.min_delay_ms) {
+		delay = jb->cfg.min_delay_ms;
+	} else if (delay > jb->cfg.max_delay_ms) {
+		delay = jb->cfg.max_delay_ms;
+	}
+	jb->delay_ms = delay;
+	jb->stats.delay_ms = delay;
+}
+
+/*
+ * Adds the lateness of audio arriving at `now_ms` to the histogram.
+ */
+static void jitter_arrived(jitter_t *jb, const int16_t *pcm, size_t samples, uint32_t now_ms) {
+	if (jb->paused) {
+		jb->paused = false;
+		jb->base_ms = now_ms;
+		jb->media = 0;
+	}
+	int32_t late = (int32_t)(now_ms - jb->base_ms - jb->media / JITTER_SAMPLES_PER_MS);
+	jb->media += samples;
+	if (samples >= JITTER_FRAME_SAMPLES) {
+		// a keepalive: the peer went quiet, and the next audio is not late for this
+		jb->paused = true;
+		for (size_t i = samples - JITTER_FRAME_SAMPLES; jb->paused && i < samples; i++) {
+			jb->paused = pcm[i] == 0;
+		}
+	}
+	if (late < 0) {
+		// earlier than any so far, so the rest were later than they looked
+		jb->base_ms += late;
+		late = 0;
+	}
+
+	uint32_t bin = late / JITTER_FRAME_MS;
+	if (bin >= JITTER_BINS) {
+		bin = JITTER_BINS - 1;
+	}
+	for (int i = 0; i < JITTER_BINS; i++) {
+		// rounded up, so that old lateness is forgotten altogether
+		uint16_t forget = (1 << JITTER_FORGET_SHIFT) - 1;
+		jb->hist[i] -= (jb->hist[i] + forget) >> JITTER_FORGET_SHIFT;
+	}
+	jb->hist[bin] += UINT16_MAX >> JITTER_FORGET_SHIFT;
+	jitter_update_delay(jb);
+}
+
+void jitter_put(jitter_t *jb, const int16_t *pcm, size_t samples, uint32_t now_ms) {
+	if (samples == 0) {
+		return;
+	}
+	jitter_arrived(jb, pcm, samples, now_ms);
+
+	if (samples > jb->fifo_len) {
+		pcm += samples - jb->fifo_len;
+		samples = jb->fifo_len;
+	}
+	if (jb->count + samples > jb->fifo_len) {
+		size_t drop = jb->count + samples - jb->fifo_len;
+		jitter_pop(jb, NULL, drop);
+		jb->stats.overruns += (drop + JITTER_FRAME_SAMPLES - 1) / JITTER_FRAME_SAMPLES;
+	}
+	size_t tail = (jb->head + jb->count) % jb->fifo_len;
+	size_t n = jb->fifo_len - tail;
+	n = n < samples ? n : samples;
+	memcpy(jb->fifo + tail, pcm, n * sizeof(int16_t));
+	memcpy(jb->fifo, pcm + n, (samples - n) * sizeof(int16_t));
+	jb->count += samples;
+	jb->stats.level_ms = jb->count / JITTER_SAMPLES_PER_MS;
+}
+
+/*
+ * Returns the lag at which the last frame played best matches the audio before it, which for
+ * voiced speech is the pitch period or a multiple of it.
+ */
+static uint16_t jitter_pitch(const int16_t *history) {
+	const int16_t *x = history + JITTER_HISTORY - JITTER_FRAME_SAMPLES;
+	uint16_t       best = JITTER_FRAME_SAMPLES;
+	float          best_score = 0;
+	for (int lag = JITTER_MIN_LAG; lag <= JITTER_MAX_LAG; lag++) {
+		const int16_t *y = x - lag;
+		int64_t        xy = 0, yy = 0;
+		for (int i = 0; i < JITTER_FRAME_SAMPLES; i++) {
+			xy += x[i] * y[i];
+			yy += y[i] * y[i];
+		}
+		if (xy <= 0 || yy == 0) {
+			continue;
+		}
+		float score = (float)xy * (float)xy / (float)yy;
+		if (score > best_score) {
+			best_score = score;
+			best = lag;
+		}
+	}
+	return best;
+}
+
+/*
+ * Returns the next sample of concealment: the last pitch period over again, fading out.
+ */
+static int16_t jitter_conceal_sample(jitter_t *jb) {
+	uint32_t total = jb->cfg.conceal_ms * JITTER_SAMPLES_PER_MS;
+	if (jb->conceal_pos >= total) {
+		return 0;
+	}
+	uint32_t period = jb->conceal_pos % jb->conceal_lag;
+	int32_t  s = jb->history[JITTER_HISTORY - jb->conceal_lag + period];
+	int32_t  gain = (int32_t)((total - jb->conceal_pos) * 32768 / total);
+	jb->conceal_pos++;
+	return (int16_t)(s * gain >> 15);
+}
+
+/*
+ * Plays the next frame from the buffer, cross-fading from the concealment, or from silence,
+ * if there was a gap before it.
+ */
+static void jitter_play(jitter_t *jb, int16_t *out) {
+	jitter_pop(jb, out, JITTER_FRAME_SAMPLES);
+	if (jb->conceal_pos == 0) {
+		return;
+	}
+	for (int i = 0; i < JITTER_XFADE_SAMPLES; i++) {
+		int32_t c = jitter_conceal_sample(jb);
+		out[i] = (int16_t)((c * (JITTER_XFADE_SAMPLES - i) + out[i] * i) /
+		                   JITTER_XFADE_SAMPLES);
+	}
+	jb->conceal_pos = 0;
+}
+
+/*
+ * Plays the next two frames as one, cross-fading from the first to the second.
+ */
+static void jitter_play_compressed(jitter_t *jb, int16_t *out) {
+	int16_t next[JITTER_FRAME_SAMPLES];
+	jitter_play(jb, out);
+	jitter_pop(jb, next, JITTER_FRAME_SAMPLES);
+	for (int i = 0; i < JITTER_FRAME_SAMPLES; i++) {
+		out[i] = (int16_t)((out[i] * (JITTER_FRAME_SAMPLES - i) + next[i] * i) /
+		                   JITTER_FRAME_SAMPLES);
+	}
+	jb->stats.compressed++;
+}
+
+/*
+ * Cuts the delay that has built up over the last window, which is what was waiting all along
+ * on top of the delay: the peak right after an arrival does not count, since it is played before
+ * the next. Drops it if that leaves more than max_delay_ms waiting, otherwise compresses it,
+ * less a frame of slack.
+ */
+static void jitter_watch_level(jitter_t *jb) {
+	if (jb->count < jb->level_min) {
+		jb->level_min = jb->count;
+	}
+	if (++jb->level_frames < JITTER_WINDOW_FRAMES) {
+		return;
+	}
+	size_t delay = jb->delay_ms * JITTER_SAMPLES_PER_MS;
+	jb->compress = 0;
+	if (jb->level_min > jb->cfg.max_delay_ms * JITTER_SAMPLES_PER_MS) {
+		size_t frames = (jb->level_min - delay) / JITTER_FRAME_SAMPLES;
+		jitter_pop(jb, NULL, frames * JITTER_FRAME_SAMPLES);
+		jb->stats.overruns += frames;
+	} else if (jb->level_min > delay + JITTER_FRAME_SAMPLES * 2) {
+		jb->compress = jb->level_min - delay - JITTER_FRAME_SAMPLES;
+	}
+	jb->level_min = SIZE_MAX;
+	jb->level_frames = 0;
+}
+
+void jitter_get(jitter_t *jb, int16_t *out, uint32_t now_ms) {
+	jb->stats.frames++;
+
+	// when the oldest audio waiting is due, by time rather than by level, since a single
+	// arrival can bring more than the delay
+	uint32_t head_ms = (jb->media - jb->count) / JITTER_SAMPLES_PER_MS;
+	uint32_t due_ms = jb->base_ms + jb->delay_ms + head_ms;
+	if (!jb->playing && jb->count >= JITTER_FRAME_SAMPLES && (int32_t)(now_ms - due_ms) >= 0) {
+		jb->playing = true;
+		jb->level_min = SIZE_MAX;
+		jb->level_frames = 0;
+		jb->compress = 0;
+	}
+
+	if (!jb->playing) {
+		memset(out, 0, JITTER_FRAME_SAMPLES * sizeof(int16_t));
+	} else if (jb->count >= JITTER_FRAME_SAMPLES) {
+		jitter_watch_level(jb);
+		if (jb->conceal_pos == 0 && (int32_t)(due_ms - now_ms) >= JITTER_FRAME_MS) {
+			// ahead of the delay, which has grown: a frame more of the last pitch period, and
+			// cross-faded back into the audio after it
+			jb->conceal_lag = jitter_pitch(jb->history);
+			for (int i = 0; i < JITTER_FRAME_SAMPLES; i++) {
+				out[i] = jitter_conceal_sample(jb);
+			}
+			jb->stats.stretched++;
+			jb->stats.level_ms = jb->count / JITTER_SAMPLES_PER_MS;
+			return;
+		}
+		if (jb->compress >= JITTER_FRAME_SAMPLES && jb->count >= 2 * JITTER_FRAME_SAMPLES) {
+			jitter_play_compressed(jb, out);
+			jb->compress -= JITTER_FRAME_SAMPLES;
+		} else {
+			jitter_play(jb, out);
+		}
+		memmove(jb->history, jb->history + JITTER_FRAME_SAMPLES,
+		        (JITTER_HISTORY - JITTER_FRAME_SAMPLES) * sizeof(int16_t));
+		memcpy(jb->history + JITTER_HISTORY - JITTER_FRAME_SAMPLES, out,
+		       JITTER_FRAME_SAMPLES * sizeof(int16_t));
+	} else {
+		if (jb->conceal_pos == 0) {
+			jb->stats.underruns++;
+			jb->conceal_lag = jitter_pitch(jb->history);
+		}
+		for (int i = 0; i < JITTER_FRAME_SAMPLES; i++) {
+			out[i] = jitter_conceal_sample(jb);
+		}
+		jb->stats.concealed++;
+		if (jb->conceal_pos >= jb->cfg.conceal_ms * JITTER_SAMPLES_PER_MS) {
+			// given up: silent until the audio waiting is due
+			jb->playing = false;
+		}
+	}
+	jb->stats.level_ms = jb->count / JITTER_SAMPLES_PER_MS;
+}
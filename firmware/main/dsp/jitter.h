@@ -0,0 +1,94 @@
+#pragma once
+
+/*
+ * Jitter buffer for the peer's audio in front of the DAC, on 16 kHz, 16-bit mono PCM.
+ *
+ * Audio arrives in bursts, whenever the network delivers it, and is played a 10 ms frame at a
+ * time at the DAC's pace. The playout delay follows the arrival jitter: it covers the 95th
+ * percentile of how late audio arrived against the earliest of the talk spurt, over the last
+ * few seconds, and stays within min_delay_ms and max_delay_ms. An arrival that ends in a frame
+ * of zeros, like the keepalives of vad.h, ends the talk spurt.
+ *
+ * When the buffer runs dry, the gap is concealed by repeating the last pitch period and fading
+ * it out over conceal_ms. Longer gaps are silent, and playing resumes once the delay has built
+ * up again, cross-faded from the concealment. When the delay grows, the last pitch period is
+ * played once more now and then until the audio is late enough. When more than the delay has
+ * been waiting all along for a while, two frames are cross-faded into one until it is back
+ * down, and beyond max_delay_ms frames are dropped.
+ */
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JITTER_SAMPLE_RATE 16000
+#define JITTER_FRAME_SAMPLES 160 // 10 ms
+#define JITTER_FRAME_MS (JITTER_FRAME_SAMPLES * 1000 / JITTER_SAMPLE_RATE)
+#define JITTER_BINS 64           // of JITTER_FRAME_MS, for the lateness histogram
+#define JITTER_MAX_LAG 320       // longest pitch period concealed, 20 ms
+#define JITTER_HISTORY (JITTER_MAX_LAG + JITTER_FRAME_SAMPLES)
+
+typedef struct {
+	uint32_t min_delay_ms;
+	uint32_t max_delay_ms;
+	uint32_t conceal_ms; // longest gap concealed, after which it is silent
+} jitter_cfg_t;
+
+typedef struct {
+	uint32_t frames;     // played, counting the concealed and silent ones
+	uint32_t concealed;  // frames made up for audio that was missing
+	uint32_t underruns;  // times the buffer ran dry while playing
+	uint32_t overruns;   // frames dropped because more than max_delay_ms was waiting
+	uint32_t stretched;  // frames made up to let the delay grow
+	uint32_t compressed; // pairs of frames played as one to bring the delay down
+	uint32_t delay_ms;   // current playout delay
+	uint32_t level_ms;   // audio waiting now
+} jitter_stats_t;
+
+typedef struct {
+	jitter_cfg_t cfg;
+
+	int16_t *fifo; // ring of fifo_len samples
+	size_t   fifo_len, head, count;
+
+	// lateness of arrivals against the earliest of the talk spurt
+	bool     paused;            // since a keepalive, so the next audio starts a talk spurt
+	uint32_t base_ms;           // when the spurt would have arrived without jitter
+	uint32_t media;             // samples that have arrived in the spurt
+	uint16_t hist[JITTER_BINS]; // share of arrivals by lateness, 16 fraction bits
+	uint32_t delay_ms;          // from the histogram
+
+	bool     playing;        // otherwise waiting for the delay to pass, or silent
+	size_t   level_min;      // least audio waiting in this window, in samples
+	uint16_t level_frames;   // frames played in this window
+	size_t   compress;       // samples still to be cut by compressing
+	int16_t  history[JITTER_HISTORY]; // last samples played, oldest first
+	uint32_t conceal_pos;             // samples concealed in this gap
+	uint16_t conceal_lag;             // pitch period repeated
+
+	jitter_stats_t stats;
+} jitter_t;
+
+/*
+ * Allocates the buffer for max_delay_ms and a burst on top, and starts empty.
+ */
+esp_err_t jitter_init(jitter_t *jb, const jitter_cfg_t *cfg);
+
+/*
+ * Forgets the audio waiting and the jitter seen, e.g. when the stream restarts. Keeps the
+ * counters.
+ */
+void jitter_reset(jitter_t *jb);
+
+void jitter_deinit(jitter_t *jb);
+
+/*
+ * Adds `samples` samples that arrived at `now_ms`.
+ */
+void jitter_put(jitter_t *jb, const int16_t *pcm, size_t samples, uint32_t now_ms);
+
+/*
+ * Writes the next JITTER_FRAME_SAMPLES samples to play to `out`.
+ */
+void jitter_get(jitter_t *jb, int16_t *out, uint32_t now_ms);
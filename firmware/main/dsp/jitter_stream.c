@@ -0,0 +1,148 @@
+#include "jitter_stream.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define JITTER_STREAM_IN_BYTES 2048 // HTTP_STREAM_BUFFER_SIZE
+#define JITTER_STREAM_OUT_FRAMES 4  // between this element and the DAC, on top of the delay
+
+static const char *TAG = "jitter_stream";
+
+typedef struct {
+	jitter_t jb;
+	uint8_t  in[JITTER_STREAM_IN_BYTES];
+	size_t   in_fill; // an odd byte left from the last read
+	int16_t  out[JITTER_FRAME_SAMPLES];
+	bool     ended; // the input is done, and what is left is being played out
+	uint64_t cycles;
+
+	jitter_stream_played_t played;
+} jitter_stream_t;
+
+static uint32_t jitter_stream_now_ms(void) {
+	return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static esp_err_t jitter_stream_open(audio_element_handle_t self) {
+	jitter_stream_t *js = (jitter_stream_t *)audio_element_getdata(self);
+	jitter_reset(&js->jb);
+	js->in_fill = 0;
+	js->ended = false;
+	// the output is paced by the DAC, so the input is only ever polled
+	audio_element_set_input_timeout(self, 0);
+	return ESP_OK;
+}
+
+static esp_err_t jitter_stream_close(audio_element_handle_t self) {
+	jitter_stream_t *js = (jitter_stream_t *)audio_element_getdata(self);
+	jitter_stats_t  *st = &js->jb.stats;
+	if (st->frames > 0) {
+		ESP_LOGI(TAG,
+		         "jitter_stream_close: %lu frames played, %lu concealed, %lu underruns, "
+		         "%lu overruns, %lu stretched, %lu compressed, delay %lu ms, %llu cycles "
+		         "per frame",
+		         st->frames, st->concealed, st->underruns, st->overruns, st->stretched,
+		         st->compressed, st->delay_ms, js->cycles / st->frames);
+	}
+	return ESP_OK;
+}
+
+/*
+ * Puts everything that has arrived into the jitter buffer, without waiting. Returns 0, or the
+ * input's error.
+ */
+static int jitter_stream_read(audio_element_handle_t self, jitter_stream_t *js) {
+	while (!js->ended) {
+		int r = audio_element_input(self, (char *)js->in + js->in_fill,
+		                            sizeof(js->in) - js->in_fill);
+		if (r == AEL_IO_TIMEOUT) {
+			return 0;
+		} else if (r == AEL_IO_DONE || r == AEL_IO_OK) {
+			js->ended = true;
+			return 0;
+		} else if (r < 0) {
+			return r;
+		}
+		size_t bytes = js->in_fill + r;
+
+		esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+		jitter_put(&js->jb, (const int16_t *)js->in, bytes / sizeof(int16_t),
+		           jitter_stream_now_ms());
+		js->cycles += (esp_cpu_cycle_count_t)(esp_cpu_get_cycle_count() - start);
+
+		js->in_fill = bytes & 1;
+		if (js->in_fill) {
+			js->in[0] = js->in[bytes - 1];
+		}
+		if (bytes < sizeof(js->in)) {
+			return 0;
+		}
+	}
+	return 0;
+}
+
+static int jitter_stream_process(audio_element_handle_t self, char *buf, int len) {
+	jitter_stream_t *js = (jitter_stream_t *)audio_element_getdata(self);
+	int              r = jitter_stream_read(self, js);
+	if (r < 0) {
+		return r;
+	}
+	if (js->ended && js->jb.count < JITTER_FRAME_SAMPLES) {
+		return AEL_IO_DONE;
+	}
+
+	esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+	jitter_get(&js->jb, js->out, jitter_stream_now_ms());
+	js->cycles += (esp_cpu_cycle_count_t)(esp_cpu_get_cycle_count() - start);
+	if (js->played != NULL) {
+		js->played(js->out, JITTER_FRAME_SAMPLES);
+	}
+	return audio_element_output(self, (char *)js->out, sizeof(js->out));
+}
+
+static esp_err_t jitter_stream_destroy(audio_element_handle_t self) {
+	jitter_stream_t *js = (jitter_stream_t *)audio_element_getdata(self);
+	jitter_deinit(&js->jb);
+	free(js);
+	return ESP_OK;
+}
+
+audio_element_handle_t jitter_stream_init(const jitter_cfg_t *cfg, jitter_stream_played_t played) {
+	jitter_stream_t *js = calloc(1, sizeof(jitter_stream_t));
+	if (js == NULL) {
+		ESP_LOGE(TAG, "jitter_stream_init: Out of memory");
+		return NULL;
+	}
+	if (jitter_init(&js->jb, cfg) != ESP_OK) {
+		ESP_LOGE(TAG, "jitter_stream_init: Failed to allocate the buffer");
+		free(js);
+		return NULL;
+	}
+	js->played = played;
+
+	audio_element_cfg_t el_cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+	el_cfg.open = jitter_stream_open;
+	el_cfg.close = jitter_stream_close;
+	el_cfg.process = jitter_stream_process;
+	el_cfg.destroy = jitter_stream_destroy;
+	el_cfg.buffer_len = 0; // reads straight into js->in
+	el_cfg.out_rb_size = JITTER_STREAM_OUT_FRAMES * sizeof(js->out);
+	el_cfg.tag = "jitter";
+	audio_element_handle_t el = audio_element_init(&el_cfg);
+	if (el == NULL) {
+		ESP_LOGE(TAG, "jitter_stream_init: Failed to create element");
+		jitter_deinit(&js->jb);
+		free(js);
+		return NULL;
+	}
+	audio_element_setdata(el, js);
+	return el;
+}
+
+jitter_stream_stats_t jitter_stream_get_stats(audio_element_handle_t self) {
+	jitter_stream_t      *js = (jitter_stream_t *)audio_element_getdata(self);
+	jitter_stream_stats_t ret = {.jitter = js->jb.stats, .cycles = js->cycles};
+	return ret;
+}
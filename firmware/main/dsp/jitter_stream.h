@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+ * Audio element that plays the peer's audio through a jitter buffer, see jitter.h. Goes in front
+ * of the I2S writer of the RX pipeline, and takes 16 kHz, 16-bit mono PCM as it arrives. It
+ * hands on a 10 ms frame whenever the writer has room, so the DAC never waits on the network.
+ */
+
+#include "audio_element.h"
+#include "jitter.h"
+
+/*
+ * Takes each frame of `n` samples as it is handed to the DAC, e.g. for echo cancellation.
+ */
+typedef void (*jitter_stream_played_t)(const int16_t *frame, size_t n);
+
+typedef struct {
+	jitter_stats_t jitter;
+	uint64_t       cycles; // CPU cycles spent in jitter_put and jitter_get
+} jitter_stream_stats_t;
+
+/*
+ * Creates the element with `cfg`, or returns NULL. `played`, unless NULL, is called from the
+ * element's task with each frame it hands on.
+ */
+audio_element_handle_t jitter_stream_init(const jitter_cfg_t *cfg, jitter_stream_played_t played);
+
+/*
+ * Returns counters since the element was created, and the current delay and level.
+ */
+jitter_stream_stats_t jitter_stream_get_stats(audio_element_handle_t self);
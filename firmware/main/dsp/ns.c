@@ -0,0 +1,164 @@
+#include "ns.h"
+#include <math.h>
+#include <string.h>
+
+#define NS_SMOOTH 0.8f     // share of the last frame in the smoothed power of a bin
+#define NS_NOISE_BIAS 2.0f // the smoothed power dips below the mean of the noise, by about this
+#define NS_DD 0.95f        // share of the last frame in the decision-directed SNR
+// power of a bin of white noise of 1 LSB RMS, below which the noise is not taken to go, so that
+// a stretch of digital silence does not leave it stuck at nothing: the window halved, over the
+// FFT size, squared, and summed over the window
+#define NS_NOISE_MIN ((float)(1 << 30) / 4 / NS_FFT_SIZE / NS_FFT_SIZE * NS_FRAME_SAMPLES)
+
+esp_err_t ns_init(ns_t *ns, const ns_cfg_t *cfg) {
+	memset(ns, 0, sizeof(*ns));
+	ns->min_gain = powf(10.0f, -(float)cfg->max_db / 20);
+	ns->noise_rise = powf(10.0f, NS_NOISE_RISE_DB * NS_FRAME_MS / 10000.0f);
+	for (int i = 0; i < NS_WINDOW; i++) {
+		ns->window[i] = lroundf(32767 * sinf((float)M_PI * i / NS_WINDOW));
+	}
+#ifdef CONFIG_AUDIO_ESP_DSP
+	esp_err_t err = fft_init(&ns->plan, NS_FFT_BITS);
+	if (err != ESP_OK) {
+		return err;
+	}
+#else
+	for (int k = 0; k < NS_FFT_SIZE / 2; k++) {
+		ns->twiddle[2 * k] = lroundf(32767 * cosf(2 * (float)M_PI * k / NS_FFT_SIZE));
+		ns->twiddle[2 * k + 1] = lroundf(-32767 * sinf(2 * (float)M_PI * k / NS_FFT_SIZE));
+	}
+#endif
+	ns_reset(ns);
+	return ESP_OK;
+}
+
+void ns_reset(ns_t *ns) {
+	memset(ns->last, 0, sizeof(ns->last));
+	memset(ns->overlap, 0, sizeof(ns->overlap));
+	memset(ns->power, 0, sizeof(ns->power));
+	memset(ns->noise, 0, sizeof(ns->noise));
+	memset(ns->cleaned, 0, sizeof(ns->cleaned));
+}
+
+/*
+ * Transforms ns->fft in place, and divides it by NS_FFT_SIZE. Forward on what it holds, and,
+ * since conj(fft(conj(X))) / NS_FFT_SIZE is the inverse FFT, inverse on its conjugate.
+ */
+#ifdef CONFIG_AUDIO_ESP_DSP
+static void ns_fft(ns_t *ns) {
+	for (int i = 0; i < 2 * NS_FFT_SIZE; i++) {
+		ns->fft[i] *= 1.0f / NS_FFT_SIZE;
+	}
+	fft_forward(&ns->plan, ns->fft);
+}
+#else
+static void ns_fft(ns_t *ns) {
+	int32_t *x = ns->fft;
+	for (uint32_t i = 0, j = 0; i < NS_FFT_SIZE; i++) {
+		if (i < j) {
+			int32_t re = x[2 * i], im = x[2 * i + 1];
+			x[2 * i] = x[2 * j];
+			x[2 * i + 1] = x[2 * j + 1];
+			x[2 * j] = re;
+			x[2 * j + 1] = im;
+		}
+		uint32_t bit = NS_FFT_SIZE >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j |= bit;
+	}
+
+	// radix 2, halving each stage, which keeps the samples within 2^29
+	for (uint32_t half = 1; half < NS_FFT_SIZE; half <<= 1) {
+		uint32_t step = NS_FFT_SIZE / (2 * half);
+		for (uint32_t k = 0; k < half; k++) {
+			int32_t wr = ns->twiddle[2 * k * step], wi = ns->twiddle[2 * k * step + 1];
+			for (uint32_t i = k; i < NS_FFT_SIZE; i += 2 * half) {
+				uint32_t j = i + half;
+				int64_t  re = x[2 * j], im = x[2 * j + 1];
+				int32_t  tr = (re * wr - im * wi) >> 15;
+				int32_t  ti = (re * wi + im * wr) >> 15;
+				x[2 * j] = (x[2 * i] - tr) >> 1;
+				x[2 * j + 1] = (x[2 * i + 1] - ti) >> 1;
+				x[2 * i] = (x[2 * i] + tr) >> 1;
+				x[2 * i + 1] = (x[2 * i + 1] + ti) >> 1;
+			}
+		}
+	}
+}
+#endif
+
+static inline ns_sample_t ns_scale(ns_sample_t v, float gain) {
+#ifdef CONFIG_AUDIO_ESP_DSP
+	return v * gain;
+#else
+	return (int64_t)v * (int32_t)(gain * 32767 + 0.5f) >> 15;
+#endif
+}
+
+void ns_process(ns_t *ns, const int16_t *frame, int16_t *out) {
+	ns_stats_t *st = &ns->stats;
+	st->frames++;
+
+	// the last frame and this one under the window, halved to leave the FFT its headroom
+	memset(ns->fft, 0, sizeof(ns->fft));
+	for (int i = 0; i < NS_WINDOW; i++) {
+		int32_t s = i < NS_FRAME_SAMPLES ? ns->last[i] : frame[i - NS_FRAME_SAMPLES];
+		ns->fft[2 * i] = (s * ns->window[i]) >> 1;
+	}
+	for (int i = 0; i < NS_FRAME_SAMPLES; i++) {
+		st->energy_in += (uint32_t)(frame[i] * frame[i]);
+	}
+	memcpy(ns->last, frame, sizeof(ns->last));
+
+	ns_fft(ns);
+	bool first = ns->noise[0] == 0;
+	for (int k = 0; k < NS_BINS; k++) {
+		float re = ns->fft[2 * k], im = ns->fft[2 * k + 1];
+		float p = re * re + im * im;
+		ns->power[k] = first ? p : NS_SMOOTH * ns->power[k] + (1 - NS_SMOOTH) * p;
+		float noise = ns->power[k] * NS_NOISE_BIAS;
+		if (first || noise < ns->noise[k]) {
+			ns->noise[k] = noise > NS_NOISE_MIN ? noise : NS_NOISE_MIN;
+		} else {
+			ns->noise[k] *= ns->noise_rise;
+		}
+
+		float snr = p / ns->noise[k] - 1;
+		float xi = NS_DD * ns->cleaned[k] / ns->noise[k];
+		xi += (1 - NS_DD) * (snr > 0 ? snr : 0);
+		float gain = xi / (1 + xi);
+		if (gain < ns->min_gain) {
+			gain = ns->min_gain;
+		}
+		ns->cleaned[k] = gain * gain * p;
+
+		// the bin and its mirror, conjugated for the inverse
+		ns_sample_t *lo = ns->fft + 2 * k, *hi = ns->fft + 2 * (NS_FFT_SIZE - k);
+		lo[0] = ns_scale(lo[0], gain);
+		lo[1] = -ns_scale(lo[1], gain);
+		if (k > 0 && k < NS_FFT_SIZE / 2) {
+			hi[0] = ns_scale(hi[0], gain);
+			hi[1] = -ns_scale(hi[1], gain);
+		}
+	}
+	ns_fft(ns);
+
+	// the real part is the conjugate's; it holds the window halved, times 2^5 / 2^15
+	for (int i = 0; i < NS_WINDOW; i++) {
+#ifdef CONFIG_AUDIO_ESP_DSP
+		int32_t v = lrintf(ns->fft[2 * i] * ns->window[i] / (1 << 14));
+#else
+		int32_t v = (int64_t)ns->fft[2 * i] * ns->window[i] >> 14;
+#endif
+		if (i >= NS_FRAME_SAMPLES) {
+			ns->overlap[i - NS_FRAME_SAMPLES] = v;
+			continue;
+		}
+		// the windows of the two halves add up to 1, with 6 bits to round off
+		int32_t o = (ns->overlap[i] + v + (1 << 5)) >> 6;
+		out[i] = o > INT16_MAX ? INT16_MAX : o < INT16_MIN ? INT16_MIN : o;
+		st->energy_out += (uint32_t)(out[i] * out[i]);
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+/*
+ * Noise suppression on 16 kHz, 16-bit mono PCM in 10 ms frames.
+ *
+ * Each frame is taken with the one before it, under a square-root Hann window, into an FFT of
+ * NS_FFT_SIZE points. The noise in each bin follows the bin's smoothed power down at once and
+ * up NS_NOISE_RISE_DB a second, so that it settles on the background between words. Each bin
+ * is then scaled by a Wiener gain from its SNR, estimated decision-directed from the last
+ * frame's cleaned power and this frame's, which keeps the residual noise from warbling. The
+ * gain goes no lower than max_db below 1. The frame goes back through the inverse FFT, the
+ * same window, and is added to the second half of the last one, so the output lags the input
+ * by a frame.
+ *
+ * The FFT is fixed point, on 32-bit samples with Q15 twiddles, halved each stage so that it
+ * cannot overflow. With CONFIG_AUDIO_ESP_DSP it is the floating point one of fft.h instead,
+ * which is esp-dsp's.
+ */
+
+#include "esp_err.h"
+#include "fft.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NS_SAMPLE_RATE 16000
+#define NS_FRAME_SAMPLES 160 // 10 ms, and half the window
+#define NS_FRAME_MS (NS_FRAME_SAMPLES * 1000 / NS_SAMPLE_RATE)
+#define NS_WINDOW (2 * NS_FRAME_SAMPLES)
+#define NS_FFT_BITS 9
+#define NS_FFT_SIZE (1 << NS_FFT_BITS) // the window and zeros, so that the gains do not wrap
+#define NS_BINS (NS_FFT_SIZE / 2 + 1)
+#define NS_NOISE_RISE_DB 3 // per second
+
+#ifdef CONFIG_AUDIO_ESP_DSP
+typedef float ns_sample_t;
+#else
+typedef int32_t ns_sample_t;
+#endif
+
+typedef struct {
+	uint32_t max_db; // most the gain takes off a bin
+} ns_cfg_t;
+
+typedef struct {
+	uint32_t frames;
+	uint64_t energy_in; // sums of squared samples
+	uint64_t energy_out;
+} ns_stats_t;
+
+typedef struct {
+	float min_gain;
+	float noise_rise; // factor the noise may rise by per frame
+
+	int16_t     window[NS_WINDOW];         // square root of Hann, Q15
+	ns_sample_t fft[2 * NS_FFT_SIZE];      // re, im
+	int16_t     last[NS_FRAME_SAMPLES];    // input of the last frame
+	int32_t     overlap[NS_FRAME_SAMPLES]; // second half of the last output, 6 bits to round
+#ifdef CONFIG_AUDIO_ESP_DSP
+	fft_t plan;
+#else
+	int16_t twiddle[NS_FFT_SIZE]; // cos and -sin over the first half turn, Q15
+#endif
+
+	float power[NS_BINS];   // smoothed power of each bin
+	float noise[NS_BINS];   // of the noise in each bin, 0 before the first frame
+	float cleaned[NS_BINS]; // power of each bin after the gain, in the last frame
+
+	ns_stats_t stats;
+} ns_t;
+
+esp_err_t ns_init(ns_t *ns, const ns_cfg_t *cfg);
+
+/*
+ * Forgets the noise and the last frame, e.g. when the stream restarts. Keeps the counters.
+ */
+void ns_reset(ns_t *ns);
+
+/*
+ * Suppresses the noise in one frame of NS_FRAME_SAMPLES samples, and writes the frame before
+ * it, cleaned, to `out`.
+ */
+void ns_process(ns_t *ns, const int16_t *frame, int16_t *out);
@@ -0,0 +1,80 @@
+#include "ns_stage.h"
+#include "esp_log.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NS_FRAME_BYTES (NS_FRAME_SAMPLES * sizeof(int16_t))
+
+#ifdef CONFIG_AUDIO_ESP_DSP
+#define NS_FFT_NAME FFT_NAME
+#else
+#define NS_FFT_NAME "fixed point"
+#endif
+
+static const char *TAG = "ns_stage";
+
+typedef struct {
+	frame_stage_t stage;
+	ns_t          ns;
+	int16_t       out[NS_FRAME_SAMPLES];
+} ns_stage_t;
+
+static void ns_stage_open(frame_stage_t *self) {
+	ns_stage_t *ss = (ns_stage_t *)self->data;
+	ns_reset(&ss->ns);
+}
+
+static void ns_stage_close(frame_stage_t *self) {
+	ns_stage_t *ss = (ns_stage_t *)self->data;
+	ns_stats_t *st = &ss->ns.stats;
+	if (st->frames > 0) {
+		float   ratio = (st->energy_in + 1.0f) / (st->energy_out + 1.0f);
+		int32_t db10 = lroundf(100 * log10f(ratio));
+		ESP_LOGI(TAG,
+		         "ns_stage_close: %lu frames, %s%ld.%ld dB less out than in, %llu cycles "
+		         "per frame with the %s FFT",
+		         st->frames, db10 < 0 ? "-" : "", labs(db10) / 10, labs(db10) % 10,
+		         self->cycles / st->frames, NS_FFT_NAME);
+	}
+}
+
+static size_t ns_stage_process(frame_stage_t *self, int16_t *in, int16_t **out) {
+	ns_stage_t *ss = (ns_stage_t *)self->data;
+	ns_process(&ss->ns, in, ss->out);
+	*out = ss->out;
+	return NS_FRAME_BYTES;
+}
+
+static void ns_stage_destroy(frame_stage_t *self) {
+	free(self->data);
+}
+
+frame_stage_t *ns_stage_init(const ns_cfg_t *cfg) {
+	ns_stage_t *ss = calloc(1, sizeof(ns_stage_t));
+	if (ss == NULL) {
+		ESP_LOGE(TAG, "ns_stage_init: Out of memory");
+		return NULL;
+	}
+	if (ns_init(&ss->ns, cfg) != ESP_OK) {
+		ESP_LOGE(TAG, "ns_stage_init: Failed to set up the FFT");
+		free(ss);
+		return NULL;
+	}
+
+	ss->stage = (frame_stage_t){
+	    .frame_bytes = NS_FRAME_BYTES,
+	    .data = ss,
+	    .open = ns_stage_open,
+	    .close = ns_stage_close,
+	    .destroy = ns_stage_destroy,
+	    .process = ns_stage_process,
+	};
+	return &ss->stage;
+}
+
+ns_stage_stats_t ns_stage_get_stats(const frame_stage_t *self) {
+	ns_stage_t      *ss = (ns_stage_t *)self->data;
+	ns_stage_stats_t ret = {.ns = ss->ns.stats, .cycles = self->cycles};
+	return ret;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+ * Stage of a frame_stream.h element that suppresses background noise, see ns.h. Goes after the
+ * beamformer in the DSP of the TX pipeline and before the AGC, and takes 16 kHz, 16-bit mono
+ * PCM.
+ */
+
+#include "frame_stream.h"
+#include "ns.h"
+
+typedef struct {
+	ns_stats_t ns;
+	uint64_t   cycles; // CPU cycles spent in the stage
+} ns_stage_stats_t;
+
+/*
+ * Creates the stage with `cfg`, or returns NULL.
+ */
+frame_stage_t *ns_stage_init(const ns_cfg_t *cfg);
+
+/*
+ * Returns counters since the stage was created.
+ */
+ns_stage_stats_t ns_stage_get_stats(const frame_stage_t *self);
@@ -0,0 +1,188 @@
+#include "vad.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VAD_ZCR_MAX 60         // zero crossings per frame above which a frame sounds like hiss
+#define VAD_LOUD_SHIFT 2       // 6 dB over the threshold is speech whatever the crossings
+#define VAD_MIN_FLOOR 16       // noise floor energy, so that digital silence is not a floor
+#define VAD_FLOOR_RISE_SHIFT 6 // the floor rises by 1/64 of the gap per frame of silence
+#define VAD_FLOOR_SPEECH_SHIFT 10 // and by at most 1/1024 of itself per frame in speech
+                                  // (0.4 dB/s), to learn a steady noise that came up
+
+esp_err_t vad_init(vad_t *vad, const vad_cfg_t *cfg) {
+	memset(vad, 0, sizeof(*vad));
+	vad->threshold_q8 = (uint32_t)(256.0f * powf(10.0f, cfg->threshold_db / 10.0f) + 0.5f);
+	vad->hangover_frames = cfg->hangover_ms / VAD_FRAME_MS;
+	vad->preroll_frames = cfg->preroll_ms / VAD_FRAME_MS;
+	if (vad->preroll_frames < VAD_ONSET_FRAMES) {
+		vad->preroll_frames = VAD_ONSET_FRAMES;
+	}
+	vad->keepalive_frames = cfg->keepalive_ms / VAD_FRAME_MS;
+
+	vad->preroll = malloc(vad->preroll_frames * VAD_FRAME_SAMPLES * sizeof(int16_t));
+	if (vad->preroll == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+	vad_reset(vad);
+	return ESP_OK;
+}
+
+void vad_reset(vad_t *vad) {
+	vad->dc = 0;
+	vad->noise_floor = 0;
+	vad->active = false;
+	vad->onset = 0;
+	vad->hang = 0;
+	vad->silence = 0;
+	vad->preroll_head = 0;
+	vad->preroll_count = 0;
+}
+
+void vad_deinit(vad_t *vad) {
+	free(vad->preroll);
+	vad->preroll = NULL;
+}
+
+size_t vad_out_samples(const vad_t *vad) {
+	return vad->preroll_frames * VAD_FRAME_SAMPLES;
+}
+
+/*
+ * Returns whether `frame` is speech, and updates the DC offset and the noise floor.
+ */
+static bool vad_classify(vad_t *vad, const int16_t *frame) {
+	int32_t sum = 0;
+	for (int i = 0; i < VAD_FRAME_SAMPLES; i++) {
+		sum += frame[i];
+	}
+	int32_t mean_q4 = sum * 16 / VAD_FRAME_SAMPLES;
+	if (vad->noise_floor == 0) {
+		vad->dc = mean_q4;
+	} else {
+		vad->dc += (mean_q4 - vad->dc) / 8;
+	}
+	int32_t dc = vad->dc / 16;
+
+	// mean square and sign changes around the DC offset
+	uint64_t square = 0;
+	uint32_t crossings = 0;
+	int32_t  prev = frame[0] - dc;
+	for (int i = 0; i < VAD_FRAME_SAMPLES; i++) {
+		int32_t s = frame[i] - dc;
+		if (s > INT16_MAX) {
+			s = INT16_MAX;
+		} else if (s < INT16_MIN) {
+			s = INT16_MIN;
+		}
+		square += (uint32_t)(s * s);
+		crossings += (s ^ prev) < 0;
+		prev = s;
+	}
+	uint32_t energy = square / VAD_FRAME_SAMPLES;
+
+	if (vad->noise_floor == 0) {
+		vad->noise_floor = energy > VAD_MIN_FLOOR ? energy : VAD_MIN_FLOOR;
+	}
+	uint64_t threshold = (uint64_t)vad->noise_floor * vad->threshold_q8;
+	uint64_t level = (uint64_t)energy << 8;
+	bool     speech = (level > threshold && crossings <= VAD_ZCR_MAX) ||
+	               level > threshold << VAD_LOUD_SHIFT;
+
+	if (energy < vad->noise_floor) {
+		vad->noise_floor -= (vad->noise_floor - energy) / 4;
+		if (vad->noise_floor < VAD_MIN_FLOOR) {
+			vad->noise_floor = VAD_MIN_FLOOR;
+		}
+	} else {
+		uint32_t step = (energy - vad->noise_floor) >> VAD_FLOOR_RISE_SHIFT;
+		// the quiet sounds between syllables are not background
+		if ((speech || vad->active) && step > vad->noise_floor >> VAD_FLOOR_SPEECH_SHIFT) {
+			step = vad->noise_floor >> VAD_FLOOR_SPEECH_SHIFT;
+		}
+		vad->noise_floor += step > 0 ? step : 1;
+	}
+	return speech;
+}
+
+/*
+ * Returns whether `frame` is all zeros, a keepalive rather than audio from a microphone.
+ */
+static bool vad_is_keepalive(const int16_t *frame) {
+	for (int i = 0; i < VAD_FRAME_SAMPLES; i++) {
+		if (frame[i] != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t vad_process(vad_t *vad, const int16_t *frame, int16_t *out) {
+	vad->stats.frames++;
+	vad->stats.bytes_in += VAD_FRAME_SAMPLES * sizeof(int16_t);
+	if (vad_is_keepalive(frame)) {
+		// from the gate before the VAD: passed on, and the end of any utterance, but no
+		// background to learn the noise floor from
+		vad->active = false;
+		vad->onset = 0;
+		vad->silence = 0;
+		vad->preroll_count = 0;
+		memset(out, 0, VAD_FRAME_SAMPLES * sizeof(int16_t));
+		vad->stats.keepalives++;
+		vad->stats.bytes_out += VAD_FRAME_SAMPLES * sizeof(int16_t);
+		return VAD_FRAME_SAMPLES;
+	}
+
+	bool   speech = vad_classify(vad, frame);
+	size_t n = 0;
+
+	if (vad->active) {
+		if (speech || vad->hang > 0) {
+			vad->hang = speech ? vad->hangover_frames : vad->hang - 1;
+			memcpy(out, frame, VAD_FRAME_SAMPLES * sizeof(int16_t));
+			n = VAD_FRAME_SAMPLES;
+			vad->stats.speech_frames++;
+		} else {
+			// the keepalive right away tells the receiver that the utterance is over
+			vad->active = false;
+			vad->onset = 0;
+			vad->silence = vad->keepalive_frames;
+		}
+	} else {
+		memcpy(vad->preroll + vad->preroll_head * VAD_FRAME_SAMPLES, frame,
+		       VAD_FRAME_SAMPLES * sizeof(int16_t));
+		vad->preroll_head = (vad->preroll_head + 1) % vad->preroll_frames;
+		if (vad->preroll_count < vad->preroll_frames) {
+			vad->preroll_count++;
+		}
+		vad->onset = speech ? vad->onset + 1 : 0;
+
+		if (vad->onset >= VAD_ONSET_FRAMES) {
+			vad->active = true;
+			vad->hang = vad->hangover_frames;
+			vad->stats.utterances++;
+			// oldest first, ending with this frame
+			uint16_t i = (vad->preroll_head + vad->preroll_frames - vad->preroll_count) %
+			             vad->preroll_frames;
+			for (; vad->preroll_count > 0; vad->preroll_count--) {
+				memcpy(out + n, vad->preroll + i * VAD_FRAME_SAMPLES,
+				       VAD_FRAME_SAMPLES * sizeof(int16_t));
+				n += VAD_FRAME_SAMPLES;
+				i = (i + 1) % vad->preroll_frames;
+			}
+			vad->preroll_head = 0;
+			vad->stats.speech_frames += n / VAD_FRAME_SAMPLES;
+		} else {
+			vad->silence++;
+		}
+	}
+
+	if (!vad->active && vad->keepalive_frames > 0 && vad->silence >= vad->keepalive_frames) {
+		memset(out, 0, VAD_FRAME_SAMPLES * sizeof(int16_t));
+		n = VAD_FRAME_SAMPLES;
+		vad->silence = 0;
+		vad->stats.keepalives++;
+	}
+	vad->stats.bytes_out += n * sizeof(int16_t);
+	return n;
+}
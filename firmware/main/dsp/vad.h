@@ -0,0 +1,88 @@
+#pragma once
+
+/*
+ * Voice activity detection on 16 kHz, 16-bit mono PCM in 10 ms frames, in fixed point.
+ *
+ * A frame is speech if its energy is threshold_db above the noise floor and its zero-crossing
+ * rate is that of voice rather than hiss, or if it is much louder still. The noise floor
+ * follows quiet frames down quickly and up slowly. Speech starts after VAD_ONSET_FRAMES speech
+ * frames in a row, so that a click does not open the gate, and ends hangover_ms after the last
+ * speech frame, so that the gaps between words stay in.
+ *
+ * vad_process() gates the stream: in speech it passes frames through, starting with the
+ * preroll_ms before the onset, so the first syllable is not cut off. In silence it passes
+ * nothing but a keepalive of VAD_FRAME_SAMPLES zero samples, right when speech ends and then
+ * every keepalive_ms. A microphone never gives a frame of exact zeros, so the receiver can
+ * tell keepalives from audio and take the first one as the end of an utterance. A keepalive
+ * that comes in, from gate.h before the VAD, is passed on and ends the utterance too.
+ */
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define VAD_SAMPLE_RATE 16000
+#define VAD_FRAME_SAMPLES 160 // 10 ms
+#define VAD_FRAME_MS (VAD_FRAME_SAMPLES * 1000 / VAD_SAMPLE_RATE)
+#define VAD_ONSET_FRAMES 3
+
+typedef struct {
+	uint32_t threshold_db; // frame energy above the noise floor that is speech
+	uint32_t hangover_ms;  // speech kept after the last speech frame
+	uint32_t preroll_ms;   // audio sent from before the onset
+	uint32_t keepalive_ms; // between keepalives in silence; 0 sends none
+} vad_cfg_t;
+
+typedef struct {
+	uint32_t frames;        // frames processed
+	uint32_t speech_frames; // frames passed through
+	uint32_t utterances;    // onsets
+	uint32_t keepalives;
+	uint64_t bytes_in;
+	uint64_t bytes_out; // audio and keepalives
+} vad_stats_t;
+
+typedef struct {
+	uint32_t threshold_q8;    // energy ratio to the noise floor for speech, 8 fraction bits
+	uint16_t hangover_frames; // hangover_ms in frames
+	uint16_t preroll_frames;  // frames held back in silence, at least VAD_ONSET_FRAMES
+	uint16_t keepalive_frames;
+
+	int32_t  dc;          // DC offset of the input, 4 fraction bits
+	uint32_t noise_floor; // energy of background frames
+	bool     active;      // in speech
+	uint16_t onset;       // speech frames in a row while not active
+	uint16_t hang;        // frames left in the hangover
+	uint32_t silence;     // frames since the last keepalive
+
+	int16_t *preroll; // ring of preroll_frames frames
+	uint16_t preroll_head, preroll_count;
+
+	vad_stats_t stats;
+} vad_t;
+
+/*
+ * Allocates the pre-roll buffer and starts with no speech.
+ */
+esp_err_t vad_init(vad_t *vad, const vad_cfg_t *cfg);
+
+/*
+ * Forgets the noise floor and the audio held back, e.g. when the stream restarts. Keeps the
+ * counters.
+ */
+void vad_reset(vad_t *vad);
+
+void vad_deinit(vad_t *vad);
+
+/*
+ * Most samples one call to vad_process() can write: the pre-roll, which ends with the frame
+ * of the onset.
+ */
+size_t vad_out_samples(const vad_t *vad);
+
+/*
+ * Classifies one frame of VAD_FRAME_SAMPLES samples and writes what is to be sent to `out`,
+ * which holds vad_out_samples(). Returns the number of samples written, often 0.
+ */
+size_t vad_process(vad_t *vad, const int16_t *frame, int16_t *out);
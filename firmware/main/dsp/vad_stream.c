@@ -0,0 +1,88 @@
+#include "vad_stream.h"
+#include "esp_log.h"
+#include "frame_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define VAD_FRAME_BYTES (VAD_FRAME_SAMPLES * sizeof(int16_t))
+
+static const char *TAG = "vad_stream";
+
+typedef struct {
+	frame_stage_t stage;
+	vad_t         vad;
+	int16_t      *out;
+} vad_stream_t;
+
+static void vad_stream_open(frame_stage_t *self) {
+	vad_stream_t *vs = (vad_stream_t *)self->data;
+	vad_reset(&vs->vad);
+}
+
+static void vad_stream_close(frame_stage_t *self) {
+	vad_stream_t *vs = (vad_stream_t *)self->data;
+	vad_stats_t  *st = &vs->vad.stats;
+	if (st->frames > 0) {
+		ESP_LOGI(TAG,
+		         "vad_stream_close: %lu of %lu frames sent in %lu utterances, %llu of %llu "
+		         "bytes, %llu cycles per frame",
+		         st->speech_frames, st->frames, st->utterances, st->bytes_out, st->bytes_in,
+		         self->cycles / st->frames);
+	}
+}
+
+static size_t vad_stream_process(frame_stage_t *self, int16_t *in, int16_t **out) {
+	vad_stream_t *vs = (vad_stream_t *)self->data;
+	*out = vs->out;
+	return vad_process(&vs->vad, in, vs->out) * sizeof(int16_t);
+}
+
+static void vad_stream_destroy(frame_stage_t *self) {
+	vad_stream_t *vs = (vad_stream_t *)self->data;
+	vad_deinit(&vs->vad);
+	free(vs->out);
+	free(vs);
+}
+
+audio_element_handle_t vad_stream_init(const vad_cfg_t *cfg) {
+	vad_stream_t *vs = calloc(1, sizeof(vad_stream_t));
+	if (vs == NULL) {
+		ESP_LOGE(TAG, "vad_stream_init: Out of memory");
+		return NULL;
+	}
+	if (vad_init(&vs->vad, cfg) != ESP_OK) {
+		ESP_LOGE(TAG, "vad_stream_init: Failed to allocate the pre-roll");
+		free(vs);
+		return NULL;
+	}
+	vs->out = malloc(vad_out_samples(&vs->vad) * sizeof(int16_t));
+	if (vs->out == NULL) {
+		ESP_LOGE(TAG, "vad_stream_init: Out of memory");
+		vad_deinit(&vs->vad);
+		free(vs);
+		return NULL;
+	}
+
+	vs->stage = (frame_stage_t){
+	    .frame_bytes = VAD_FRAME_BYTES,
+	    .data = vs,
+	    .open = vad_stream_open,
+	    .close = vad_stream_close,
+	    .destroy = vad_stream_destroy,
+	    .process = vad_stream_process,
+	};
+	frame_stage_t         *stage = &vs->stage;
+	audio_element_handle_t el = frame_stream_init("vad", &stage, 1);
+	if (el == NULL) {
+		vad_stream_destroy(stage);
+		return NULL;
+	}
+	return el;
+}
+
+vad_stream_stats_t vad_stream_get_stats(audio_element_handle_t self) {
+	frame_stage_t     *stage = frame_stream_stage(self, 0);
+	vad_stream_t      *vs = (vad_stream_t *)stage->data;
+	vad_stream_stats_t ret = {.vad = vs->vad.stats, .cycles = stage->cycles};
+	return ret;
+}
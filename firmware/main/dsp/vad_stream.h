@@ -0,0 +1,24 @@
+#pragma once
+
+/*
+ * Audio element that passes only speech on, see vad.h. Goes between the I2S reader and the
+ * HTTP writer of the TX pipeline, and takes 16 kHz, 16-bit mono PCM.
+ */
+
+#include "audio_element.h"
+#include "vad.h"
+
+typedef struct {
+	vad_stats_t vad;
+	uint64_t    cycles; // CPU cycles spent in the VAD
+} vad_stream_stats_t;
+
+/*
+ * Creates the element with `cfg`, or returns NULL.
+ */
+audio_element_handle_t vad_stream_init(const vad_cfg_t *cfg);
+
+/*
+ * Returns counters since the element was created.
+ */
+vad_stream_stats_t vad_stream_get_stats(audio_element_handle_t self);
@@ -33,6 +33,7 @@
 #include "esp_log.h"
 #include "freertos/idf_additions.h"
 #include "freertos/projdefs.h"
+#include <string.h>
 
 static const char *TAG = "EPD";
 
@@ -293,52 +294,53 @@ void EPD_7IN5_V2_Display(UBYTE *blackimage) {
 		EPD_SendData2((UBYTE *)(blackimage + j * Width), Width);
 	}
 
+	// Invert one row at a time into a scratch buffer, so that the image buffer still matches
+	// the screen afterwards and later partial updates can send it as is.
 	EPD_SendCommand(0x13);
+	UBYTE row[EPD_7IN5_V2_WIDTH_BYTES];
 	for (UDOUBLE j = 0; j < Height; j++) {
 		for (UDOUBLE i = 0; i < Width; i++) {
-			blackimage[i + j * Width] = ~blackimage[i + j * Width];
+			row[i] = ~blackimage[i + j * Width];
 		}
-	}
-	for (UDOUBLE j = 0; j < Height; j++) {
-		EPD_SendData2((UBYTE *)(blackimage + j * Width), Width);
+		EPD_SendData2(row, Width);
 	}
 	EPD_7IN5_V2_TurnOnDisplay();
 }
 
 /******************************************************************************
-function :	Sends rectangular area from image buffer in RAM to e-Paper and
-		displays. Coordinates are start-inclusive, end-exclusive.
-parameter:	blackimage: full-screen image buffer
+function :	Validates a rectangular area, rounds its x coordinates out to whole
+		bytes and makes it the partial window. Coordinates are
+		start-inclusive, end-exclusive.
+parameter:	caller: function name for log messages
+return:		false if the area is invalid and nothing was sent
 ******************************************************************************/
-void EPD_7IN5_V2_Display_Part(UBYTE *blackimage, UDOUBLE x_start,
-                              UDOUBLE y_start, UDOUBLE x_end, UDOUBLE y_end) {
-	ESP_LOGI(EPD_TAG, "EPD_Display_Part");
-
-	if (x_start >= x_end) {
-		ESP_LOGE(EPD_TAG, "EPD_Display_Part: x_start (%u) must be less than x_end (%u)",
-		         (unsigned int)x_start, (unsigned int)x_end);
-		return;
+static bool EPD_7IN5_V2_SetPartialWindow(const char *caller, UDOUBLE *x_start, UDOUBLE y_start,
+                                         UDOUBLE *x_end, UDOUBLE y_end) {
+	if (*x_start >= *x_end) {
+		ESP_LOGE(EPD_TAG, "%s: x_start (%u) must be less than x_end (%u)", caller,
+		         (unsigned int)*x_start, (unsigned int)*x_end);
+		return false;
 	}
 
 	if (y_start >= y_end) {
-		ESP_LOGE(EPD_TAG, "EPD_Display_Part: y_start (%u) must be less than y_end (%u)",
+		ESP_LOGE(EPD_TAG, "%s: y_start (%u) must be less than y_end (%u)", caller,
 		         (unsigned int)y_start, (unsigned int)y_end);
-		return;
+		return false;
 	}
 
-	if (x_end > EPD_7IN5_V2_WIDTH || y_end > EPD_7IN5_V2_HEIGHT) {
-		ESP_LOGE(EPD_TAG, "EPD_Display_Part: (x_end=%u, y_end=%u) exceeds display range",
-		         (unsigned int)x_end, (unsigned int)y_end);
-		return;
+	if (*x_end > EPD_7IN5_V2_WIDTH || y_end > EPD_7IN5_V2_HEIGHT) {
+		ESP_LOGE(EPD_TAG, "%s: (x_end=%u, y_end=%u) exceeds display range", caller,
+		         (unsigned int)*x_end, (unsigned int)y_end);
+		return false;
 	}
 
 	// Because SPI transmissions are in bytes, the screen only accepts x coordinates that are
 	// multiples of 8.
-	x_start = x_start / 8 * 8;
-	x_end = (x_end + 7) / 8 * 8;
+	*x_start = *x_start / 8 * 8;
+	*x_end = (*x_end + 7) / 8 * 8;
 
-	ESP_LOGI(EPD_TAG, "EPD_Display_Part: Drawing (%u, %u) -- (%u, %u)", (unsigned int)x_start,
-	         (unsigned int)y_start, (unsigned int)x_end, (unsigned int)y_end);
+	ESP_LOGI(EPD_TAG, "%s: Drawing (%u, %u) -- (%u, %u)", caller, (unsigned int)*x_start,
+	         (unsigned int)y_start, (unsigned int)*x_end, (unsigned int)y_end);
 
 	EPD_SendCommand(0x50);
 	EPD_SendData(0xA9);
@@ -347,13 +349,13 @@ void EPD_7IN5_V2_Display_Part(UBYTE *blackimage, UDOUBLE x_start,
 	EPD_SendCommand(0x91); // enter partial mode
 	EPD_SendCommand(0x90); // resolution setting
 
-	EPD_SendData(x_start / 256);
-	EPD_SendData(x_start % 256);
+	EPD_SendData(*x_start / 256);
+	EPD_SendData(*x_start % 256);
 
 	// Unlike in software, the range that the hardware accepts is inclusive on
 	// both ends. Therefore, the end coordinate must be a multiple of 8 minus 1.
-	EPD_SendData((x_end - 1) / 256);
-	EPD_SendData((x_end - 1) % 256);
+	EPD_SendData((*x_end - 1) / 256);
+	EPD_SendData((*x_end - 1) % 256);
 
 	EPD_SendData(y_start / 256);
 	EPD_SendData(y_start % 256);
@@ -362,10 +364,25 @@ void EPD_7IN5_V2_Display_Part(UBYTE *blackimage, UDOUBLE x_start,
 	EPD_SendData((y_end - 1) % 256);
 
 	EPD_SendData(0x01);
+	return true;
+}
+
+/******************************************************************************
+function :	Sends rectangular area from image buffer in RAM to e-Paper and
+		displays. Coordinates are start-inclusive, end-exclusive.
+parameter:	blackimage: full-screen image buffer
+******************************************************************************/
+void EPD_7IN5_V2_Display_Part(UBYTE *blackimage, UDOUBLE x_start,
+                              UDOUBLE y_start, UDOUBLE x_end, UDOUBLE y_end) {
+	ESP_LOGI(EPD_TAG, "EPD_Display_Part");
+
+	if (!EPD_7IN5_V2_SetPartialWindow("EPD_Display_Part", &x_start, y_start, &x_end, y_end)) {
+		return;
+	}
 
 	EPD_SendCommand(0x13);
 
-	UDOUBLE rect_width_bytes = (x_end - x_start + 1) / 8;
+	UDOUBLE rect_width_bytes = (x_end - x_start) / 8;
 	for (UDOUBLE y = y_start; y < y_end; y++) {
 		EPD_SendData2((UBYTE *)(blackimage + y * EPD_7IN5_V2_WIDTH_BYTES + x_start / 8),
 		              rect_width_bytes);
@@ -373,6 +390,56 @@ void EPD_7IN5_V2_Display_Part(UBYTE *blackimage, UDOUBLE x_start,
 	EPD_7IN5_V2_TurnOnDisplay();
 }
 
+/******************************************************************************
+function :	Clears rectangular area of e-Paper to white with a partial refresh.
+		Streams a constant row, so no image buffer is needed.
+		Coordinates are start-inclusive, end-exclusive.
+******************************************************************************/
+void EPD_7IN5_V2_Clear_Part(UDOUBLE x_start, UDOUBLE y_start, UDOUBLE x_end, UDOUBLE y_end) {
+	ESP_LOGI(EPD_TAG, "EPD_Clear_Part");
+
+	if (!EPD_7IN5_V2_SetPartialWindow("EPD_Clear_Part", &x_start, y_start, &x_end, y_end)) {
+		return;
+	}
+
+	EPD_SendCommand(0x13);
+
+	UBYTE   row[EPD_7IN5_V2_WIDTH_BYTES];
+	UDOUBLE rect_width_bytes = (x_end - x_start) / 8;
+	memset(row, 0xFF, rect_width_bytes); // same polarity as the image buffer: 1 is white
+	for (UDOUBLE y = y_start; y < y_end; y++) {
+		EPD_SendData2(row, rect_width_bytes);
+	}
+	EPD_7IN5_V2_TurnOnDisplay();
+}
+
+/******************************************************************************
+function :	Turns the charge pumps off. Registers and image RAM are kept, so
+		EPD_7IN5_V2_PowerOn() is enough to refresh again.
+parameter:
+******************************************************************************/
+void EPD_7IN5_V2_PowerOff(void) {
+	ESP_LOGI(EPD_TAG, "EPD_PowerOff");
+
+	xQueueReset(gpio_evt_queue);
+	EPD_SendCommand(0X02); // POWER OFF
+	EPD_WaitUntilIdle();
+}
+
+/******************************************************************************
+function :	Turns the charge pumps back on after EPD_7IN5_V2_PowerOff().
+		After EPD_7IN5_V2_Sleep(), one of the Init functions is needed instead.
+parameter:
+******************************************************************************/
+void EPD_7IN5_V2_PowerOn(void) {
+	ESP_LOGI(EPD_TAG, "EPD_PowerOn");
+
+	xQueueReset(gpio_evt_queue);
+	EPD_SendCommand(0x04); // POWER ON
+	DEV_Delay_ms(10);
+	EPD_WaitUntilIdle();
+}
+
 /******************************************************************************
 function :	Enter sleep mode
 parameter:
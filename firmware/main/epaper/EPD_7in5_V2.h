@@ -49,6 +49,9 @@
 #define EPD_ClearBlack EPD_7IN5_V2_ClearBlack
 #define EPD_Display EPD_7IN5_V2_Display
 #define EPD_Display_Part EPD_7IN5_V2_Display_Part
+#define EPD_Clear_Part EPD_7IN5_V2_Clear_Part
+#define EPD_PowerOff EPD_7IN5_V2_PowerOff
+#define EPD_PowerOn EPD_7IN5_V2_PowerOn
 #define EPD_Sleep EPD_7IN5_V2_Sleep
 
 UBYTE EPD_7IN5_V2_Init(void);
@@ -59,6 +62,10 @@ void  EPD_7IN5_V2_ClearBlack(void);
 void  EPD_7IN5_V2_Display(UBYTE *blackimage);
 void  EPD_7IN5_V2_Display_Part(UBYTE *blackimage, UDOUBLE x_start,
                                UDOUBLE y_start, UDOUBLE x_end, UDOUBLE y_end);
+void  EPD_7IN5_V2_Clear_Part(UDOUBLE x_start, UDOUBLE y_start, UDOUBLE x_end,
+                             UDOUBLE y_end);
+void  EPD_7IN5_V2_PowerOff(void);
+void  EPD_7IN5_V2_PowerOn(void);
 void  EPD_7IN5_V2_Sleep(void);
 
 #endif
@@ -306,6 +306,51 @@ void Paint_ClearWindows(UWORD Xstart, UWORD Ystart, UWORD Xend, UWORD Yend, UWOR
 	}
 }
 
+/******************************************************************************
+function: Scroll a window up, and fill the rows that scroll in at the bottom
+parameter:
+    Xstart : x starting point, rounded down to a whole byte
+    Ystart : Y starting point
+    Xend   : x end point, rounded up to a whole byte
+    Yend   : y end point
+    Lines  : number of pixel rows to scroll by
+    Color  : color of the rows that scroll in
+Moves whole bytes, so only for 2-color images that are not rotated or mirrored.
+A window as wide as the image is moved with a single memmove.
+******************************************************************************/
+void Paint_ScrollWindows(UWORD Xstart, UWORD Ystart, UWORD Xend, UWORD Yend, UWORD Lines,
+                         UWORD Color) {
+	if (Paint.Scale != 2 || Paint.Rotate != ROTATE_0 || Paint.Mirror != MIRROR_NONE) {
+		ESP_LOGE(TAG, "Paint_ScrollWindows: Only for unrotated 2-color images");
+		return;
+	}
+	if (Xend > Paint.WidthMemory || Yend > Paint.HeightMemory || Ystart >= Yend) {
+		ESP_LOGE(TAG, "Paint_ScrollWindows: Window exceeds image");
+		return;
+	}
+	if (Lines > Yend - Ystart) {
+		Lines = Yend - Ystart;
+	}
+
+	UWORD  byte_start = Xstart / 8, byte_end = (Xend + 7) / 8;
+	UWORD  row_bytes = byte_end - byte_start;
+	UBYTE *dst = Paint.Image + Ystart * Paint.WidthByte + byte_start;
+	UBYTE *src = dst + Lines * Paint.WidthByte;
+	UWORD  rows = Yend - Ystart - Lines;
+
+	if (row_bytes == Paint.WidthByte) {
+		memmove(dst, src, rows * Paint.WidthByte);
+	} else {
+		for (UWORD Y = 0; Y < rows; Y++) {
+			memmove(dst + Y * Paint.WidthByte, src + Y * Paint.WidthByte, row_bytes);
+		}
+	}
+
+	for (UWORD Y = Yend - Lines; Y < Yend; Y++) {
+		memset(Paint.Image + Y * Paint.WidthByte + byte_start, Color, row_bytes);
+	}
+}
+
 /******************************************************************************
 function: Draw Point(Xpoint, Ypoint) Fill the color
 parameter:
@@ -627,6 +672,167 @@ void Paint_DrawString_EN(UWORD Xstart, UWORD Ystart, const char *pString, sFONT
 	}
 }
 
+/******************************************************************************
+function: Write up to 8 bits, MSB first, at any bit position of an image row
+parameter:
+    Row   : first byte of the image row
+    X     : bit position in the row
+    Bits  : bits to write, in the high bits
+    Count : number of bits, 1 to 8
+******************************************************************************/
+static void Paint_WriteBits(UBYTE *Row, UWORD X, UBYTE Bits, UBYTE Count) {
+	UBYTE *dst = Row + X / 8;
+	UBYTE  shift = X % 8;
+	UBYTE  mask = 0xFF << (8 - Count);
+
+	if (shift == 0 && Count == 8) {
+		*dst = Bits;
+		return;
+	}
+	Bits &= mask;
+	dst[0] = (dst[0] & ~(mask >> shift)) | (Bits >> shift);
+	if (shift + Count > 8) {
+		dst[1] = (dst[1] & ~(UBYTE)(mask << (8 - shift))) | (UBYTE)(Bits << (8 - shift));
+	}
+}
+
+/*
+ * Glyph rows FirstPage..FirstPage + Pages of pString, XORed with invert, into the rows of Image
+ * from (Xstart, Ystart) on.
+ */
+static void Paint_RenderText(UBYTE *Image, UWORD WidthByte, UWORD Xstart, UWORD Ystart,
+                             const char *pString, UWORD Len, sFONT *Font, UWORD FirstPage,
+                             UWORD Pages, UBYTE invert) {
+	UWORD glyph_row_bytes = Font->Width / 8 + (Font->Width % 8 ? 1 : 0);
+
+	for (UWORD Page = FirstPage; Page < FirstPage + Pages; Page++) {
+		UBYTE *row = Image + (Ystart + Page - FirstPage) * WidthByte;
+		UWORD  X = Xstart;
+		for (UWORD i = 0; i < Len; i++) {
+			const unsigned char *ptr =
+			    &Font->table[((pString[i] - ' ') * Font->Height + Page) * glyph_row_bytes];
+			for (UWORD Column = 0; Column < Font->Width; Column += 8) {
+				UBYTE count = Font->Width - Column < 8 ? Font->Width - Column : 8;
+				Paint_WriteBits(row, X + Column, *ptr++ ^ invert, count);
+			}
+			X += Font->Width;
+		}
+	}
+}
+
+/******************************************************************************
+function: Display a run of characters on one line, background included
+parameter:
+    Xstart           ：X coordinate
+    Ystart           ：Y coordinate
+    pString          ：The characters, not necessarily null-terminated
+    Len              ：Number of characters
+    Font             ：A structure pointer that displays a character size
+    Color_Foreground : Select the foreground color
+    Color_Background : Select the background color
+Copies the glyphs a byte at a time instead of setting each pixel, for 2-color
+images that are not rotated or mirrored. Others are drawn with Paint_DrawChar.
+******************************************************************************/
+void Paint_DrawTextRun(UWORD Xstart, UWORD Ystart, const char *pString, UWORD Len,
+                       sFONT *Font, UWORD Color_Foreground, UWORD Color_Background) {
+	UWORD Xend = Xstart + Len * Font->Width;
+	UWORD Yend = Ystart + Font->Height;
+
+	if (Xend > Paint.Width || Yend > Paint.Height) {
+		ESP_LOGE(TAG, "Paint_DrawTextRun: (%u, %u) exceeds display range", Xend, Yend);
+		return;
+	}
+
+	if (Paint.Scale != 2 || Paint.Rotate != ROTATE_0 || Paint.Mirror != MIRROR_NONE ||
+	    Color_Foreground == Color_Background) {
+		Paint_ClearWindows(Xstart, Ystart, Xend, Yend, Color_Background);
+		for (UWORD i = 0; i < Len; i++) {
+			Paint_DrawChar(Xstart + i * Font->Width, Ystart, pString[i], Font,
+			               Color_Foreground, Color_Background);
+		}
+		return;
+	}
+
+	// glyph bits are set for the foreground, image bits for white
+	Paint_RenderText(Paint.Image, Paint.WidthByte, Xstart, Ystart, pString, Len, Font, 0,
+	                 Font->Height, Color_Foreground == BLACK ? 0xFF : 0x00);
+}
+
+/******************************************************************************
+function: Rasterize rows of a run of characters into a 1-bit image of its own
+parameter:
+    Image            ：Len * Font->Width wide, rows padded to a byte, Rows high
+    pString          ：The characters, not necessarily null-terminated
+    Len              ：Number of characters
+    Font             ：A structure pointer that displays a character size
+    FirstRow         ：First row of the glyphs to rasterize
+    Rows             ：Number of rows
+    Color_Foreground : BLACK or WHITE
+    Color_Background : BLACK or WHITE
+The image has the bits of a 2-color frame buffer, for Paint_BlitImage.
+The padding bits are left as they are.
+******************************************************************************/
+void Paint_RasterizeText(UBYTE *Image, const char *pString, UWORD Len, sFONT *Font,
+                         UWORD FirstRow, UWORD Rows, UWORD Color_Foreground,
+                         UWORD Color_Background) {
+	UWORD WidthByte = (Len * Font->Width + 7) / 8;
+
+	if (Color_Foreground == Color_Background) {
+		memset(Image, Color_Background == BLACK ? 0x00 : 0xFF, WidthByte * Rows);
+		return;
+	}
+	Paint_RenderText(Image, WidthByte, 0, 0, pString, Len, Font, FirstRow, Rows,
+	                 Color_Foreground == BLACK ? 0xFF : 0x00);
+}
+
+/******************************************************************************
+function: Display a 1-bit image at any X
+parameter:
+    Image  ：Image start address, with the bits of a 2-color frame buffer and
+             rows padded to a byte
+    Xstart ：X coordinate
+    Ystart ：Y coordinate
+    Width  ：Image width
+    Height ：Image height
+Unlike Paint_DrawImage, Xstart and Width need not be multiples of 8, and
+rotated or mirrored images are drawn a pixel at a time.
+******************************************************************************/
+void Paint_BlitImage(const UBYTE *Image, UWORD Xstart, UWORD Ystart, UWORD Width, UWORD Height) {
+	UWORD ImageWidthByte = (Width + 7) / 8;
+
+	if (Xstart + Width > Paint.Width || Ystart + Height > Paint.Height) {
+		ESP_LOGE(TAG, "Paint_BlitImage: (%u, %u) exceeds display range", Xstart + Width,
+		         Ystart + Height);
+		return;
+	}
+
+	if (Paint.Scale != 2 || Paint.Rotate != ROTATE_0 || Paint.Mirror != MIRROR_NONE) {
+		for (UWORD y = 0; y < Height; y++) {
+			const UBYTE *src = Image + y * ImageWidthByte;
+			for (UWORD x = 0; x < Width; x++) {
+				UBYTE white = src[x / 8] & (0x80 >> (x % 8));
+				Paint_SetPixel(Xstart + x, Ystart + y, white ? WHITE : BLACK);
+			}
+		}
+		return;
+	}
+
+	UWORD full = Xstart % 8 ? 0 : Width / 8; // bytes that can be copied as they are
+
+	for (UWORD y = 0; y < Height; y++) {
+		const UBYTE *src = Image + y * ImageWidthByte;
+		UBYTE       *row = Paint.Image + (Ystart + y) * Paint.WidthByte;
+		UBYTE       *dst = row + Xstart / 8;
+		for (UWORD i = 0; i < full; i++) {
+			dst[i] = src[i];
+		}
+		for (UWORD Column = full * 8; Column < Width; Column += 8) {
+			UBYTE count = Width - Column < 8 ? Width - Column : 8;
+			Paint_WriteBits(row, Xstart + Column, src[Column / 8], count);
+		}
+	}
+}
+
 /******************************************************************************
 function: Display the string
 parameter:
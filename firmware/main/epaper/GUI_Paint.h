@@ -201,6 +201,8 @@ void Paint_SetScale(UBYTE scale);
 void Paint_Clear(UWORD Color);
 void Paint_ClearWindows(UWORD Xstart, UWORD Ystart, UWORD Xend, UWORD Yend,
                         UWORD Color);
+void Paint_ScrollWindows(UWORD Xstart, UWORD Ystart, UWORD Xend, UWORD Yend, UWORD Lines,
+                         UWORD Color);
 
 // Drawing
 void Paint_DrawPoint(UWORD Xpoint, UWORD Ypoint, UWORD Color,
@@ -220,6 +222,11 @@ void Paint_DrawChar(UWORD Xstart, UWORD Ystart, const char Acsii_Char,
 void Paint_DrawString_EN(UWORD Xstart, UWORD Ystart, const char *pString,
                          sFONT *Font, UWORD Color_Foreground,
                          UWORD Color_Background);
+void Paint_DrawTextRun(UWORD Xstart, UWORD Ystart, const char *pString, UWORD Len,
+                       sFONT *Font, UWORD Color_Foreground, UWORD Color_Background);
+void Paint_RasterizeText(UBYTE *Image, const char *pString, UWORD Len, sFONT *Font,
+                         UWORD FirstRow, UWORD Rows, UWORD Color_Foreground,
+                         UWORD Color_Background);
 #if 0
 void Paint_DrawString_CN(UWORD Xstart, UWORD Ystart, const char *pString,
                          cFONT *font, UWORD Color_Foreground,
@@ -234,5 +241,6 @@ void Paint_DrawTime(UWORD Xstart, UWORD Ystart, PAINT_TIME *pTime, sFONT *Font,
 void Paint_DrawBitMap(const unsigned char *image_buffer);
 void Paint_DrawImage(const unsigned char *image_buffer, UWORD xStart,
                      UWORD yStart, UWORD W_Image, UWORD H_Image);
+void Paint_BlitImage(const UBYTE *Image, UWORD Xstart, UWORD Ystart, UWORD Width, UWORD Height);
 
 #endif
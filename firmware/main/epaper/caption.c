@@ -1,26 +1,145 @@
-#include "epaper.h"
+#include "caption.h"
+#include "caption_history.h"
+#include "caption_strip.h"
 #include "epaper.h"
 #include "DEV_Config.h"
 #include "EPD_7in5_V2.h"
 #include "GUI_Paint.h"
+#include "esp_cpu.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "font/fonts.h"
 #include "freertos/idf_additions.h"
 #include "freertos/projdefs.h"
+#include "sprite_cache.h"
+#include "token_ring.h"
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 
-#define MSG_BUF_LEN 256
-#define MAX_WORD_LEN 32 // including null terminator
+#define CAPTION_RING_LEN 4096 // bytes; ~10 minutes of speech ahead of the display
+#define CAPTION_CHUNK_LEN 64  // longer tokens are stored as several glued chunks
+#define CAPTION_INDEX_LEN 64  // pieces of the hypothesis that can still be revised
+#define CAPTION_LIVE_CELLS 256 // max. rows * cols of the live band
+#define CAPTION_LIVE_LEN (CAPTION_LIVE_CELLS + 2 * CAPTION_CHUNK_LEN)
+#define CAPTION_RUN_LEN 80     // max. cols of the caption area
+#define CAPTION_TEXT_CELLS 512 // max. rows * cols of committed text
+#define CAPTION_PAGE_TIMEOUT_MS 20000 // back to the live caption after this long
+#define CAPTION_PAGE_LABEL_LEN 16     // page number shown above the caption area, in Font32
+#define CAPTION_PAGE_LABEL_BYTES 2048 // framebuffer bytes under it
+
+// Tokens starting with these are edits rather than text; caption_edit never queues text
+// below ' '.
+#define TOKEN_REWIND '\x01' // followed by the word index in decimal
+#define TOKEN_COMMIT '\x02'
+#define TOKEN_LINE '\x03'   // followed by the row and the column, one byte each, and the text
+#define TOKEN_SCROLL '\x04' // followed by the number of rows, one byte
+
+// A batch that wraps around the end of the ring leaves the end unused, less than the record of
+// the longest token, a TOKEN_LINE of a whole row. Only a batch this much smaller than the ring
+// always fits once it is empty.
+#define CAPTION_RING_SLACK (TOKEN_RING_HDR_LEN + 3 + CAPTION_RUN_LEN + 1)
 
 static const char *TAG = "caption";
 
-MessageBufferHandle_t caption_buf = NULL;
+static token_ring_t caption_ring; // words from caption_append to caption_display
+static bool caption_ring_ready = false;
+static caption_stats_t stats;
 
 static caption_cfg_t cfg;
 
+// text_col is the column right after the last character drawn
 static UWORD text_row = 0, text_col = 0;
+static size_t token_offset = 0; // characters of the oldest token already drawn
+
+static uint32_t last_seq = 0; // caption_edit only
+
+/*
+ * Batching: caption_display holds words back for a while when more are expected soon, so
+ * that they share a refresh. caption_edit stamps the arrival of the oldest word waiting and
+ * keeps the average gap between words; caption_display clears the stamp before it draws.
+ */
+static bool       batch_open = false;  // batch_since is set; shared, seq_cst atomics
+static TickType_t batch_since;         // when the first word of the batch arrived
+static TickType_t last_edit_ticks = 0; // caption_edit only
+static uint32_t   word_gap_ms = 0;     // moving average; written by caption_edit only
+static uint32_t   batch_cols_in = 0;   // cells of words accepted; caption_edit only
+static uint32_t   batch_cols_out = 0;  // cells of words drawn; caption_display only
+
+/*
+ * Where each piece of the hypothesis was drawn, oldest first, so that a revision can erase
+ * exactly those cells. A word split across rows takes one piece per row. Owned by
+ * caption_display.
+ */
+typedef struct {
+	uint16_t word;               // index in the hypothesis
+	UWORD    row, col, len;      // cells taken
+	UWORD    prev_row, prev_col; // cursor before the piece was drawn
+} caption_piece_t;
+
+static caption_piece_t pieces[CAPTION_INDEX_LEN];
+static uint16_t        num_pieces = 0;
+static uint16_t        num_words = 0;    // words in the hypothesis drawn so far
+static uint16_t        frozen_words = 0; // words that can no longer be revised
+
+/*
+ * With a live band (cfg.live_rows > 0), the hypothesis is kept as text and shown in the band
+ * instead, and only moves up to the committed region above once it is committed, or when it
+ * has grown too long for the band. Owned by caption_display.
+ */
+static char     live_buf[CAPTION_LIVE_LEN]; // words of the hypothesis, separated by one space
+static uint16_t live_len = 0;
+static uint16_t live_words = 0;
+static uint16_t live_base = 0;                  // words of the hypothesis already moved up
+static char     live_shown[CAPTION_LIVE_CELLS]; // band contents on screen, row-major
+static struct {
+	bool     valid;
+	uint16_t pos; // offset in live_buf the layout starts at
+	bool     fits;
+	char     cells[CAPTION_LIVE_CELLS];
+} live_cache; // last live_layout result, until live_buf changes
+static UWORD    live_y_start = 0;
+static uint16_t move_words = 0;     // words at the front of live_buf to move up
+static uint16_t move_done = 0;      // of which this many are done
+static uint16_t move_pos = 0;       // offset in live_buf of the word being moved
+static size_t   move_offset = 0;    // characters of that word already moved
+static bool     move_final = false; // the move is a commit, which starts a new hypothesis
+
+/*
+ * Committed rows as on screen, row-major, and when each was started, so that they can go to
+ * the history when they leave the screen. Owned by caption_display.
+ */
+static char     text_cells[CAPTION_TEXT_CELLS];
+static uint32_t row_ms[CAPTION_TEXT_CELLS / 8]; // there are at least 8 cols
+
+/*
+ * Paging through the history: caption_page sets the page wanted, 0 being the live caption,
+ * and caption_display shows it.
+ */
+static int        page_requested = 0; // shared, atomics
+static TickType_t page_requested_at;  // shared, atomics
+static int        page_shown = 0;     // caption_display only
+static UBYTE      page_label_under[CAPTION_PAGE_LABEL_BYTES]; // what the label covers
+
+/*
+ * Characters placed by caption_put but not drawn yet. Pieces that follow each other on a row
+ * are drawn together, spaces included, by one run_flush. Owned by caption_display.
+ */
+static struct {
+	UWORD row, col, len;
+	char  chars[CAPTION_RUN_LEN];
+} run;
+
+// area drawn or erased by one caption_display call
+typedef struct {
+	UWORD min_x, min_y, max_x, max_y;
+	bool  need_clear; // rows clear_row_start..clear_row_end are about to be reached
+	UWORD clear_row_start, clear_row_end;
+	bool  scrolled; // the committed rows moved up
+} caption_pass_t;
+
 static UWORD total_text_rows = 0, total_text_cols = 0; // # rows/cols we can display in the area
 
 static bool rect_is_valid(UWORD x_start, UWORD y_start, UWORD x_end, UWORD y_end) {
@@ -28,6 +147,16 @@ static bool rect_is_valid(UWORD x_start, UWORD y_start, UWORD x_end, UWORD y_end
 	       (y_end <= EPD_7IN5_V2_HEIGHT);
 }
 
+static void live_reset(void) {
+	live_len = live_words = live_base = 0;
+	live_buf[0] = '\0';
+	live_cache.valid = false;
+	memset(live_shown, ' ', sizeof(live_shown));
+	move_words = move_done = move_pos = 0;
+	move_offset = 0;
+	move_final = false;
+}
+
 epaper_err_t caption_init(caption_cfg_t *init_cfg) {
 	if (!rect_is_valid(init_cfg->x_start, init_cfg->y_start, init_cfg->x_end,
 	                   init_cfg->y_end)) {
@@ -43,198 +172,1093 @@ epaper_err_t caption_init(caption_cfg_t *init_cfg) {
 	UWORD rows = (init_cfg->y_end - init_cfg->y_start) / init_cfg->font->Height;
 	UWORD cols = (init_cfg->x_end - init_cfg->x_start) / init_cfg->font->Width;
 
-	if (cols < 8 || rows < 2) {
+	if (cols < 8 || rows < init_cfg->live_rows + 2) {
 		ESP_LOGE(TAG, "caption_init: Area too small");
 		return EPAPER_ERR;
 	}
 
-	if (caption_buf == NULL) {
+	if (cols > CAPTION_RUN_LEN) {
+		ESP_LOGE(TAG, "caption_init: Area too wide");
+		return EPAPER_ERR;
+	}
+
+	if ((rows - init_cfg->live_rows) * cols > CAPTION_TEXT_CELLS) {
+		ESP_LOGE(TAG, "caption_init: Area too large");
+		return EPAPER_ERR;
+	}
+
+	if (init_cfg->live_rows * cols > CAPTION_LIVE_CELLS) {
+		ESP_LOGE(TAG, "caption_init: Live band too large");
+		return EPAPER_ERR;
+	}
+
+	if (!caption_ring_ready) {
 		// create buffer if not yet
-		caption_buf = xMessageBufferCreate(MSG_BUF_LEN);
-		if (caption_buf == NULL) {
+		if (token_ring_init(&caption_ring, CAPTION_RING_LEN) != EPAPER_OK) {
 			ESP_LOGE(TAG, "caption_init: Failed to create caption buffer");
 			return EPAPER_ERR;
 		}
+		caption_ring_ready = true;
 		ESP_LOGI(TAG, "caption_init: Created caption buffer");
 	} else {
 		// clear buffer if it exists
-		xMessageBufferReset(caption_buf);
+		token_ring_reset(&caption_ring);
 		ESP_LOGI(TAG, "caption_init: Reset caption buffer");
 	}
 
+	if (init_cfg->history_size > 0 &&
+	    caption_history_init(init_cfg->history_size, init_cfg->history_minutes * 60000) !=
+	        EPAPER_OK) {
+		ESP_LOGW(TAG, "caption_init: Continuing without history");
+	}
+	if (sprite_cache_init(init_cfg->sprite_cache_size) != EPAPER_OK) {
+		ESP_LOGW(TAG, "caption_init: Continuing without word cache");
+	}
+	if (caption_strip_init(init_cfg) != EPAPER_OK) {
+		ESP_LOGW(TAG, "caption_init: Continuing without caption strips");
+	}
+
 	cfg = *init_cfg;
+	memset(text_cells, ' ', sizeof(text_cells));
+	page_requested = page_shown = 0;
 	text_row = 0;
 	text_col = 0;
-	total_text_rows = rows;
+	token_offset = 0;
+	run.len = 0;
+	num_pieces = num_words = frozen_words = 0;
+	last_seq = 0;
+	batch_open = false;
+	batch_cols_in = batch_cols_out = 0;
+	word_gap_ms = 0;
+	total_text_rows = rows - cfg.live_rows; // rows of committed text
 	total_text_cols = cols;
-	ESP_LOGI(TAG, "caption_init: Initialized caption area with %u columns, %u rows",
-	         total_text_cols, total_text_rows);
+	live_y_start = cfg.y_start + total_text_rows * cfg.font->Height;
+	live_reset();
+	ESP_LOGI(TAG, "caption_init: Initialized caption area with %u columns, %u + %u rows, "
+	              "batching deadline %u ms",
+	         total_text_cols, total_text_rows, cfg.live_rows, cfg.batch_deadline_ms);
 	return EPAPER_OK;
 }
 
+/*
+ * Committed row `row` as on screen.
+ */
+static char *row_cells(UWORD row) { return text_cells + row * total_text_cols; }
+
+/*
+ * Adds a committed row to the history as it leaves the screen, and blanks it.
+ */
+static void row_retire(UWORD row) {
+	caption_history_add(row_cells(row), total_text_cols, row_ms[row]);
+	memset(row_cells(row), ' ', total_text_cols);
+}
+
+/*
+ * Where the page label goes: right above the caption area, in whole bytes of the framebuffer.
+ */
+static epaper_refresh_area_t page_label_area(void) {
+	return (epaper_refresh_area_t){
+		.mode = EPAPER_REFRESH_PARTIAL,
+		.x_start = (cfg.x_end - CAPTION_PAGE_LABEL_LEN * Font32.Width) / 8 * 8,
+		.y_start = cfg.y_start - Font32.Height,
+		.x_end = (cfg.x_end + 7) / 8 * 8,
+		.y_end = cfg.y_start,
+	};
+}
+
+/*
+ * Saves or puts back what the page label covers, e.g. the peer's name.
+ */
+static void page_label_swap(bool save) {
+	epaper_refresh_area_t area = page_label_area();
+	UWORD                 row_bytes = (area.x_end - area.x_start) / 8;
+	if (row_bytes * (area.y_end - area.y_start) > sizeof(page_label_under)) {
+		return;
+	}
+	for (UWORD y = area.y_start; y < area.y_end; y++) {
+		UBYTE *fb = Paint.Image + y * Paint.WidthByte + area.x_start / 8;
+		UBYTE *under = page_label_under + (y - area.y_start) * row_bytes;
+		memcpy(save ? under : fb, save ? fb : under, row_bytes);
+	}
+}
+
+static bool clear_requested = false; // by caption_clear, for caption_display
+
 epaper_err_t caption_clear() {
+	__atomic_store_n(&clear_requested, true, __ATOMIC_SEQ_CST);
+	return EPAPER_OK;
+}
+
+/*
+ * Does what caption_clear asks for, on epaper_task, as it changes the rows caption_display draws.
+ */
+static epaper_err_t clear_now() {
+	// the rows after the cursor are the oldest ones when wrapping, and blank when scrolling
+	for (UWORD i = 1; i <= total_text_rows; i++) {
+		row_retire((text_row + i) % total_text_rows);
+	}
+	if (page_shown > 0) {
+		page_label_swap(false);
+		epaper_refresh_area_t label_area = page_label_area();
+		epaper_refresh(EPAPER_CLASS_INPUT, &label_area);
+	}
+	__atomic_store_n(&page_requested, 0, __ATOMIC_SEQ_CST);
+	page_shown = 0;
+
 	text_row = 0;
 	text_col = 0;
+	num_pieces = num_words = frozen_words = 0;
+	live_reset();
+	caption_strip_invalidate();
 
-	Paint_ClearWindows(cfg.x_start, cfg.y_start, cfg.x_end, cfg.y_end, WHITE);
+	// Clear the caption rows across the whole width, so that the previous layout does not
+	// linger in the margins. The rest of the screen (e.g. buttons) is left as is.
+	Paint_ClearWindows(0, cfg.y_start, EPD_7IN5_V2_WIDTH, cfg.y_end, WHITE);
 
-	// HACK: hardcoded to clear entire screen
 	epaper_refresh_area_t refresh_area = {
 		.mode = EPAPER_REFRESH_CLEAR,
+		.x_start = 0,
+		.y_start = cfg.y_start,
+		.x_end = EPD_7IN5_V2_WIDTH,
+		.y_end = cfg.y_end,
 	};
-	if (xQueueSend(epaper_refresh_queue, &refresh_area, 0) == pdFALSE) {
-		ESP_LOGE(TAG, "caption_clear: Failed to enqueue");
+	// part of switching layouts, so it goes ahead of caption text
+	if (epaper_refresh(EPAPER_CLASS_INPUT, &refresh_area) != EPAPER_OK) {
+		ESP_LOGE(TAG, "clear_now: Failed to enqueue");
 		return EPAPER_ERR;
 	}
 	return EPAPER_OK;
 }
 
+/*
+ * Stages one token for caption_edit. On failure, drops everything staged so far.
+ */
+static epaper_err_t stage_token(const char *token, size_t len, bool glued, size_t *num_bytes) {
+	if (!token_ring_push(&caption_ring, token, len, glued)) {
+		token_ring_abort(&caption_ring);
+		stats.posts_rejected++;
+		if (*num_bytes + TOKEN_RING_HDR_LEN + len + 1 > CAPTION_RING_LEN - CAPTION_RING_SLACK) {
+			// would not fit even if the display caught up; retrying won't help
+			ESP_LOGE(TAG, "caption_edit: String too long");
+			return EPAPER_ERR;
+		}
+		return EPAPER_ERR_FULL;
+	}
+	*num_bytes += TOKEN_RING_HDR_LEN + len + 1;
+	return EPAPER_OK;
+}
+
+/*
+ * Updates the batching state after caption_edit queued `words` words taking `cols` cells.
+ */
+static void batch_note_edit(uint32_t words, uint32_t cols) {
+	TickType_t now = xTaskGetTickCount();
+	if (words > 0 && last_edit_ticks != 0) {
+		uint32_t gap_ms = pdTICKS_TO_MS(now - last_edit_ticks) / words;
+		word_gap_ms = (word_gap_ms * 3 + gap_ms) / 4;
+	}
+	if (words > 0) {
+		last_edit_ticks = now;
+	}
+	__atomic_store_n(&batch_cols_in, batch_cols_in + cols, __ATOMIC_SEQ_CST);
+
+	// The tokens are committed before the stamp is checked, and caption_display clears the
+	// stamp before it reads tokens, so a word is never left waiting without one.
+	if (!__atomic_load_n(&batch_open, __ATOMIC_SEQ_CST)) {
+		__atomic_store_n(&batch_since, now, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&batch_open, true, __ATOMIC_SEQ_CST);
+	}
+}
+
+/*
+ * Whether caption_display should draw the words waiting now, or hold them for the ones after
+ * them. Holding is worth it while the words would still be on screen by the deadline after
+ * one more word and a refresh, going by the recent gap between words and refresh time, and
+ * the row they go on still has room.
+ */
+static bool batch_ready(void) {
+	if (cfg.batch_deadline_ms == 0 || move_words > 0) {
+		return true;
+	}
+	if (!__atomic_load_n(&batch_open, __ATOMIC_SEQ_CST)) {
+		// nothing waiting, or left over from a pass that stopped early
+		return true;
+	}
+
+	uint32_t age_ms = pdTICKS_TO_MS(xTaskGetTickCount() -
+	                                __atomic_load_n(&batch_since, __ATOMIC_SEQ_CST));
+	uint32_t busy_ms = age_ms + epaper_get_partial_refresh_us() / 1000;
+	if (busy_ms >= cfg.batch_deadline_ms ||
+	    word_gap_ms >= cfg.batch_deadline_ms - busy_ms) {
+		return true;
+	}
+
+	uint32_t cols = __atomic_load_n(&batch_cols_in, __ATOMIC_SEQ_CST) - batch_cols_out;
+	UWORD    col = cfg.live_rows > 0 ? live_len % total_text_cols : text_col;
+	return col + cols >= total_text_cols;
+}
+
 epaper_err_t caption_append(const char *string) {
-	const size_t string_len = strlen(string);
+	return caption_edit(CAPTION_OP_APPEND, 0, CAPTION_INDEX_END, string);
+}
+
+epaper_err_t caption_edit(caption_op_t op, uint32_t seq, uint16_t index, const char *string) {
+	if (!caption_ring_ready) {
+		ESP_LOGE(TAG, "caption_edit: Not initialized");
+		return EPAPER_ERR;
+	}
+
+	if (seq > 1 && seq <= last_seq) {
+		ESP_LOGW(TAG, "caption_edit: Ignoring duplicate seq %u (last %u)", seq, last_seq);
+		stats.edits_ignored++;
+		return EPAPER_OK;
+	}
+
+	// all tokens of one edit are accepted or none
+	uint32_t     num_tokens = 0, num_new_words = 0, num_cols = 0;
+	size_t       num_bytes = 0;
+	epaper_err_t err;
+
+	if (op != CAPTION_OP_APPEND && index != CAPTION_INDEX_END) {
+		char rewind[8];
+		int  len = snprintf(rewind, sizeof(rewind), "%c%u", TOKEN_REWIND, index);
+		if ((err = stage_token(rewind, len, false, &num_bytes)) != EPAPER_OK) {
+			goto rejected;
+		}
+		num_tokens++;
+	}
 
 	// split string into space-delimited words
-	char   word[MAX_WORD_LEN];
-	size_t word_len = 0;
-
-	// TODO: handle overflow
-	for (size_t i = 0; i < string_len + 1; i++) {
-		if (string[i] != ' ' && string[i] != '\0') {
-			// append letter to word
-			word[word_len] = string[i];
-			word_len++;
-		} else {
-			// commit word
-			word[word_len] = '\0';
-			size_t bytes_sent =
-			    xMessageBufferSend(caption_buf, (void *)word, word_len + 1, 0);
-			if (bytes_sent != word_len + 1) {
-				ESP_LOGE(TAG,
-				         "caption_append: Failed to send word \"%s\" to buffer "
-				         "(expect to send %u bytes, sent %u)",
-				         word, word_len + 1, bytes_sent);
-				return EPAPER_ERR; // buffer full
+	const char *p = string;
+	while (true) {
+		while (*p == ' ') {
+			p++;
+		}
+		if (*p == '\0') {
+			break;
+		}
+
+		size_t word_len = strcspn(p, " ");
+		bool   glued = false;
+		num_new_words++;
+		num_cols += word_len + 1;
+		while (word_len > 0) {
+			char   chunk[CAPTION_CHUNK_LEN];
+			size_t chunk_len = MIN(word_len, CAPTION_CHUNK_LEN);
+			// the fonts only cover printable ASCII
+			for (size_t i = 0; i < chunk_len; i++) {
+				chunk[i] = (p[i] >= ' ' && p[i] <= '~') ? p[i] : '?';
+			}
+
+			if ((err = stage_token(chunk, chunk_len, glued, &num_bytes)) != EPAPER_OK) {
+				goto rejected;
 			}
-			word_len = 0;
+			num_tokens++;
+			p += chunk_len;
+			word_len -= chunk_len;
+			glued = true;
+		}
+	}
+
+	if (op == CAPTION_OP_COMMIT) {
+		const char commit = TOKEN_COMMIT;
+		if ((err = stage_token(&commit, 1, false, &num_bytes)) != EPAPER_OK) {
+			goto rejected;
 		}
+		num_tokens++;
 	}
+
+	token_ring_commit(&caption_ring);
+	stats.tokens_in += num_tokens;
+	if (seq != 0) {
+		last_seq = seq;
+	}
+	batch_note_edit(num_new_words, num_cols);
 	return EPAPER_OK;
-}
 
-epaper_err_t caption_display() {
-	bool has_update = false, // there is new text to print
-	    has_error = false,   // an error was encountered
-	    need_clear = false;  // a part of the caption area needs to be cleared
+rejected:
+	if (err == EPAPER_ERR_FULL) {
+		ESP_LOGW(TAG, "caption_edit: Buffer full, rejecting \"%s\"", string);
+	}
+	return err;
+}
 
-	// {min,max}_{x,y} will be updated to clamp to the updated area
-	UWORD min_x = cfg.x_end, max_x = cfg.x_start, min_y = cfg.y_end, max_y = cfg.y_start;
+epaper_err_t caption_lines(UWORD scroll, UWORD row, UWORD col, const char *lines) {
+	if (!caption_ring_ready) {
+		ESP_LOGE(TAG, "caption_lines: Not initialized");
+		return EPAPER_ERR;
+	}
+	if (scroll >= total_text_rows) {
+		ESP_LOGW(TAG, "caption_lines: Can't scroll by %u rows", scroll);
+		stats.posts_rejected++;
+		return EPAPER_ERR;
+	}
 
-	UWORD clear_row_start = 0, clear_row_end = 0;
+	// all lines are accepted or none, like the words of caption_edit
+	uint32_t     num_tokens = 0;
+	size_t       num_bytes = 0;
+	epaper_err_t err;
+	if (scroll > 0) {
+		const char token[2] = {TOKEN_SCROLL, scroll};
+		if ((err = stage_token(token, sizeof(token), false, &num_bytes)) != EPAPER_OK) {
+			return err;
+		}
+		num_tokens++;
+	}
 
-	// TODO: edge case where word length > MAX_WORD_LEN (unlikely)
-	while (xMessageBufferIsEmpty(caption_buf) == pdFALSE) {
-		char word[MAX_WORD_LEN];
+	const char *p = lines;
+	for (UWORD r = row; scroll == 0 || *p != '\0'; r++, col = 0) {
+		size_t len = strcspn(p, "\n");
+		if (r >= total_text_rows + cfg.live_rows || col + len > total_text_cols) {
+			ESP_LOGW(TAG, "caption_lines: Line does not fit at row %u, column %u", r, col);
+			token_ring_abort(&caption_ring);
+			stats.posts_rejected++;
+			return EPAPER_ERR;
+		}
 
-		has_update = true;
+		char token[3 + CAPTION_RUN_LEN];
+		token[0] = TOKEN_LINE;
+		token[1] = r;
+		token[2] = col;
+		for (size_t i = 0; i < len; i++) {
+			token[3 + i] = (p[i] >= ' ' && p[i] <= '~') ? p[i] : '?';
+		}
+		if ((err = stage_token(token, 3 + len, false, &num_bytes)) != EPAPER_OK) {
+			return err;
+		}
+		num_tokens++;
 
-		size_t bytes_recv =
-		    xMessageBufferReceive(caption_buf, (void *)word, MAX_WORD_LEN, 0);
-		/* ESP_LOGI(TAG, "caption_display: Received word \"%s\"", word); */
-		if (bytes_recv == 0) {
-			ESP_LOGE(TAG, "caption_display: Failed to receive word from buffer");
-			has_error = true;
+		p += len;
+		if (p[0] == '\0' || (p[0] == '\n' && p[1] == '\0')) {
 			break;
 		}
+		p++;
+	}
 
-		size_t word_len = strlen(word);
+	token_ring_commit(&caption_ring);
+	stats.tokens_in += num_tokens;
+	return EPAPER_OK;
+}
 
-		if (text_col + word_len >= total_text_cols) {
-			// wrap to next row
-			text_col = 0;
-			text_row = (text_row + 1) % total_text_rows;
+caption_geometry_t caption_get_geometry(void) {
+	return (caption_geometry_t){
+		.cols = total_text_cols,
+		.rows = total_text_rows,
+		.live_rows = cfg.live_rows,
+		.font_width = cfg.font->Width,
+		.font_height = cfg.font->Height,
+		.x_start = cfg.x_start,
+		.y_start = cfg.y_start,
+		.refresh_ms = epaper_get_partial_refresh_us() / 1000,
+	};
+}
 
-			// erase area we are going to print on soon
-			if (text_row == total_text_rows / 2 - 1) {
-				clear_row_start = total_text_rows / 2;
-				clear_row_end = total_text_rows;
-				need_clear = true;
-			} else if (text_row == total_text_rows - 1) {
-				clear_row_start = 0;
-				clear_row_end = total_text_rows / 2;
-				need_clear = true;
-			}
+/*
+ * Forgets the oldest `n` pieces, and the rest of the word the last of them belongs to, so that
+ * a word is either fully revisable or not at all.
+ */
+static void pieces_drop_front(uint16_t n) {
+	while (n < num_pieces && n > 0 && pieces[n].word == pieces[n - 1].word) {
+		n++;
+	}
+	n = MIN(n, num_pieces);
+	memmove(pieces, pieces + n, (num_pieces - n) * sizeof(pieces[0]));
+	num_pieces -= n;
+	frozen_words = num_pieces > 0 ? pieces[0].word : num_words;
+}
+
+/*
+ * Scrolls the committed rows up by one, leaving the last one empty for the cursor.
+ */
+static void caption_scroll(caption_pass_t *pass) {
+	row_retire(0);
+	memmove(text_cells, row_cells(1), (total_text_rows - 1) * total_text_cols);
+	memset(row_cells(total_text_rows - 1), ' ', total_text_cols);
+	memmove(row_ms, row_ms + 1, (total_text_rows - 1) * sizeof(row_ms[0]));
+
+	// full width, like caption_clear, so that the rows move with one memmove
+	Paint_ScrollWindows(0, cfg.y_start, EPD_7IN5_V2_WIDTH,
+	                    cfg.y_start + total_text_rows * cfg.font->Height, cfg.font->Height,
+	                    WHITE);
+	pass->scrolled = true;
+
+	// words on the top row are gone, so they can't be revised any more
+	uint16_t n = 0;
+	while (n < num_pieces && pieces[n].row == 0) {
+		n++;
+	}
+	pieces_drop_front(n);
+	for (uint16_t i = 0; i < num_pieces; i++) {
+		pieces[i].row--;
+		if (pieces[i].prev_row == 0) {
+			// the row before is gone; the start of this one puts the word in the same place
+			pieces[i].prev_col = 0;
+		} else {
+			pieces[i].prev_row--;
+		}
+	}
+}
+
+/*
+ * Draws `len` cells of caption text at (x, y), background included. Each word, and each gap
+ * between words, is copied from the sprite cache if it can be.
+ */
+static void draw_text(UWORD x, UWORD y, const char *chars, size_t len) {
+	esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+	for (size_t i = 0, n; i < len; i += n) {
+		bool space = chars[i] == ' ';
+		for (n = 1; i + n < len && (chars[i + n] == ' ') == space; n++) {
+		}
+		UWORD x_start = x + i * cfg.font->Width;
+		if (!sprite_cache_draw(x_start, y, chars + i, n, cfg.font)) {
+			Paint_DrawTextRun(x_start, y, chars + i, n, cfg.font, BLACK, WHITE);
 		}
+	}
+	stats.draw_cycles += (esp_cpu_cycle_count_t)(esp_cpu_get_cycle_count() - start);
+}
+
+/*
+ * Draws the characters placed since the last call.
+ */
+static void run_flush(void) {
+	if (run.len == 0) {
+		return;
+	}
+	UWORD x_start = cfg.x_start + run.col * cfg.font->Width;
+	UWORD y_start = cfg.y_start + run.row * cfg.font->Height;
+	ESP_LOGI(TAG, "caption_display: Drawing \"%.*s\" (x=%d, y=%d, col=%d, row=%d)",
+	         (int)run.len, run.chars, x_start, y_start, run.col, run.row);
+	draw_text(x_start, y_start, run.chars, run.len);
+	run.len = 0;
+}
+
+/*
+ * Adds `len` characters at `col` on `row` to the run, drawing the run first if they don't
+ * continue it.
+ */
+static void run_add(UWORD row, UWORD col, const char *chars, size_t len) {
+	UWORD end = run.col + run.len;
+	if (run.len > 0 && (row != run.row || col < end || col > end + 1)) {
+		run_flush();
+	}
+	if (run.len == 0) {
+		run.row = row;
+		run.col = col;
+	}
+	if (col > run.col + run.len) {
+		run.chars[run.len++] = ' ';
+	}
+	memcpy(run.chars + run.len, chars, len);
+	run.len += len;
+}
+
+/*
+ * Moves to the start of the next row. When wrapping, tells which rows to erase when that is
+ * about to reach text that is still on screen.
+ */
+static void caption_newline(caption_pass_t *pass) {
+	run_flush();
+	text_col = 0;
+	if (cfg.scroll) {
+		if (text_row + 1 < total_text_rows) {
+			text_row++;
+		} else {
+			caption_scroll(pass);
+		}
+		return;
+	}
+
+	text_row = (text_row + 1) % total_text_rows;
 
-		UWORD word_width_px = word_len * cfg.font->Width;
-		UWORD word_start_x = cfg.x_start + text_col * cfg.font->Width;
-		UWORD word_start_y = cfg.y_start + text_row * cfg.font->Height;
-		UWORD word_end_x = word_start_x + word_width_px;
-		UWORD word_end_y = word_start_y + cfg.font->Height;
+	// erase area we are going to print on soon
+	if (text_row == total_text_rows / 2 - 1) {
+		pass->clear_row_start = total_text_rows / 2;
+		pass->clear_row_end = total_text_rows;
+		pass->need_clear = true;
+	} else if (text_row == total_text_rows - 1) {
+		pass->clear_row_start = 0;
+		pass->clear_row_end = total_text_rows / 2;
+		pass->need_clear = true;
+	} else {
+		return;
+	}
+	for (UWORD row = pass->clear_row_start; row < pass->clear_row_end; row++) {
+		row_retire(row);
+	}
+
+	// words in the erased rows are gone, so they can't be revised any more
+	uint16_t n = 0;
+	while (n < num_pieces && pieces[n].row >= pass->clear_row_start &&
+	       pieces[n].row < pass->clear_row_end) {
+		n++;
+	}
+	pieces_drop_front(n);
+}
+
+static void pass_grow(caption_pass_t *pass, UWORD x_start, UWORD y_start, UWORD x_end,
+                      UWORD y_end) {
+	pass->min_x = MIN(pass->min_x, x_start);
+	pass->min_y = MIN(pass->min_y, y_start);
+	pass->max_x = MAX(pass->max_x, x_end);
+	pass->max_y = MAX(pass->max_y, y_end);
+}
+
+/*
+ * Places as much of `piece` as fits at the cursor, after a space unless `continues`. A word
+ * that fits on a row of its own is moved there instead of being broken. Returns the number of
+ * characters placed. They are drawn by run_flush.
+ */
+static size_t caption_put(const char *piece, size_t piece_len, bool continues,
+                          caption_pass_t *pass) {
+	UWORD col = (text_col == 0 || continues) ? text_col : text_col + 1;
+
+	if (col + piece_len > total_text_cols &&
+	    (col >= total_text_cols || (!continues && piece_len <= total_text_cols))) {
+		caption_newline(pass);
+		col = 0;
+	}
+	piece_len = MIN(piece_len, total_text_cols - col);
+
+	UWORD word_width_px = piece_len * cfg.font->Width;
+	UWORD word_start_x = cfg.x_start + col * cfg.font->Width;
+	UWORD word_start_y = cfg.y_start + text_row * cfg.font->Height;
+	UWORD word_end_x = word_start_x + word_width_px;
+	UWORD word_end_y = word_start_y + cfg.font->Height;
+	pass_grow(pass, word_start_x, word_start_y, word_end_x, word_end_y);
+
+	run_add(text_row, col, piece, piece_len);
+	memcpy(row_cells(text_row) + col, piece, piece_len);
+	if (col == 0) {
+		row_ms[text_row] = esp_timer_get_time() / 1000;
+	}
+
+	text_col = col + piece_len;
+	return piece_len;
+}
+
+/*
+ * Erases the hypothesis from word `index` on and moves the cursor back to where it started.
+ */
+static void caption_rewind(uint16_t index, caption_pass_t *pass) {
+	run_flush();
+	if (index < frozen_words) {
+		ESP_LOGW(TAG, "caption_display: Words from %u on are no longer on screen, keeping "
+		              "them",
+		         index);
+		index = frozen_words;
+	}
+	if (index >= num_words) {
+		return;
+	}
 
-		min_x = MIN(min_x, word_start_x);
-		min_y = MIN(min_y, word_start_y);
-		max_x = MAX(max_x, word_end_x);
-		max_y = MAX(max_y, word_end_y);
+	uint16_t first = 0;
+	while (first < num_pieces && pieces[first].word < index) {
+		first++;
+	}
+	for (uint16_t i = first; i < num_pieces; i++) {
+		UWORD x_start = cfg.x_start + pieces[i].col * cfg.font->Width;
+		UWORD y_start = cfg.y_start + pieces[i].row * cfg.font->Height;
+		UWORD x_end = x_start + pieces[i].len * cfg.font->Width;
+		UWORD y_end = y_start + cfg.font->Height;
+		Paint_ClearWindows(x_start, y_start, x_end, y_end, WHITE);
+		pass_grow(pass, x_start, y_start, x_end, y_end);
+		memset(row_cells(pieces[i].row) + pieces[i].col, ' ', pieces[i].len);
+	}
+	if (first < num_pieces) {
+		text_row = pieces[first].prev_row;
+		text_col = pieces[first].prev_col;
+	}
 
-		ESP_LOGI(TAG, "caption_display: Drawing \"%s\" (x=%d:%d, y=%d:%d, col=%d, row=%d)",
-		         word, word_start_x, word_end_x, word_start_y, word_end_y, text_col,
-		         text_row);
+	ESP_LOGI(TAG, "caption_display: Revising words %u..%u", index, num_words - 1);
+	stats.words_revised += num_words - index;
+	num_pieces = first;
+	num_words = index;
+}
 
-		Paint_DrawString_EN(word_start_x, word_start_y, word, cfg.font, BLACK, WHITE);
+/*
+ * Offset in live_buf of word `index`, or live_len if there are not that many words.
+ */
+static uint16_t live_word_offset(uint16_t index) {
+	uint16_t pos = 0;
+	while (index > 0 && pos < live_len) {
+		pos += strcspn(live_buf + pos, " ");
+		pos += pos < live_len;
+		index--;
+	}
+	return pos;
+}
 
-		text_col += strlen(word) + 1;
+/*
+ * Lays out the live words from `pos` on in the band, like caption_put would. Returns false if
+ * they don't fit; `*cells_out` then holds what does. The result stays valid until live_buf
+ * changes, and is reused while it does not.
+ */
+static bool live_layout(uint16_t pos, const char **cells_out) {
+	char *cells = live_cache.cells;
+	*cells_out = cells;
+	if (live_cache.valid && live_cache.pos == pos) {
+		return live_cache.fits;
+	}
 
-		if (need_clear) {
+	UWORD band_cells = cfg.live_rows * total_text_cols;
+	UWORD cell = 0; // next free cell, row-major
+	bool  fits = true;
+	live_cache.pos = pos;
+
+	memset(cells, ' ', band_cells);
+	while (pos < live_len) {
+		size_t len = strcspn(live_buf + pos, " ");
+		UWORD  col = cell % total_text_cols;
+		if (col > 0) {
+			// after a space, or on the next row if the word would fit there whole
+			cell += (col + 1 + len > total_text_cols && len <= total_text_cols)
+			            ? total_text_cols - col
+			            : 1;
+		}
+		if (cell + len > band_cells) {
+			if (cell < band_cells) {
+				memcpy(cells + cell, live_buf + pos, band_cells - cell);
+			}
+			fits = false;
 			break;
 		}
+		memcpy(cells + cell, live_buf + pos, len);
+		cell += len;
+		pos += len;
+		pos += pos < live_len;
 	}
 
-	UWORD clear_y_start = cfg.y_start + clear_row_start * cfg.font->Height,
-	      clear_y_end = cfg.y_start + clear_row_end * cfg.font->Height;
+	live_cache.valid = true;
+	live_cache.fits = fits;
+	return fits;
+}
 
-	if (has_update) {
-		epaper_refresh_area_t refresh_area;
-		if (need_clear) {
-			ESP_LOGI(TAG, "caption_display: Updating entire caption area");
-			Paint_ClearWindows(cfg.x_start, clear_y_start, cfg.x_end, clear_y_end,
-			                   WHITE);
-			refresh_area = (epaper_refresh_area_t){
-				.mode = EPAPER_REFRESH_PARTIAL,
-				.x_start = cfg.x_start,
-				.y_start = cfg.y_start,
-				.x_end = cfg.x_end,
-				.y_end = cfg.y_end,
-			};
-		} else {
-			ESP_LOGI(TAG, "caption_display: Updating screen area (%u, %u) -- (%u, %u)",
-			         min_x, min_y, max_x, max_y);
-			refresh_area = (epaper_refresh_area_t){
-				.mode = EPAPER_REFRESH_PARTIAL,
-				.x_start = min_x,
-				.y_start = min_y,
-				.x_end = max_x,
-				.y_end = max_y,
+/*
+ * Applies a token to the hypothesis in the live band. Text that no longer fits in the band is
+ * queued to move up to the committed region, oldest words first.
+ */
+static void live_apply(const char *token, size_t token_len, bool glued) {
+	if (token[0] == TOKEN_REWIND) {
+		uint16_t index = atoi(token + 1);
+		if (index < live_base) {
+			ESP_LOGW(TAG, "caption_display: Words from %u on were already committed, keeping "
+			              "them",
+			         index);
+			index = live_base;
+		}
+		if (index - live_base < live_words) {
+			stats.words_revised += live_words - (index - live_base);
+			live_len = live_word_offset(index - live_base);
+			live_len -= live_len > 0; // the space before
+			live_words = index - live_base;
+			live_buf[live_len] = '\0';
+			live_cache.valid = false;
+		}
+		return;
+	}
+	if (token[0] == TOKEN_COMMIT) {
+		if (live_words == 0) {
+			live_base = 0;
+		}
+		move_words = live_words;
+		move_final = true;
+		return;
+	}
+
+	// the space, the token, and the terminator
+	size_t room = sizeof(live_buf) - live_len - 2;
+	if (token_len > room) {
+		ESP_LOGW(TAG, "caption_display: Word too long for the live band, truncating");
+		token_len = room;
+	}
+	if (!glued && live_len > 0) {
+		live_buf[live_len++] = ' ';
+	}
+	memcpy(live_buf + live_len, token, token_len);
+	live_len += token_len;
+	live_buf[live_len] = '\0';
+	live_cache.valid = false;
+	live_words += !glued || live_words == 0;
+
+	// Move up all but the newest word, which is the one most likely to be revised, so that
+	// the committed region is redrawn once per band rather than once per word.
+	const char *cells;
+	if (live_words > 1 && !live_layout(0, &cells)) {
+		move_words = live_words - 1;
+	}
+}
+
+/*
+ * Moves the next piece of the words queued by live_apply up to the committed region.
+ */
+static void live_move(caption_pass_t *pass) {
+	const char *word = live_buf + move_pos;
+	size_t      len = strcspn(word, " ");
+	move_offset += caption_put(word + move_offset, len - move_offset, move_offset > 0, pass);
+	if (move_offset < len) {
+		return;
+	}
+
+	move_pos += len;
+	move_pos += move_pos < live_len;
+	move_offset = 0;
+	if (++move_done < move_words) {
+		return;
+	}
+
+	// drop the moved words from the hypothesis
+	memmove(live_buf, live_buf + move_pos, live_len - move_pos + 1);
+	live_len -= move_pos;
+	live_cache.valid = false;
+	live_words -= move_done;
+	live_base = move_final ? 0 : live_base + move_done;
+	move_pos = move_done = move_words = 0;
+	move_final = false;
+}
+
+/*
+ * Redraws the cells of the live band that changed.
+ */
+static void live_draw(caption_pass_t *band) {
+	const char *cells;
+	live_layout(live_word_offset(move_words), &cells); // words being moved up are not shown
+
+	for (UWORD row = 0; row < cfg.live_rows; row++) {
+		const char *new = cells + row * total_text_cols;
+		char       *old = live_shown + row * total_text_cols;
+		UWORD       first = 0, last = total_text_cols;
+		while (first < last && new[first] == old[first]) {
+			first++;
+		}
+		while (last > first && new[last - 1] == old[last - 1]) {
+			last--;
+		}
+		if (first == last) {
+			continue;
+		}
+
+		UWORD x_start = cfg.x_start + first * cfg.font->Width;
+		UWORD x_end = cfg.x_start + last * cfg.font->Width;
+		UWORD y_start = live_y_start + row * cfg.font->Height;
+		UWORD y_end = y_start + cfg.font->Height;
+		draw_text(x_start, y_start, new + first, last - first);
+		pass_grow(band, x_start, y_start, x_end, y_end);
+		memcpy(old + first, new + first, last - first);
+	}
+}
+
+/*
+ * Puts a line laid out by the server on `row`, from column `col` to the end of the row, and
+ * draws the cells that changed. The badge no longer knows where the words of the hypothesis
+ * are, so they can't be revised any more.
+ */
+static void line_put(UWORD row, UWORD col, const char *chars, size_t len, caption_pass_t *pass) {
+	run_flush();
+	char *old = row < total_text_rows ? row_cells(row)
+	                                  : live_shown + (row - total_text_rows) * total_text_cols;
+	char  new[CAPTION_RUN_LEN];
+	memcpy(new, old, col);
+	memcpy(new + col, chars, len);
+	memset(new + col + len, ' ', total_text_cols - col - len);
+	if (row < total_text_rows && col == 0) {
+		row_ms[row] = esp_timer_get_time() / 1000;
+	}
+	num_pieces = num_words = frozen_words = 0;
+
+	UWORD first = col, last = total_text_cols;
+	while (first < last && new[first] == old[first]) {
+		first++;
+	}
+	while (last > first && new[last - 1] == old[last - 1]) {
+		last--;
+	}
+	if (first == last) {
+		return;
+	}
+
+	UWORD x_start = cfg.x_start + first * cfg.font->Width;
+	UWORD y_start = cfg.y_start + row * cfg.font->Height;
+	draw_text(x_start, y_start, new + first, last - first);
+	pass_grow(pass, x_start, y_start, cfg.x_start + last * cfg.font->Width,
+	          y_start + cfg.font->Height);
+	memcpy(old + first, new + first, last - first);
+}
+
+/*
+ * Counts a token taken out of the ring towards the cells drawn, the same way caption_edit
+ * counted it in.
+ */
+static void batch_drawn(const char *token, size_t token_len, bool glued) {
+	if (token[0] == TOKEN_REWIND || token[0] == TOKEN_COMMIT || token[0] == TOKEN_LINE ||
+	    token[0] == TOKEN_SCROLL) {
+		return;
+	}
+	batch_cols_out += token_len + (glued ? 0 : 1);
+}
+
+static bool caption_refresh(const caption_pass_t *pass) {
+	if (pass->min_x >= pass->max_x || pass->min_y >= pass->max_y) {
+		return true;
+	}
+	// text drawn over strips leaves no base for a delta
+	caption_strip_invalidate();
+	ESP_LOGI(TAG, "caption_display: Updating screen area (%u, %u) -- (%u, %u)", pass->min_x,
+	         pass->min_y, pass->max_x, pass->max_y);
+	epaper_refresh_area_t refresh_area = {
+		.mode = EPAPER_REFRESH_PARTIAL,
+		.x_start = pass->min_x,
+		.y_start = pass->min_y,
+		.x_end = pass->max_x,
+		.y_end = pass->max_y,
+	};
+	if (epaper_refresh(EPAPER_CLASS_CAPTION, &refresh_area) != EPAPER_OK) {
+		ESP_LOGE(TAG, "caption_display: Failed to enqueue");
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Shows page `page` of the history, 0 being the live caption. Each row is drawn from what was
+ * laid out when it was on screen, so this is one strip per row and one refresh.
+ */
+static void page_show(int page) {
+	char  cells[CAPTION_RUN_LEN];
+	UWORD rows = total_text_rows + cfg.live_rows;
+	ESP_LOGI(TAG, "caption_display: Showing page %d", page);
+	caption_strip_invalidate();
+
+	for (UWORD row = 0; row < rows; row++) {
+		const char *src = cells;
+		if (page == 0) {
+			src = row < total_text_rows ? row_cells(row)
+			                            : live_shown + (row - total_text_rows) * total_text_cols;
+		} else if (row >= total_text_rows ||
+		           !caption_history_get(page * total_text_rows - row, cells,
+		                                total_text_cols)) {
+			memset(cells, ' ', total_text_cols);
+		}
+		draw_text(cfg.x_start, cfg.y_start + row * cfg.font->Height, src, total_text_cols);
+	}
+
+	epaper_refresh_area_t label_area = page_label_area();
+	if (page_shown == 0) {
+		page_label_swap(true);
+	}
+	if (page > 0) {
+		char label[CAPTION_PAGE_LABEL_LEN + 1];
+		int  pages = (caption_history_rows() + total_text_rows - 1) / total_text_rows;
+		int  len = snprintf(label, sizeof(label), "page -%d of %d", page, pages);
+		len = MIN(len, CAPTION_PAGE_LABEL_LEN);
+		// right-aligned, over spaces that hide what was there
+		char padded[CAPTION_PAGE_LABEL_LEN];
+		memset(padded, ' ', sizeof(padded));
+		memcpy(padded + CAPTION_PAGE_LABEL_LEN - len, label, len);
+		Paint_DrawTextRun(cfg.x_end - CAPTION_PAGE_LABEL_LEN * Font32.Width, label_area.y_start,
+		                  padded, CAPTION_PAGE_LABEL_LEN, &Font32, BLACK, WHITE);
+	} else {
+		page_label_swap(false);
+	}
+
+	epaper_refresh_area_t refresh_area = {
+		.mode = EPAPER_REFRESH_PARTIAL,
+		.x_start = cfg.x_start,
+		.y_start = cfg.y_start - Font32.Height,
+		.x_end = cfg.x_end,
+		.y_end = cfg.y_start + rows * cfg.font->Height,
+	};
+	// the reader is waiting for it, like for a button icon
+	if (epaper_refresh(EPAPER_CLASS_INPUT, &refresh_area) != EPAPER_OK) {
+		ESP_LOGE(TAG, "caption_display: Failed to enqueue page");
+	}
+	stats.pages_shown++;
+}
+
+epaper_err_t caption_page(int pages) {
+	int total = (caption_history_rows() + total_text_rows - 1) / total_text_rows;
+	int page = __atomic_load_n(&page_requested, __ATOMIC_SEQ_CST) + pages;
+	page = MAX(0, MIN(page, total));
+	__atomic_store_n(&page_requested_at, xTaskGetTickCount(), __ATOMIC_SEQ_CST);
+	__atomic_store_n(&page_requested, page, __ATOMIC_SEQ_CST);
+	return EPAPER_OK;
+}
+
+epaper_err_t caption_display() {
+	bool has_error = false; // an error was encountered
+
+	if (__atomic_exchange_n(&clear_requested, false, __ATOMIC_SEQ_CST)) {
+		has_error |= clear_now() != EPAPER_OK;
+	}
+
+	// while paged back, new words wait in the queue
+	int page = __atomic_load_n(&page_requested, __ATOMIC_SEQ_CST);
+	if (page != page_shown) {
+		page_show(page);
+		page_shown = page;
+	}
+	if (page_shown > 0) {
+		TickType_t since = __atomic_load_n(&page_requested_at, __ATOMIC_SEQ_CST);
+		if (xTaskGetTickCount() - since >= pdMS_TO_TICKS(CAPTION_PAGE_TIMEOUT_MS)) {
+			ESP_LOGI(TAG, "caption_display: No paging for a while, back to live caption");
+			__atomic_compare_exchange_n(&page_requested, &page, 0, false,
+			                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+		}
+		return EPAPER_OK;
+	}
+
+	// strips from the server are drawn as they come; they are not batched
+	caption_strip_display();
+
+	if (!batch_ready()) {
+		return EPAPER_OK;
+	}
+	__atomic_store_n(&batch_open, false, __ATOMIC_SEQ_CST);
+	esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+
+	// area drawn or erased in the committed region, and in the live band
+	caption_pass_t pass = {.min_x = cfg.x_end, .min_y = cfg.y_end};
+	caption_pass_t band = pass;
+	bool           band_changed = false;
+
+	const char *token;
+	size_t      token_len;
+	bool        glued;
+	while (true) {
+		if (move_words > 0) {
+			live_move(&pass);
+			band_changed = true;
+			if (pass.need_clear) {
+				break;
+			}
+			continue;
+		}
+
+		if ((token = token_ring_peek(&caption_ring, &token_len, &glued)) == NULL) {
+			break;
+		}
+
+		if (token[0] == TOKEN_LINE) {
+			line_put((uint8_t)token[1], (uint8_t)token[2], token + 3, token_len - 3, &pass);
+			token_ring_pop(&caption_ring);
+			stats.tokens_out++;
+			continue;
+		}
+		if (token[0] == TOKEN_SCROLL) {
+			run_flush();
+			for (uint8_t i = 0; i < (uint8_t)token[1]; i++) {
+				caption_scroll(&pass);
+			}
+			token_ring_pop(&caption_ring);
+			stats.tokens_out++;
+			continue;
+		}
+
+		if (cfg.live_rows > 0) {
+			live_apply(token, token_len, glued);
+			band_changed = true;
+			batch_drawn(token, token_len, glued);
+			token_ring_pop(&caption_ring);
+			stats.tokens_out++;
+			continue;
+		}
+
+		if (token[0] == TOKEN_REWIND) {
+			caption_rewind(atoi(token + 1), &pass);
+			token_ring_pop(&caption_ring);
+			stats.tokens_out++;
+			continue;
+		}
+		if (token[0] == TOKEN_COMMIT) {
+			// the hypothesis stays on screen as is
+			num_pieces = num_words = frozen_words = 0;
+			token_ring_pop(&caption_ring);
+			stats.tokens_out++;
+			continue;
+		}
+
+		// draw what fits on the current row
+		UWORD  prev_row = text_row, prev_col = text_col;
+		bool   continues = glued || token_offset > 0;
+		size_t n = caption_put(token + token_offset, token_len - token_offset, continues,
+		                       &pass);
+		if (!continues) {
+			num_words++;
+		}
+
+		if (num_pieces == CAPTION_INDEX_LEN) {
+			pieces_drop_front(1);
+		}
+		if (num_words > frozen_words) {
+			pieces[num_pieces++] = (caption_piece_t){
+				.word = num_words - 1,
+				.row = text_row,
+				.col = text_col - n,
+				.len = n,
+				.prev_row = prev_row,
+				.prev_col = prev_col,
 			};
 		}
 
-		if (xQueueSend(epaper_refresh_queue, &refresh_area, 0) == pdFALSE) {
-			ESP_LOGE(TAG, "caption_display: Failed to enqueue");
-			has_error = true;
+		token_offset += n;
+		if (token_offset == token_len) {
+			batch_drawn(token, token_len, glued);
+			token_ring_pop(&caption_ring);
+			token_offset = 0;
+			stats.tokens_out++;
+		}
+
+		if (pass.need_clear) {
+			break;
 		}
+	}
+	run_flush();
+
+	if (pass.scrolled) {
+		ESP_LOGI(TAG, "caption_display: Scrolled, updating committed rows");
+		pass_grow(&pass, cfg.x_start, cfg.y_start, cfg.x_end,
+		          cfg.y_start + total_text_rows * cfg.font->Height);
+	}
+	if (pass.need_clear) {
+		ESP_LOGI(TAG, "caption_display: Updating entire caption area");
+		UWORD clear_y_start = cfg.y_start + pass.clear_row_start * cfg.font->Height,
+		      clear_y_end = cfg.y_start + pass.clear_row_end * cfg.font->Height;
+		Paint_ClearWindows(cfg.x_start, clear_y_start, cfg.x_end, clear_y_end, WHITE);
+		pass.min_x = cfg.x_start;
+		pass.min_y = cfg.y_start;
+		pass.max_x = cfg.x_end;
+		pass.max_y = cfg.y_start + total_text_rows * cfg.font->Height;
+	}
+	if (band_changed) {
+		live_draw(&band);
+	}
 
-		Paint_ClearWindows(256, 10, 344, 74, WHITE); // HACK
-		epaper_refresh_area_t button_refresh_area = {
-			.mode = EPAPER_REFRESH_PARTIAL,
-			.x_start = 256,
-			.y_start = 10,
-			.x_end = 344,
-			.y_end = 74,
-		};
-		xQueueSend(epaper_refresh_queue, &button_refresh_area, 0);
+	// Text moving up from the band changes both regions at once. One refresh of both costs
+	// less panel time than two, as a partial refresh takes as long whatever its size.
+	if (pass.min_x < pass.max_x && band.min_x < band.max_x) {
+		pass_grow(&pass, band.min_x, band.min_y, band.max_x, band.max_y);
+		band.min_x = band.max_x;
+	}
+	if (pass.min_x < pass.max_x || band_changed) {
+		// not the passes that find nothing to do
+		stats.display_cycles += (esp_cpu_cycle_count_t)(esp_cpu_get_cycle_count() - start);
 	}
 
+	// a commit, or a rewind to words that are gone, changes nothing on screen
+	has_error |= !caption_refresh(&pass);
+	has_error |= !caption_refresh(&band);
+
 	if (has_error) {
 		return EPAPER_ERR;
 	}
 
 	return EPAPER_OK;
 }
+
+caption_stats_t caption_get_stats(void) {
+	caption_stats_t ret = stats;
+	ret.ring_used_max = caption_ring_ready ? caption_ring.used_max : 0;
+	ret.ring_size = CAPTION_RING_LEN;
+	return ret;
+}
+
+caption_cfg_t caption_get_cfg(void) { return cfg; }
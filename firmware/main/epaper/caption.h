@@ -1,6 +1,21 @@
 #pragma once
 
 #include "epaper.h"
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+	uint32_t tokens_in;      // tokens accepted by caption_append
+	uint32_t tokens_out;     // tokens fully drawn by caption_display
+	uint32_t posts_rejected; // caption_append calls refused, e.g. with EPAPER_ERR_FULL
+	uint32_t edits_ignored;  // duplicate seq numbers
+	uint32_t words_revised;  // words erased by REPLACE or COMMIT
+	uint32_t pages_shown;    // history pages, and returns to the live caption
+	uint64_t draw_cycles;    // CPU cycles spent drawing caption text into the framebuffer
+	uint64_t display_cycles; // CPU cycles of caption_display passes that drew, drawing included
+	size_t   ring_used_max;  // most bytes ever waiting to be drawn
+	size_t   ring_size;
+} caption_stats_t;
 
 /*
  * Initializes data structures needed for caption.
@@ -10,18 +25,81 @@ epaper_err_t caption_init(caption_cfg_t *cfg);
 
 /*
  * Clears caption area on screen, so that the next chunk of text will be printed in the top left
- * corner.
+ * corner. Only asks for it: epaper_task clears the area before it next draws any text.
  */
 epaper_err_t caption_clear();
 
 /*
- * Schedules `string` to be printed in caption area on screen.
+ * Schedules `string` to be printed in caption area on screen. Either all words of `string` are
+ * queued or none are: EPAPER_ERR_FULL means the queue has no room for them yet and the caller
+ * should retry later, in order. Does not block.
  *
  * string: null-terminated C string
  */
 epaper_err_t caption_append(const char *string);
 
+typedef enum {
+	CAPTION_OP_APPEND,  // add words after the current hypothesis
+	CAPTION_OP_REPLACE, // replace the hypothesis from word `index` on
+	CAPTION_OP_COMMIT,  // replace from `index` on, then make the hypothesis final
+} caption_op_t;
+
+#define CAPTION_INDEX_END UINT16_MAX // `index` meaning "after the last word"
+
+/*
+ * Edits the current hypothesis, i.e. the words since the last commit. Word `index` counts from
+ * the start of the hypothesis. Only the replaced words are erased and redrawn, unless they have
+ * scrolled away or are too far back to still be tracked, in which case they stay.
+ *
+ * seq numbers the edits of one stream, starting at 1. An edit with a seq that is not greater
+ * than the last one accepted is a duplicate and is ignored; seq 1 starts a new stream, and seq 0
+ * skips the check. Like caption_append, the edit is queued whole or not at all.
+ */
+epaper_err_t caption_edit(caption_op_t op, uint32_t seq, uint16_t index, const char *string);
+
+/*
+ * Shows lines laid out by the caller, e.g. the server, instead of words for the badge to wrap.
+ * First the committed rows scroll up by `scroll` rows, into the history, the way the badge
+ * scrolls its own text. Then `lines`, separated by '\n', go on row `row` and the rows after
+ * it, the first from column `col` and the others from column 0, each blanking the rest of its
+ * row; with `scroll`, `lines` may be empty. Rows count from the top of the caption area, the
+ * live rows at the bottom included (see caption_get_geometry). The lines are queued with the
+ * words of caption_edit, whole or not at all, and are drawn without waiting for more;
+ * EPAPER_ERR means a line does not fit. Does not block.
+ */
+epaper_err_t caption_lines(UWORD scroll, UWORD row, UWORD col, const char *lines);
+
+typedef struct {
+	UWORD    cols, rows;              // grid of committed text, in characters
+	UWORD    live_rows;               // rows of the hypothesis band, below the committed ones
+	UWORD    font_width, font_height; // size of a character cell, in pixels
+	UWORD    x_start, y_start;        // top left corner of the grid on screen
+	uint32_t refresh_ms;              // time a partial refresh took lately, 0 before the first
+} caption_geometry_t;
+
+/*
+ * Returns the caption grid laid out by caption_init, for a caller that lays out lines itself.
+ */
+caption_geometry_t caption_get_geometry(void);
+
 /*
  * Updates area on screen dedicated to caption.
  */
 epaper_err_t caption_display();
+
+/*
+ * Pages the caption area back through rows that have left the screen (`pages` > 0), or forward
+ * towards the live caption (`pages` < 0). While paged back, new words wait in the queue; after
+ * 20 seconds without paging the live caption comes back. Does not block.
+ */
+epaper_err_t caption_page(int pages);
+
+/*
+ * Returns the configuration given to caption_init.
+ */
+caption_cfg_t caption_get_cfg(void);
+
+/*
+ * Returns counters since boot.
+ */
+caption_stats_t caption_get_stats(void);
@@ -0,0 +1,130 @@
+#include "caption_history.h"
+#include "esp_log.h"
+#include "psram.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define HISTORY_HDR_LEN 5   // uint32_t start time in ms, uint8_t length
+#define HISTORY_ROW_BYTES 8 // bytes of history per index entry; rows take more than this
+#define HISTORY_MAX_LEN 0xFF
+
+static const char *TAG = "caption_history";
+
+static uint8_t  *buf = NULL;       // records back to back; none wraps around the end
+static uint32_t *row_index = NULL; // ring of record offsets, oldest first
+static size_t    size = 0;
+static uint32_t  index_len = 0;
+static uint32_t  first = 0, rows = 0; // in row_index
+static size_t    head = 0;            // where the next record goes
+static uint32_t  max_age_ms = 0;
+
+static caption_history_stats_t stats;
+
+epaper_err_t caption_history_init(size_t init_size, uint32_t init_max_age_ms) {
+	if (buf == NULL || size != init_size) {
+		free(buf);
+		free(row_index);
+		size = init_size;
+		index_len = init_size / HISTORY_ROW_BYTES;
+		buf = psram_alloc(size, TAG, "caption_history_init");
+		row_index =
+		    psram_alloc(index_len * sizeof(row_index[0]), TAG, "caption_history_init");
+		if (buf == NULL || row_index == NULL) {
+			ESP_LOGE(TAG, "caption_history_init: Failed to allocate %u bytes",
+			         (unsigned)size);
+			free(buf);
+			free(row_index);
+			buf = NULL;
+			row_index = NULL;
+			size = 0;
+			return EPAPER_ERR;
+		}
+	}
+	max_age_ms = init_max_age_ms;
+	first = rows = 0;
+	head = 0;
+	stats = (caption_history_stats_t){.size = size};
+	return EPAPER_OK;
+}
+
+static size_t record_len(size_t offset) { return HISTORY_HDR_LEN + buf[offset + 4]; }
+
+static uint32_t record_ms(size_t offset) {
+	uint32_t ms;
+	memcpy(&ms, buf + offset, sizeof(ms));
+	return ms;
+}
+
+static void drop_oldest(void) {
+	stats.bytes -= record_len(row_index[first]);
+	first = (first + 1) % index_len;
+	rows--;
+	stats.rows_dropped++;
+}
+
+void caption_history_add(const char *cells, size_t len, uint32_t ms) {
+	if (buf == NULL) {
+		return;
+	}
+	while (len > 0 && cells[len - 1] == ' ') {
+		len--;
+	}
+	if (len == 0) {
+		return;
+	}
+	len = len < HISTORY_MAX_LEN ? len : HISTORY_MAX_LEN;
+
+	while (rows > 0 && ms - record_ms(row_index[first]) > max_age_ms) {
+		drop_oldest();
+	}
+	if (rows == index_len) {
+		drop_oldest();
+	}
+
+	// Records are oldest first from the one after head, so the ones in the way of the new
+	// record are always the oldest. Skipping the end of the buffer drops all after head.
+	size_t n = HISTORY_HDR_LEN + len;
+	size_t pos = head + n > size ? 0 : head;
+	while (rows > 0) {
+		size_t old = row_index[first];
+		bool   skipped = pos == 0 && head > 0 && old >= head;
+		if (!skipped && !(old >= pos && old < pos + n)) {
+			break;
+		}
+		drop_oldest();
+	}
+
+	memcpy(buf + pos, &ms, sizeof(ms));
+	buf[pos + 4] = len;
+	memcpy(buf + pos + HISTORY_HDR_LEN, cells, len);
+	row_index[(first + rows) % index_len] = pos;
+	rows++;
+	head = pos + n;
+
+	stats.bytes += n;
+	stats.first_ms = record_ms(row_index[first]);
+	stats.last_ms = ms;
+}
+
+uint32_t caption_history_rows(void) { return rows; }
+
+bool caption_history_get(uint32_t back, char *cells, size_t len) {
+	if (back == 0 || back > rows) {
+		return false;
+	}
+	size_t offset = row_index[(first + rows - back) % index_len];
+	size_t row_len = buf[offset + 4];
+	row_len = row_len < len ? row_len : len;
+	memcpy(cells, buf + offset + HISTORY_HDR_LEN, row_len);
+	memset(cells + row_len, ' ', len - row_len);
+	return true;
+}
+
+caption_history_stats_t caption_history_get_stats(void) {
+	caption_history_stats_t ret = stats;
+	ret.rows = rows;
+	return ret;
+}
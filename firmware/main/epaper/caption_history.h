@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+ * Append-only history of caption rows that have left the screen, so that they can be paged
+ * back to. Rows are stored as laid out on screen, one record each (timestamp, length and the
+ * characters, trailing spaces dropped), with an index of where each row starts. The oldest rows
+ * are dropped when the history is full or older than its maximum age.
+ *
+ * Only used by epaper_task, except caption_history_rows and caption_history_get_stats.
+ */
+
+#include "epaper.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+	uint32_t rows;              // rows kept
+	uint32_t rows_dropped;      // for lack of room or age
+	size_t   bytes;             // bytes taken by the rows kept
+	size_t   size;              // 0 if there is no history
+	uint32_t first_ms, last_ms; // when the oldest and newest row kept were started
+} caption_history_stats_t;
+
+/*
+ * Allocates a history of `size` bytes, in PSRAM if there is any, keeping rows for up to
+ * `max_age_ms`. Calling it again empties the history.
+ */
+epaper_err_t caption_history_init(size_t size, uint32_t max_age_ms);
+
+/*
+ * Adds a row of `len` cells started at `ms`. Blank rows are skipped.
+ */
+void caption_history_add(const char *cells, size_t len, uint32_t ms);
+
+/*
+ * Number of rows kept.
+ */
+uint32_t caption_history_rows(void);
+
+/*
+ * Copies row `back` (1 is the newest) into `cells`, which is `len` cells wide and padded with
+ * spaces. Returns false if there is no such row.
+ */
+bool caption_history_get(uint32_t back, char *cells, size_t len);
+
+caption_history_stats_t caption_history_get_stats(void);
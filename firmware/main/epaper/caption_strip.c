@@ -0,0 +1,259 @@
+#include "caption_strip.h"
+#include "GUI_Paint.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "token_ring.h"
+#include <string.h>
+
+#define STRIP_RING_LEN 16384 // a few strips of the longest kind
+
+static const char *TAG = "caption_strip";
+
+// queued as its own record, right before the compressed bytes
+typedef struct {
+	uint32_t epoch; // when the strip was posted, see caption_strip_invalidate
+	UWORD    y, height, scroll;
+	uint8_t  enc;
+} strip_hdr_t;
+
+static token_ring_t ring;
+static bool         ring_ready = false;
+
+// caption area, in framebuffer rows and bytes
+static UWORD area_x_byte, area_bytes = 0, area_y, area_height;
+
+// A delta applies if the last keyframe was posted in the current epoch. epoch is bumped by
+// epaper_task; base_epoch, key_epoch and key_rows belong to the posting task.
+static uint32_t epoch = 1, base_epoch = 0;
+static uint32_t key_epoch = 0;
+static UWORD    key_rows = 0; // rows of the area covered by the keyframe being posted
+
+static caption_strip_stats_t stats;
+
+epaper_err_t caption_strip_init(const caption_cfg_t *cfg) {
+	if (!ring_ready) {
+		if (token_ring_init(&ring, STRIP_RING_LEN) != EPAPER_OK) {
+			ESP_LOGE(TAG, "caption_strip_init: Failed to create strip buffer");
+			return EPAPER_ERR;
+		}
+		ring_ready = true;
+	} else {
+		token_ring_reset(&ring);
+	}
+	caption_strip_invalidate();
+
+	if (cfg->x_start % 8 != 0 || cfg->x_end % 8 != 0) {
+		ESP_LOGW(TAG, "caption_strip_init: Caption area not on byte boundaries, no strips");
+		area_bytes = 0;
+		return EPAPER_ERR;
+	}
+	area_x_byte = cfg->x_start / 8;
+	area_bytes = (cfg->x_end - cfg->x_start) / 8;
+	area_y = cfg->y_start;
+	area_height = cfg->y_end - cfg->y_start;
+	return EPAPER_OK;
+}
+
+/*
+ * Bytes that PackBits `data` decompresses to, or 0 if the last run is cut short. A header byte n
+ * of 0..127 is followed by n + 1 literal bytes, -1..-127 by one byte repeated 1 - n times, and
+ * -128 is skipped.
+ */
+static size_t packbits_len(const uint8_t *data, size_t len) {
+	size_t out = 0;
+	for (size_t i = 0; i < len;) {
+		int8_t n = (int8_t)data[i++];
+		if (n >= 0) {
+			if (len - i < (size_t)n + 1) {
+				return 0;
+			}
+			i += n + 1;
+			out += n + 1;
+		} else if (n != -128) {
+			if (i == len) {
+				return 0;
+			}
+			i++;
+			out += 1 - n;
+		}
+	}
+	return out;
+}
+
+epaper_err_t caption_strip_post(caption_strip_enc_t enc, UWORD y, UWORD height, UWORD scroll,
+                                const uint8_t *data, size_t len) {
+	if (!ring_ready || area_bytes == 0) {
+		stats.posts_rejected++;
+		return EPAPER_ERR;
+	}
+	if (len > CAPTION_STRIP_MAX_LEN || (height == 0 && scroll == 0) || y >= area_height ||
+	    height > area_height - y || scroll >= area_height ||
+	    packbits_len(data, len) != (size_t)height * area_bytes) {
+		ESP_LOGW(TAG, "caption_strip_post: Malformed strip of %u rows at %u", height, y);
+		stats.posts_rejected++;
+		return EPAPER_ERR;
+	}
+
+	uint32_t now = __atomic_load_n(&epoch, __ATOMIC_SEQ_CST);
+	if ((enc == CAPTION_STRIP_DELTA || scroll > 0) && base_epoch != now) {
+		stats.strips_stale++;
+		return EPAPER_ERR_STALE;
+	}
+
+	strip_hdr_t hdr = {.epoch = now, .y = y, .height = height, .scroll = scroll, .enc = enc};
+	if (!token_ring_push(&ring, (const char *)&hdr, sizeof(hdr), false) ||
+	    !token_ring_push(&ring, (const char *)data, len, false)) {
+		token_ring_abort(&ring);
+		stats.posts_rejected++;
+		return EPAPER_ERR_FULL;
+	}
+	token_ring_commit(&ring);
+
+	// a keyframe may come in several strips, top to bottom
+	if (enc == CAPTION_STRIP_RLE && height > 0) {
+		if (y == 0) {
+			key_epoch = now;
+			key_rows = height;
+		} else if (key_epoch == now && y <= key_rows) {
+			key_rows = MAX(key_rows, y + height);
+		}
+		if (key_epoch == now && key_rows == area_height) {
+			base_epoch = now;
+		}
+	}
+	stats.strips_in++;
+	stats.bytes_in += len;
+	return EPAPER_OK;
+}
+
+/*
+ * Decompresses `data` into the framebuffer row by row from `row`, replacing the bytes or, for a
+ * delta, XORing into them. The strip has been checked by caption_strip_post.
+ */
+static void strip_decode(UBYTE *row, const uint8_t *data, size_t len, bool delta) {
+	UWORD col = 0;
+	for (size_t i = 0; i < len;) {
+		int8_t         n = (int8_t)data[i++];
+		const uint8_t *src = NULL;
+		size_t         count;
+		UBYTE          fill = 0;
+		if (n >= 0) {
+			src = data + i;
+			count = n + 1;
+			i += count;
+		} else if (n != -128) {
+			fill = data[i++];
+			count = 1 - n;
+		} else {
+			continue;
+		}
+
+		while (count > 0) {
+			UWORD  k = MIN(count, (size_t)(area_bytes - col));
+			UBYTE *dst = row + col;
+			if (src != NULL) {
+				if (delta) {
+					for (UWORD j = 0; j < k; j++) {
+						dst[j] ^= src[j];
+					}
+				} else {
+					memcpy(dst, src, k);
+				}
+				src += k;
+			} else if (!delta) {
+				memset(dst, fill, k);
+			} else if (fill != 0) {
+				// runs of zeros, where nothing changed, cost nothing
+				for (UWORD j = 0; j < k; j++) {
+					dst[j] ^= fill;
+				}
+			}
+			count -= k;
+			col += k;
+			if (col == area_bytes) {
+				col = 0;
+				row += Paint.WidthByte;
+			}
+		}
+	}
+}
+
+/*
+ * Moves the caption area up by `rows` rows and blanks the ones at the bottom.
+ */
+static void strip_scroll(UWORD rows) {
+	UBYTE *dst = Paint.Image + area_y * Paint.WidthByte + area_x_byte;
+	for (UWORD y = 0; y < area_height; y++, dst += Paint.WidthByte) {
+		if (y + rows < area_height) {
+			memcpy(dst, dst + rows * Paint.WidthByte, area_bytes);
+		} else {
+			memset(dst, 0xFF, area_bytes);
+		}
+	}
+}
+
+void caption_strip_display(void) {
+	if (!ring_ready) {
+		return;
+	}
+
+	UWORD       min_y = area_height, max_y = 0;
+	const char *rec;
+	size_t      len;
+	bool        glued;
+	while ((rec = token_ring_peek(&ring, &len, &glued)) != NULL) {
+		strip_hdr_t hdr;
+		memcpy(&hdr, rec, sizeof(hdr));
+		token_ring_pop(&ring);
+		// committed together with its header
+		const uint8_t *data = (const uint8_t *)token_ring_peek(&ring, &len, &glued);
+
+		if ((hdr.enc == CAPTION_STRIP_DELTA || hdr.scroll > 0) && hdr.epoch != epoch) {
+			// the rows it applies to are gone
+			stats.strips_stale++;
+		} else {
+			esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+			if (hdr.scroll > 0) {
+				strip_scroll(hdr.scroll);
+				min_y = 0;
+				max_y = area_height;
+			}
+			UBYTE *row = Paint.Image + (area_y + hdr.y) * Paint.WidthByte + area_x_byte;
+			strip_decode(row, data, len, hdr.enc == CAPTION_STRIP_DELTA);
+			stats.decode_cycles +=
+			    (esp_cpu_cycle_count_t)(esp_cpu_get_cycle_count() - start);
+			stats.strips_out++;
+			if (hdr.height > 0) {
+				min_y = MIN(min_y, hdr.y);
+				max_y = MAX(max_y, hdr.y + hdr.height);
+			}
+		}
+		token_ring_pop(&ring);
+	}
+	if (min_y >= max_y) {
+		return;
+	}
+
+	ESP_LOGI(TAG, "caption_strip_display: Updating rows %u -- %u", min_y, max_y);
+	epaper_refresh_area_t refresh_area = {
+		.mode = EPAPER_REFRESH_PARTIAL,
+		.x_start = area_x_byte * 8,
+		.y_start = area_y + min_y,
+		.x_end = (area_x_byte + area_bytes) * 8,
+		.y_end = area_y + max_y,
+	};
+	if (epaper_refresh(EPAPER_CLASS_CAPTION, &refresh_area) != EPAPER_OK) {
+		ESP_LOGE(TAG, "caption_strip_display: Failed to enqueue");
+	}
+}
+
+void caption_strip_invalidate(void) {
+	__atomic_add_fetch(&epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+caption_strip_stats_t caption_strip_get_stats(void) {
+	caption_strip_stats_t ret = stats;
+	ret.ring_used_max = ring_ready ? ring.used_max : 0;
+	ret.ring_size = STRIP_RING_LEN;
+	return ret;
+}
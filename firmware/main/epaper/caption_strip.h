@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ * Caption strips: rows of the caption area rendered by the server, sent as 1 bit per pixel in
+ * framebuffer polarity (1 is white) and compressed with PackBits. The server can then use any
+ * font and layout, and the badge only decompresses into the framebuffer.
+ *
+ * A strip covers the full width of the caption area, `height` rows from row `y` of the area.
+ * CAPTION_STRIP_RLE replaces the rows; CAPTION_STRIP_DELTA is XORed into them, so that it is
+ * mostly runs of zeros where nothing changed. Before that, the whole area can be moved up by
+ * `scroll` rows, with white rows coming in at the bottom, so that a new line of text costs a
+ * line and not the area. A delta or a scroll only makes sense against what the server last
+ * sent, so it is refused with EPAPER_ERR_STALE until a keyframe (RLE strips of the whole area)
+ * has been posted, and again once anything else draws in the caption area (caption_clear, a
+ * history page, caption text, caption_init). The server then sends a keyframe.
+ *
+ * Strips are queued by caption_strip_post and drawn by caption_display in epaper_task.
+ */
+
+#include "epaper.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAPTION_STRIP_MAX_LEN 4096 // longest compressed strip; the server splits bigger ones
+
+typedef enum {
+	CAPTION_STRIP_RLE,
+	CAPTION_STRIP_DELTA,
+} caption_strip_enc_t;
+
+typedef struct {
+	uint32_t strips_in;      // accepted by caption_strip_post
+	uint32_t strips_out;     // drawn by caption_strip_display
+	uint32_t strips_stale;   // deltas refused or dropped for want of a base
+	uint32_t posts_rejected; // malformed, or refused with EPAPER_ERR_FULL
+	uint64_t bytes_in;       // compressed bytes accepted
+	uint64_t decode_cycles;  // CPU cycles spent decompressing into the framebuffer
+	size_t   ring_used_max;  // most bytes ever waiting to be drawn
+	size_t   ring_size;
+} caption_strip_stats_t;
+
+/*
+ * Takes the caption area from `cfg`, empties the queue and forgets the delta base. Strips need
+ * x_start and x_end on byte boundaries of the framebuffer. Called by caption_init.
+ */
+epaper_err_t caption_strip_init(const caption_cfg_t *cfg);
+
+/*
+ * Queues a strip of `len` compressed bytes, scrolling first if `scroll` is not 0. A scroll may
+ * come without rows (`height` 0). The whole strip is checked here, so a strip that is queued is
+ * drawn. Returns EPAPER_ERR_FULL if the queue has no room for it yet, EPAPER_ERR_STALE for a
+ * delta or scroll without a base and EPAPER_ERR if the strip is malformed. Does not block.
+ */
+epaper_err_t caption_strip_post(caption_strip_enc_t enc, UWORD y, UWORD height, UWORD scroll,
+                                const uint8_t *data, size_t len);
+
+/*
+ * Draws the queued strips into the framebuffer and queues one refresh of the rows they cover.
+ * Only called by caption_display.
+ */
+void caption_strip_display(void);
+
+/*
+ * Makes the next delta stale, because something else drew in the caption area. Deltas already
+ * queued are dropped. Only called in epaper_task.
+ */
+void caption_strip_invalidate(void);
+
+/*
+ * Returns counters since boot.
+ */
+caption_strip_stats_t caption_strip_get_stats(void);
@@ -9,7 +9,9 @@
 
 #include "esp_log.h"
 #include "freertos/idf_additions.h"
+#include "esp_timer.h"
 #include "freertos/projdefs.h"
+#include "sdkconfig.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,9 +31,36 @@
 static bool epaper_is_on = false;
 static TaskHandle_t epaper_task_handle;
 
+// Power state of the panel controller, so that it can be turned off when idle and woken up
+// with as little work as possible. Only touched by epaper_task while holding epaper_sem.
+typedef enum {
+	PANEL_DEEP_SLEEP, // needs a reset and an Init function
+	PANEL_OFF,        // initialized, charge pumps off, EPD_PowerOn is enough
+	PANEL_ON,
+} panel_state_t;
+
+static panel_state_t panel_state = PANEL_DEEP_SLEEP;
+static bool panel_partial = false; // last initialized with EPD_Init_Part
+static TickType_t panel_idle_since;
+
+static uint32_t idle_power_off_ms = CONFIG_EPAPER_IDLE_POWER_OFF_MS;
+static uint32_t idle_deep_sleep_ms = CONFIG_EPAPER_IDLE_DEEP_SLEEP_MS;
+
 bool caption_enabled;
 SemaphoreHandle_t epaper_sem; // take when epaper is refreshing, give when done
-QueueHandle_t epaper_refresh_queue; // queue of areas to refresh
+
+typedef struct {
+	epaper_refresh_area_t area;
+	int64_t enqueued_us;
+} refresh_request_t;
+
+static QueueHandle_t epaper_refresh_queues[EPAPER_NUM_CLASSES]; // one queue of areas per class
+static uint8_t refresh_skips[EPAPER_NUM_CLASSES]; // times a waiting class was passed over
+static epaper_refresh_stats_t refresh_stats[EPAPER_NUM_CLASSES];
+
+static uint32_t partials_since_full = 0; // partial refreshes since the last full-screen one
+static bool ghost_cleanup_queued = false; // and the full-screen one asked for since
+static uint32_t partial_refresh_us = 0;  // moving average of their duration
 
 void epaper_task(void *arg);
 
@@ -44,9 +73,16 @@ epaper_err_t epaper_init(void) {
 	if (first_time) {
 		epaper_sem = xSemaphoreCreateBinary();
 		xSemaphoreGive(epaper_sem);
-		epaper_refresh_queue = xQueueCreate(16, sizeof(epaper_refresh_area_t));
+		for (int i = 0; i < EPAPER_NUM_CLASSES; i++) {
+			epaper_refresh_queues[i] = xQueueCreate(16, sizeof(refresh_request_t));
+		}
+	}
+	for (int i = 0; i < EPAPER_NUM_CLASSES; i++) {
+		xQueueReset(epaper_refresh_queues[i]);
+		refresh_skips[i] = 0;
 	}
-	xQueueReset(epaper_refresh_queue);
+	partials_since_full = 0;
+	ghost_cleanup_queued = false;
 
 	esp_log_level_set(SPI_TAG, ESP_LOG_NONE);
 
@@ -56,6 +92,9 @@ epaper_err_t epaper_init(void) {
 	}
 	EPD_Init_Fast();
 	EPD_Clear();
+	panel_state = PANEL_ON;
+	panel_partial = false;
+	panel_idle_since = xTaskGetTickCount();
 	DEV_Delay_ms(500);
 
 	// Create global framebuffer
@@ -74,10 +113,18 @@ epaper_err_t epaper_init(void) {
 	// Initialize caption layout on screen
 	caption_cfg_t caption_cfg = {
 		.x_start = 16,
-		.y_start = 60,
+		.y_start = 74, // below the icons above the buttons, which end at 74
 		.x_end = 784,
 		.y_end = 480,
 		.font = &Font48,
+		.live_rows = CONFIG_EPAPER_CAPTION_LIVE_ROWS,
+#ifdef CONFIG_EPAPER_CAPTION_SCROLL
+		.scroll = true,
+#endif
+		.batch_deadline_ms = CONFIG_EPAPER_CAPTION_BATCH_DEADLINE_MS,
+		.history_size = CONFIG_EPAPER_CAPTION_HISTORY_KB * 1024,
+		.history_minutes = CONFIG_EPAPER_CAPTION_HISTORY_MINUTES,
+		.sprite_cache_size = CONFIG_EPAPER_CAPTION_SPRITE_CACHE_KB * 1024,
 	};
 	caption_init(&caption_cfg);
 
@@ -101,6 +148,7 @@ epaper_err_t epaper_shutdown(void) {
 		ESP_LOGW(TAG, "epaper_shutdown take semaphore timeout");
 	}
 	EPD_Sleep();
+	panel_state = PANEL_DEEP_SLEEP;
 	vTaskSuspend(epaper_task_handle);
 	free(framebuffer);
 	xSemaphoreGive(epaper_sem);
@@ -109,6 +157,160 @@ epaper_err_t epaper_shutdown(void) {
 	return EPAPER_OK;
 }
 
+epaper_err_t epaper_refresh(epaper_refresh_class_t refresh_class,
+                            const epaper_refresh_area_t *area) {
+	assert(refresh_class < EPAPER_NUM_CLASSES);
+	refresh_request_t req = {
+		.area = *area,
+		.enqueued_us = esp_timer_get_time(),
+	};
+	if (xQueueSend(epaper_refresh_queues[refresh_class], &req, 0) == pdFALSE) {
+		refresh_stats[refresh_class].dropped++;
+		return EPAPER_ERR;
+	}
+	return EPAPER_OK;
+}
+
+uint32_t epaper_refresh_waiting(void) {
+	uint32_t waiting = 0;
+	for (int i = 0; i < EPAPER_NUM_CLASSES; i++) {
+		waiting += uxQueueMessagesWaiting(epaper_refresh_queues[i]);
+	}
+	return waiting;
+}
+
+void epaper_get_refresh_stats(epaper_refresh_stats_t stats[EPAPER_NUM_CLASSES]) {
+	memcpy(stats, refresh_stats, sizeof(refresh_stats));
+}
+
+/*
+ * Takes the next refresh to do: from the first non-empty class, unless a waiting class has
+ * been passed over EPAPER_STARVATION_LIMIT times. Returns false if all queues are empty.
+ */
+static bool refresh_dequeue(refresh_request_t *req, epaper_refresh_class_t *refresh_class) {
+	int first = -1, starved = -1;
+	for (int i = 0; i < EPAPER_NUM_CLASSES; i++) {
+		if (uxQueueMessagesWaiting(epaper_refresh_queues[i]) == 0) {
+			continue;
+		}
+		if (first < 0) {
+			first = i;
+		}
+		if (starved < 0 && refresh_skips[i] >= EPAPER_STARVATION_LIMIT) {
+			starved = i;
+		}
+	}
+	if (first < 0) {
+		return false;
+	}
+
+	int pick = starved >= 0 ? starved : first;
+	if (xQueueReceive(epaper_refresh_queues[pick], req, 0) == pdFALSE) {
+		return false;
+	}
+	if (pick != first) {
+		refresh_stats[pick].promoted++;
+	}
+
+	refresh_skips[pick] = 0;
+	for (int i = 0; i < EPAPER_NUM_CLASSES; i++) {
+		if (i != pick && uxQueueMessagesWaiting(epaper_refresh_queues[i]) > 0) {
+			refresh_skips[i]++;
+		}
+	}
+	*refresh_class = pick;
+	return true;
+}
+
+static void refresh_record(epaper_refresh_class_t refresh_class, const refresh_request_t *req) {
+	epaper_refresh_stats_t *stats = &refresh_stats[refresh_class];
+	uint64_t latency_us = esp_timer_get_time() - req->enqueued_us;
+	stats->count++;
+	stats->total_us += latency_us;
+	stats->max_us = MAX(stats->max_us, latency_us);
+}
+
+static void partial_refresh_record(uint32_t us) {
+	partial_refresh_us = partial_refresh_us == 0 ? us : (partial_refresh_us * 3 + us) / 4;
+}
+
+uint32_t epaper_get_partial_refresh_us(void) { return partial_refresh_us; }
+
+/*
+ * Partial updates leave ghosts of earlier text behind. After enough of them, ask for a full
+ * refresh of the screen when nothing more important is waiting, and again after each partial
+ * one until it could be queued.
+ */
+static void ghost_cleanup_check(epaper_refresh_mode_t refresh_mode) {
+	if (refresh_mode == EPAPER_REFRESH_PARTIAL || refresh_mode == EPAPER_REFRESH_CLEAR) {
+		partials_since_full++;
+		if (CONFIG_EPAPER_GHOST_CLEANUP_PARTIALS > 0 && !ghost_cleanup_queued &&
+		    partials_since_full >= CONFIG_EPAPER_GHOST_CLEANUP_PARTIALS) {
+			epaper_refresh_area_t refresh_area = {
+				.mode = EPAPER_REFRESH_FAST,
+			};
+			if (epaper_refresh(EPAPER_CLASS_HOUSEKEEPING, &refresh_area) == EPAPER_OK) {
+				ESP_LOGI(TAG, "epaper_task: %lu partial refreshes, queued ghost cleanup",
+				         (unsigned long)partials_since_full);
+				ghost_cleanup_queued = true;
+			}
+		}
+	} else {
+		// a full-screen refresh cleans up as well
+		partials_since_full = 0;
+		ghost_cleanup_queued = false;
+		xQueueReset(epaper_refresh_queues[EPAPER_CLASS_HOUSEKEEPING]);
+		refresh_skips[EPAPER_CLASS_HOUSEKEEPING] = 0;
+	}
+}
+
+void epaper_set_idle_timeout(uint32_t power_off_ms, uint32_t deep_sleep_ms) {
+	idle_power_off_ms = power_off_ms;
+	idle_deep_sleep_ms = deep_sleep_ms;
+}
+
+/*
+ * Gets the panel ready for a partial update. Consecutive partial updates reuse the
+ * initialization of the first one; after an idle power off only the charge pumps are
+ * turned back on.
+ */
+static void panel_wake_part(void) {
+	if (panel_partial && panel_state == PANEL_ON) {
+		return;
+	}
+	if (panel_partial && panel_state == PANEL_OFF) {
+		ESP_LOGI(TAG, "epaper_task: Waking up from power off");
+		EPD_PowerOn();
+	} else {
+		EPD_Init_Part();
+	}
+	panel_state = PANEL_ON;
+	panel_partial = true;
+}
+
+/*
+ * Powers the panel down in steps once nothing has been refreshed for a while.
+ */
+static void panel_check_idle(void) {
+	TickType_t idle_ticks = xTaskGetTickCount() - panel_idle_since;
+
+	if (panel_state == PANEL_ON && idle_power_off_ms > 0 &&
+	    idle_ticks >= pdMS_TO_TICKS(idle_power_off_ms)) {
+		ESP_LOGI(TAG, "epaper_task: Idle for %lu ms, powering off",
+		         (unsigned long)pdTICKS_TO_MS(idle_ticks));
+		EPD_PowerOff();
+		panel_state = PANEL_OFF;
+	}
+
+	if (panel_state != PANEL_DEEP_SLEEP && idle_deep_sleep_ms > 0 &&
+	    idle_ticks >= pdMS_TO_TICKS(idle_deep_sleep_ms)) {
+		ESP_LOGI(TAG, "epaper_task: Idle for %lu ms, entering deep sleep",
+		         (unsigned long)pdTICKS_TO_MS(idle_ticks));
+		EPD_Sleep();
+		panel_state = PANEL_DEEP_SLEEP;
+	}
+}
+
 void epaper_task(void *arg) {
 	while (true) {
 		// Update framebuffer depending on layout
@@ -125,43 +327,53 @@ void epaper_task(void *arg) {
 		bool need_sleep = false;
 
 		// Transmit refreshed areas to epaper hardware
-		while (uxQueueMessagesWaiting(epaper_refresh_queue) > 0) {
-			epaper_refresh_area_t refresh_area;
-
-			if (xQueueReceive(epaper_refresh_queue, &refresh_area, 0) == pdFALSE) {
-				ESP_LOGE(TAG, "epaper_task: Failed to dequeue");
-				continue;
-			}
-
+		refresh_request_t req;
+		epaper_refresh_class_t refresh_class;
+		while (refresh_dequeue(&req, &refresh_class)) {
+			epaper_refresh_area_t refresh_area = req.area;
 			epaper_refresh_mode_t refresh_mode = refresh_area.mode;
-			ESP_LOGI(TAG, "epaper_task: Dequeued mode=%d", refresh_mode);
+			ESP_LOGI(TAG, "epaper_task: Dequeued mode=%d class=%d", refresh_mode,
+			         refresh_class);
 
 			need_sleep = false;
 
 			if (refresh_mode & EPAPER_REFRESH_SLOW) {
 				EPD_Init();
 				EPD_Display(framebuffer);
+				panel_partial = false;
 			} else if (refresh_mode == EPAPER_REFRESH_FAST) {
 				EPD_Init_Fast();
 				EPD_Display(framebuffer);
+				panel_partial = false;
 			} else if (refresh_mode == EPAPER_REFRESH_PARTIAL) {
-				EPD_Init_Part();
+				int64_t start_us = esp_timer_get_time();
+				panel_wake_part();
 				EPD_Display_Part(framebuffer, refresh_area.x_start,
 				                 refresh_area.y_start, refresh_area.x_end,
 				                 refresh_area.y_end);
+				partial_refresh_record(esp_timer_get_time() - start_us);
 			} else if (refresh_mode == EPAPER_REFRESH_CLEAR) {
-				EPD_Init_Fast();
-				EPD_Clear();
+				panel_wake_part();
+				EPD_Clear_Part(refresh_area.x_start, refresh_area.y_start,
+				               refresh_area.x_end, refresh_area.y_end);
 			} else if (refresh_mode == EPAPER_REFRESH_SLEEP) {
 				EPD_Init();
 				EPD_Display(framebuffer);
+				panel_partial = false;
 				need_sleep = true;
 			}
+			panel_state = PANEL_ON;
+			panel_idle_since = xTaskGetTickCount();
+			refresh_record(refresh_class, &req);
+			ghost_cleanup_check(refresh_mode);
 			DEV_Delay_ms(50);
 		}
 
 		if (need_sleep) {
 			EPD_Sleep();
+			panel_state = PANEL_DEEP_SLEEP;
+		} else {
+			panel_check_idle();
 		}
 
 		xSemaphoreGive(epaper_sem);
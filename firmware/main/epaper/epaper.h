@@ -26,13 +26,15 @@
 typedef enum {
 	EPAPER_OK,
 	EPAPER_ERR,
+	EPAPER_ERR_FULL,  // no room right now; try again later
+	EPAPER_ERR_STALE, // based on screen contents that are gone; send them again in full
 } epaper_err_t;
 
 typedef enum {
 	EPAPER_REFRESH_SLOW,
 	EPAPER_REFRESH_FAST,
 	EPAPER_REFRESH_PARTIAL,
-	EPAPER_REFRESH_CLEAR,
+	EPAPER_REFRESH_CLEAR, // partial refresh of the area to white, framebuffer is not read
 	EPAPER_REFRESH_SLEEP,
 } epaper_refresh_mode_t;
 
@@ -43,7 +45,26 @@ typedef struct {
 	UWORD x_start, y_start, x_end, y_end;
 } epaper_refresh_area_t;
 
-extern QueueHandle_t epaper_refresh_queue; // queue of areas to refresh
+/*
+ * Refreshes are queued by class. epaper_task always serves the first non-empty class, except
+ * that a class passed over EPAPER_STARVATION_LIMIT times in a row goes next.
+ */
+typedef enum {
+	EPAPER_CLASS_INPUT,        // feedback to a button press, e.g. layouts and the mute icon
+	EPAPER_CLASS_CAPTION,      // caption text
+	EPAPER_CLASS_HOUSEKEEPING, // ghost cleanup; dropped when a full refresh happens anyway
+	EPAPER_NUM_CLASSES,
+} epaper_refresh_class_t;
+
+#define EPAPER_STARVATION_LIMIT 4
+
+typedef struct {
+	uint32_t count;    // refreshes done
+	uint32_t promoted; // served ahead of a higher class because of the starvation limit
+	uint32_t dropped;  // queue full
+	// from epaper_refresh() until the panel finished refreshing, in microseconds
+	uint64_t total_us, max_us;
+} epaper_refresh_stats_t;
 
 extern bool caption_enabled;
 
@@ -51,6 +72,20 @@ typedef struct {
 	// bounding box position, in pixels
 	UWORD x_start, y_start, x_end, y_end;
 	sFONT *font;
+	// Rows at the bottom of the box for the hypothesis that is still being revised, which
+	// moves up to the rows above once committed. 0 shows the hypothesis in line.
+	UWORD live_rows;
+	// When the last row is full, scroll the text up by a row instead of continuing at the top.
+	bool scroll;
+	// Longest a word may wait for more words to share its refresh, from caption_edit until
+	// the refresh showing it is done, in milliseconds. 0 refreshes as soon as possible.
+	uint32_t batch_deadline_ms;
+	// Bytes kept of rows that have left the screen, for paging back to, and for how long.
+	// 0 keeps no history.
+	size_t   history_size;
+	uint32_t history_minutes;
+	// Bytes of rasterized words kept for drawing them again. 0 draws every word from the font.
+	size_t sprite_cache_size;
 } caption_cfg_t;
 
 /*
@@ -62,3 +97,32 @@ epaper_err_t epaper_init(void);
  * Clears epaper and puts epaper to sleep. Stops epaper_task.
  */
 epaper_err_t epaper_shutdown(void);
+
+/*
+ * Queues `area` to be sent from the framebuffer to the screen. Does not block.
+ */
+epaper_err_t epaper_refresh(epaper_refresh_class_t refresh_class,
+                            const epaper_refresh_area_t *area);
+
+/*
+ * Returns how many refreshes are queued and not yet taken by epaper_task, of all classes.
+ */
+uint32_t epaper_refresh_waiting(void);
+
+/*
+ * Copies per-class refresh statistics since startup into `stats`.
+ */
+void epaper_get_refresh_stats(epaper_refresh_stats_t stats[EPAPER_NUM_CLASSES]);
+
+/*
+ * Average time the last few partial refreshes took, from waking the panel up until it was done,
+ * in microseconds. 0 before the first one. Only meaningful in epaper_task.
+ */
+uint32_t epaper_get_partial_refresh_us(void);
+
+/*
+ * Sets how long epaper_task waits after the last refresh before it powers the panel off, and
+ * before it puts the panel into deep sleep. 0 disables that step. Defaults come from
+ * CONFIG_EPAPER_IDLE_POWER_OFF_MS and CONFIG_EPAPER_IDLE_DEEP_SLEEP_MS.
+ */
+void epaper_set_idle_timeout(uint32_t power_off_ms, uint32_t deep_sleep_ms);
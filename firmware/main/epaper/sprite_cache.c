@@ -0,0 +1,235 @@
+#include "sprite_cache.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "psram.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+#define SPRITE_BLOCK_BYTES 256 // a Font48 glyph, a row of a 16-letter word is 64 bytes
+#define SPRITE_BUCKETS 256
+#define SPRITE_NONE 0xFFFF
+#define SPRITE_SEEN_BITS 4096 // words seen once, which are not cached until they come up again
+
+static const char *TAG = "sprite_cache";
+
+typedef struct {
+	sFONT   *font;
+	uint32_t hash;
+	uint16_t newer, older; // LRU list
+	uint16_t next;         // in the bucket, or the list of free entries
+	uint16_t block;        // first block
+	uint8_t  len;
+	char     word[SPRITE_WORD_LEN];
+} sprite_t;
+
+static UBYTE    *blocks = NULL;
+static uint16_t *block_next = NULL; // next block of the same sprite, or free block
+static uint16_t  num_blocks = 0, free_blocks = 0;
+static uint16_t  free_block = SPRITE_NONE;
+
+// there are as many entries as blocks, since every sprite takes at least one
+static sprite_t *sprites = NULL;
+static uint16_t  free_sprite = SPRITE_NONE;
+static uint16_t  buckets[SPRITE_BUCKETS];
+static uint16_t  newest = SPRITE_NONE, oldest = SPRITE_NONE;
+static uint32_t  seen[SPRITE_SEEN_BITS / 32]; // by hash, forgotten every SPRITE_SEEN_BITS / 4
+static uint16_t  seen_count = 0;
+
+static sprite_cache_stats_t stats;
+
+epaper_err_t sprite_cache_init(size_t size) {
+	size_t n = size / SPRITE_BLOCK_BYTES;
+	n = n < SPRITE_NONE ? n : SPRITE_NONE - 1;
+
+	if (blocks == NULL || num_blocks != n) {
+		free(blocks);
+		free(block_next);
+		free(sprites);
+		blocks = NULL;
+		block_next = NULL;
+		sprites = NULL;
+		num_blocks = n;
+		if (n > 0) {
+			blocks = psram_alloc(n * SPRITE_BLOCK_BYTES, TAG, "sprite_cache_init");
+			block_next = psram_alloc(n * sizeof(block_next[0]), TAG, "sprite_cache_init");
+			sprites = psram_alloc(n * sizeof(sprites[0]), TAG, "sprite_cache_init");
+		}
+		if (n > 0 && (blocks == NULL || block_next == NULL || sprites == NULL)) {
+			ESP_LOGE(TAG, "sprite_cache_init: Failed to allocate %u bytes",
+			         (unsigned)size);
+			free(blocks);
+			free(block_next);
+			free(sprites);
+			blocks = NULL;
+			block_next = NULL;
+			sprites = NULL;
+			num_blocks = 0;
+		}
+	}
+
+	for (uint16_t i = 0; i < num_blocks; i++) {
+		block_next[i] = i + 1 < num_blocks ? i + 1 : SPRITE_NONE;
+		sprites[i].next = i + 1 < num_blocks ? i + 1 : SPRITE_NONE;
+	}
+	free_block = free_sprite = num_blocks > 0 ? 0 : SPRITE_NONE;
+	free_blocks = num_blocks;
+	// touched up front, so that committing the pages (on the host) is not charged to the
+	// first words drawn
+	memset(blocks, 0, num_blocks * SPRITE_BLOCK_BYTES);
+	newest = oldest = SPRITE_NONE;
+	memset(buckets, 0xFF, sizeof(buckets));
+	memset(seen, 0, sizeof(seen));
+	seen_count = 0;
+	stats = (sprite_cache_stats_t){.size = num_blocks * SPRITE_BLOCK_BYTES};
+	return num_blocks > 0 || size == 0 ? EPAPER_OK : EPAPER_ERR;
+}
+
+static uint32_t word_hash(const char *word, size_t len, sFONT *font) {
+	uint32_t hash = 2166136261u ^ (uint32_t)(uintptr_t)font; // FNV-1a
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ (uint8_t)word[i]) * 16777619u;
+	}
+	return hash;
+}
+
+// sprite rows that fit in a block
+static UWORD block_rows(size_t len, sFONT *font) {
+	return SPRITE_BLOCK_BYTES / ((len * font->Width + 7) / 8);
+}
+
+static uint16_t sprite_blocks(size_t len, sFONT *font) {
+	UWORD rows = block_rows(len, font);
+	return (font->Height + rows - 1) / rows;
+}
+
+static void lru_unlink(uint16_t i) {
+	sprite_t *s = &sprites[i];
+	if (s->newer != SPRITE_NONE) {
+		sprites[s->newer].older = s->older;
+	} else {
+		newest = s->older;
+	}
+	if (s->older != SPRITE_NONE) {
+		sprites[s->older].newer = s->newer;
+	} else {
+		oldest = s->newer;
+	}
+}
+
+static void lru_push(uint16_t i) {
+	sprites[i].newer = SPRITE_NONE;
+	sprites[i].older = newest;
+	if (newest != SPRITE_NONE) {
+		sprites[newest].newer = i;
+	} else {
+		oldest = i;
+	}
+	newest = i;
+}
+
+static void evict_oldest(void) {
+	uint16_t  i = oldest;
+	sprite_t *s = &sprites[i];
+	lru_unlink(i);
+
+	uint16_t *link = &buckets[s->hash % SPRITE_BUCKETS];
+	while (*link != i) {
+		link = &sprites[*link].next;
+	}
+	*link = s->next;
+
+	uint16_t n = sprite_blocks(s->len, s->font);
+	uint16_t last = s->block;
+	for (uint16_t b = 1; b < n; b++) {
+		last = block_next[last];
+	}
+	block_next[last] = free_block;
+	free_block = s->block;
+	free_blocks += n;
+
+	s->next = free_sprite;
+	free_sprite = i;
+	stats.bytes -= n * SPRITE_BLOCK_BYTES;
+	stats.sprites--;
+	stats.evictions++;
+}
+
+static void sprite_blit(const sprite_t *s, UWORD x, UWORD y) {
+	UWORD width = s->len * s->font->Width;
+	UWORD rows = block_rows(s->len, s->font);
+	for (UWORD row = 0, b = s->block; row < s->font->Height; row += rows, b = block_next[b]) {
+		UWORD n = MIN(rows, s->font->Height - row);
+		Paint_BlitImage(blocks + b * SPRITE_BLOCK_BYTES, x, y + row, width, n);
+	}
+}
+
+bool sprite_cache_draw(UWORD x, UWORD y, const char *word, size_t len, sFONT *font) {
+	if (num_blocks == 0) {
+		return false;
+	}
+	if (len == 0 || len > SPRITE_WORD_LEN || (len * font->Width + 7) / 8 > SPRITE_BLOCK_BYTES ||
+	    sprite_blocks(len, font) > num_blocks / 4) {
+		stats.uncached++;
+		return false;
+	}
+
+	uint32_t hash = word_hash(word, len, font);
+	uint16_t bucket = hash % SPRITE_BUCKETS;
+	for (uint16_t i = buckets[bucket]; i != SPRITE_NONE; i = sprites[i].next) {
+		sprite_t *s = &sprites[i];
+		if (s->hash == hash && s->font == font && s->len == len &&
+		    memcmp(s->word, word, len) == 0) {
+			stats.hits++;
+			lru_unlink(i);
+			lru_push(i);
+			sprite_blit(s, x, y);
+			return true;
+		}
+	}
+
+	stats.misses++;
+	uint32_t bit = hash / (UINT32_MAX / SPRITE_SEEN_BITS + 1);
+	if (!(seen[bit / 32] & 1u << bit % 32)) {
+		if (++seen_count > SPRITE_SEEN_BITS / 4) {
+			memset(seen, 0, sizeof(seen));
+			seen_count = 1;
+		}
+		seen[bit / 32] |= 1u << bit % 32;
+		return false;
+	}
+	uint16_t n = sprite_blocks(len, font);
+	while (free_blocks < n || free_sprite == SPRITE_NONE) {
+		evict_oldest();
+	}
+
+	uint16_t  i = free_sprite;
+	sprite_t *s = &sprites[i];
+	free_sprite = s->next;
+	s->font = font;
+	s->hash = hash;
+	s->len = len;
+	memcpy(s->word, word, len);
+	s->block = free_block;
+
+	esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+	UWORD                 rows = block_rows(len, font);
+	for (UWORD row = 0; row < font->Height; row += rows) {
+		Paint_RasterizeText(blocks + free_block * SPRITE_BLOCK_BYTES, word, len, font, row,
+		                    MIN(rows, font->Height - row), BLACK, WHITE);
+		free_block = block_next[free_block];
+	}
+	stats.raster_cycles += (esp_cpu_cycle_count_t)(esp_cpu_get_cycle_count() - start);
+	free_blocks -= n;
+
+	s->next = buckets[bucket];
+	buckets[bucket] = i;
+	lru_push(i);
+	stats.bytes += n * SPRITE_BLOCK_BYTES;
+	stats.sprites++;
+	sprite_blit(s, x, y);
+	return true;
+}
+
+sprite_cache_stats_t sprite_cache_get_stats(void) { return stats; }
@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+ * Rasterized words, so that a word that comes up again is copied to the framebuffer instead of
+ * being drawn glyph by glyph. Sprites are black on white and kept by (word, font); the least
+ * recently used go first when the cache is full. A word is only cached the second time it comes
+ * up (within the last 1024 new words), so that words said once don't push out the ones that
+ * repeat. A sprite is in the word's own coordinates, so Paint_BlitImage draws it in any rotation.
+ *
+ * The cache is one allocation of fixed-size blocks, each holding some rows of a sprite, so that
+ * sprites of any size come and go without fragmenting the heap.
+ *
+ * Only used by epaper_task, except sprite_cache_get_stats.
+ */
+
+#include "GUI_Paint.h"
+#include "epaper.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPRITE_WORD_LEN 16 // longer words are not cached
+
+typedef struct {
+	uint32_t hits, misses;  // misses include words not cached yet because they are new
+	uint32_t uncached;      // words too long or too large to cache
+	uint32_t evictions;     // sprites dropped to make room
+	uint64_t raster_cycles; // CPU cycles spent rasterizing misses
+	uint32_t sprites;       // sprites kept
+	size_t   bytes;         // bytes of the blocks taken by the sprites kept
+	size_t   size;          // 0 if there is no cache
+} sprite_cache_stats_t;
+
+/*
+ * Sets aside `size` bytes for sprites, in PSRAM if there is any. Calling it again empties the
+ * cache; 0 turns it off.
+ */
+epaper_err_t sprite_cache_init(size_t size);
+
+/*
+ * Draws the `len` characters of `word` in `font` at (x, y) from their sprite, rasterizing it
+ * first on a miss. Returns false if the word is not cached, in which case the caller draws it
+ * itself.
+ */
+bool sprite_cache_draw(UWORD x, UWORD y, const char *word, size_t len, sFONT *font);
+
+sprite_cache_stats_t sprite_cache_get_stats(void);
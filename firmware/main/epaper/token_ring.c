@@ -0,0 +1,120 @@
+#include "token_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define GLUED_BIT 0x8000
+#define WRAP_MARKER 0xFFFF // rest of the arena is unused, next record is at offset 0
+
+// head and tail are shared between the two tasks; the acquire/release pairs make sure a
+// record's bytes are visible before the index that covers them.
+static size_t load_acquire(const size_t *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static void   store_release(size_t *p, size_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+static uint16_t read_hdr(const token_ring_t *ring, size_t pos) {
+	uint16_t hdr;
+	memcpy(&hdr, ring->buf + pos, sizeof(hdr));
+	return hdr;
+}
+
+static void write_hdr(token_ring_t *ring, size_t pos, uint16_t hdr) {
+	memcpy(ring->buf + pos, &hdr, sizeof(hdr));
+}
+
+epaper_err_t token_ring_init(token_ring_t *ring, size_t size) {
+	ring->buf = malloc(size);
+	if (ring->buf == NULL) {
+		return EPAPER_ERR;
+	}
+	ring->size = size;
+	token_ring_reset(ring);
+	return EPAPER_OK;
+}
+
+void token_ring_reset(token_ring_t *ring) {
+	ring->head = 0;
+	ring->tail = 0;
+	ring->stage = 0;
+	ring->read = 0;
+	ring->read_len = 0;
+	ring->used_max = 0;
+}
+
+bool token_ring_push(token_ring_t *ring, const char *token, size_t len, bool glued) {
+	if (len > TOKEN_RING_MAX_TOKEN_LEN) {
+		return false;
+	}
+
+	size_t n = TOKEN_RING_HDR_LEN + len + 1;
+	size_t pos = ring->stage;
+	size_t tail = load_acquire(&ring->tail);
+
+	// pos must never catch up with tail, or the ring would look empty
+	if (pos >= tail) {
+		size_t to_end = ring->size - pos;
+		if (n > to_end || (n == to_end && tail == 0)) {
+			// does not fit before the end of the arena; start over at 0
+			if (n >= tail) {
+				return false;
+			}
+			if (to_end >= TOKEN_RING_HDR_LEN) {
+				write_hdr(ring, pos, WRAP_MARKER);
+			}
+			pos = 0;
+		}
+	} else if (n >= tail - pos) {
+		return false;
+	}
+
+	write_hdr(ring, pos, len | (glued ? GLUED_BIT : 0));
+	memcpy(ring->buf + pos + TOKEN_RING_HDR_LEN, token, len);
+	ring->buf[pos + TOKEN_RING_HDR_LEN + len] = '\0';
+
+	pos += n;
+	ring->stage = pos == ring->size ? 0 : pos;
+	return true;
+}
+
+void token_ring_commit(token_ring_t *ring) {
+	store_release(&ring->head, ring->stage);
+	size_t used = token_ring_used(ring);
+	if (used > ring->used_max) {
+		ring->used_max = used;
+	}
+}
+
+void token_ring_abort(token_ring_t *ring) { ring->stage = ring->head; }
+
+const char *token_ring_peek(token_ring_t *ring, size_t *len, bool *glued) {
+	size_t pos = ring->tail;
+	if (pos == load_acquire(&ring->head)) {
+		return NULL;
+	}
+
+	// the producer skips the end of the arena when a record does not fit there
+	if (ring->size - pos < TOKEN_RING_HDR_LEN || read_hdr(ring, pos) == WRAP_MARKER) {
+		pos = 0;
+	}
+
+	uint16_t hdr = read_hdr(ring, pos);
+	*len = hdr & ~GLUED_BIT;
+	*glued = (hdr & GLUED_BIT) != 0;
+	ring->read = pos;
+	ring->read_len = TOKEN_RING_HDR_LEN + *len + 1;
+	return (const char *)ring->buf + pos + TOKEN_RING_HDR_LEN;
+}
+
+void token_ring_pop(token_ring_t *ring) {
+	if (ring->read_len == 0) {
+		return;
+	}
+	size_t pos = ring->read + ring->read_len;
+	ring->read_len = 0;
+	store_release(&ring->tail, pos == ring->size ? 0 : pos);
+}
+
+size_t token_ring_used(const token_ring_t *ring) {
+	size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	return head >= tail ? head - tail : ring->size - tail + head;
+}
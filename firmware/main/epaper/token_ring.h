@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ * Single-producer, single-consumer ring of text tokens, stored back to back in one byte
+ * arena. Each record is a 2-byte header (length, and whether the token continues the
+ * previous one without a space) followed by the bytes and a null terminator, so the
+ * consumer can use a token in place without copying it out.
+ *
+ * The producer stages any number of tokens with token_ring_push() and makes them visible
+ * with token_ring_commit(), or drops them with token_ring_abort(). This lets a whole batch
+ * be accepted or refused at once.
+ */
+
+#include "epaper.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TOKEN_RING_HDR_LEN 2
+#define TOKEN_RING_MAX_TOKEN_LEN 0x7FFF
+
+typedef struct {
+	uint8_t *buf;
+	size_t   size;
+	size_t   head;        // end of committed records; written by the producer
+	size_t   tail;        // start of unread records; written by the consumer
+	size_t   stage;       // end of staged records; producer only
+	size_t   read;        // start of the record returned by token_ring_peek; consumer only
+	size_t   read_len;    // size of that record, 0 if none
+	size_t   used_max;    // high-water mark of committed bytes
+} token_ring_t;
+
+/*
+ * Allocates a ring of `size` bytes. One record takes TOKEN_RING_HDR_LEN + length + 1 bytes.
+ */
+epaper_err_t token_ring_init(token_ring_t *ring, size_t size);
+
+/*
+ * Empties the ring. Neither side may be using it.
+ */
+void token_ring_reset(token_ring_t *ring);
+
+/*
+ * Stages a token of `len` bytes. `glued` means it continues the previous token without a
+ * space. Returns false if there is no room.
+ */
+bool token_ring_push(token_ring_t *ring, const char *token, size_t len, bool glued);
+
+/*
+ * Publishes all staged tokens to the consumer.
+ */
+void token_ring_commit(token_ring_t *ring);
+
+/*
+ * Drops all staged tokens.
+ */
+void token_ring_abort(token_ring_t *ring);
+
+/*
+ * Returns the oldest token, null-terminated, or NULL if the ring is empty. The token stays
+ * valid until token_ring_pop().
+ */
+const char *token_ring_peek(token_ring_t *ring, size_t *len, bool *glued);
+
+/*
+ * Releases the token returned by token_ring_peek().
+ */
+void token_ring_pop(token_ring_t *ring);
+
+/*
+ * Bytes taken by committed records.
+ */
+size_t token_ring_used(const token_ring_t *ring);
@@ -30,21 +30,50 @@ void draw_bitmap(UWORD x_start, UWORD y_start, const bitmap_t *bitmap) {
 	Paint_DrawImage(bitmap->table, x_start, y_start, bitmap->width, bitmap->height);
 }
 
-void draw_button(int button_id, const bitmap_t *bitmap) {
-	// bitmap must be rotated 180 degrees.
-	UWORD x_start = 0;
+#define BUTTON_Y_START 10
+#define BUTTON_SIZE 64
+
+// x coordinate of the icon above a button, or 0 if there is no such button
+static UWORD button_x_start(int button_id) {
 	if (button_id == BUTTON_ID_1) {
-		x_start = 270;
+		return 270;
 	} else if (button_id == BUTTON_ID_2) {
-		x_start = 190;
+		return 190;
 	} else if (button_id == BUTTON_ID_3) {
-		x_start = 110;
-	} else {
+		return 110;
+	}
+	return 0;
+}
+
+void draw_button(int button_id, const bitmap_t *bitmap) {
+	// bitmap must be rotated 180 degrees.
+	UWORD x_start = button_x_start(button_id);
+	if (x_start == 0) {
 		ESP_LOGE(TAG, "draw_button: Invalid button_id %d", button_id);
 		return;
 	}
 
-	draw_bitmap(x_start, 10, bitmap);
+	draw_bitmap(x_start, BUTTON_Y_START, bitmap);
+}
+
+/*
+ * Shows the icon of one button without redrawing the rest of the screen.
+ */
+static epaper_err_t refresh_button(int button_id) {
+	UWORD x_start = button_x_start(button_id);
+	if (x_start == 0) {
+		ESP_LOGE(TAG, "refresh_button: Invalid button_id %d", button_id);
+		return EPAPER_ERR;
+	}
+
+	epaper_refresh_area_t refresh_area = {
+		.mode = EPAPER_REFRESH_PARTIAL,
+		.x_start = x_start,
+		.y_start = BUTTON_Y_START,
+		.x_end = x_start + BUTTON_SIZE,
+		.y_end = BUTTON_Y_START + BUTTON_SIZE,
+	};
+	return epaper_refresh(EPAPER_CLASS_INPUT, &refresh_area);
 }
 
 epaper_err_t ui_layout_badge(const char *peer_name) {
@@ -78,7 +107,7 @@ epaper_err_t ui_layout_badge(const char *peer_name) {
 		.mode = EPAPER_REFRESH_SLEEP,
 	};
 
-	xQueueSend(epaper_refresh_queue, &refresh_area, 0);
+	epaper_refresh(EPAPER_CLASS_INPUT, &refresh_area);
 	caption_enabled = false;
 	return EPAPER_OK;
 }
@@ -86,9 +115,12 @@ epaper_err_t ui_layout_badge(const char *peer_name) {
 epaper_err_t ui_layout_caption(void) {
 	ESP_LOGI(TAG, "ui_layout_caption");
 
+	// asked for first, so that epaper_task clears before it draws anything of the new layout
+	caption_clear();
 	caption_enabled = true;
 	draw_button(BUTTON_ID_1, &MUTE_LOGO);
-	return caption_clear();
+	refresh_button(BUTTON_ID_1); // before the caption area, as it is what the user waits for
+	return EPAPER_OK;
 }
 
 static void print_name(void) {
@@ -113,7 +145,7 @@ epaper_err_t ui_layout_pair_searching(void) {
 	epaper_refresh_area_t refresh_area = {
 		.mode = EPAPER_REFRESH_FAST,
 	};
-	xQueueSend(epaper_refresh_queue, &refresh_area, 0);
+	epaper_refresh(EPAPER_CLASS_INPUT, &refresh_area);
 	return EPAPER_OK;
 }
 
@@ -140,7 +172,7 @@ epaper_err_t ui_layout_pair_confirm(const char *peer_name) {
 	epaper_refresh_area_t refresh_area = {
 		.mode = EPAPER_REFRESH_FAST,
 	};
-	xQueueSend(epaper_refresh_queue, &refresh_area, 0);
+	epaper_refresh(EPAPER_CLASS_INPUT, &refresh_area);
 	return EPAPER_OK;
 }
 
@@ -161,7 +193,7 @@ epaper_err_t ui_layout_pair_pending(const char *peer_name) {
 	epaper_refresh_area_t refresh_area = {
 		.mode = EPAPER_REFRESH_FAST,
 	};
-	xQueueSend(epaper_refresh_queue, &refresh_area, 0);
+	epaper_refresh(EPAPER_CLASS_INPUT, &refresh_area);
 	return EPAPER_OK;
 }
 
@@ -187,7 +219,7 @@ epaper_err_t ui_layout_pair_result(const char *peer_name) {
 	epaper_refresh_area_t refresh_area = {
 		.mode = EPAPER_REFRESH_FAST,
 	};
-	xQueueSend(epaper_refresh_queue, &refresh_area, 0);
+	epaper_refresh(EPAPER_CLASS_INPUT, &refresh_area);
 	return EPAPER_OK;
 }
 
@@ -201,7 +233,7 @@ epaper_err_t ui_layout_wifi_connecting(void) {
 		.mode = EPAPER_REFRESH_FAST,
 	};
 
-	xQueueSend(epaper_refresh_queue, &refresh_area, 0);
+	epaper_refresh(EPAPER_CLASS_INPUT, &refresh_area);
 	return EPAPER_OK;
 }
 
@@ -215,7 +247,7 @@ epaper_err_t ui_layout_wifi_connected(void) {
 		.mode = EPAPER_REFRESH_FAST,
 	};
 
-	xQueueSend(epaper_refresh_queue, &refresh_area, 0);
+	epaper_refresh(EPAPER_CLASS_INPUT, &refresh_area);
 	return EPAPER_OK;
 }
 
@@ -229,6 +261,6 @@ epaper_err_t ui_layout_wifi_disconnected(void) {
 		.mode = EPAPER_REFRESH_FAST,
 	};
 
-	xQueueSend(epaper_refresh_queue, &refresh_area, 0);
+	epaper_refresh(EPAPER_CLASS_INPUT, &refresh_area);
 	return EPAPER_OK;
 }
@@ -3,16 +3,74 @@
 #include "esp_err.h"
 #include "esp_http_client.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "http_stream.h"
 #include "sdkconfig.h"
+#include "vad.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define UP_CHUNK_HDR_MAX 6      // hex length of up to 0xffff and CRLF
+#define UP_CHUNK_MAX 2048       // the HTTP writer's buffer, so one chunk per call
+#define UP_LOG_INTERVAL_US 5000000
+#define CODECS_LIST_MAX 32 // of the x-audio-codecs header
 
 static const char *TAG = "http_client";
 
+/*
+ * The uplink's chunk framing. The payload goes at a fixed offset after room reserved for the
+ * chunk header, which is written right before it, so that a chunk goes out in one write: one
+ * TCP segment or two instead of a tiny one for the header that Nagle's algorithm then holds
+ * the payload behind.
+ */
+static char *up_chunk;
+
+static struct {
+	int64_t  start_us;
+	int64_t  logged_us;
+	int64_t  write_us; // spent in esp_http_client_write
+	uint32_t chunks;
+	uint32_t bytes;
+} up_stats;
+
+/*
+ * Frames `len` bytes of `data`, at most UP_CHUNK_MAX, as a chunk in up_chunk. Returns where the
+ * chunk starts and sets *chunk_len.
+ */
+static char *up_frame_chunk(const char *data, int len, int *chunk_len) {
+	char *payload = up_chunk + UP_CHUNK_HDR_MAX;
+	memcpy(payload, data, len);
+	payload[len] = '\r';
+	payload[len + 1] = '\n';
+
+	char *p = payload;
+	*--p = '\n';
+	*--p = '\r';
+	int n = len;
+	do {
+		*--p = "0123456789abcdef"[n & 0xf];
+		n >>= 4;
+	} while (n > 0);
+	*chunk_len = payload + len + 2 - p;
+	return p;
+}
+
+static void up_log_stats(const char *when) {
+	int64_t now = esp_timer_get_time();
+	int64_t us = now - up_stats.start_us;
+	if (us <= 0) {
+		return;
+	}
+	ESP_LOGI(TAG, "%s: %lu bytes in %lu chunks, %llu chunks/s, %lld us/s writing", when,
+	         up_stats.bytes, up_stats.chunks, up_stats.chunks * 1000000ULL / us,
+	         up_stats.write_us * 1000000 / us);
+	up_stats.logged_us = now;
+}
+
 esp_err_t _http_up_stream_event_handle(http_stream_event_msg_t *msg) {
 	esp_http_client_handle_t http = (esp_http_client_handle_t)msg->http_client;
-	char                     len_buf[16];
-	static int               total_write = 0;
 
 	if (msg->event_id == HTTP_STREAM_PRE_REQUEST) {
 		// set header
@@ -28,24 +86,48 @@ esp_err_t _http_up_stream_event_handle(http_stream_event_msg_t *msg) {
 		memset(dat, 0, sizeof(dat));
 		snprintf(dat, sizeof(dat), "%d", AUDIO_CHANNELS);
 		esp_http_client_set_header(http, "x-audio-channel", dat);
-		total_write = 0;
+		esp_http_client_set_header(http, "x-audio-codec", audio_codec_name(audio_codec));
+#ifdef AUDIO_TX_KEEPALIVES
+		// only speech or talk is sent; a run of this many zero samples is a keepalive
+		memset(dat, 0, sizeof(dat));
+		snprintf(dat, sizeof(dat), "%d", VAD_FRAME_SAMPLES);
+		esp_http_client_set_header(http, "x-audio-vad", dat);
+#endif
+		if (up_chunk == NULL) {
+			up_chunk = malloc(UP_CHUNK_HDR_MAX + UP_CHUNK_MAX + 2);
+			if (up_chunk == NULL) {
+				ESP_LOGE(TAG, "Out of memory for the chunk buffer");
+				return ESP_FAIL;
+			}
+		}
+		memset(&up_stats, 0, sizeof(up_stats));
+		up_stats.start_us = up_stats.logged_us = esp_timer_get_time();
 		return ESP_OK;
 	}
 
 	if (msg->event_id == HTTP_STREAM_ON_REQUEST) {
-		// write data
-		int wlen = sprintf(len_buf, "%x\r\n", msg->buffer_len);
-		if (esp_http_client_write(http, len_buf, wlen) <= 0) {
-			return ESP_FAIL;
+		// write data, a chunk per write
+		int64_t start = esp_timer_get_time();
+		for (int off = 0; off < msg->buffer_len; off += UP_CHUNK_MAX) {
+			int len = msg->buffer_len - off;
+			if (len > UP_CHUNK_MAX) {
+				len = UP_CHUNK_MAX;
+			}
+			int   chunk_len;
+			char *chunk = up_frame_chunk(msg->buffer + off, len, &chunk_len);
+			if (esp_http_client_write(http, chunk, chunk_len) <= 0) {
+				return ESP_FAIL;
+			}
+			up_stats.chunks++;
 		}
-		if (esp_http_client_write(http, msg->buffer, msg->buffer_len) <= 0) {
-			return ESP_FAIL;
-		}
-		if (esp_http_client_write(http, "\r\n", 2) <= 0) {
-			return ESP_FAIL;
+		audio_tx_sent();
+		int64_t now = esp_timer_get_time();
+		up_stats.write_us += now - start;
+		up_stats.bytes += msg->buffer_len;
+		ESP_LOGD(TAG, "Total bytes written: %lu", up_stats.bytes);
+		if (now - up_stats.logged_us >= UP_LOG_INTERVAL_US) {
+			up_log_stats("Streaming");
 		}
-		total_write += msg->buffer_len;
-		ESP_LOGI(TAG, "Total bytes written: %d", total_write);
 		return msg->buffer_len;
 	}
 
@@ -55,6 +137,7 @@ esp_err_t _http_up_stream_event_handle(http_stream_event_msg_t *msg) {
 		if (esp_http_client_write(http, "0\r\n\r\n", 5) <= 0) {
 			return ESP_FAIL;
 		}
+		up_log_stats("Streamed");
 		return ESP_OK;
 	}
 
@@ -76,6 +159,13 @@ esp_err_t _http_up_stream_event_handle(http_stream_event_msg_t *msg) {
 }
 
 esp_err_t _http_down_stream_event_handle(http_stream_event_msg_t *msg) {
+	esp_http_client_handle_t http = (esp_http_client_handle_t)msg->http_client;
+
+	if (msg->event_id == HTTP_STREAM_PRE_REQUEST) {
+		// the server encodes the peer's audio to match
+		esp_http_client_set_header(http, "x-audio-codec", audio_codec_name(audio_codec));
+		return ESP_OK;
+	}
 	return ESP_OK;
 }
 
@@ -136,3 +226,56 @@ esp_err_t http_request_to_unpair() {
 	}
 	return ESP_OK;
 }
+
+static esp_err_t codecs_event_handle(esp_http_client_event_t *evt) {
+	if (evt->event_id == HTTP_EVENT_ON_HEADER &&
+	    strcasecmp(evt->header_key, "x-audio-codecs") == 0) {
+		strlcpy(evt->user_data, evt->header_value, CODECS_LIST_MAX);
+	}
+	return ESP_OK;
+}
+
+// whether `name` is one of the names, separated by commas and spaces, in `list`
+static bool codec_listed(const char *list, const char *name) {
+	size_t len = strlen(name);
+	for (const char *p = list + strspn(list, ", "); *p != '\0'; p += strspn(p, ", ")) {
+		size_t n = strcspn(p, ", ");
+		if (n == len && strncasecmp(p, name, n) == 0) {
+			return true;
+		}
+		p += n;
+	}
+	return false;
+}
+
+audio_codec_id_t http_request_codec(audio_codec_id_t want) {
+	char codecs[CODECS_LIST_MAX] = {0};
+	esp_http_client_config_t config = {
+	    .host = CONFIG_SERVER_IP,
+	    .port = atoi(CONFIG_SERVER_PORT),
+	    .path = "/audio/codecs",
+	    .event_handler = codecs_event_handle,
+	    .user_data = codecs,
+	    .timeout_ms = 5000,
+	};
+	esp_http_client_handle_t client = esp_http_client_init(&config);
+	esp_err_t err = esp_http_client_perform(client);
+	int status = esp_http_client_get_status_code(client);
+	esp_http_client_cleanup(client);
+	if (err != ESP_OK || status != 200 || codecs[0] == '\0') {
+		ESP_LOGW(TAG, "HTTP GET /audio/codecs failed, using %s", audio_codec_name(want));
+		return want;
+	}
+
+	ESP_LOGI(TAG, "Server takes %s", codecs);
+	if (codec_listed(codecs, audio_codec_name(want))) {
+		return want;
+	}
+	// not PCM, which goes over HTTP without the packets the pipelines are built for
+	if (codec_listed(codecs, audio_codec_name(AUDIO_CODEC_ADPCM))) {
+		ESP_LOGW(TAG, "Server does not take %s, using adpcm", audio_codec_name(want));
+		return AUDIO_CODEC_ADPCM;
+	}
+	ESP_LOGE(TAG, "Server does not take %s or adpcm", audio_codec_name(want));
+	return want;
+}
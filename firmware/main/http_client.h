@@ -1,5 +1,6 @@
 #pragma once
 
+#include "audio_codec.h"
 #include "http_stream.h"
 
 esp_err_t _http_up_stream_event_handle(http_stream_event_msg_t *msg);
@@ -7,3 +8,10 @@ esp_err_t _http_down_stream_event_handle(http_stream_event_msg_t *msg);
 
 esp_err_t http_request_to_pair(const char *peer_ip);
 esp_err_t http_request_to_unpair();
+
+/*
+ * Asks the server which codecs it takes, with GET /audio/codecs. Returns `want` if it is one of
+ * them, or else AUDIO_CODEC_ADPCM if the server takes that. Returns `want` if the server could
+ * not be asked.
+ */
+audio_codec_id_t http_request_codec(audio_codec_id_t want);
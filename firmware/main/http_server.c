@@ -6,6 +6,7 @@
 
 #include "FreeRTOSConfig.h"
 #include "epaper/caption.h"
+#include "epaper/caption_strip.h"
 #include "es8311.h"
 #include "esp_err.h"
 #include "ringbuf.h"
@@ -29,6 +30,24 @@ extern char role[20];
 extern bool   paired;
 extern user_t peer_badge;
 
+/*
+ * Reads an unsigned integer header; returns `dflt` if it is missing or malformed.
+ */
+static unsigned long get_hdr_ulong(httpd_req_t *req, const char *field, unsigned long dflt) {
+	char  val[16];
+	char *end;
+	if (httpd_req_get_hdr_value_str(req, field, val, sizeof(val)) != ESP_OK) {
+		return dflt;
+	}
+	unsigned long ret = strtoul(val, &end, 10);
+	return (end == val || *end != '\0') ? dflt : ret;
+}
+
+/*
+ * POST /transcription: the body is words to show. Without headers they are appended. With
+ * x-caption-op: append | replace | commit, x-caption-index: <word> and x-caption-seq: <n>
+ * they edit the current hypothesis, see caption_edit().
+ */
 static esp_err_t transcription_post_handler(httpd_req_t *req) {
 	char *buf = calloc(req->content_len + 1, 1);
 	int   ret;
@@ -56,11 +75,36 @@ static esp_err_t transcription_post_handler(httpd_req_t *req) {
 
 	buf[bytes_recv] = '\0';
 
-	caption_append(buf);
+	char         op_str[8] = "append";
+	caption_op_t op = CAPTION_OP_APPEND;
+	httpd_req_get_hdr_value_str(req, "x-caption-op", op_str, sizeof(op_str));
+	if (strcmp(op_str, "replace") == 0) {
+		op = CAPTION_OP_REPLACE;
+	} else if (strcmp(op_str, "commit") == 0) {
+		op = CAPTION_OP_COMMIT;
+	} else if (strcmp(op_str, "append") != 0) {
+		ESP_LOGW(TAG, "Unknown x-caption-op \"%s\"", op_str);
+		free(buf);
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown x-caption-op");
+		return ESP_OK;
+	}
+	uint32_t seq = get_hdr_ulong(req, "x-caption-seq", 0);
+	uint16_t index = MIN(get_hdr_ulong(req, "x-caption-index", CAPTION_INDEX_END),
+	                     CAPTION_INDEX_END);
+
+	epaper_err_t err = caption_edit(op, seq, index, buf);
+	free(buf);
+
+	if (err == EPAPER_ERR_FULL) {
+		// the display is behind; the transcriber keeps the words and sends them again
+		httpd_resp_set_status(req, "503 Service Unavailable");
+		httpd_resp_set_hdr(req, "Retry-After", "1");
+	} else if (err != EPAPER_OK) {
+		httpd_resp_set_status(req, HTTPD_500);
+	}
 
 	// End response
 	httpd_resp_send_chunk(req, NULL, 0);
-	free(buf);
 	return ESP_OK;
 }
 
@@ -71,6 +115,162 @@ static const httpd_uri_t transcription_uri = {
     .user_ctx = NULL,
 };
 
+/*
+ * POST /caption/strip: the body is rows of the caption area rendered by the server, see
+ * caption_strip.h. x-strip-y: <row> and x-strip-height: <rows> place them in the area,
+ * x-strip-encoding: rle | delta tells how they are compressed, and x-strip-scroll: <rows>
+ * moves the area up first. A delta that the badge has no
+ * base for gets 409 Conflict, after which the server sends the whole area with rle.
+ */
+static esp_err_t strip_post_handler(httpd_req_t *req) {
+	if (req->content_len > CAPTION_STRIP_MAX_LEN) {
+		httpd_resp_set_status(req, "413 Payload Too Large");
+		httpd_resp_send_chunk(req, NULL, 0);
+		return ESP_OK;
+	}
+
+	uint8_t *buf = malloc(MAX(req->content_len, 1));
+	int      ret;
+	int      bytes_recv = 0;
+	if (buf == NULL) {
+		httpd_resp_send_500(req);
+		return ESP_OK;
+	}
+
+	while (bytes_recv < req->content_len) {
+		ret = httpd_req_recv(req, (char *)buf + bytes_recv, req->content_len - bytes_recv);
+		if (ret <= 0) {
+			if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+				continue;
+			}
+			free(buf);
+			return ESP_FAIL;
+		}
+		bytes_recv += ret;
+	}
+
+	char                enc_str[8] = "";
+	caption_strip_enc_t enc;
+	httpd_req_get_hdr_value_str(req, "x-strip-encoding", enc_str, sizeof(enc_str));
+	if (strcmp(enc_str, "rle") == 0) {
+		enc = CAPTION_STRIP_RLE;
+	} else if (strcmp(enc_str, "delta") == 0) {
+		enc = CAPTION_STRIP_DELTA;
+	} else {
+		ESP_LOGW(TAG, "Unknown x-strip-encoding \"%s\"", enc_str);
+		free(buf);
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown x-strip-encoding");
+		return ESP_OK;
+	}
+	UWORD y = MIN(get_hdr_ulong(req, "x-strip-y", UINT16_MAX), UINT16_MAX);
+	UWORD height = MIN(get_hdr_ulong(req, "x-strip-height", 0), UINT16_MAX);
+	UWORD scroll = MIN(get_hdr_ulong(req, "x-strip-scroll", 0), UINT16_MAX);
+	ESP_LOGD(TAG, "POST /caption/strip: %s, %u rows at %u, %d bytes", enc_str, height, y,
+	         bytes_recv);
+
+	epaper_err_t err = caption_strip_post(enc, y, height, scroll, buf, bytes_recv);
+	free(buf);
+	if (err == EPAPER_ERR_FULL) {
+		httpd_resp_set_status(req, "503 Service Unavailable");
+		httpd_resp_set_hdr(req, "Retry-After", "1");
+	} else if (err == EPAPER_ERR_STALE) {
+		httpd_resp_set_status(req, "409 Conflict");
+	} else if (err != EPAPER_OK) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Malformed strip");
+		return ESP_OK;
+	}
+
+	httpd_resp_send_chunk(req, NULL, 0);
+	return ESP_OK;
+}
+
+static const httpd_uri_t strip_uri = {
+    .uri = "/caption/strip",
+    .method = HTTP_POST,
+    .handler = strip_post_handler,
+    .user_ctx = NULL,
+};
+
+/*
+ * GET /caption/geometry: the caption grid and font cell, as JSON, for a server that lays out
+ * the lines itself and sends them to /caption/lines. refresh_ms is how long a partial refresh
+ * took lately, which is how often it is worth sending lines.
+ */
+static esp_err_t geometry_get_handler(httpd_req_t *req) {
+	caption_geometry_t g = caption_get_geometry();
+	char               json[192];
+	int                len =
+	    snprintf(json, sizeof(json),
+	             "{\"cols\":%u,\"rows\":%u,\"live_rows\":%u,\"font_width\":%u,"
+	             "\"font_height\":%u,\"x\":%u,\"y\":%u,\"refresh_ms\":%lu}",
+	             g.cols, g.rows, g.live_rows, g.font_width, g.font_height, g.x_start, g.y_start,
+	             (unsigned long)g.refresh_ms);
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, json, len);
+	return ESP_OK;
+}
+
+static const httpd_uri_t geometry_uri = {
+    .uri = "/caption/geometry",
+    .method = HTTP_GET,
+    .handler = geometry_get_handler,
+    .user_ctx = NULL,
+};
+
+/*
+ * POST /caption/lines: the body is lines of caption text laid out by the server, one per row,
+ * separated by newlines. x-line-row: <row> is where the first one goes and x-line-col: <col>
+ * where it starts, after the text has scrolled up by x-line-scroll: <rows>, see
+ * caption_lines().
+ */
+static esp_err_t lines_post_handler(httpd_req_t *req) {
+	char *buf = calloc(req->content_len + 1, 1);
+	int   ret;
+	int   bytes_recv = 0;
+	if (buf == NULL) {
+		httpd_resp_send_500(req);
+		return ESP_OK;
+	}
+
+	while (bytes_recv < req->content_len) {
+		ret = httpd_req_recv(req, buf + bytes_recv, req->content_len - bytes_recv);
+		if (ret <= 0) {
+			if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+				continue;
+			}
+			free(buf);
+			return ESP_FAIL;
+		}
+		bytes_recv += ret;
+	}
+	buf[bytes_recv] = '\0';
+
+	UWORD scroll = MIN(get_hdr_ulong(req, "x-line-scroll", 0), UINT16_MAX);
+	UWORD row = MIN(get_hdr_ulong(req, "x-line-row", 0), UINT16_MAX);
+	UWORD col = MIN(get_hdr_ulong(req, "x-line-col", 0), UINT16_MAX);
+	ESP_LOGD(TAG, "POST /caption/lines: scroll %u, row %u, col %u: %s", scroll, row, col, buf);
+
+	epaper_err_t err = caption_lines(scroll, row, col, buf);
+	free(buf);
+	if (err == EPAPER_ERR_FULL) {
+		httpd_resp_set_status(req, "503 Service Unavailable");
+		httpd_resp_set_hdr(req, "Retry-After", "1");
+	} else if (err != EPAPER_OK) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Line does not fit");
+		return ESP_OK;
+	}
+
+	httpd_resp_send_chunk(req, NULL, 0);
+	return ESP_OK;
+}
+
+static const httpd_uri_t lines_uri = {
+    .uri = "/caption/lines",
+    .method = HTTP_POST,
+    .handler = lines_post_handler,
+    .user_ctx = NULL,
+};
+
 static esp_err_t reboot_get_handler(httpd_req_t *req) {
 	ESP_LOGI(TAG, "======== GET /reboot =======");
 
@@ -220,6 +420,9 @@ httpd_handle_t start_webserver(void) {
 		// Set URI handlers
 		ESP_LOGI(TAG, "Registering URI handlers");
 		httpd_register_uri_handler(server, &transcription_uri);
+		httpd_register_uri_handler(server, &strip_uri);
+		httpd_register_uri_handler(server, &geometry_uri);
+		httpd_register_uri_handler(server, &lines_uri);
 		httpd_register_uri_handler(server, &reboot_uri);
 		httpd_register_uri_handler(server, &user_uri);
 		httpd_register_uri_handler(server, &poke_uri);
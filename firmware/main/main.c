@@ -1,4 +1,5 @@
 #include "audio.h"
+#include "caption.h"
 #include "epaper/DEV_Config.h"
 #include "epaper/epaper.h"
 #include "esp_system.h"
@@ -51,8 +52,8 @@ char role[20] = CONFIG_PARTICIPANT_ROLE;
 void handle_button(int button_id) {
 	if (badge_mode == MODE_LISTEN) {
 		if (button_id == BUTTON_ID_1) {
-			if (audio_pipeline_run(tx_pipeline) == ESP_OK) {
-				ESP_LOGI(TAG, "MODE_TALK, Start ADC pipeline");
+			if (audio_tx_start() == ESP_OK) {
+				ESP_LOGI(TAG, "MODE_TALK, Start sending audio");
 				badge_mode = MODE_TALK;
 				ui_layout_caption();
 			}
@@ -82,17 +83,16 @@ void handle_button(int button_id) {
 		}
 	} else if (badge_mode == MODE_TALK) {
 		if (button_id == BUTTON_ID_1) {
-			ESP_LOGI(TAG, "MODE_LISTEN, Stop ADC pipeline");
+			ESP_LOGI(TAG, "MODE_LISTEN, Stop sending audio");
 			badge_mode = MODE_LISTEN;
-
-			audio_element_set_ringbuf_done(adc_i2s);
-			audio_pipeline_stop(tx_pipeline);
-			audio_pipeline_wait_for_stop(tx_pipeline);
-			audio_pipeline_reset_ringbuffer(tx_pipeline);
-			audio_pipeline_reset_elements(tx_pipeline);
-			audio_pipeline_terminate(tx_pipeline);
+			audio_tx_stop();
 
 			ui_layout_badge(paired ? peer_badge.name : NULL);
+		} else if (button_id == BUTTON_ID_2) {
+			// page back through captions that have left the screen
+			caption_page(1);
+		} else if (button_id == BUTTON_ID_3) {
+			caption_page(-1);
 		}
 	} else if (badge_mode == MODE_PAIR_SEARCH) {
 		// no interaction available
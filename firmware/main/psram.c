@@ -0,0 +1,19 @@
+#include "psram.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+
+#if CONFIG_SPIRAM
+#include "esp_heap_caps.h"
+#endif
+
+void *psram_alloc(size_t len, const char *tag, const char *who) {
+#if CONFIG_SPIRAM
+	void *p = heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+	if (p != NULL) {
+		return p;
+	}
+	ESP_LOGW(tag, "%s: No PSRAM, using internal RAM", who);
+#endif
+	return malloc(len);
+}
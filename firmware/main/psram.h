@@ -0,0 +1,13 @@
+#pragma once
+
+/*
+ * Allocation of large buffers that do not need to be fast, such as caches and backlogs.
+ */
+
+#include <stddef.h>
+
+/*
+ * Allocates `len` bytes in PSRAM if there is any with room, otherwise in internal RAM, logging
+ * so under `tag` as `who`. Returns NULL if neither has room. Freed with free().
+ */
+void *psram_alloc(size_t len, const char *tag, const char *who);
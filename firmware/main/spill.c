@@ -0,0 +1,368 @@
+#include "spill.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "psram.h"
+#include "udp_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#ifdef CONFIG_AUDIO_SPILL_FLASH
+#include "esp_littlefs.h"
+#endif
+
+#define SPILL_FRAME_MS 20 // of a datagram of audio
+#define SPILL_REC_HDR 6   // uint16_t length of the datagram ahead of it, uint32_t ms it was sent
+#define SPILL_FILE_HDR 2  // only the length
+#define SPILL_MAX_DGRAM (UDP_AUDIO_HDR_LEN + AUDIO_CODEC_MAX_PACKET)
+#define SPILL_BASE_PATH "/spill"
+#define SPILL_FILE SPILL_BASE_PATH "/backlog"
+
+static const char *TAG = "spill";
+
+static spill_cfg_t       cfg;
+static SemaphoreHandle_t lock;
+static int               sock = -1; // of the backlog
+static bool              online;
+
+// Records of a header and a datagram, back to back, wrapping around the end. From `tail` the
+// copies of those sent, then from `unsent` the backlog, up to `head`.
+static uint8_t *ring = NULL;
+static size_t   tail, unsent, head;
+static size_t   used;      // bytes from tail to head
+static uint32_t kept;      // records from tail to unsent
+static size_t   kept_len;  // and their bytes
+static uint32_t queued;    // from unsent to head
+static uint32_t to_resend; // the first of those, sent once already
+
+// Records of a length and a datagram, all newer than the ring's, from file_read to file_write
+static FILE  *file = NULL;
+static size_t file_len; // most bytes written to it before it is emptied
+static size_t file_read, file_write;
+
+static int64_t       backlog_since_us; // when Wi-Fi came back, 0 without a backlog
+static spill_stats_t stats;
+
+static uint32_t now_ms(void) {
+	return esp_timer_get_time() / 1000;
+}
+
+static size_t ring_next(size_t at, size_t len) {
+	return (at + len) % cfg.ram_len;
+}
+
+static void ring_write(size_t at, const uint8_t *src, size_t len) {
+	size_t first = MIN(len, cfg.ram_len - at);
+	memcpy(ring + at, src, first);
+	memcpy(ring, src + first, len - first);
+}
+
+static void ring_read(size_t at, uint8_t *dst, size_t len) {
+	size_t first = MIN(len, cfg.ram_len - at);
+	memcpy(dst, ring + at, first);
+	memcpy(dst + first, ring, len - first);
+}
+
+/*
+ * Returns the length of the datagram of the record at `at`, and copies it to `dgram` unless that
+ * is NULL.
+ */
+static size_t ring_record(size_t at, uint8_t *dgram) {
+	uint8_t hdr[SPILL_REC_HDR];
+	ring_read(at, hdr, sizeof(hdr));
+	size_t len = hdr[0] | hdr[1] << 8;
+	if (dgram != NULL) {
+		ring_read(ring_next(at, SPILL_REC_HDR), dgram, len);
+	}
+	return len;
+}
+
+static uint32_t ring_record_sent(size_t at) {
+	uint8_t hdr[SPILL_REC_HDR];
+	ring_read(at, hdr, sizeof(hdr));
+	return udp_audio_get_le32(hdr + 2);
+}
+
+static void ring_record_set_sent(size_t at, uint32_t ms) {
+	uint8_t sent[4];
+	udp_audio_put_le32(sent, ms);
+	ring_write(ring_next(at, 2), sent, sizeof(sent));
+}
+
+/*
+ * Lets go of the copies sent more than resend_ms ago, then of as many more as it takes for
+ * `need` bytes to fit, down to `keep` bytes of them. Returns whether they fit.
+ */
+static bool ring_make_room(size_t need, size_t keep) {
+	uint32_t now = now_ms();
+	while (kept > 0 && ((cfg.ram_len - used < need && kept_len > keep) ||
+	                    now - ring_record_sent(tail) > cfg.resend_ms)) {
+		size_t len = SPILL_REC_HDR + ring_record(tail, NULL);
+		tail = ring_next(tail, len);
+		used -= len;
+		kept--;
+		kept_len -= len;
+	}
+	return cfg.ram_len - used >= need;
+}
+
+static void ring_append(const uint8_t *dgram, size_t len, uint32_t sent_ms) {
+	uint8_t hdr[SPILL_REC_HDR] = {len, len >> 8};
+	udp_audio_put_le32(hdr + 2, sent_ms);
+	ring_write(head, hdr, SPILL_REC_HDR);
+	ring_write(ring_next(head, SPILL_REC_HDR), dgram, len);
+	head = ring_next(head, SPILL_REC_HDR + len);
+	used += SPILL_REC_HDR + len;
+}
+
+/*
+ * Queues a datagram at the end of the backlog: in the ring, unless it is full or the file has
+ * some of the backlog already, else in the file. Returns whether there was room.
+ */
+static bool backlog_push(const uint8_t *dgram, size_t len) {
+	if (file_read == file_write && ring_make_room(SPILL_REC_HDR + len, 0)) {
+		ring_append(dgram, len, 0);
+		queued++;
+		stats.peak_ram = MAX(stats.peak_ram, used);
+		return true;
+	}
+	if (file == NULL || file_write + SPILL_FILE_HDR + len > file_len) {
+		return false;
+	}
+	uint8_t hdr[SPILL_FILE_HDR] = {len, len >> 8};
+	fseek(file, file_write, SEEK_SET);
+	if (fwrite(hdr, 1, SPILL_FILE_HDR, file) != SPILL_FILE_HDR ||
+	    fwrite(dgram, 1, len, file) != len) {
+		return false;
+	}
+	file_write += SPILL_FILE_HDR + len;
+	stats.filed++;
+	stats.peak_file = MAX(stats.peak_file, file_write - file_read);
+	return true;
+}
+
+/*
+ * Moves the oldest records of the file into the ring while they fit, and empties the file once
+ * they have all moved, so that LittleFS only ever appends to it.
+ */
+static void backlog_refill(void) {
+	static uint8_t dgram[SPILL_MAX_DGRAM];
+	while (file_read < file_write) {
+		uint8_t hdr[SPILL_FILE_HDR];
+		fseek(file, file_read, SEEK_SET);
+		if (fread(hdr, 1, SPILL_FILE_HDR, file) != SPILL_FILE_HDR) {
+			break;
+		}
+		size_t len = hdr[0] | hdr[1] << 8;
+		// half of the ring stays for the copies, or a second outage while catching up would
+		// lose what was sent from the backlog before it was noticed
+		if (!ring_make_room(SPILL_REC_HDR + len, cfg.ram_len / 2)) {
+			return;
+		}
+		if (len > SPILL_MAX_DGRAM || fread(dgram, 1, len, file) != len) {
+			break;
+		}
+		ring_append(dgram, len, 0);
+		queued++;
+		file_read += SPILL_FILE_HDR + len;
+	}
+	if (file_read < file_write) {
+		ESP_LOGE(TAG, "backlog_refill: Failed to read " SPILL_FILE ", dropping %u bytes",
+		         file_write - file_read);
+	}
+	file = freopen(SPILL_FILE, "w+", file);
+	if (file == NULL) {
+		ESP_LOGE(TAG, "backlog_refill: Failed to empty " SPILL_FILE ", errno %d", errno);
+	}
+	file_read = file_write = 0;
+}
+
+static void spill_task(void *arg) {
+	static uint8_t dgram[SPILL_MAX_DGRAM];
+	while (1) {
+		vTaskDelay(pdMS_TO_TICKS(SPILL_FRAME_MS));
+		xSemaphoreTake(lock, portMAX_DELAY);
+		if (file_read < file_write) {
+			backlog_refill();
+		}
+		ring_make_room(0, 0);
+		// the datagrams sent directly wait behind these, so the backlog shrinks by rate - 1
+		// frames each frame while the wearer talks
+		for (uint32_t i = 0; online && i < cfg.rate && queued > 0; i++) {
+			size_t len = ring_record(unsent, dgram);
+			if (now_ms() - udp_audio_get_le32(dgram + 4) > SPILL_STALE_MS) {
+				dgram[11] |= UDP_AUDIO_FLAG_STORED;
+			}
+			if (send(sock, dgram, len, MSG_DONTWAIT) < 0) {
+				break; // tried again next frame
+			}
+			ring_record_set_sent(unsent, now_ms());
+			unsent = ring_next(unsent, SPILL_REC_HDR + len);
+			queued--;
+			kept++;
+			kept_len += SPILL_REC_HDR + len;
+			if (to_resend > 0) {
+				to_resend--;
+				stats.resent++;
+			} else {
+				stats.forwarded++;
+			}
+		}
+		if (backlog_since_us != 0 && queued == 0 && file_read == file_write) {
+			ESP_LOGI(TAG, "spill_task: Backlog sent in %lld ms",
+			         (esp_timer_get_time() - backlog_since_us) / 1000);
+			backlog_since_us = 0;
+		}
+		xSemaphoreGive(lock);
+	}
+}
+
+static void spill_event(void *arg, esp_event_base_t base, int32_t id, void *data) {
+	xSemaphoreTake(lock, portMAX_DELAY);
+	if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED && online) {
+		online = false;
+		stats.outages++;
+		// the access point may have been gone for a while before the beacons were missed
+		unsent = tail;
+		queued += kept;
+		to_resend += kept;
+		kept_len = 0;
+		ESP_LOGW(TAG, "spill_event: Wi-Fi down, %lu datagrams to send again", kept);
+		kept = 0;
+		backlog_since_us = 0;
+	} else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP && !online) {
+		online = true;
+		if (queued > 0 || file_read < file_write) {
+			backlog_since_us = esp_timer_get_time();
+			ESP_LOGI(TAG,
+			         "spill_event: Wi-Fi up, sending a backlog of %u bytes in RAM and "
+			         "%u in flash",
+			         used, file_write - file_read);
+		}
+	}
+	xSemaphoreGive(lock);
+}
+
+#ifdef CONFIG_AUDIO_SPILL_FLASH
+static void spill_mount(void) {
+	esp_vfs_littlefs_conf_t fs_cfg = {
+	    .base_path = SPILL_BASE_PATH,
+	    .partition_label = cfg.partition,
+	    .format_if_mount_failed = true,
+	};
+	esp_err_t err = esp_vfs_littlefs_register(&fs_cfg);
+	if (err != ESP_OK) {
+		ESP_LOGW(TAG, "spill_init: Failed to mount partition %s: %s", cfg.partition,
+		         esp_err_to_name(err));
+		return;
+	}
+	size_t total = 0, fs_used = 0;
+	esp_littlefs_info(cfg.partition, &total, &fs_used);
+	// what a reboot left behind belongs to streams the server has given up on
+	file = fopen(SPILL_FILE, "w+");
+	if (file == NULL) {
+		ESP_LOGW(TAG, "spill_init: Failed to create " SPILL_FILE ", errno %d", errno);
+		return;
+	}
+	// LittleFS needs free blocks to write into
+	file_len = total / 4 * 3;
+}
+#endif
+
+esp_err_t spill_init(const spill_cfg_t *init_cfg) {
+	cfg = *init_cfg;
+	uint8_t *buf = psram_alloc(cfg.ram_len, TAG, "spill_init");
+	if (buf == NULL) {
+		ESP_LOGE(TAG, "spill_init: Out of memory");
+		return ESP_ERR_NO_MEM;
+	}
+
+	struct sockaddr_in addr = {
+	    .sin_family = AF_INET,
+	    .sin_port = htons(cfg.port),
+	};
+	if (inet_pton(AF_INET, cfg.host, &addr.sin_addr) != 1) {
+		ESP_LOGE(TAG, "spill_init: Invalid server address %s", cfg.host);
+		free(buf);
+		return ESP_ERR_INVALID_ARG;
+	}
+	sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		ESP_LOGE(TAG, "spill_init: Failed to create socket: errno %d", errno);
+		if (sock >= 0) {
+			close(sock);
+			sock = -1;
+		}
+		free(buf);
+		return ESP_FAIL;
+	}
+
+#ifdef CONFIG_AUDIO_SPILL_FLASH
+	if (cfg.partition != NULL) {
+		spill_mount();
+	}
+#endif
+	lock = xSemaphoreCreateMutex();
+	esp_netif_t        *sta = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+	esp_netif_ip_info_t ip;
+	online = sta != NULL && esp_netif_get_ip_info(sta, &ip) == ESP_OK && ip.ip.addr != 0;
+	ESP_ERROR_CHECK(esp_event_handler_instance_register(
+	    WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &spill_event, NULL, NULL));
+	ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP,
+	                                                    &spill_event, NULL, NULL));
+	xTaskCreate(spill_task, "spill", 4 * 1024, NULL, 3, NULL);
+	ring = buf;
+
+	ESP_LOGI(TAG, "spill_init: Backlog of up to %u bytes in RAM and %u in flash, at %lux",
+	         cfg.ram_len, file_len, cfg.rate);
+	return ESP_OK;
+}
+
+int spill_send(int s, const uint8_t *dgram, size_t len) {
+	if (ring == NULL) {
+		return send(s, dgram, len, MSG_DONTWAIT);
+	}
+	xSemaphoreTake(lock, portMAX_DELAY);
+	if (online && queued == 0 && file_read == file_write) {
+		int r = send(s, dgram, len, MSG_DONTWAIT);
+		if (r >= 0) {
+			if (ring_make_room(SPILL_REC_HDR + len, 0)) {
+				ring_append(dgram, len, now_ms());
+				unsent = head;
+				kept++;
+				kept_len += SPILL_REC_HDR + len;
+			}
+			xSemaphoreGive(lock);
+			return r;
+		}
+		// e.g. lwIP is out of buffers, or the interface has just gone down
+	}
+	int r = 0;
+	if (backlog_push(dgram, len)) {
+		stats.stored++;
+	} else {
+		stats.dropped++;
+		r = -1;
+	}
+	xSemaphoreGive(lock);
+	return r;
+}
+
+spill_stats_t spill_get_stats(void) {
+	if (ring == NULL) {
+		return stats;
+	}
+	spill_stats_t st;
+	xSemaphoreTake(lock, portMAX_DELAY);
+	st = stats;
+	xSemaphoreGive(lock);
+	return st;
+}
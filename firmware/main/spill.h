@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * Store and forward of the datagrams of udp_stream.h, so that what is said while Wi-Fi is down
+ * is captioned late rather than never.
+ *
+ * While the badge is off the network, the datagrams queue up in a ring of ram_len bytes in RAM,
+ * PSRAM if there is any, and once that is full, in a file on the LittleFS partition `partition`, in
+ * order. When it is back, a task sends the backlog `rate` datagrams per 20 ms frame, on a socket of
+ * its own, and the datagrams sent after it queue up behind it until it has gone. Those older than
+ * SPILL_STALE_MS are marked UDP_AUDIO_FLAG_STORED, so that the server transcribes them but does not
+ * play them on the peers.
+ *
+ * The badge only learns the access point is gone when its beacons have been missing for a while,
+ * and until then lwIP sends into the void. So a copy of each datagram sent is kept for
+ * resend_ms, and sent again from the start of the backlog once Wi-Fi is found to be down. The
+ * server drops those it has by sequence number.
+ */
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPILL_STALE_MS 200 // older than this, a datagram is too late for the peers' speakers
+
+typedef struct {
+	const char *host; // IPv4 address of the server
+	uint16_t    port;
+	size_t      ram_len;
+	const char *partition; // label of the LittleFS partition to overflow into, or NULL
+	uint32_t    resend_ms;
+	uint32_t    rate; // times real time the backlog is sent at
+} spill_cfg_t;
+
+typedef struct {
+	uint32_t outages;
+	uint32_t stored;    // datagrams queued while they could not be sent
+	uint32_t filed;     // of those, that went to the file
+	uint32_t forwarded; // sent from the backlog
+	uint32_t resent;    // sent again after an outage, in case they were lost
+	uint32_t dropped;   // with no room left to queue them
+	size_t   peak_ram;  // most bytes in the ring, with the copies
+	size_t   peak_file; // and in the file
+} spill_stats_t;
+
+/*
+ * Allocates the ring, mounts the partition and starts the task. Without the partition, the
+ * backlog is only as long as the ring. Returns ESP_ERR_NO_MEM without the ring, in which case
+ * spill_send() only sends.
+ */
+esp_err_t spill_init(const spill_cfg_t *cfg);
+
+/*
+ * Sends the `len` bytes of `dgram` on the connected socket `sock` of the caller, or queues them
+ * behind the backlog. Returns the bytes sent, 0 if they were queued, or -1 if they were dropped.
+ */
+int spill_send(int sock, const uint8_t *dgram, size_t len);
+
+/*
+ * Returns counters since spill_init().
+ */
+spill_stats_t spill_get_stats(void);
@@ -0,0 +1,200 @@
+#include "udp_stream.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "spill.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define UDP_AUDIO_END_REPEATS 3 // the end of a stream must not be lost
+#define UDP_AUDIO_TOS 0xB8      // DSCP EF, like other voice traffic
+
+static const char *TAG = "udp_stream";
+
+typedef struct {
+	udp_stream_cfg_t   cfg;
+	int                sock;
+	uint32_t           seq;
+	uint16_t           stream;
+	uint8_t            dgram[UDP_AUDIO_HDR_LEN + AUDIO_CODEC_MAX_PACKET];
+	size_t             fill; // bytes of the packet read so far, its length first
+	udp_stream_stats_t stats;
+} udp_stream_t;
+
+void udp_audio_put_le32(uint8_t *p, uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+uint32_t udp_audio_get_le32(const uint8_t *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/*
+ * Sends the header and `len` bytes of payload in us->dgram.
+ */
+static void udp_stream_send(udp_stream_t *us, size_t len, uint8_t flags) {
+	uint8_t *h = us->dgram;
+	udp_audio_put_le32(h, us->seq++);
+	udp_audio_put_le32(h + 4, esp_timer_get_time() / 1000);
+	h[8] = us->stream;
+	h[9] = us->stream >> 8;
+	h[10] = us->cfg.codec;
+	h[11] = flags | (us->cfg.vad ? UDP_AUDIO_FLAG_VAD : 0);
+#ifdef CONFIG_AUDIO_SPILL
+	int r = spill_send(us->sock, us->dgram, UDP_AUDIO_HDR_LEN + len);
+	if (r == 0) {
+		us->stats.stored++;
+		return;
+	}
+#else
+	// never blocks: a datagram lwIP has no room for is dropped like one lost on the air
+	int r = send(us->sock, us->dgram, UDP_AUDIO_HDR_LEN + len, MSG_DONTWAIT);
+#endif
+	if (r < 0) {
+		us->stats.send_errors++;
+		return;
+	}
+	us->stats.datagrams++;
+	us->stats.bytes += r;
+}
+
+static esp_err_t udp_stream_open(audio_element_handle_t self) {
+	udp_stream_t *us = (udp_stream_t *)audio_element_getdata(self);
+
+	struct sockaddr_in addr = {
+	    .sin_family = AF_INET,
+	    .sin_port = htons(us->cfg.port),
+	};
+	if (inet_pton(AF_INET, us->cfg.host, &addr.sin_addr) != 1) {
+		ESP_LOGE(TAG, "udp_stream_open: Invalid server address %s", us->cfg.host);
+		return ESP_FAIL;
+	}
+	us->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (us->sock < 0) {
+		ESP_LOGE(TAG, "udp_stream_open: Failed to create socket: errno %d", errno);
+		return ESP_FAIL;
+	}
+	int tos = UDP_AUDIO_TOS;
+	setsockopt(us->sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+	if (connect(us->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		ESP_LOGE(TAG, "udp_stream_open: Failed to connect to %s:%u: errno %d", us->cfg.host,
+		         us->cfg.port, errno);
+		close(us->sock);
+		us->sock = -1;
+		return ESP_FAIL;
+	}
+
+	us->seq = 0;
+	us->stream = esp_random();
+	us->fill = 0;
+	ESP_LOGI(TAG, "udp_stream_open: Stream %04x to %s:%u", us->stream, us->cfg.host,
+	         us->cfg.port);
+	return ESP_OK;
+}
+
+static esp_err_t udp_stream_close(audio_element_handle_t self) {
+	udp_stream_t *us = (udp_stream_t *)audio_element_getdata(self);
+	if (us->sock < 0) {
+		return ESP_OK;
+	}
+	for (int i = 0; i < UDP_AUDIO_END_REPEATS; i++) {
+		udp_stream_send(us, 0, UDP_AUDIO_FLAG_END);
+	}
+	close(us->sock);
+	us->sock = -1;
+
+	udp_stream_stats_t *st = &us->stats;
+	ESP_LOGI(TAG,
+	         "udp_stream_close: %lu datagrams with %lu keepalives, %llu bytes, %lu queued, "
+	         "%lu not sent",
+	         st->datagrams, st->keepalives, st->bytes, st->stored, st->send_errors);
+#ifdef CONFIG_AUDIO_SPILL
+	spill_stats_t sp = spill_get_stats();
+	ESP_LOGI(TAG,
+	         "udp_stream_close: Since boot, %lu outages, %lu datagrams queued with %lu in "
+	         "flash, %lu sent from the backlog and %lu again, %lu dropped, at most %u bytes "
+	         "in PSRAM and %u in flash",
+	         sp.outages, sp.stored, sp.filed, sp.forwarded, sp.resent, sp.dropped, sp.peak_ram,
+	         sp.peak_file);
+#endif
+	return ESP_OK;
+}
+
+static int udp_stream_process(audio_element_handle_t self, char *buf, int len) {
+	udp_stream_t *us = (udp_stream_t *)audio_element_getdata(self);
+	// the packet length lands in the last bytes of the datagram header, which are written
+	// after it has been read, so the payload needs no copying
+	uint8_t *pkt = us->dgram + UDP_AUDIO_HDR_LEN - AUDIO_CODEC_PACKET_HDR_LEN;
+	size_t   need = AUDIO_CODEC_PACKET_HDR_LEN;
+	if (us->fill >= AUDIO_CODEC_PACKET_HDR_LEN) {
+		need += pkt[0] | pkt[1] << 8;
+	}
+	int r = audio_element_input(self, (char *)pkt + us->fill, need - us->fill);
+	if (r <= 0) {
+		return r;
+	}
+	us->fill += r;
+	if (us->fill == AUDIO_CODEC_PACKET_HDR_LEN) {
+		need += pkt[0] | pkt[1] << 8;
+		if (need > AUDIO_CODEC_PACKET_HDR_LEN + AUDIO_CODEC_MAX_PACKET) {
+			ESP_LOGE(TAG, "udp_stream_process: Packet of %u bytes is too long",
+			         need - AUDIO_CODEC_PACKET_HDR_LEN);
+			return ESP_FAIL;
+		}
+	}
+	if (us->fill < need) {
+		return r;
+	}
+	us->fill = 0;
+
+	size_t payload = need - AUDIO_CODEC_PACKET_HDR_LEN;
+	if (payload == 0) {
+		us->stats.keepalives++;
+	}
+	udp_stream_send(us, payload, payload == 0 ? UDP_AUDIO_FLAG_KEEPALIVE : 0);
+	if (payload != 0 && us->cfg.sent != NULL) {
+		us->cfg.sent();
+	}
+	return r;
+}
+
+static esp_err_t udp_stream_destroy(audio_element_handle_t self) {
+	udp_stream_t *us = (udp_stream_t *)audio_element_getdata(self);
+	free(us);
+	return ESP_OK;
+}
+
+audio_element_handle_t udp_stream_init(const udp_stream_cfg_t *cfg) {
+	udp_stream_t *us = calloc(1, sizeof(udp_stream_t));
+	if (us == NULL) {
+		ESP_LOGE(TAG, "udp_stream_init: Out of memory");
+		return NULL;
+	}
+	us->cfg = *cfg;
+	us->sock = -1;
+
+	audio_element_cfg_t el_cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+	el_cfg.open = udp_stream_open;
+	el_cfg.close = udp_stream_close;
+	el_cfg.process = udp_stream_process;
+	el_cfg.destroy = udp_stream_destroy;
+	el_cfg.buffer_len = 0; // reads straight into us->dgram
+	el_cfg.tag = "tx-udp";
+	audio_element_handle_t el = audio_element_init(&el_cfg);
+	if (el == NULL) {
+		ESP_LOGE(TAG, "udp_stream_init: Failed to create element");
+		free(us);
+		return NULL;
+	}
+	audio_element_setdata(el, us);
+	return el;
+}
+
+udp_stream_stats_t udp_stream_get_stats(audio_element_handle_t self) {
+	udp_stream_t *us = (udp_stream_t *)audio_element_getdata(self);
+	return us->stats;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * Audio element that sends the packets of an encoder (codec_stream.h) to the server over UDP, one
+ * datagram per 20 ms frame, instead of a chunked HTTP POST. A lost datagram costs the server
+ * that frame and nothing else, where TCP holds back everything behind it until the
+ * retransmission.
+ *
+ * A datagram is a little-endian header followed by the packet without its length:
+ *
+ *   0  seq      uint32  counts the datagrams of a stream from 0
+ *   4  time_ms  uint32  badge clock when the packet was sent
+ *   8  stream   uint16  random for each run of the pipeline
+ *  10  codec    uint8   audio_codec_id_t
+ *  11  flags    uint8   UDP_AUDIO_FLAG_*
+ *
+ * With CONFIG_AUDIO_SPILL, the datagrams that cannot be sent while Wi-Fi is down go up later
+ * (spill.h) instead of being lost.
+ */
+
+#include "audio_codec.h"
+#include "audio_element.h"
+
+#define UDP_AUDIO_HDR_LEN 12
+#define UDP_AUDIO_FLAG_KEEPALIVE 0x01 // a keepalive of the VAD, no payload
+#define UDP_AUDIO_FLAG_VAD 0x02       // only speech is sent, like x-audio-vad
+#define UDP_AUDIO_FLAG_END 0x04       // the pipeline stopped, no payload
+#define UDP_AUDIO_FLAG_STORED 0x08    // sent late from the backlog of spill.h
+
+typedef struct {
+	const char      *host; // IPv4 address of the server
+	uint16_t         port;
+	audio_codec_id_t codec;
+	bool             vad;
+	void (*sent)(void); // called after each datagram of audio, if not NULL
+} udp_stream_cfg_t;
+
+typedef struct {
+	uint32_t datagrams;
+	uint32_t keepalives;
+	uint32_t stored;      // queued behind the backlog of spill.h
+	uint32_t send_errors; // dropped because lwIP was out of buffers, or with no room to queue
+	uint64_t bytes;       // with the headers
+} udp_stream_stats_t;
+
+/*
+ * Write and read the little-endian uint32 fields of the header, and of spill.h's records.
+ */
+void     udp_audio_put_le32(uint8_t *p, uint32_t v);
+uint32_t udp_audio_get_le32(const uint8_t *p);
+
+/*
+ * Creates the element with `cfg`, or returns NULL. The socket is opened with the pipeline.
+ */
+audio_element_handle_t udp_stream_init(const udp_stream_cfg_t *cfg);
+
+/*
+ * Returns counters since the element was created.
+ */
+udp_stream_stats_t udp_stream_get_stats(audio_element_handle_t self);
@@ -9,12 +9,14 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "freertos/task.h"
 #include "nvs_flash.h"
 #include <string.h>
+#include <sys/param.h>
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
@@ -76,6 +78,7 @@ void intToStr(int num, char *str) {
    the config you want - ie #define EXAMPLE_WIFI_SSID "mywifissid"
 */
 #define EXAMPLE_ESP_MAXIMUM_RETRY 5
+#define WIFI_RETRY_BACKOFF_MAX_MS 30000 // between the retries after those
 
 #if CONFIG_ESP_WPA3_SAE_PWE_HUNT_AND_PECK
 #define ESP_WIFI_SAE_MODE WPA3_SAE_PWE_HUNT_AND_PECK
@@ -107,6 +110,7 @@ void intToStr(int num, char *str) {
 
 /* FreeRTOS event group to signal when we are connected*/
 static EventGroupHandle_t s_wifi_event_group;
+static esp_timer_handle_t s_retry_timer;
 
 /* The event group allows multiple bits for each event, but we only care about two events:
  * - we are connected to the AP with an IP
@@ -114,6 +118,10 @@ static EventGroupHandle_t s_wifi_event_group;
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT BIT1
 
+static void retry_timer_cb(void *arg) {
+	esp_wifi_connect();
+}
+
 static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id,
                           void *event_data) {
 	if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
@@ -122,11 +130,16 @@ static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_
 		wifiIsConnected = false;
 		if (s_retry_num < EXAMPLE_ESP_MAXIMUM_RETRY) {
 			esp_wifi_connect();
-			s_retry_num++;
 			ESP_LOGI(TAG, "retry to connect to the AP");
 		} else {
+			// keep trying, less and less often, so that the badge is back with the AP
+			int      doublings = MIN(s_retry_num - EXAMPLE_ESP_MAXIMUM_RETRY, 5);
+			uint32_t backoff_ms = MIN(1000 << doublings, WIFI_RETRY_BACKOFF_MAX_MS);
+			esp_timer_start_once(s_retry_timer, backoff_ms * 1000ULL);
+			ESP_LOGI(TAG, "retry to connect to the AP in %lu ms", backoff_ms);
 			xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
 		}
+		s_retry_num++;
 		ESP_LOGI(TAG, "connect to the AP fail");
 	} else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
 		ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
@@ -164,6 +177,12 @@ void wifi_init(void) {
 	ESP_ERROR_CHECK(esp_event_loop_create_default());
 	esp_netif_create_default_wifi_sta();
 
+	esp_timer_create_args_t retry_timer_args = {
+	    .callback = retry_timer_cb,
+	    .name = "wifi_retry",
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&retry_timer_args, &s_retry_timer));
+
 	wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
 	ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
@@ -0,0 +1,221 @@
+"""
+The badge's audio codecs (firmware/main/dsp/audio_codec.h), for the audio it sends and the
+peer audio it plays.
+
+An encoded stream is a sequence of packets, each a 2-byte little-endian length and that many
+bytes, one per 20 ms frame of 16 kHz, 16-bit mono PCM. A packet of length 0 is a keepalive of
+the badge's VAD and decodes to 160 zero samples, so that the server finds it in the PCM as if
+there were no codec. "pcm" is plain samples without packets.
+"""
+
+import struct
+
+try:
+    import audioop  # until Python 3.12, much faster than adpcm_decode below
+except ImportError:
+    audioop = None
+
+FRAME_SAMPLES = 320  # 20 ms
+KEEPALIVE_SAMPLES = 160  # VAD_FRAME_SAMPLES
+ADPCM_HDR_LEN = 4
+
+STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60,
+    66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371,
+    408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707,
+    1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132,
+    7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+    27086, 29794, 32767,
+]  # fmt: skip
+INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8]
+
+# the badge puts the first sample of a byte in the low nibble, audioop in the high one
+SWAP_NIBBLES = bytes((b >> 4) | (b << 4) & 0xF0 for b in range(256))
+
+
+def _step(predictor, index, nibble):
+    step = STEP_TABLE[index]
+    diff = step >> 3
+    if nibble & 4:
+        diff += step
+    if nibble & 2:
+        diff += step >> 1
+    if nibble & 1:
+        diff += step >> 2
+    predictor = predictor - diff if nibble & 8 else predictor + diff
+    predictor = max(-32768, min(32767, predictor))
+    index = max(0, min(88, index + INDEX_TABLE[nibble]))
+    return predictor, index
+
+
+def adpcm_decode(block):
+    """Returns the PCM bytes of an ADPCM block (firmware/main/dsp/adpcm.h)."""
+    if len(block) < ADPCM_HDR_LEN or block[2] > 88:
+        raise ValueError("malformed ADPCM block")
+    predictor, index = struct.unpack_from("<hB", block)
+    if audioop is not None:
+        data = block[ADPCM_HDR_LEN:].translate(SWAP_NIBBLES)
+        return audioop.adpcm2lin(data, 2, (predictor, index))[0]
+    out = []
+    for b in block[ADPCM_HDR_LEN:]:
+        predictor, index = _step(predictor, index, b & 0xF)
+        out.append(predictor)
+        predictor, index = _step(predictor, index, b >> 4)
+        out.append(predictor)
+    return struct.pack(f"<{len(out)}h", *out)
+
+
+class AdpcmEncoder:
+    def __init__(self):
+        self.predictor, self.index = 0, 0
+
+    def encode(self, pcm):
+        """Returns the ADPCM block of `pcm` bytes, carrying the state on."""
+        header = struct.pack("<hBB", self.predictor, self.index, 0)
+        if audioop is not None:
+            data, (self.predictor, self.index) = audioop.lin2adpcm(
+                pcm, 2, (self.predictor, self.index)
+            )
+            return header + data.translate(SWAP_NIBBLES)
+        samples = struct.unpack(f"<{len(pcm) // 2}h", pcm)
+        nibbles = []
+        for sample in samples:
+            diff = sample - self.predictor
+            step = STEP_TABLE[self.index]
+            nibble = 0
+            if diff < 0:
+                nibble, diff = 8, -diff
+            for bit in (4, 2, 1):
+                if diff >= step:
+                    nibble |= bit
+                    diff -= step
+                step >>= 1
+            self.predictor, self.index = _step(self.predictor, self.index, nibble)
+            nibbles.append(nibble)
+        nibbles.append(0)
+        return header + bytes(nibbles[i] | nibbles[i + 1] << 4 for i in range(0, len(samples), 2))
+
+
+class OpusCodec:
+    def __init__(self):
+        import opuslib  # only needed for Opus badges
+
+        self.decoder = opuslib.Decoder(16000, 1)
+        self.encoder = opuslib.Encoder(16000, 1, opuslib.APPLICATION_VOIP)
+
+    def decode(self, packet):
+        return self.decoder.decode(packet, FRAME_SAMPLES)
+
+    def encode(self, pcm):
+        return self.encoder.encode(pcm, FRAME_SAMPLES)
+
+
+def codec_names():
+    """
+    The codecs this server can take, for the x-audio-codecs header of GET /audio/codecs and
+    of a refusal.
+    """
+    names = ["pcm", "adpcm"]
+    try:
+        import opuslib  # noqa: F401
+
+        names.append("opus")
+    except ImportError:
+        pass
+    return names
+
+
+class PacketDecoder:
+    """Turns an encoded stream, in pieces of any size, back into PCM."""
+
+    def __init__(self, codec):
+        if codec == "adpcm":
+            self.decode = adpcm_decode
+        elif codec == "opus":
+            self.decode = OpusCodec().decode
+        else:
+            raise ValueError(f"unknown codec {codec}")
+        self.pending = b""
+
+    def feed(self, data):
+        """Returns the PCM of the whole packets received so far."""
+        self.pending += data
+        out = []
+        while len(self.pending) >= 2:
+            (length,) = struct.unpack_from("<H", self.pending)
+            if len(self.pending) < 2 + length:
+                break
+            packet, self.pending = self.pending[2 : 2 + length], self.pending[2 + length :]
+            out.append(self.decode(packet) if length else b"\0\0" * KEEPALIVE_SAMPLES)
+        return b"".join(out)
+
+
+class PacketEncoder:
+    """Turns PCM, in pieces of any size, into an encoded stream."""
+
+    def __init__(self, codec):
+        if codec == "adpcm":
+            self.encode = AdpcmEncoder().encode
+        elif codec == "opus":
+            self.encode = OpusCodec().encode
+        else:
+            raise ValueError(f"unknown codec {codec}")
+        self.pending = b""
+
+    def feed(self, pcm):
+        """Returns the packets of the whole frames received so far."""
+        self.pending += pcm
+        frame = FRAME_SAMPLES * 2
+        out = []
+        while len(self.pending) >= frame:
+            packet = self.encode(self.pending[:frame])
+            self.pending = self.pending[frame:]
+            out.append(struct.pack("<H", len(packet)) + packet)
+        return b"".join(out)
+
+
+class Utterances:
+    """
+    Splits the PCM of a badge that sends only speech (x-audio-vad, or FLAG_VAD over UDP) at its
+    keepalives, runs of `vad` zero samples. Without `vad`, all of it is speech.
+    """
+
+    def __init__(self, vad):
+        self.keepalive = b"\0\0" * vad if vad else None
+        self.pending = b""  # audio held back in case a keepalive starts at its end
+        self.talking = False  # speech came since the last keepalive
+
+    def _find_keepalive(self):
+        """Offset of the first keepalive in `pending` on a sample boundary, or -1."""
+        m = self.pending.find(self.keepalive)
+        while m > 0 and m % 2:
+            m = self.pending.find(self.keepalive, m + 1)
+        return m
+
+    def feed(self, pcm):
+        """
+        Returns the speech received so far in runs, and None where a keepalive ends an
+        utterance. Keepalives between utterances are dropped.
+        """
+        if self.keepalive is None:
+            self.talking = True
+            return [pcm]
+        self.pending += pcm
+        out = []
+        m = self._find_keepalive()
+        while m >= 0:
+            if m > 0:
+                out.append(self.pending[:m])
+                self.talking = True
+            if self.talking:
+                out.append(None)
+                self.talking = False
+            self.pending = self.pending[m + len(self.keepalive) :]
+            m = self._find_keepalive()
+        cut = max(0, len(self.pending) - len(self.keepalive) + 2)
+        cut -= cut % 2
+        if cut > 0:
+            out.append(self.pending[:cut])
+            self.talking = True
+            self.pending = self.pending[cut:]
+        return out
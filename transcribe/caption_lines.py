@@ -0,0 +1,156 @@
+"""
+Lays out the caption on the server in the badge's character grid and sends it as positioned
+lines (POST /caption/lines), so that the badge draws them without wrapping words itself. The
+grid comes from GET /caption/geometry. Lines are sent at most once per partial refresh of the
+badge, with the edits that came in meanwhile, so that each refresh shows whole lines.
+
+Run as a script, it turns a transcript of the host simulator (firmware/host/transcripts) into
+a lines file for `epd_sim lines`, and compares the bytes on the wire with the text POSTs:
+
+    python3 caption_lines.py ../firmware/host/transcripts/expo_demo.txt expo_demo.lines
+"""
+
+import argparse
+import os
+
+from caption_text import CaptionText, parse_transcript, request_bytes
+
+# what GET /caption/geometry gives with the default configuration
+DEFAULT_GEOMETRY = {"cols": 24, "rows": 7, "live_rows": 0, "refresh_ms": 0}
+
+
+class LineLayout:
+    """
+    Wraps the caption into rows of the badge's grid, newest row at the bottom once the grid is
+    full, and works out the line commands that bring the badge from what it shows to the new
+    rows.
+    """
+
+    def __init__(self, geometry):
+        self.cols = geometry["cols"]
+        self.rows = geometry["rows"] + geometry["live_rows"]
+        # the badge scrolls the committed rows only, so scrolling needs all rows to be those
+        self.can_scroll = geometry["live_rows"] == 0
+        self.shown = [""] * self.rows
+        self.top = 0  # lines scrolled off the top
+
+    def invalidate(self):
+        """The badge has lost what it showed, e.g. after caption_clear; send every row."""
+        self.shown = [None] * self.rows
+
+    def layout(self, words):
+        """Returns the rows of the grid and the number of lines scrolled off the top."""
+        lines, line = [], ""
+        for word in words:
+            # like caption_put: a word too long for a row is broken, others move to the next
+            while len(word) > self.cols:
+                if line:
+                    lines.append(line)
+                    line = ""
+                lines.append(word[: self.cols])
+                word = word[self.cols :]
+            if line and len(line) + 1 + len(word) > self.cols:
+                lines.append(line)
+                line = ""
+            line = f"{line} {word}" if line else word
+        if line:
+            lines.append(line)
+        top = max(0, len(lines) - self.rows)
+        lines = lines[top:]
+        return lines + [""] * (self.rows - len(lines)), top
+
+    def update(self, words):
+        """Returns the commands, as (scroll, row, col, lines), that show `words`: a scroll, then
+        runs of changed rows, the first from the column where it starts to differ."""
+        rows, top = self.layout(words)
+        # the badge moves the rows up itself, so that only the new line is sent
+        scroll = top - self.top
+        if not self.can_scroll or not 0 <= scroll < self.rows or None in self.shown:
+            scroll = 0
+        self.top = top
+        self.shown = self.shown[scroll:] + [""] * scroll
+        commands = []
+        for row, (new, old) in enumerate(zip(rows, self.shown)):
+            if new == old:
+                continue
+            if commands and commands[-1][1] + len(commands[-1][3]) == row:
+                commands[-1][3].append(new)
+                continue
+            col = 0
+            if old is not None:
+                while col < min(len(new), len(old)) and new[col] == old[col]:
+                    col += 1
+            commands.append((0, row, col, [new[col:]]))
+        if scroll > 0:
+            if commands:
+                commands[0] = (scroll,) + commands[0][1:]
+            else:
+                commands = [(scroll, 0, 0, [])]
+        self.shown = rows
+        return commands
+
+
+def paced(edits, refresh_ms):
+    """
+    Yields (ms, words) for the caption after `edits`, at most once per `refresh_ms`: an edit
+    that comes sooner after the last update waits, and the edits after it join it.
+    """
+    caption = CaptionText()
+    last, due = None, None
+    for ms, op, index, words in edits:
+        if due is not None and ms >= due:
+            yield due, caption.words()
+            last, due = due, None
+        caption.edit(op, index, words)
+        if due is None:
+            due = ms if last is None else max(ms, last + refresh_ms)
+            if due == ms:
+                yield ms, caption.words()
+                last, due = ms, None
+    if due is not None:
+        yield due, caption.words()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("transcript")
+    parser.add_argument("lines", help="lines file to write for epd_sim")
+    parser.add_argument(
+        "--refresh-ms",
+        type=int,
+        default=0,
+        help="least time between updates, like refresh_ms of /caption/geometry (default 0)",
+    )
+    args = parser.parse_args()
+
+    text = {"posts": 0, "wire": 0}
+    for seq, (ms, op, index, words) in enumerate(parse_transcript(args.transcript), 1):
+        headers = {"x-caption-op": op, "x-caption-seq": seq}
+        if index is not None:
+            headers["x-caption-index"] = index
+        text["posts"] += 1
+        text["wire"] += request_bytes("/transcription", headers, len(" ".join(words)))
+
+    layout = LineLayout(DEFAULT_GEOMETRY)
+    lines = {"updates": 0, "posts": 0, "wire": 0}
+    with open(args.lines, "w") as out:
+        out.write(f"# {os.path.basename(args.transcript)} laid out by caption_lines.py\n")
+        for ms, words in paced(parse_transcript(args.transcript), args.refresh_ms):
+            lines["updates"] += 1
+            for scroll, row, col, rows in layout.update(words):
+                out.write(f"{ms} {scroll} {row} {col} {'|'.join(rows)}\n")
+                headers = {"x-line-row": row, "x-line-col": col}
+                if scroll:
+                    headers["x-line-scroll"] = scroll
+                lines["posts"] += 1
+                lines["wire"] += request_bytes("/caption/lines", headers, len("\n".join(rows)))
+
+    print(f"text:  {text['posts']} posts, {text['wire']} bytes on the wire")
+    print(
+        f"lines: {lines['posts']} posts in {lines['updates']} updates, {lines['wire']} bytes "
+        f"on the wire"
+    )
+
+
+if __name__ == "__main__":
+    main()
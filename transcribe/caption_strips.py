@@ -0,0 +1,199 @@
+"""
+Renders the caption on the server and sends it to the badge as compressed 1-bit strips
+(POST /caption/strip, see firmware/main/epaper/caption_strip.h), instead of sending words for
+the badge to lay out in its fixed-width font.
+
+Run as a script, it turns a transcript of the host simulator (firmware/host/transcripts) into
+a strips file for `epd_sim strips`, and compares the bytes on the wire with the text POSTs:
+
+    python3 caption_strips.py ../firmware/host/transcripts/expo_demo.txt expo_demo.strips
+"""
+
+import argparse
+import os
+
+from PIL import Image, ImageDraw, ImageFont
+
+from caption_text import CaptionText, parse_transcript, request_bytes
+
+# the badge's caption area, see ui_layout_caption
+AREA_WIDTH = 768
+AREA_HEIGHT = 420
+LINE_HEIGHT = 60
+FONT_SIZE = 44
+FONT_PATHS = [
+    "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+    "DejaVuSans.ttf",
+]
+MAX_STRIP_LEN = 4096  # CAPTION_STRIP_MAX_LEN
+MERGE_GAP = 16  # changed rows this close together go in one strip, to save a request
+
+
+def packbits(data):
+    """PackBits: n in 0..127 is followed by n + 1 literal bytes, -1..-127 by a byte repeated
+    1 - n times."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        run = 1
+        while i + run < len(data) and run < 128 and data[i + run] == data[i]:
+            run += 1
+        if run >= 2:
+            out += bytes([(1 - run) & 0xFF, data[i]])
+            i += run
+            continue
+        # literals up to the next run of 3 or more, where a repeat starts paying off
+        j = i
+        while j < len(data) and j - i < 128:
+            if j + 2 < len(data) and data[j] == data[j + 1] == data[j + 2]:
+                break
+            j += 1
+        out += bytes([j - i - 1]) + data[i:j]
+        i = j
+    return bytes(out)
+
+
+class StripRenderer:
+    """
+    Lays out the caption in a proportional font, newest line at the bottom once the area is
+    full, and works out the strips that bring the badge from what it shows to the new image.
+    """
+
+    def __init__(self, font_path=None, font_size=FONT_SIZE):
+        path = font_path or next((p for p in FONT_PATHS if os.path.exists(p)), FONT_PATHS[-1])
+        self.font = ImageFont.truetype(path, font_size)
+        self.space = self.font.getlength(" ")
+        self.row_bytes = AREA_WIDTH // 8
+        self.shown = bytes([0xFF]) * (self.row_bytes * AREA_HEIGHT)  # white
+        self.top = 0  # lines scrolled off the top
+        self.base_valid = False
+
+    def invalidate(self):
+        """The badge has drawn over the area (409 Conflict); send the next image in full."""
+        self.base_valid = False
+
+    def render(self, words):
+        """Returns the image of the area and the number of lines scrolled off the top."""
+        lines, line, width = [], [], 0.0
+        for word in words:
+            w = self.font.getlength(word)
+            if line and width + self.space + w > AREA_WIDTH:
+                lines.append(" ".join(line))
+                line, width = [], 0.0
+            width += (self.space if line else 0) + w
+            line.append(word)
+        if line:
+            lines.append(" ".join(line))
+        top = max(0, len(lines) - AREA_HEIGHT // LINE_HEIGHT)
+        lines = lines[top:]
+
+        image = Image.new("1", (AREA_WIDTH, AREA_HEIGHT), 1)
+        draw = ImageDraw.Draw(image)
+        for i, text in enumerate(lines):
+            draw.text((0, i * LINE_HEIGHT), text, font=self.font, fill=0)
+        # mode "1" packs 8 pixels per byte, MSB first, 1 = white like the framebuffer
+        return image.tobytes(), top
+
+    def _rows(self, image, y, height):
+        return image[y * self.row_bytes : (y + height) * self.row_bytes]
+
+    def _encode(self, image, y, height):
+        """Strips for rows y..y + height, each at most MAX_STRIP_LEN bytes, top to bottom, as
+        (y, height, encoding, data)."""
+        new = self._rows(image, y, height)
+        rle = packbits(new)
+        best = ("rle", rle)
+        if self.base_valid:
+            old = self._rows(self.shown, y, height)
+            delta = packbits(bytes(a ^ b for a, b in zip(new, old)))
+            if len(delta) < len(rle):
+                best = ("delta", delta)
+        if len(best[1]) <= MAX_STRIP_LEN or height == 1:
+            return [(y, height, best[0], best[1])]
+        half = height // 2
+        return self._encode(image, y, half) + self._encode(image, y + half, height - half)
+
+    def update(self, words):
+        """Returns the strips, as (y, height, scroll, encoding, data), that show `words`."""
+        image, top = self.render(words)
+        # the badge moves the text up itself, so that only the new line is sent
+        scroll = (top - self.top) * LINE_HEIGHT
+        if not self.base_valid or not 0 <= scroll < AREA_HEIGHT:
+            scroll = 0
+        self.top = top
+        if scroll > 0:
+            white = bytes([0xFF]) * (scroll * self.row_bytes)
+            self.shown = self.shown[scroll * self.row_bytes :] + white
+        if not self.base_valid:
+            spans = [(0, AREA_HEIGHT)]
+        else:
+            changed = [
+                y
+                for y in range(AREA_HEIGHT)
+                if self._rows(image, y, 1) != self._rows(self.shown, y, 1)
+            ]
+            spans = []
+            for y in changed:
+                if spans and y - spans[-1][1] <= MERGE_GAP:
+                    spans[-1][1] = y + 1
+                else:
+                    spans.append([y, y + 1])
+        strips = []
+        for start, end in spans:
+            strips += self._encode(image, start, end - start)
+        if scroll > 0 and not strips:
+            strips = [(0, 0, "delta", b"")]
+        strips = [(y, h, scroll if i == 0 else 0, e, d) for i, (y, h, e, d) in enumerate(strips)]
+        self.shown = image
+        self.base_valid = True
+        return strips
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("transcript")
+    parser.add_argument("strips", help="strips file to write for epd_sim")
+    parser.add_argument("--font", help="TrueType font (default DejaVu Sans)")
+    parser.add_argument("--font-size", type=int, default=FONT_SIZE)
+    args = parser.parse_args()
+
+    caption = CaptionText()
+    renderer = StripRenderer(args.font, args.font_size)
+    updates = 0
+    text = {"body": 0, "wire": 0}
+    strips = {"body": 0, "wire": 0, "posts": 0, "delta": 0}
+    with open(args.strips, "w") as out:
+        out.write(f"# {os.path.basename(args.transcript)} rendered by caption_strips.py\n")
+        for seq, (ms, op, index, words) in enumerate(parse_transcript(args.transcript), 1):
+            body = " ".join(words)
+            headers = {"x-caption-op": op, "x-caption-seq": seq}
+            if index is not None:
+                headers["x-caption-index"] = index
+            text["body"] += len(body)
+            text["wire"] += request_bytes("/transcription", headers, len(body))
+
+            caption.edit(op, index, words)
+            updates += 1
+            for y, height, scroll, enc, data in renderer.update(caption.words()):
+                out.write(f"{ms} {y} {height} {scroll} {enc} {data.hex()}\n")
+                headers = {"x-strip-y": y, "x-strip-height": height, "x-strip-encoding": enc}
+                if scroll:
+                    headers["x-strip-scroll"] = scroll
+                strips["posts"] += 1
+                strips["delta"] += enc == "delta"
+                strips["body"] += len(data)
+                strips["wire"] += request_bytes("/caption/strip", headers, len(data))
+
+    print(f"{updates} caption updates")
+    print(
+        f"text:   {updates} posts, {text['body']} body bytes, {text['wire']} on the wire, "
+        f"{text['wire'] / updates:.0f} per update"
+    )
+    print(
+        f"strips: {strips['posts']} posts ({strips['delta']} delta), {strips['body']} body "
+        f"bytes, {strips['wire']} on the wire, {strips['wire'] / updates:.0f} per update"
+    )
+
+
+if __name__ == "__main__":
+    main()
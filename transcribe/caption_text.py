@@ -0,0 +1,53 @@
+"""
+The caption as the badge has it, edited like caption_edit does, for the servers that lay it out
+themselves (caption_strips.py, caption_lines.py), and the simulator's transcripts.
+"""
+
+KEEP_WORDS = 400  # committed words kept for layout; older ones have scrolled away
+
+
+class CaptionText:
+    """The words on the badge, edited like caption_edit does."""
+
+    def __init__(self):
+        self.committed = []
+        self.hypothesis = []
+
+    def edit(self, op, index, words):
+        if op in ("replace", "commit"):
+            del self.hypothesis[index:]
+        self.hypothesis += words
+        if op == "commit":
+            self.committed = (self.committed + self.hypothesis)[-KEEP_WORDS:]
+            self.hypothesis = []
+
+    def words(self):
+        return self.committed + self.hypothesis
+
+
+def request_bytes(path, headers, body_len):
+    """Bytes of an HTTP/1.1 request as python-requests sends it to a badge."""
+    head = f"POST {path} HTTP/1.1\r\nHost: 192.168.227.113\r\n"
+    head += "User-Agent: python-requests/2.31.0\r\nAccept-Encoding: gzip, deflate\r\n"
+    head += "Accept: */*\r\nConnection: keep-alive\r\n"
+    head += f"Content-Length: {body_len}\r\n"
+    head += "".join(f"{k}: {v}\r\n" for k, v in headers.items()) + "\r\n"
+    return len(head) + body_len
+
+
+def parse_transcript(path):
+    """Yields (ms, op, index, words) for the POSTs of a simulator transcript."""
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip("\r\n")
+            if not line or line.startswith("#"):
+                continue
+            ms, _, text = line.partition(" ")
+            if text.startswith("^"):
+                continue  # a button press, not a POST
+            op, index = "append", None
+            if text[:1] in ("=", "!"):
+                op = "replace" if text[0] == "=" else "commit"
+                num, _, text = text[1:].partition(" ")
+                index = int(num)
+            yield int(ms), op, index, text.split()
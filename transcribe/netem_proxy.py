@@ -0,0 +1,173 @@
+"""
+A netem-style proxy for trying the badge's audio transports on a bad link: forwards TCP and UDP
+from a local port to the server, with delay, jitter and loss added towards the server.
+
+    python3 netem_proxy.py --listen 8001 --to 127.0.0.1:8000 --loss 2 --delay 20 --jitter 10
+
+Point the badge's CONFIG_SERVER_PORT at the proxy. UDP datagrams are dropped or delayed each on
+their own, so jitter reorders them. TCP cannot lose data above the socket, so a lost segment is
+delivered a retransmission timeout late instead, and the data behind it waits for it, which is
+what the application sees of a loss. Replies from the server are forwarded as they come.
+"""
+
+import argparse
+import heapq
+import itertools
+import random
+import socket
+import threading
+import time
+
+MSS = 1460  # bytes of a TCP segment
+
+
+class Link:
+    """Loss and delay of one direction, with bursts of loss by the Gilbert model."""
+
+    def __init__(self, loss, burst, delay_s, jitter_s, seed=None):
+        self.rng = random.Random(seed)
+        # mean burst length `burst`, and `loss` of the time in the losing state
+        self.p_recover = 1 / max(1.0, burst)
+        self.p_fail = loss * self.p_recover / (1 - loss) if loss < 1 else 1.0
+        self.losing = False
+        self.delay_s = delay_s
+        self.jitter_s = jitter_s
+        self.sent = 0
+        self.lost = 0
+
+    def lose(self):
+        """Whether the next packet is lost."""
+        if self.losing:
+            self.losing = self.rng.random() >= self.p_recover
+        else:
+            self.losing = self.rng.random() < self.p_fail
+        self.sent += 1
+        self.lost += self.losing
+        return self.losing
+
+    def delay(self):
+        return self.delay_s + self.rng.uniform(0, self.jitter_s)
+
+
+class Scheduler:
+    """Runs functions at given times on a thread of its own."""
+
+    def __init__(self):
+        self.queue = []
+        self.order = itertools.count()
+        self.cond = threading.Condition()
+        threading.Thread(target=self._run, daemon=True).start()
+
+    def at(self, when, fn):
+        with self.cond:
+            heapq.heappush(self.queue, (when, next(self.order), fn))
+            self.cond.notify()
+
+    def _run(self):
+        while True:
+            with self.cond:
+                while not self.queue or self.queue[0][0] > time.monotonic():
+                    self.cond.wait(self.queue[0][0] - time.monotonic() if self.queue else None)
+                _, _, fn = heapq.heappop(self.queue)
+            try:
+                fn()
+            except OSError:
+                pass
+
+
+class UdpProxy:
+    def __init__(self, listen, target, link, scheduler):
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.bind(listen)
+        self.out = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.target = target
+        self.link = link
+        self.scheduler = scheduler
+        threading.Thread(target=self._run, daemon=True).start()
+
+    def _run(self):
+        while True:
+            datagram, _ = self.sock.recvfrom(65536)
+            if self.link.lose():
+                continue
+            self.scheduler.at(
+                time.monotonic() + self.link.delay(),
+                lambda d=datagram: self.out.sendto(d, self.target),
+            )
+
+
+class TcpProxy:
+    def __init__(self, listen, target, link, scheduler, rto_s):
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.sock.bind(listen)
+        self.sock.listen()
+        self.target = target
+        self.link = link
+        self.scheduler = scheduler
+        self.rto_s = rto_s
+        threading.Thread(target=self._run, daemon=True).start()
+
+    def _run(self):
+        while True:
+            client, _ = self.sock.accept()
+            server = socket.create_connection(self.target)
+            for s in (client, server):
+                s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            threading.Thread(target=self._up, args=(client, server), daemon=True).start()
+            threading.Thread(target=self._down, args=(server, client), daemon=True).start()
+
+    def _up(self, client, server):
+        ready = 0.0  # when the last segment is delivered, which later ones wait for
+        while True:
+            data = client.recv(65536)
+            now = time.monotonic()
+            for i in range(0, max(1, len(data)), MSS):
+                segment = data[i : i + MSS]
+                when = now + self.link.delay()
+                if data and self.link.lose():
+                    when += self.rto_s
+                ready = max(ready, when)
+                if segment:
+                    self.scheduler.at(ready, lambda s=segment: server.sendall(s))
+            if not data:
+                self.scheduler.at(ready, lambda: server.shutdown(socket.SHUT_WR))
+                return
+
+    def _down(self, server, client):
+        while True:
+            data = server.recv(65536)
+            if not data:
+                client.close()
+                return
+            client.sendall(data)
+
+
+def address(s):
+    host, port = s.rsplit(":", 1)
+    return host, int(port)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--listen", type=int, required=True, help="local port, TCP and UDP")
+    parser.add_argument("--to", type=address, required=True, help="HOST:PORT of the server")
+    parser.add_argument("--loss", type=float, default=0, help="percent of packets lost")
+    parser.add_argument("--burst", type=float, default=1, help="mean packets lost in a row")
+    parser.add_argument("--delay", type=float, default=0, help="ms added to every packet")
+    parser.add_argument("--jitter", type=float, default=0, help="up to this many ms more")
+    parser.add_argument("--rto", type=float, default=300, help="ms to retransmit a TCP loss")
+    args = parser.parse_args()
+
+    scheduler = Scheduler()
+    link = Link(args.loss / 100, args.burst, args.delay / 1000, args.jitter / 1000)
+    UdpProxy(("0.0.0.0", args.listen), args.to, link, scheduler)
+    TcpProxy(("0.0.0.0", args.listen), args.to, link, scheduler, args.rto / 1000)
+    print(f"Forwarding port {args.listen} to {args.to[0]}:{args.to[1]}")
+    while True:
+        time.sleep(10)
+        print(f"{link.sent} packets, {link.lost} lost")
+
+
+if __name__ == "__main__":
+    main()
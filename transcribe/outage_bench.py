@@ -0,0 +1,182 @@
+"""
+Models how the badge's audio gets through a Wi-Fi outage with the backlog of
+firmware/main/spill.h, in simulated time, and what the server (udp_audio.py) makes of it.
+
+    python3 outage_bench.py --outage 3,10,60,300 --codec opus
+
+The badge talks throughout, a datagram per 20 ms frame, and at 20 s the link goes dead for the
+length of the outage. The badge only notices --beacon-s into it, when the access point's beacons
+have been missing for that long, and until then sends into the void; then it starts over from
+what it sent --resend-ms before. It is back on the network when the outage ends. The spill task
+sends --rate datagrams of the backlog every 20 ms, with the new ones waiting behind them.
+Without the backlog, what is sent during the outage is lost.
+
+Reports the seconds of audio the recognizer never got, the duplicates the server dropped, how
+long after the outage the audio the server got was live again, and the most PSRAM and flash the
+backlog took. An outage shorter than --beacon-s goes unnoticed, and what was sent in it is lost
+either way.
+"""
+
+import argparse
+from collections import deque
+
+import udp_audio
+
+FRAME_S = 0.02
+STALE_S = 0.2  # SPILL_STALE_MS
+REC_HDR = 6  # SPILL_REC_HDR
+FILE_HDR = 2  # SPILL_FILE_HDR
+FRAME_BYTES = {"pcm": 640, "adpcm": 164, "opus": 60}  # payloads of a frame, Opus at 24 kbit/s
+OUTAGE_AT = 20.0
+
+
+class Spill:
+    """
+    spill.c by datagrams (seq, time_ms, length): the copies sent in the last resend_s, then the
+    backlog, in PSRAM and after it in flash.
+    """
+
+    def __init__(self, args, enabled):
+        self.enabled = enabled
+        self.ram = args.ram_kb * 1024
+        self.flash = args.flash_kb * 1024 * 3 // 4
+        self.resend_s = args.resend_ms / 1000
+        self.rate = args.rate
+        self.copies = deque()  # (sent, datagram)
+        self.ring = deque()
+        self.file = deque()
+        self.copies_used = self.ring_used = self.file_used = 0
+        self.online = True
+        self.peak_ram = self.peak_file = self.dropped = 0
+
+    def _make_room(self, now, need, keep):
+        while self.copies and (
+            now - self.copies[0][0] > self.resend_s
+            or (self.ram - self.copies_used - self.ring_used < need and self.copies_used > keep)
+        ):
+            self.copies_used -= REC_HDR + self.copies.popleft()[1][2]
+        return self.ram - self.copies_used - self.ring_used >= need
+
+    def _keep(self, now, dgram):
+        self.copies.append((now, dgram))
+        self.copies_used += REC_HDR + dgram[2]
+
+    def _push(self, now, dgram):
+        if not self.file and self._make_room(now, REC_HDR + dgram[2], 0):
+            self.ring.append(dgram)
+            self.ring_used += REC_HDR + dgram[2]
+        elif self.file_used + FILE_HDR + dgram[2] <= self.flash:
+            self.file.append(dgram)
+            self.file_used += FILE_HDR + dgram[2]
+        else:
+            self.dropped += 1
+        self.peak_ram = max(self.peak_ram, self.copies_used + self.ring_used)
+        self.peak_file = max(self.peak_file, self.file_used)
+
+    def send(self, now, dgram, link):
+        """Like spill_send(): returns the datagrams that go out now, with whether stored."""
+        if not self.enabled:
+            return [(dgram, False)]
+        if self.online and not self.ring and not self.file:
+            self._make_room(now, REC_HDR + dgram[2], 0)
+            self._keep(now, dgram)
+            return [(dgram, False)]
+        self._push(now, dgram)
+        return []
+
+    def tick(self, now):
+        """Like an iteration of spill_task()."""
+        if not self.enabled:
+            return []
+        while self.file and self._make_room(now, REC_HDR + self.file[0][2], self.ram // 2):
+            dgram = self.file.popleft()
+            self.file_used -= FILE_HDR + dgram[2]
+            self.ring.append(dgram)
+            self.ring_used += REC_HDR + dgram[2]
+        self._make_room(now, 0, 0)
+        out = []
+        while self.online and self.ring and len(out) < self.rate:
+            dgram = self.ring.popleft()
+            self.ring_used -= REC_HDR + dgram[2]
+            self._keep(now, dgram)
+            out.append((dgram, now - dgram[1] / 1000 > STALE_S))
+        return out
+
+    def disconnected(self):
+        self.online = False
+        for _, dgram in reversed(self.copies):
+            self.ring.appendleft(dgram)
+            self.ring_used += REC_HDR + dgram[2]
+        self.copies.clear()
+        self.copies_used = 0
+
+
+def run(args, outage, enabled):
+    spill = Spill(args, enabled)
+    stream = udp_audio.UdpStream(1, "pcm", 0, args.reorder_ms / 1000)
+    size = FRAME_BYTES[args.codec]
+    end = OUTAGE_AT + outage
+    noticed = OUTAGE_AT + args.beacon_s if outage > args.beacon_s else None
+    frames = 0
+    got = 0
+    live_again = None
+    seconds = OUTAGE_AT + outage + args.after
+    for i in range(int(seconds / FRAME_S)):
+        now = i * FRAME_S
+        if noticed is not None and now >= noticed:
+            spill.disconnected()
+            noticed = None
+        if now >= end:
+            spill.online = True
+        link = not OUTAGE_AT <= now < end
+        out = spill.send(now, (frames, int(now * 1000), size), link)
+        frames += 1
+        out += spill.tick(now)
+        arrival = now + args.delay_ms / 1000
+        runs = []
+        for (seq, time_ms, _), stored in out:
+            if link:
+                flags = udp_audio.FLAG_STORED if stored else 0
+                runs += stream.push(seq, time_ms, flags, b"\0\1", arrival)
+        runs += stream.poll(arrival)
+        for pcm, stored in runs:
+            got += len(pcm) // 2
+            if not stored and now >= end and live_again is None:
+                live_again = now - end
+    runs = stream.poll(float("inf"))
+    got += sum(len(pcm) // 2 for pcm, _ in runs)
+    return frames, got, stream, spill, live_again
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--outage", default="3,10,60,300", help="seconds, comma separated")
+    parser.add_argument("--codec", default="opus", choices=sorted(FRAME_BYTES))
+    parser.add_argument("--ram-kb", type=int, default=1024, help="like the Kconfig's")
+    parser.add_argument("--flash-kb", type=int, default=1024, help="of the spill partition")
+    parser.add_argument("--resend-ms", type=int, default=8000, help="like the Kconfig's")
+    parser.add_argument("--rate", type=int, default=4, help="like the Kconfig's")
+    parser.add_argument("--beacon-s", type=float, default=6, help="until the badge notices")
+    parser.add_argument("--delay", dest="delay_ms", type=float, default=5, help="ms on the link")
+    parser.add_argument("--reorder-ms", type=float, default=60, help="like server_esp.py's")
+    parser.add_argument("--after", type=float, default=180, help="seconds after the outage")
+    args = parser.parse_args()
+
+    print(
+        f"{args.codec}, {args.ram_kb} KiB PSRAM, {args.flash_kb} KiB flash, resend "
+        f"{args.resend_ms} ms, {args.rate}x, beacons missed after {args.beacon_s:g} s"
+    )
+    print("outage  lost without  with backlog  duplicates  live again  PSRAM     flash")
+    for outage in (float(x) for x in args.outage.split(",")):
+        frames, without, _, _, _ = run(args, outage, False)
+        frames, got, stream, spill, live_again = run(args, outage, True)
+        live = f"{live_again:.1f} s" if live_again is not None else "never"
+        print(
+            f"{outage:5g} s  {(frames - without) * FRAME_S:10.1f} s  "
+            f"{(frames - got) * FRAME_S:10.1f} s  {stream.reorder.duplicates:10}  {live:>10}  "
+            f"{spill.peak_ram // 1024:4} KiB  {spill.peak_file // 1024:4} KiB"
+        )
+
+
+if __name__ == "__main__":
+    main()
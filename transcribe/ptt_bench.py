@@ -0,0 +1,257 @@
+"""
+Measures how long the first audio of a talk takes from the talk button to the server, with the
+TX pipeline started by the button and with it kept warm behind a gate (CONFIG_AUDIO_TX_WARM),
+over chunked HTTP through netem_proxy.py.
+
+    python3 ptt_bench.py RECORDING --loss 0,3 --presses 10
+
+RECORDING is 16 kHz, 16-bit mono PCM, as WAV or raw, and is sent as PCM. Cold, each press
+connects to the server, which takes a round trip on the link and a SYN retransmission when the
+SYN or its answer is lost, sends the headers, and the I2S reader hands on its first 3600 bytes
+112.5 ms after capture started. Warm, the connection is up already and the reader hands on a
+frame at a time: the gate sends the pre-roll and the frame the button went on in, and a
+keepalive a second between talks. What starting the ADF elements and I2S costs on the badge is
+left out, which only makes the cold numbers look better. On the badge, audio.c logs the same
+latency up to the first write.
+
+The server splits the audio at its keepalives like server_esp.py, and counts when it would poke
+the peer, let it go, and what of the audio it would relay: one poke and one unpoke a talk, and
+the speech but none of the keepalives, however long the stream stays warm.
+"""
+
+import argparse
+import socket
+import threading
+import time
+
+import netem_proxy
+import udp_audio
+from audio_codec import Utterances
+from transport_bench import read_pcm
+
+FRAME_BYTES = 320  # 10 ms, a frame of the gate
+FRAME_S = 0.01
+I2S_BUFFER = 3600  # I2S_STREAM_BUF_SIZE
+KEEPALIVE = b"\0" * FRAME_BYTES
+VAD = FRAME_BYTES // 2  # x-audio-vad, samples in a keepalive
+
+
+class Server:
+    """Reads chunked POSTs like server_esp.py, and times the first audio after each press."""
+
+    def __init__(self):
+        self.sock = socket.create_server(("127.0.0.1", 0))
+        self.lock = threading.Lock()
+        self.pressed = None  # when the button went on, until its first audio arrives
+        self.latencies = []
+        self.talking = False  # like speaking[ip] in server_esp.py
+        self.pokes = 0
+        self.unpokes = 0
+        self.speech_sent = 0  # bytes, told by the badge
+        self.relayed = 0  # bytes that would go to the peer
+        threading.Thread(target=self._accept, daemon=True).start()
+
+    def press(self, now):
+        with self.lock:
+            self.pressed = now
+
+    def sent(self, speech):
+        with self.lock:
+            self.speech_sent += len(speech)
+
+    def _talking(self, talking):
+        if self.talking != talking:
+            self.talking = talking
+            if talking:
+                self.pokes += 1
+            else:
+                self.unpokes += 1
+
+    def _accept(self):
+        while True:
+            conn, _ = self.sock.accept()
+            threading.Thread(target=self._receive, args=(conn,), daemon=True).start()
+
+    def _receive(self, conn):
+        f = conn.makefile("rb")
+        while f.readline() not in (b"\r\n", b""):
+            pass
+        utterances = Utterances(VAD)
+        while True:
+            line = f.readline()
+            if not line or int(line[:-2], 16) == 0:
+                break
+            data = f.read(int(line[:-2], 16))
+            f.read(2)
+            now = time.monotonic()
+            for run in utterances.feed(data):
+                with self.lock:
+                    self._talking(run is not None)
+                    if run is None:
+                        continue
+                    self.relayed += len(run)
+                    if self.pressed is not None:
+                        self.latencies.append(now - self.pressed)
+                        self.pressed = None
+        with self.lock:
+            self._talking(False)  # as the uplink closes
+        conn.sendall(b"HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n")
+        conn.close()
+
+
+def pace(until):
+    delay = until - time.monotonic()
+    if delay > 0:
+        time.sleep(delay)
+
+
+def chunk(data):
+    return f"{len(data):x}\r\n".encode() + data + b"\r\n"
+
+
+def connect(addr, link, syn_rto_s):
+    """Connects like lwIP would on `link`: a round trip, and more for a lost SYN or SYN-ACK."""
+    start = time.monotonic()
+    handshake = 2 * link.delay()
+    for _ in range(2):
+        if link.lose():
+            handshake += syn_rto_s
+    sock = socket.create_connection(addr)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    pace(start + handshake)
+    sock.sendall(
+        b"POST /audio HTTP/1.1\r\nHost: bench\r\nTransfer-Encoding: chunked\r\n"
+        b"x-audio-codec: pcm\r\nx-audio-vad: 160\r\n\r\n"
+    )
+    return sock
+
+
+def close(sock):
+    sock.sendall(b"0\r\n\r\n")
+    sock.recv(1024)
+    sock.close()
+
+
+def talks(args, t0):
+    """When the button goes on and off, as (on, off)."""
+    period = args.talk + args.pause
+    return [(t0 + i * period, t0 + i * period + args.talk) for i in range(args.presses)]
+
+
+def run_cold(addr, pcm, server, link, args, t0):
+    """Each press runs the pipeline: connect, then the I2S batches as they are captured."""
+    for on, off in talks(args, t0):
+        pace(on)
+        server.press(time.monotonic())
+        sock = connect(addr, link, args.syn_rto / 1000)
+        for i in range(0, int((off - on) * 32000), I2S_BUFFER):
+            pace(on + (i + I2S_BUFFER) / 32000)
+            data = pcm[i % len(pcm) :][:I2S_BUFFER]
+            server.sent(data)
+            sock.sendall(chunk(data))
+        close(sock)
+
+
+def run_warm(addr, pcm, server, link, args, t0):
+    """The pipeline runs all along, and the gate passes a frame at a time while the button is on."""
+    preroll = args.preroll_ms // 10
+    keepalive = args.keepalive_ms // 10
+    presses = talks(args, t0)
+    sock = connect(addr, link, args.syn_rto / 1000)
+    ring = []
+    silence = keepalive
+    was_open = False
+    frame = 0
+    while True:
+        end = t0 + (frame + 1) * FRAME_S
+        if end > presses[-1][1] + FRAME_S:
+            break
+        pace(end)
+        data = pcm[(frame * FRAME_BYTES) % len(pcm) :][:FRAME_BYTES]
+        frame += 1
+        now = time.monotonic()
+        is_open = any(on <= now < off for on, off in presses)
+        if is_open and not was_open:
+            # the press happened during this frame
+            server.press(max(on for on, _ in presses if on <= now))
+            server.sent(b"".join(ring) + data)
+            sock.sendall(chunk(b"".join(ring) + data))
+            ring = []
+        elif is_open:
+            server.sent(data)
+            sock.sendall(chunk(data))
+        else:
+            if was_open:
+                silence = keepalive
+            ring = (ring + [data])[-preroll:] if preroll else []
+            silence += 1
+            if silence >= keepalive:
+                sock.sendall(chunk(KEEPALIVE))
+                silence = 0
+        was_open = is_open
+    close(sock)
+
+
+def bench(pcm, mode, loss, args, seed):
+    server = Server()
+    link = netem_proxy.Link(
+        loss / 100, args.burst, args.delay / 1000, args.jitter / 1000, seed=seed
+    )
+    # the handshake draws from its own link, so that both modes see the same losses of audio
+    handshake = netem_proxy.Link(
+        loss / 100, args.burst, args.delay / 1000, args.jitter / 1000, seed=seed + 1000
+    )
+    proxy = netem_proxy.TcpProxy(
+        ("127.0.0.1", 0), server.sock.getsockname(), link, netem_proxy.Scheduler(), args.rto / 1000
+    )
+    run = run_cold if mode == "cold" else run_warm
+    run(proxy.sock.getsockname(), pcm, server, handshake, args, time.monotonic() + 0.5)
+    time.sleep(0.5)
+
+    ms = sorted(x * 1000 for x in server.latencies)
+    p = lambda q: udp_audio.percentile(ms, q)
+    print(
+        f"  {mode}: {len(ms)} of {args.presses} presses, button to first audio at the server "
+        f"mean {sum(ms) / max(1, len(ms)):.0f} ms, p50 {p(50):.0f} ms, p95 {p(95):.0f} ms, "
+        f"max {max(ms, default=0):.0f} ms"
+    )
+    # the last few ms of a cold talk wait for a keepalive that never comes, and are dropped
+    print(
+        f"    {server.pokes} pokes, {server.unpokes} unpokes, relayed {server.relayed} of "
+        f"{server.speech_sent} bytes of speech"
+    )
+    if server.pokes != args.presses or server.unpokes != args.presses:
+        print(f"    FAIL: expected a poke and an unpoke for each of {args.presses} presses")
+    if server.relayed > server.speech_sent:
+        print("    FAIL: relayed keepalives")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("recording")
+    parser.add_argument("--presses", type=int, default=10, help="talks in each mode")
+    parser.add_argument("--talk", type=float, default=2, help="seconds the button is on")
+    parser.add_argument("--pause", type=float, default=1, help="seconds between talks")
+    parser.add_argument("--loss", default="0,3", help="percentages to try, comma separated")
+    parser.add_argument("--burst", type=float, default=1, help="mean packets lost in a row")
+    parser.add_argument("--delay", type=float, default=5, help="ms added to every packet")
+    parser.add_argument("--jitter", type=float, default=10, help="up to this many ms more")
+    parser.add_argument("--rto", type=float, default=300, help="ms to retransmit a TCP loss")
+    parser.add_argument("--syn-rto", type=float, default=1500, help="ms to retransmit a SYN")
+    parser.add_argument("--preroll-ms", type=int, default=300, help="like the Kconfig's")
+    parser.add_argument("--keepalive-ms", type=int, default=1000, help="like the Kconfig's")
+    args = parser.parse_args()
+
+    pcm = read_pcm(args.recording)
+    pcm = pcm[: len(pcm) - len(pcm) % FRAME_BYTES]
+    for i, loss in enumerate(float(x) for x in args.loss.split(",")):
+        print(
+            f"loss {loss:g}% in bursts of {args.burst:g}, delay {args.delay:g} ms "
+            f"+ up to {args.jitter:g} ms:"
+        )
+        for mode in ("cold", "warm"):
+            bench(pcm, mode, loss, args, seed=i)
+
+
+if __name__ == "__main__":
+    main()
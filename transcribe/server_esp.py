@@ -15,6 +15,9 @@ import threading
 
 from vosk import Model, KaldiRecognizer
 
+from audio_codec import KEEPALIVE_SAMPLES, PacketDecoder, PacketEncoder, Utterances, codec_names
+import udp_audio
+
 print("###########Start loading Vosk model###########")
 model = Model(lang="en-us")
 print("###########Finish loading model###########")
@@ -36,6 +39,8 @@ agree = False
 
 BADGE_IP_ADDRS = ["192.168.227.113", "192.168.227.117"]
 
+CAPTION_FULL_RETRIES = 30  # 503s, about a second apart, before a badge's caption is given up on
+
 
 def poke_badge(ip: str):
     url = f"http://{ip}/poke"
@@ -59,6 +64,22 @@ global buffer, speaking
 buffer = queue.Queue()
 speaking = dict() # IP address -> bool
 
+def postToBadge(url, data, headers):
+    """
+    POSTs to a badge, and again with the same body while it answers 503 because its caption
+    queue is full, up to CAPTION_FULL_RETRIES times. A badge whose display has stopped keeping
+    up must not hold the one sender thread, and the other badges with it, forever. Returns the
+    last response.
+    """
+    r = requests.post(url, data=data, headers=headers)
+    for _ in range(CAPTION_FULL_RETRIES):
+        if r.status_code != 503:
+            break
+        time.sleep(float(r.headers.get("Retry-After", "1")))
+        r = requests.post(url, data=data, headers=headers)
+    return r
+
+
 def resetPairVariable():
     global pair_dict, firstOne, requested, agree
     pair_dict = dict()
@@ -72,24 +93,317 @@ def checkPairingCondition():
         if value in pair_dict:
             agree = True
 
+def postStrips(ip, renderer, words):
+    """
+    Sends the strips that bring the badge's caption area to `words`. A 409 means the badge has
+    drawn over the area since, so the whole area is sent again.
+    """
+    url = f"http://{ip}:80/caption/strip"
+    strips = renderer.update(words)
+    while strips:
+        y, height, scroll, enc, data = strips.pop(0)
+        headers = {
+            "x-strip-y": str(y),
+            "x-strip-height": str(height),
+            "x-strip-scroll": str(scroll),
+            "x-strip-encoding": enc,
+        }
+        r = postToBadge(url, data, headers)
+        if r.status_code == 409:
+            renderer.invalidate()
+            strips = renderer.update(words)
+        elif r.status_code != 200:
+            print(f"Strip of {height} rows at {y} to {url}, Response: {r.status_code}")
+            # the next update sends the whole area, not only what changed since this one
+            renderer.invalidate()
+    print(f"Sent strips for {len(words)} words to {url}")
+
+
+class BadgeLines:
+    """The caption of one badge with --lines: laid out here, sent at most once a refresh."""
+
+    def __init__(self, ip):
+        self.ip = ip
+        geometry = requests.get(f"http://{ip}:80/caption/geometry").json()
+        self.caption = CaptionText()
+        self.layout = LineLayout(geometry)
+        self.refresh_s = geometry["refresh_ms"] / 1000
+        self.last_post = 0.0
+        self.dirty = False
+
+    def post(self):
+        url = f"http://{self.ip}:80/caption/lines"
+        for scroll, row, col, rows in self.layout.update(self.caption.words()):
+            headers = {"x-line-row": str(row), "x-line-col": str(col)}
+            if scroll:
+                headers["x-line-scroll"] = str(scroll)
+            data = "\n".join(rows)
+            r = postToBadge(url, data, headers)
+            if r.status_code != 200:
+                print(f"Lines at row {row} to {url}, Response: {r.status_code}")
+                self.layout.invalidate()
+        self.last_post = time.monotonic()
+        self.dirty = False
+
+
+def flushLines(badges):
+    """Sends the lines of the badges whose last update is at least a refresh old."""
+    for badge in badges.values():
+        if badge.dirty and time.monotonic() - badge.last_post >= badge.refresh_s:
+            try:
+                badge.post()
+            except Exception as e:
+                print(f"Error sending lines to {badge.ip}: {e}")
+
+
 def sendTranscriptionResult():
     global buffer
+    seq = dict()  # IP address -> last x-caption-seq sent
+    captions = dict()  # IP address -> (CaptionText, StripRenderer), with --strips
+    badges = dict()  # IP address -> BadgeLines, with --lines
     while True:
-        if not buffer.empty():
-            words, clientAddress = buffer.get()
+        if args.lines:
+            flushLines(badges)
+        if buffer.empty():
+            time.sleep(0.01)
+        else:
+            op, index, words, clientAddress = buffer.get()
+            if args.lines:
+                try:
+                    if clientAddress not in badges:
+                        badges[clientAddress] = BadgeLines(clientAddress)
+                    badges[clientAddress].caption.edit(op, index, words.split())
+                    badges[clientAddress].dirty = True
+                except Exception as e:
+                    print(f"Error laying out {words} for {clientAddress}: {e}")
+                finally:
+                    buffer.task_done()
+                continue
+            if args.strips:
+                if clientAddress not in captions:
+                    captions[clientAddress] = (CaptionText(), StripRenderer())
+                caption, renderer = captions[clientAddress]
+                try:
+                    caption.edit(op, index, words.split())
+                    postStrips(clientAddress, renderer, caption.words())
+                except Exception as e:
+                    print(f"Error sending strips for {words} to {clientAddress}: {e}")
+                finally:
+                    buffer.task_done()
+                continue
+            seq[clientAddress] = seq.get(clientAddress, 0) + 1
+            headers = {
+                "x-caption-op": op,
+                "x-caption-seq": str(seq[clientAddress]),
+            }
+            if index is not None:
+                headers["x-caption-index"] = str(index)
             try:
                 url = f"http://{clientAddress}:80/transcription"
-                r = requests.post(url, data=words)
-                print(f"Sent: {words} to {url}, Response: {r.status_code}")
+                # 503: the badge's caption queue is full. Keep the words and send them
+                # again with the same seq, so that nothing is lost and the order is kept,
+                # unless it stays full, when they are dropped.
+                r = postToBadge(url, words, headers)
+                print(f"Sent: {op} {index} {words} to {url}, Response: {r.status_code}")
             except Exception as e:
                 print(f"Error sending word {words} to {clientAddress}: {e}")
             finally:
                 buffer.task_done()
 
 
+def sendHypothesis(ip, shown, words, final):
+    """
+    Brings the badge from showing `shown` (the words of the current utterance sent so far) to
+    showing `words`, replacing only the words after the common prefix. Returns the new `shown`.
+    """
+    common = 0
+    while common < min(len(shown), len(words)) and shown[common] == words[common]:
+        common += 1
+    new_words = " ".join(words[common:])
+    if final:
+        buffer.put(("commit", common, new_words, ip))
+        return []
+    if common < len(shown):
+        buffer.put(("replace", common, new_words, ip))
+    elif new_words:
+        buffer.put(("append", None, new_words, ip))
+    return words
+
+
+class AudioUplink:
+    """
+    The audio of one badge while it talks, whether it comes by POST /audio or over UDP: relayed
+    to the peers and transcribed.
+    """
+
+    def __init__(self, ip, vad):
+        self.ip = ip
+        self.rec = KaldiRecognizer(model, 16000)
+        self.rec.SetWords(True)
+        self.rec.SetPartialWords(True)
+        self.textBuffer = []
+        # With `vad` the badge sends only speech, and a run of that many zero samples in
+        # between, even while it is quiet for a long time with its TX pipeline kept warm. The
+        # first one after speech ends the utterance, so it is finished right away instead of
+        # after the silence Vosk would wait for, and the peers are let go.
+        self.utterances = Utterances(vad)
+        self.vosk_seconds = 0.0  # CPU time in the recognizer
+        self.pcm_bytes = 0
+
+    def _recognize(self, audio):
+        # The partial hypothesis may revise words already sent, so the badge is
+        # told which word to replace from instead of getting the string again.
+        if self.rec.AcceptWaveform(audio):
+            self._finish(self.rec.Result())
+        else:
+            partialResult = json.loads(self.rec.PartialResult())["partial"]
+            self.textBuffer = sendHypothesis(
+                self.ip, self.textBuffer, partialResult.split(), final=False
+            )
+
+    def _finish(self, result_json):
+        result = json.loads(result_json)["text"]
+        print("Result:", result)
+        if result or self.textBuffer:
+            self.textBuffer = sendHypothesis(self.ip, self.textBuffer, result.split(), final=True)
+
+    def _talking(self, talking):
+        """
+        Pokes the peers as the badge starts talking. Once it stops, each peer's GET /audio
+        unpokes it when the audio relayed to it has gone out.
+        """
+        if speaking.get(self.ip, False) == talking:
+            return
+        speaking[self.ip] = talking
+        if talking:
+            for badge_ip in BADGE_IP_ADDRS:
+                if badge_ip != self.ip:
+                    p = Process(target=poke_badge, args=(badge_ip,))
+                    p.start()
+
+    def feed(self, pcm, relay=True):
+        """Without `relay`, e.g. audio held back by an outage, it is only transcribed."""
+        self.pcm_bytes += len(pcm)
+        for run in self.utterances.feed(pcm):
+            if run is None:
+                start = time.thread_time()
+                self._finish(self.rec.FinalResult())
+                self.vosk_seconds += time.thread_time() - start
+                self._talking(False)
+                continue
+            if relay:
+                self._talking(True)
+                for peer_ip, peer_queue in audio_queues.items():
+                    if peer_ip != self.ip:
+                        peer_queue.put(run)
+            start = time.thread_time()
+            self._recognize(run)
+            self.vosk_seconds += time.thread_time() - start
+
+    def close(self, received):
+        """`received` describes what came in, for the log."""
+        print(
+            f"Audio from {self.ip}: {received}, {self.pcm_bytes / 32000:.1f} s, "
+            f"recognizer {self.vosk_seconds:.1f} s CPU"
+        )
+        print("____________")
+        speaking[self.ip] = False
+
+
+def feedUplink(uplink, pcm_queue):
+    """
+    Feeds the PCM of a UDP stream to its uplink, like POST /audio does in its thread. The PCM
+    comes with whether to relay it.
+    """
+    while True:
+        item = pcm_queue.get()
+        if isinstance(item, str):
+            uplink.close(item)
+            return
+        uplink.feed(*item)
+
+
+def receiveUdpAudio(sock):
+    """
+    Takes the badges' audio over UDP, see udp_audio.py. A stream ends with its end datagrams,
+    or when nothing has come from it for --udp-timeout seconds, which is several keepalives.
+    One that went quiet, e.g. while the badge was off Wi-Fi, picks up where it left off if it
+    comes back, with the audio the badge held on to.
+    """
+    streams = dict()  # IP address -> [UdpStream, queue of PCM for feedUplink, last arrival]
+    finished = dict()  # IP address -> stream ID last ended, whose stragglers are dropped
+    quiet = dict()  # IP address -> UdpStream that timed out
+
+    def start(ip, stream, now):
+        vad = KEEPALIVE_SAMPLES if stream.vad else None
+        pcm_queue = queue.Queue()
+        threading.Thread(
+            target=feedUplink, args=(AudioUplink(ip, vad), pcm_queue), daemon=True
+        ).start()
+        streams[ip] = [stream, pcm_queue, now]
+
+    def end(ip, timed_out=False):
+        stream, pcm_queue, _ = streams.pop(ip)
+        if timed_out:
+            quiet[ip] = stream
+        else:
+            finished[ip] = stream.stream
+        pcm_queue.put(stream.summary())
+
+    def put(pcm_queue, runs):
+        for pcm, stored in runs:
+            pcm_queue.put((pcm, not stored))
+
+    sock.settimeout(0.01)
+    while True:
+        try:
+            datagram, (ip, _) = sock.recvfrom(2048)
+        except socket.timeout:
+            datagram = None
+        now = time.monotonic()
+
+        if datagram is not None:
+            try:
+                seq, time_ms, stream_id, codec, flags, payload = udp_audio.parse(datagram)
+            except ValueError as e:
+                print(f"Malformed UDP audio from {ip}: {e}")
+                continue
+            if ip in streams and streams[ip][0].stream != stream_id:
+                end(ip)
+            if ip not in streams and ip in quiet:
+                stream = quiet.pop(ip)
+                if stream.stream == stream_id:
+                    print(f"UDP audio from {ip}, stream {stream_id:04x} resumed")
+                    start(ip, stream, now)
+                else:
+                    finished[ip] = stream.stream
+            if ip not in streams and finished.get(ip) != stream_id:
+                try:
+                    stream = udp_audio.UdpStream(
+                        stream_id, codec, flags, args.udp_reorder_ms / 1000
+                    )
+                except (ValueError, ImportError):
+                    print(f"Unsupported audio codec {codec} from {ip}")
+                    finished[ip] = stream_id
+                    continue
+                print(f"UDP audio from {ip}, stream {stream_id:04x}, codec: {codec}")
+                start(ip, stream, now)
+            if ip in streams:
+                stream, pcm_queue, _ = streams[ip]
+                streams[ip][2] = now
+                put(pcm_queue, stream.push(seq, time_ms, flags, payload, now))
+                if stream.ended:
+                    end(ip)
+
+        for ip in list(streams):
+            stream, pcm_queue, last = streams[ip]
+            put(pcm_queue, stream.poll(now))
+            if now - last > args.udp_timeout:
+                end(ip, timed_out=True)
+
+
 class Handler(BaseHTTPRequestHandler):
     text = ""
-    previous_stream = ""
     textBuffer = []
     firstTimeStamp = datetime.now()
     secondTimeStamp = datetime.now()
@@ -111,6 +425,14 @@ class Handler(BaseHTTPRequestHandler):
         self.rfile.read(2)
         return data
 
+    def _refuse_codec(self, codec):
+        print(f"Unsupported audio codec {codec} from {self.client_address[0]}")
+        self.send_response(415)
+        self.send_header("x-audio-codecs", ", ".join(codec_names()))
+        self.send_header("Connection", "close")
+        self.end_headers()
+        self.close_connection = True
+
     def _write_wav(self, data, rates, bits, ch):
         t = datetime.datetime.now(datetime.UTC)
         time = t.strftime("%Y%m%dT%H%M%SZ")
@@ -138,25 +460,25 @@ class Handler(BaseHTTPRequestHandler):
             ip = self.client_address[0]
             print(f"POST /audio from {ip}")
 
-            speaking[ip] = True
-
-            for badge_ip in BADGE_IP_ADDRS:
-                if badge_ip != ip:
-                    p = Process(target=poke_badge, args=(badge_ip,))
-                    p.start()
+            # x-audio-codec: how the badge encodes its audio, see audio_codec.py
+            codec = self.headers.get("x-audio-codec", "pcm").lower()
+            try:
+                decoder = None if codec == "pcm" else PacketDecoder(codec)
+            except (ValueError, ImportError):
+                self._refuse_codec(codec)
+                return
 
-            rec = KaldiRecognizer(model, 16000)
-            rec.SetWords(True)
-            rec.SetPartialWords(True)
             data = []
             sample_rates = self.headers.get("x-audio-sample-rates", "").lower()
             bits = self.headers.get("x-audio-bits", "").lower()
             channel = self.headers.get("x-audio-channel", "").lower()
             sample_rates = self.headers.get("x-audio-sample-rates", "").lower()
+            vad = self.headers.get("x-audio-vad")
+            uplink = AudioUplink(ip, int(vad) if vad else None)
 
             print(
-                "Audio information, sample rates: {}, bits: {}, channel(s): {}".format(
-                    sample_rates, bits, channel
+                "Audio information, sample rates: {}, bits: {}, channel(s): {}, codec: {}".format(
+                    sample_rates, bits, channel, codec
                 )
             )
             # https://stackoverflow.com/questions/24500752/how-can-i-read-exactly-one-response-chunk-with-pythons-http-client
@@ -168,46 +490,20 @@ class Handler(BaseHTTPRequestHandler):
                     break
                 else:
                     chunk_data = self._get_chunk_data(chunk_size)
+                    if decoder is not None:
+                        # the recognizer, the keepalives and the peers all work on PCM
+                        chunk_data = decoder.feed(chunk_data)
+                        if not chunk_data:
+                            continue
                     data += chunk_data
-                    for peer_ip, peer_queue in audio_queues.items():
-                        if peer_ip != ip:
-                            peer_queue.put(chunk_data)
-
-                    if rec.AcceptWaveform(chunk_data):
-                        result = json.loads(rec.Result())["text"]
-                        print("Result:", result)
-                        if result:
-                            self.text = result
-                            temp = result.split()
-                            new_elements = temp[len(self.textBuffer) :]
-                            self.textBuffer.extend(new_elements)
-                            if new_elements:
-                                buffer.put((" ".join(new_elements), self.client_address[0]))
-                            for word in self.textBuffer:
-                                print(word)
-                            self.textBuffer = []
-                            self.previous_stream = ""
-                    else:
-                        partialResult = json.loads(rec.PartialResult())["partial"]
-                        if partialResult.startswith(self.previous_stream):
-                            new_part = partialResult[
-                                len(self.previous_stream) :
-                            ].strip()
-                            if new_part:
-                                self.textBuffer.extend(new_part.split())
-                                buffer.put((new_part, self.client_address[0]))
-                        else:
-                            self.textBuffer = partialResult.split()
-                            buffer.put((partialResult, self.client_address[0]))
-                        self.previous_stream = partialResult
-
-            print("____________")
+                    uplink.feed(chunk_data)
+
+            uplink.close(f"{total_bytes} bytes of {codec}")
             self.send_response(200)
             self.send_header("Content-type", "text/html;charset=utf-8")
             self.end_headers()
             #  self.wfile.write(partialResult.encode("utf-8"))
             #  self._write_wav(data, 16000, 16, 1)
-            speaking[ip] = False
 
     def do_GET(self):
         global firstOne, pair_dict, firstOne, requested, agree
@@ -217,6 +513,14 @@ class Handler(BaseHTTPRequestHandler):
         if request_file_path == "audio":
             global audio_queues
 
+            # x-audio-codec: how the badge wants the peer's audio, encoded here for it
+            codec = self.headers.get("x-audio-codec", "pcm").lower()
+            try:
+                encoder = None if codec == "pcm" else PacketEncoder(codec)
+            except (ValueError, ImportError):
+                self._refuse_codec(codec)
+                return
+
             self.send_response(200)
             self.send_header("Content-Type", "application/octet-stream")
             self.send_header("Transfer-Encoding", "chunked")
@@ -245,6 +549,10 @@ class Handler(BaseHTTPRequestHandler):
                         p.start()
                         break
 
+                if encoder is not None:
+                    chunk = encoder.feed(chunk)
+                    if not chunk:
+                        continue
                 total_bytes += len(chunk)
                 print(
                     f"  -> {ip}: TX {total_bytes} bytes total, queue length: {audio_queues[ip].qsize()}"
@@ -260,6 +568,16 @@ class Handler(BaseHTTPRequestHandler):
             self.wfile.write(b"0\r\n\r\n")
             del audio_queues[ip]
 
+        elif request_file_path == "audio/codecs":
+            # asked by the badge before it builds its pipelines, so that it can fall back to
+            # a codec this server takes instead of being refused with 415
+            names = ", ".join(codec_names())
+            self.send_response(200)
+            self.send_header("x-audio-codecs", names)
+            self.send_header("Content-Length", str(len(names)))
+            self.end_headers()
+            self.wfile.write(names.encode("utf-8"))
+
         elif request_file_path == "pair":
             if not urlparts.query.startswith("with="):
                 self.send_response(400)
@@ -299,7 +617,35 @@ parser = argparse.ArgumentParser(
 )
 parser.add_argument("--ip", "-i", nargs="?", type=str)
 parser.add_argument("--port", "-p", nargs="?", type=int)
+parser.add_argument(
+    "--strips",
+    action="store_true",
+    help="render the caption here and send it as bitmaps (POST /caption/strip)",
+)
+parser.add_argument(
+    "--lines",
+    action="store_true",
+    help="lay out the caption here and send it as lines (POST /caption/lines)",
+)
+parser.add_argument(
+    "--udp-reorder-ms",
+    type=float,
+    default=60,
+    help="how long UDP audio ahead of a lost datagram waits for it (default 60)",
+)
+parser.add_argument(
+    "--udp-timeout",
+    type=float,
+    default=5,
+    help="seconds without UDP audio from a badge before its stream ends (default 5)",
+)
 args = parser.parse_args()
+if args.strips or args.lines:
+    from caption_text import CaptionText
+if args.strips:
+    from caption_strips import StripRenderer
+if args.lines:
+    from caption_lines import LineLayout
 if not args.ip:
     args.ip = get_host_ip()
 if not args.port:
@@ -308,7 +654,12 @@ if not args.port:
 transcriptionThread = threading.Thread(target=sendTranscriptionResult, daemon=True)
 transcriptionThread.start()
 
+udpSocket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+udpSocket.bind((args.ip, args.port))
+udpThread = threading.Thread(target=receiveUdpAudio, args=(udpSocket,), daemon=True)
+udpThread.start()
+
 httpd = ThreadingHTTPServer((args.ip, args.port), Handler)
 
-print("Serving HTTP on {} port {}".format(args.ip, args.port))
+print("Serving HTTP and UDP audio on {} port {}".format(args.ip, args.port))
 httpd.serve_forever()
@@ -0,0 +1,237 @@
+"""
+Compares the badge's audio transports on a bad link: streams a recording in real time like the
+TX pipeline does, by chunked HTTP POST and by UDP (udp_audio.py) at the same time, through
+netem_proxy.py, and reports how long each 20 ms frame took from the end of its capture to the
+point where the server hands it to the recognizer, and the frames lost.
+
+    python3 transport_bench.py RECORDING --loss 0,1,5 --seconds 30
+
+RECORDING is 16 kHz, 16-bit mono PCM, as WAV or raw. The HTTP stream is sent as ADF's elements
+send it: the I2S reader hands on 3600 bytes at a time and the HTTP writer writes up to 2048
+bytes a chunk. With UDP the reader hands on a frame at a time. The recognizer itself is left
+out, since it costs the same either way.
+
+--trace DIR writes when each HTTP chunk arrived and its bytes of PCM to DIR/http-lossN.txt, for
+firmware/host's `audio_bench jitter`.
+"""
+
+import argparse
+import os
+import socket
+import threading
+import time
+import wave
+
+import netem_proxy
+import udp_audio
+from audio_codec import FRAME_SAMPLES, PacketDecoder, PacketEncoder
+
+FRAME_BYTES = FRAME_SAMPLES * 2
+FRAME_S = 0.02
+I2S_BUFFER = 3600  # I2S_STREAM_BUF_SIZE
+HTTP_CHUNK = 2048  # HTTP_STREAM_BUFFER_SIZE
+
+
+def read_pcm(path):
+    try:
+        with wave.open(path, "rb") as w:
+            if w.getframerate() != 16000 or w.getsampwidth() != 2 or w.getnchannels() != 1:
+                raise SystemExit(f"{path}: Not 16 kHz, 16-bit mono PCM")
+            return w.readframes(w.getnframes())
+    except wave.Error:
+        with open(path, "rb") as f:
+            return f.read()
+
+
+def encoder(codec):
+    if codec == "pcm":
+        return lambda pcm: pcm
+    return PacketEncoder(codec).feed
+
+
+def pace(t0, seconds):
+    delay = t0 + seconds - time.monotonic()
+    if delay > 0:
+        time.sleep(delay)
+
+
+def send_http(addr, pcm, codec, t0):
+    sock = socket.create_connection(addr)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    sock.sendall(
+        b"POST /audio HTTP/1.1\r\nHost: bench\r\nTransfer-Encoding: chunked\r\n"
+        b"x-audio-codec: " + codec.encode() + b"\r\n\r\n"
+    )
+    encode = encoder(codec)
+    for i in range(0, len(pcm), I2S_BUFFER):
+        batch = pcm[i : i + I2S_BUFFER]
+        pace(t0, (i + len(batch)) / 32000)
+        data = encode(batch)
+        for j in range(0, len(data), HTTP_CHUNK):
+            chunk = data[j : j + HTTP_CHUNK]
+            sock.sendall(f"{len(chunk):x}\r\n".encode() + chunk + b"\r\n")
+    sock.sendall(b"0\r\n\r\n")
+    sock.recv(1024)
+    sock.close()
+
+
+def send_udp(addr, pcm, codec, t0):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    encode = encoder(codec)
+    codec_id = udp_audio.CODECS.index(codec)
+    frames = len(pcm) // FRAME_BYTES
+    for seq in range(frames):
+        pace(t0, (seq + 1) * FRAME_S)
+        packet = encode(pcm[seq * FRAME_BYTES : (seq + 1) * FRAME_BYTES])
+        if codec != "pcm":
+            packet = packet[2:]  # the datagram has the length
+        time_ms = int(time.monotonic() * 1000) & 0xFFFFFFFF
+        header = udp_audio.HEADER.pack(seq, time_ms, 1, codec_id, 0)
+        sock.sendto(header + packet, addr)
+    for i in range(3):
+        header = udp_audio.HEADER.pack(frames + i, 0, 1, codec_id, udp_audio.FLAG_END)
+        sock.sendto(header, addr)
+
+
+def receive_http(sock, codec, t0, latencies, trace):
+    """
+    Reads the chunks like server_esp.py's do_POST, times each whole frame, and adds the arrival
+    time and PCM bytes of each chunk to `trace`.
+    """
+    conn, _ = sock.accept()
+    f = conn.makefile("rb")
+    while f.readline() not in (b"\r\n", b""):
+        pass
+    decode = (lambda data: data) if codec == "pcm" else PacketDecoder(codec).feed
+    pcm_bytes = 0
+    while True:
+        size = int(f.readline()[:-2], 16)
+        if size == 0:
+            break
+        data = decode(f.read(size))
+        f.read(2)
+        now = time.monotonic()
+        trace.append((now - t0, len(data)))
+        for frame in range(pcm_bytes // FRAME_BYTES, (pcm_bytes + len(data)) // FRAME_BYTES):
+            latencies.append(now - t0 - (frame + 1) * FRAME_S)
+        pcm_bytes += len(data)
+    conn.sendall(b"HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n")
+    conn.close()
+
+
+def receive_udp(sock, t0, wait_s, latencies, result):
+    """Puts the datagrams back in order like server_esp.py, and times each frame."""
+    reorder = udp_audio.ReorderBuffer(wait_s)
+    sock.settimeout(0.01)
+    ended = False
+    last = time.monotonic()
+    while not ended and time.monotonic() - last < 1:
+        try:
+            datagram = sock.recv(2048)
+        except socket.timeout:
+            datagram = None
+        now = time.monotonic()
+        if datagram is None:
+            released = reorder.poll(now)
+        else:
+            last = now
+            seq, _, _, _, flags, _ = udp_audio.parse(datagram)
+            released = reorder.push(seq, (seq, flags), now)
+        for seq, flags in released:
+            if flags & udp_audio.FLAG_END:
+                ended = True
+            else:
+                latencies.append(now - t0 - (seq + 1) * FRAME_S)
+    result.append(reorder)
+
+
+def summary(latencies):
+    ms = sorted(x * 1000 for x in latencies)
+    p = lambda q: udp_audio.percentile(ms, q)
+    return (
+        f"capture to recognizer p50 {p(50):.0f} ms, p95 {p(95):.0f} ms, "
+        f"p99 {p(99):.0f} ms, max {ms[-1]:.0f} ms"
+    )
+
+
+def bench(pcm, codec, loss, args, seed):
+    scheduler = netem_proxy.Scheduler()
+    server_tcp = socket.create_server(("127.0.0.1", 0))
+    server_udp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    server_udp.bind(("127.0.0.1", 0))
+    proxies = []
+    for proxy, server in ((netem_proxy.TcpProxy, server_tcp), (netem_proxy.UdpProxy, server_udp)):
+        link = netem_proxy.Link(
+            loss / 100, args.burst, args.delay / 1000, args.jitter / 1000, seed=seed
+        )
+        extra = (args.rto / 1000,) if proxy is netem_proxy.TcpProxy else ()
+        proxies.append(proxy(("127.0.0.1", 0), server.getsockname(), link, scheduler, *extra))
+
+    t0 = time.monotonic() + 0.1
+    http_latencies, udp_latencies, reorder, trace = [], [], [], []
+    threads = [
+        threading.Thread(target=receive_http, args=(server_tcp, codec, t0, http_latencies, trace)),
+        threading.Thread(
+            target=receive_udp,
+            args=(server_udp, t0, args.reorder_ms / 1000, udp_latencies, reorder),
+        ),
+        threading.Thread(target=send_http, args=(proxies[0].sock.getsockname(), pcm, codec, t0)),
+        threading.Thread(target=send_udp, args=(proxies[1].sock.getsockname(), pcm, codec, t0)),
+    ]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    frames = len(pcm) // FRAME_BYTES
+    lost = frames - len(udp_latencies)
+    r = reorder[0]
+    print(
+        f"loss {loss:g}% in bursts of {args.burst:g}, delay {args.delay:g} ms "
+        f"+ up to {args.jitter:g} ms, {codec}:"
+    )
+    print(f"  http: {len(http_latencies)} of {frames} frames, {summary(http_latencies)}")
+    print(
+        f"  udp:  {len(udp_latencies)} of {frames} frames, {summary(udp_latencies)}, "
+        f"{lost} lost ({100 * lost / frames:.1f}%), {r.late} late, "
+        f"{r.reordered} out of order"
+    )
+    if args.trace:
+        write_trace(args, loss, trace)
+
+
+def write_trace(args, loss, trace):
+    path = os.path.join(args.trace, f"http-loss{loss:g}.txt")
+    with open(path, "w") as f:
+        f.write(
+            f"# transport_bench.py: HTTP chunks of {args.codec}, loss {loss:g}% in bursts of "
+            f"{args.burst:g}, delay {args.delay:g} ms + up to {args.jitter:g} ms, "
+            f"rto {args.rto:g} ms\n# <ms> <bytes of PCM>\n"
+        )
+        for t, size in trace:
+            f.write(f"{round(t * 1000)} {size}\n")
+    print(f"  wrote {path}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("recording")
+    parser.add_argument("--seconds", type=float, default=30, help="of the recording to send")
+    parser.add_argument("--loss", default="0,1,5", help="percentages to try, comma separated")
+    parser.add_argument("--burst", type=float, default=1, help="mean packets lost in a row")
+    parser.add_argument("--delay", type=float, default=5, help="ms added to every packet")
+    parser.add_argument("--jitter", type=float, default=10, help="up to this many ms more")
+    parser.add_argument("--rto", type=float, default=300, help="ms to retransmit a TCP loss")
+    parser.add_argument("--reorder-ms", type=float, default=60, help="like server_esp.py's")
+    parser.add_argument("--codec", default="adpcm", choices=["pcm", "adpcm"])
+    parser.add_argument("--trace", metavar="DIR", help="write the HTTP arrivals here")
+    args = parser.parse_args()
+
+    pcm = read_pcm(args.recording)[: int(args.seconds * 16000) * 2]
+    pcm = pcm[: len(pcm) - len(pcm) % FRAME_BYTES]
+    for i, loss in enumerate(float(x) for x in args.loss.split(",")):
+        bench(pcm, args.codec, loss, args, seed=i)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,194 @@
+"""
+The badge's UDP audio transport (firmware/main/udp_stream.h): a datagram per 20 ms frame, with
+a sequence number and the badge's clock, put back in order here before the recognizer.
+
+What the badge could not send while its Wi-Fi was down comes later, faster than real time
+(firmware/main/spill.h), along with some it had sent already, which are dropped by sequence
+number like any duplicate.
+"""
+
+import struct
+
+from audio_codec import KEEPALIVE_SAMPLES, PacketDecoder
+
+HEADER = struct.Struct("<IIHBB")  # seq, time_ms, stream, codec, flags
+FLAG_KEEPALIVE = 0x01
+FLAG_VAD = 0x02
+FLAG_END = 0x04
+FLAG_STORED = 0x08  # from the backlog, too late to play
+CODECS = ["pcm", "adpcm", "opus"]  # audio_codec_id_t
+
+
+def parse(datagram):
+    """Returns seq, time_ms, stream, codec name, flags and payload, or raises ValueError."""
+    if len(datagram) < HEADER.size:
+        raise ValueError("short datagram")
+    seq, time_ms, stream, codec, flags = HEADER.unpack_from(datagram)
+    if codec >= len(CODECS):
+        raise ValueError(f"unknown codec {codec}")
+    return seq, time_ms, stream, CODECS[codec], flags, datagram[HEADER.size :]
+
+
+def frame_decoder(codec):
+    """Returns a function from the payload of a datagram to PCM."""
+    if codec == "pcm":
+        return bytes
+    return PacketDecoder(codec).decode
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+class ReorderBuffer:
+    """
+    Puts the datagrams of one stream back in order. One that arrives ahead of a gap waits up to
+    `wait_s` for the ones before it, which then count as lost. A lost one that turns up after
+    that is late and dropped, since the audio after it has gone to the recognizer already.
+    """
+
+    def __init__(self, wait_s):
+        self.wait_s = wait_s
+        self.next = 0
+        self.held = dict()  # seq -> (arrival, item)
+        self.missing = set()  # seqs given up on
+        self.highest = -1
+        self.received = 0
+        self.reordered = 0  # arrived after one that was sent later
+        self.lost = 0
+        self.late = 0
+        self.duplicates = 0
+
+    def push(self, seq, item, now):
+        """Returns the items that are now in order, with those released by poll()."""
+        if seq < self.next or seq in self.held:
+            if seq in self.missing:
+                self.missing.discard(seq)
+                self.late += 1
+            else:
+                self.duplicates += 1
+            return self.poll(now)
+        self.received += 1
+        if seq < self.highest:
+            self.reordered += 1
+        self.highest = max(self.highest, seq)
+        self.held[seq] = (now, item)
+        return self.poll(now)
+
+    def poll(self, now):
+        """Returns the items in order, giving up on gaps that have waited long enough."""
+        out = []
+        while self.held:
+            if self.next in self.held:
+                out.append(self.held.pop(self.next)[1])
+                self.next += 1
+                continue
+            if now - min(arrival for arrival, _ in self.held.values()) < self.wait_s:
+                break
+            first = min(self.held)
+            self.lost += first - self.next
+            self.missing.update(range(max(self.next, first - 1000), first))
+            self.next = first
+        if len(self.missing) > 2000:
+            self.missing = {seq for seq in self.missing if seq > self.next - 1000}
+        return out
+
+
+class TransitStats:
+    """
+    The delay of each frame from the badge to the recognizer, less that of the fastest one,
+    since the clocks are not synchronized, and the interarrival jitter of RFC 3550.
+    """
+
+    def __init__(self):
+        self.transits = []  # seconds
+        self.jitter = 0.0
+        self.last = None  # arrival, time_ms
+
+    def arrived(self, now, time_ms):
+        if self.last is not None:
+            d = (now - self.last[0]) - (time_ms - self.last[1]) / 1000
+            self.jitter += (abs(d) - self.jitter) / 16
+        self.last = (now, time_ms)
+
+    def released(self, now, time_ms):
+        self.transits.append(now - time_ms / 1000)
+
+    def summary(self):
+        if not self.transits:
+            return "no frames"
+        base = min(self.transits)
+        delays = [(t - base) * 1000 for t in self.transits]
+        return (
+            f"delay above the fastest frame p50 {percentile(delays, 50):.0f} ms, "
+            f"p99 {percentile(delays, 99):.0f} ms, max {max(delays):.0f} ms, "
+            f"jitter {self.jitter * 1000:.1f} ms"
+        )
+
+
+class UdpStream:
+    """
+    One stream of a badge: datagrams in, PCM in order out, in runs of (pcm, stored) where
+    `stored` is whether it came from the badge's backlog.
+    """
+
+    def __init__(self, stream, codec, flags, wait_s):
+        self.stream = stream
+        self.codec = codec
+        self.vad = flags & FLAG_VAD != 0
+        self.decode = frame_decoder(codec)
+        self.reorder = ReorderBuffer(wait_s)
+        self.transit = TransitStats()
+        self.bytes = 0
+        self.stored = 0
+        self.ended = False
+
+    def push(self, seq, time_ms, flags, payload, now):
+        """Returns the runs of PCM of the frames that are now in order."""
+        self.bytes += HEADER.size + len(payload)
+        self.transit.arrived(now, time_ms)
+        return self._pcm(self.reorder.push(seq, (time_ms, flags, payload), now), now)
+
+    def poll(self, now):
+        return self._pcm(self.reorder.poll(now), now)
+
+    def _pcm(self, items, now):
+        runs = []
+        for time_ms, flags, payload in items:
+            if flags & FLAG_END:
+                # in order, so all the audio before it has been seen or given up on
+                self.ended = True
+                break
+            stored = flags & FLAG_STORED != 0
+            if stored:
+                # its delay is that of the outage, not of the network
+                self.stored += 1
+            else:
+                self.transit.released(now, time_ms)
+            if flags & FLAG_KEEPALIVE:
+                pcm = b"\0\0" * KEEPALIVE_SAMPLES
+            elif payload:
+                try:
+                    pcm = self.decode(payload)
+                except ValueError:
+                    continue
+            else:
+                continue
+            if runs and runs[-1][1] == stored:
+                runs[-1][0].append(pcm)
+            else:
+                runs.append(([pcm], stored))
+        return [(b"".join(pcm), stored) for pcm, stored in runs]
+
+    def summary(self):
+        r = self.reorder
+        total = max(1, r.received + r.lost)
+        return (
+            f"{r.received} datagrams of {self.codec}, {self.bytes} bytes, "
+            f"{r.lost} lost ({100 * r.lost / total:.1f}%), {r.late} late, "
+            f"{r.reordered} out of order, {r.duplicates} duplicates, {self.stored} from the "
+            f"backlog; {self.transit.summary()}"
+        )